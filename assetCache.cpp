@@ -0,0 +1,160 @@
+#include "assetCache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+	struct EntryHeader {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t payloadSize;
+		uint64_t payloadHash;
+	};
+
+	constexpr uint32_t c_entryMagic = 0x4b4f4f43; //"COOK"
+	constexpr uint32_t c_entryVersion = 1; //To change with the layout of any entry
+}
+
+//FNV-1a over 64 bits words, with a shift to spread the high bits: not cryptographic, a cache key
+uint64_t AssetCache::hashBytes(ByteSpan bytes, uint64_t seed)
+{
+	uint64_t hash = 14695981039346656037ull ^ seed;
+	const size_t words = bytes.size / sizeof(uint64_t);
+	for (size_t i = 0; i < words; ++i)
+	{
+		uint64_t word;
+		memcpy(&word, bytes.data + i * sizeof(uint64_t), sizeof(uint64_t));
+		hash = (hash ^ word) * 1099511628211ull;
+		hash ^= hash >> 29;
+	}
+	for (size_t i = words * sizeof(uint64_t); i < bytes.size; ++i)
+		hash = (hash ^ bytes.data[i]) * 1099511628211ull;
+	return hash ^ bytes.size;
+}
+
+uint64_t AssetCache::hashFile(const std::string& path, uint64_t seed)
+{
+	MappedFile file;
+	if (!file.open(path)) return 0;
+	return hashBytes(file.getBytes(), seed);
+}
+
+uint64_t AssetCache::hashFileStamp(const std::string& path, uint64_t seed)
+{
+	std::error_code error;
+	const std::filesystem::path absolute = std::filesystem::absolute(path, error);
+	const uintmax_t size = std::filesystem::file_size(path, error);
+	if (error) return 0;
+	const auto modified = std::filesystem::last_write_time(path, error);
+	if (error) return 0;
+	const std::string name = absolute.string();
+	const int64_t stamp[2] = { static_cast<int64_t>(size), static_cast<int64_t>(modified.time_since_epoch().count()) };
+	uint64_t hash = hashBytes({ reinterpret_cast<const uint8_t*>(name.data()), name.size() }, seed);
+	return hashBytes({ reinterpret_cast<const uint8_t*>(stamp), sizeof(stamp) }, hash);
+}
+
+std::string AssetCache::getAssetDirectory(uint64_t asset) const
+{
+	std::stringstream name;
+	name << std::hex << asset;
+	return (std::filesystem::path(m_cacheDirectory) / name.str()).string();
+}
+
+bool AssetCache::load(uint64_t asset, const std::string& entry, MappedFile& file, ByteSpan& payload) const
+{
+	std::string path = (std::filesystem::path(getAssetDirectory(asset)) / entry).string();
+	std::error_code error;
+	if (!std::filesystem::exists(path, error) || !file.open(path)) return false;
+
+	ByteSpan bytes = file.getBytes();
+	EntryHeader header;
+	if (bytes.size < sizeof(header)) return false;
+	memcpy(&header, bytes.data, sizeof(header));
+	payload = { bytes.data + sizeof(header), bytes.size - sizeof(header) };
+	if (header.magic != c_entryMagic || header.version != c_entryVersion || header.payloadSize != payload.size
+		|| header.payloadHash != hashBytes(payload))
+	{
+		std::cerr << "Asset cache: " << path << " is stale or damaged, it is cooked again" << std::endl;
+		file.close();
+		return false;
+	}
+	return true;
+}
+
+bool AssetCache::save(uint64_t asset, const std::string& entry, const std::vector<uint8_t>& payload) const
+{
+	std::filesystem::path directory = getAssetDirectory(asset);
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	//Several workers may cook the same asset, each one writes its own temporary file
+	std::stringstream temporaryName;
+	temporaryName << entry << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+	std::filesystem::path temporaryPath = directory / temporaryName.str();
+	{
+		std::ofstream file(temporaryPath, std::ios::binary);
+		if (!file)
+		{
+			std::cerr << "Asset cache: cannot write " << temporaryPath.string() << std::endl;
+			return false;
+		}
+		EntryHeader header = { c_entryMagic, c_entryVersion, payload.size(), hashBytes({ payload.data(), payload.size() }) };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+		if (!file)
+		{
+			file.close();
+			std::filesystem::remove(temporaryPath, error);
+			return false;
+		}
+	}
+	std::filesystem::rename(temporaryPath, directory / entry, error);
+	if (error)
+	{
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+	return true;
+}
+
+void AssetCache::touch(uint64_t asset) const
+{
+	std::error_code error;
+	std::filesystem::path used = getAssetDirectory(asset);
+	std::filesystem::last_write_time(used, std::filesystem::file_time_type::clock::now(), error);
+
+	struct Asset {
+		std::filesystem::path path;
+		std::filesystem::file_time_type lastUse;
+		uint64_t size = 0;
+	};
+	std::vector<Asset> assets;
+	uint64_t totalSize = 0;
+	for (const auto& directory : std::filesystem::directory_iterator(m_cacheDirectory, error))
+	{
+		if (!directory.is_directory(error)) continue;
+		Asset asset{ directory.path(), directory.last_write_time(error) };
+		for (const auto& file : std::filesystem::directory_iterator(directory.path(), error))
+		{
+			if (file.is_regular_file(error))
+				asset.size += file.file_size(error);
+		}
+		totalSize += asset.size;
+		assets.push_back(asset);
+	}
+
+	std::sort(assets.begin(), assets.end(), [](const Asset& a, const Asset& b) { return a.lastUse < b.lastUse; });
+	for (const Asset& asset : assets)
+	{
+		if (totalSize <= m_maxSize) break;
+		if (asset.path == used) continue;
+		std::filesystem::remove_all(asset.path, error);
+		totalSize -= asset.size;
+		std::cout << "Asset cache: evicted " << asset.path.string() << " (" << asset.size / (1024 * 1024) << " MB)" << std::endl;
+	}
+}
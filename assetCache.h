@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "mappedFile.h"
+
+// Serialization of the cooked entries: values and vectors of trivially copyable types, read back in the same order
+class BlobWriter
+{
+public:
+	template<typename T>
+	void write(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Written as is");
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+		m_bytes.insert(m_bytes.end(), bytes, bytes + sizeof(T));
+	}
+
+	template<typename T>
+	void write(const std::vector<T>& values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Written as is");
+		write<uint64_t>(values.size());
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values.data());
+		m_bytes.insert(m_bytes.end(), bytes, bytes + values.size() * sizeof(T));
+	}
+
+	const std::vector<uint8_t>& getBytes() const { return m_bytes; }
+
+private:
+	std::vector<uint8_t> m_bytes;
+};
+
+class BlobReader
+{
+public:
+	BlobReader(ByteSpan bytes) : m_bytes(bytes) {}
+
+	//False once a read went past the end, the later reads fail too
+	template<typename T>
+	bool read(T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Read as is");
+		if (!m_valid || m_bytes.size - m_offset < sizeof(T)) return m_valid = false;
+		memcpy(&value, m_bytes.data + m_offset, sizeof(T));
+		m_offset += sizeof(T);
+		return true;
+	}
+
+	template<typename T>
+	bool read(std::vector<T>& values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Read as is");
+		uint64_t count = 0;
+		if (!read(count) || count > (m_bytes.size - m_offset) / sizeof(T)) return m_valid = false;
+		values.resize(static_cast<size_t>(count));
+		memcpy(values.data(), m_bytes.data + m_offset, values.size() * sizeof(T));
+		m_offset += values.size() * sizeof(T);
+		return true;
+	}
+
+	bool isValid() const { return m_valid; }
+	bool isAtEnd() const { return m_offset == m_bytes.size; }
+
+private:
+	ByteSpan m_bytes;
+	size_t m_offset = 0;
+	bool m_valid = true;
+};
+
+// Engine ready data of the imported files, so that the next imports skip the decoding and the processing.
+// An asset is a directory named by the hash of its sources (content or file stamp), holding one file per entry (image, meshes...).
+// The entries are written atomically (temporary file, then renamed) and checked on read (header and payload hash):
+// a missing, stale or damaged entry is a miss. The least recently used assets are evicted over the size budget.
+class AssetCache
+{
+public:
+	static AssetCache& getInstance() {
+		static AssetCache assetCache;
+		return assetCache;
+	};
+
+	void setCacheDirectory(const std::string& directory) { m_cacheDirectory = directory; }
+	void setMaxSize(uint64_t bytes) { m_maxSize = bytes; }
+
+	static uint64_t hashBytes(ByteSpan bytes, uint64_t seed = 0);
+	//Hash of the content of a file, 0 when it cannot be read
+	static uint64_t hashFile(const std::string& path, uint64_t seed = 0);
+	//Hash of the absolute path, size and modification time of a file, 0 when it does not exist.
+	//For the large sources: the file is not read, an edited file gets another key.
+	static uint64_t hashFileStamp(const std::string& path, uint64_t seed = 0);
+
+	//The payload is a span into file, valid while it stays open. Thread safe, as save.
+	bool load(uint64_t asset, const std::string& entry, MappedFile& file, ByteSpan& payload) const;
+	bool save(uint64_t asset, const std::string& entry, const std::vector<uint8_t>& payload) const;
+
+	//Marks the asset as just used, then evicts the least recently used ones while the cache is over budget
+	void touch(uint64_t asset) const;
+
+private:
+	AssetCache() = default;
+	~AssetCache() = default;
+
+	std::string getAssetDirectory(uint64_t asset) const;
+
+	std::string m_cacheDirectory = "assetCache";
+	uint64_t m_maxSize = 2ull << 30;
+};
@@ -20,6 +20,7 @@ namespace Issam {
 		std::string name;
 		AttributeValue value;
 		int handle = -1;
+		TextureViewDimension dimension = TextureViewDimension::e2D; //Of the textures: texture_2d, texture_cube or texture_2d_array
 	};
 
 	enum class Binding : uint8_t
@@ -32,24 +33,29 @@ namespace Issam {
 
 	class AttributeGroup {
 	public:
-		AttributeGroup(Binding binding = Binding::Material, int versionCount = 1) :
+		//dynamicOffset: the uniforms are bound with a dynamic offset even with one version (see SharedMaterial)
+		AttributeGroup(Binding binding = Binding::Material, int versionCount = 1, bool dynamicOffset = false) :
 			m_binding(binding) ,
-			m_versionCount(versionCount)
+			m_versionCount(versionCount),
+			m_dynamicOffset(dynamicOffset)
 		{};
-		void addAttribute(std::string name, const AttributeValue& defaultValue) {
+		void addAttribute(std::string name, const AttributeValue& defaultValue, TextureViewDimension dimension = TextureViewDimension::e2D) {
 			Attribute attribute;
 			attribute.name = name;
 			attribute.value = defaultValue;
+			attribute.dimension = dimension;
 			m_attributes.push_back(attribute);
 		};
 
 		std::vector<Attribute>& getAttributes() { return m_attributes; }	
 		const Binding& getBinding()const { return m_binding; }
 		const int getVersionCount()const { return m_versionCount; }
+		bool hasDynamicOffset() const { return m_versionCount > 1 || m_dynamicOffset; }
 	protected:
 		std::vector<Attribute> m_attributes{};
 		Binding m_binding{ Binding::Material };
 		int m_versionCount = 1;
+		bool m_dynamicOffset = false;
 	};
 
 	class AttributedManager
@@ -102,6 +108,7 @@ namespace Issam {
 		{
 			auto materialModel = Issam::AttributedManager::getInstance().get(attributesId);
 			m_attributes = materialModel.getAttributes(); //Une copie
+			m_dynamicOffset = materialModel.hasDynamicOffset();
 			for (auto& attribute : m_attributes)
 			{
 				if (std::holds_alternative< UniformValue>(attribute.value))
@@ -142,6 +149,8 @@ namespace Issam {
 			return *it;
 		}
 
+		const std::vector<Issam::Attribute>& getAttributes() const { return m_attributes; }
+
 		bool hasAttribute(std::string name) {
 			auto it = std::find_if(m_attributes.begin(), m_attributes.end(), [name](const Issam::Attribute& obj) {
 				return obj.name == name;
@@ -212,6 +221,8 @@ namespace Issam {
 		}
 		
 		const size_t& getNumVersions() { return m_numVersions; }
+		//The layout of the group takes one dynamic offset for the uniforms
+		bool hasDynamicOffset() const { return m_dynamicOffset; }
 	private:
 		std::vector<std::pair<std::string, TextureView> > m_textures{};
 		std::vector<std::pair<std::string, Sampler>> m_samplers{};
@@ -241,6 +252,7 @@ namespace Issam {
 		bool dirtyBindGroup = true;
 
 		size_t m_numVersions = 1;
+		bool m_dynamicOffset = false;
 
 		/*std::vector<std::pair<std::string, TextureView> > m_textures{};
 		std::vector<std::pair<std::string, Sampler>> m_samplers{};
@@ -0,0 +1,810 @@
+#include "bcEncoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "threadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define BC_ENCODER_SSE2
+#endif
+
+namespace
+{
+	//16 texels, RGBA
+	using Block = uint8_t[64];
+
+	//Texels of the block at (bx, by), the edges are replicated into the blocks partly outside the level
+	void loadBlock(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, Block texels)
+	{
+		for (uint32_t y = 0; y < 4; ++y)
+		{
+			const uint32_t sy = std::min(by * 4 + y, height - 1);
+			for (uint32_t x = 0; x < 4; ++x)
+			{
+				const uint32_t sx = std::min(bx * 4 + x, width - 1);
+				memcpy(texels + 4 * (y * 4 + x), pixels + 4 * (sy * width + sx), 4);
+			}
+		}
+	}
+
+	//Nearest palette entry (RGBA) of each texel, returns the sum of the squared errors. count is even.
+	uint32_t findIndices(const Block texels, const uint8_t* palette, int count, uint8_t indices[16])
+	{
+		uint32_t total = 0;
+#ifdef BC_ENCODER_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		for (int i = 0; i < 16; ++i)
+		{
+			//The texel in both halves, two palette entries per register
+			int32_t texel32;
+			memcpy(&texel32, texels + 4 * i, 4);
+			__m128i texel = _mm_unpacklo_epi8(_mm_cvtsi32_si128(texel32), zero);
+			texel = _mm_unpacklo_epi64(texel, texel);
+			uint32_t best = UINT32_MAX;
+			for (int p = 0; p < count; p += 2)
+			{
+				__m128i entries = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(palette + 4 * p)), zero);
+				__m128i diff = _mm_sub_epi16(texel, entries);
+				__m128i squares = _mm_madd_epi16(diff, diff);
+				squares = _mm_add_epi32(squares, _mm_shuffle_epi32(squares, _MM_SHUFFLE(2, 3, 0, 1)));
+				const uint32_t error0 = static_cast<uint32_t>(_mm_cvtsi128_si32(squares));
+				const uint32_t error1 = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_shuffle_epi32(squares, _MM_SHUFFLE(2, 2, 2, 2))));
+				if (error0 < best) { best = error0; indices[i] = static_cast<uint8_t>(p); }
+				if (error1 < best) { best = error1; indices[i] = static_cast<uint8_t>(p + 1); }
+			}
+			total += best;
+		}
+#else
+		for (int i = 0; i < 16; ++i)
+		{
+			uint32_t best = UINT32_MAX;
+			for (int p = 0; p < count; ++p)
+			{
+				uint32_t error = 0;
+				for (int c = 0; c < 4; ++c)
+				{
+					const int diff = int(texels[4 * i + c]) - int(palette[4 * p + c]);
+					error += diff * diff;
+				}
+				if (error < best) { best = error; indices[i] = static_cast<uint8_t>(p); }
+			}
+			total += best;
+		}
+#endif
+		return total;
+	}
+
+	//Endpoints of the texels of mask along their principal axis (power iteration on the covariance)
+	void principalEndpoints(const Block texels, int channels, float lo[4], float hi[4], uint16_t mask = 0xffff)
+	{
+		int count = 0;
+		for (int i = 0; i < 16; ++i)
+			count += (mask >> i) & 1;
+		float mean[4] = {};
+		for (int i = 0; i < 16; ++i)
+			for (int c = 0; c < channels && (mask >> i) & 1; ++c)
+				mean[c] += texels[4 * i + c] / float(count);
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; ++i)
+			for (int a = 0; a < channels && (mask >> i) & 1; ++a)
+				for (int b = 0; b < channels; ++b)
+					covariance[a][b] += (texels[4 * i + a] - mean[a]) * (texels[4 * i + b] - mean[b]);
+
+		float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		for (int iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[4] = {};
+			float length = 0.0f;
+			for (int a = 0; a < channels; ++a)
+			{
+				for (int b = 0; b < channels; ++b)
+					next[a] += covariance[a][b] * axis[b];
+				length = std::max(length, std::abs(next[a]));
+			}
+			if (length < 1e-6f) break; //Flat block
+			for (int a = 0; a < channels; ++a)
+				axis[a] = next[a] / length;
+		}
+		float length = 0.0f;
+		for (int c = 0; c < channels; ++c)
+			length += axis[c] * axis[c];
+		length = std::sqrt(length);
+		for (int c = 0; c < channels; ++c)
+			axis[c] /= length;
+
+		float tMin = 0.0f, tMax = 0.0f;
+		for (int i = 0; i < 16; ++i)
+		{
+			if (!((mask >> i) & 1)) continue;
+			float t = 0.0f;
+			for (int c = 0; c < channels; ++c)
+				t += (texels[4 * i + c] - mean[c]) * axis[c];
+			tMin = std::min(tMin, t);
+			tMax = std::max(tMax, t);
+		}
+		for (int c = 0; c < channels; ++c)
+		{
+			lo[c] = std::clamp(mean[c] + tMin * axis[c], 0.0f, 255.0f);
+			hi[c] = std::clamp(mean[c] + tMax * axis[c], 0.0f, 255.0f);
+		}
+	}
+
+	//Least squares endpoints for the texels of mask at the given positions between them (0: first endpoint, 1: second).
+	//False when all the texels are at the same position.
+	bool refineEndpoints(const Block texels, int channels, const float weights[16], float e0[4], float e1[4], uint16_t mask = 0xffff)
+	{
+		float a = 0.0f, b = 0.0f, c = 0.0f;
+		float x0[4] = {}, x1[4] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			if (!((mask >> i) & 1)) continue;
+			const float w = weights[i];
+			a += (1.0f - w) * (1.0f - w);
+			b += (1.0f - w) * w;
+			c += w * w;
+			for (int k = 0; k < channels; ++k)
+			{
+				x0[k] += (1.0f - w) * texels[4 * i + k];
+				x1[k] += w * texels[4 * i + k];
+			}
+		}
+		const float determinant = a * c - b * b;
+		if (std::abs(determinant) < 1e-6f) return false;
+		for (int k = 0; k < channels; ++k)
+		{
+			e0[k] = std::clamp((c * x0[k] - b * x1[k]) / determinant, 0.0f, 255.0f);
+			e1[k] = std::clamp((a * x1[k] - b * x0[k]) / determinant, 0.0f, 255.0f);
+		}
+		return true;
+	}
+
+	uint16_t packRgb565(const float color[3])
+	{
+		const int r = static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f);
+		const int g = static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f);
+		const int b = static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f);
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	void unpackRgb565(uint16_t color, uint8_t rgba[4])
+	{
+		const int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+		rgba[0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+		rgba[1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+		rgba[2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+		rgba[3] = 255;
+	}
+
+	//Color block of BC1 and BC3, always in the 4 colors mode. The alpha of the texels is ignored.
+	uint32_t encodeColorBlock(const Block block, bool high, uint8_t* output)
+	{
+		Block texels;
+		memcpy(texels, block, sizeof(Block));
+		for (int i = 0; i < 16; ++i)
+			texels[4 * i + 3] = 255;
+
+		//Palette order: c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1
+		static constexpr float c_weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+		float e0[4], e1[4];
+		principalEndpoints(texels, 3, e1, e0);
+
+		uint32_t bestError = UINT32_MAX;
+		uint16_t bestColors[2] = {};
+		uint8_t bestIndices[16] = {};
+		for (int iteration = 0; iteration < (high ? 3 : 1); ++iteration)
+		{
+			uint16_t c0 = packRgb565(e0), c1 = packRgb565(e1);
+			if (c0 < c1) std::swap(c0, c1);
+			uint8_t palette[16];
+			unpackRgb565(c0, palette);
+			unpackRgb565(c1, palette + 4);
+			for (int c = 0; c < 3; ++c)
+			{
+				palette[8 + c] = static_cast<uint8_t>((2 * palette[c] + palette[4 + c]) / 3);
+				palette[12 + c] = static_cast<uint8_t>((palette[c] + 2 * palette[4 + c]) / 3);
+			}
+			palette[11] = palette[15] = 255;
+
+			uint8_t indices[16];
+			//Equal endpoints decode in the 3 colors mode: only the index 0 is the color
+			const uint32_t error = c0 == c1 ? findIndices(texels, palette, 2, indices) : findIndices(texels, palette, 4, indices);
+			if (c0 == c1) std::fill(indices, indices + 16, uint8_t(0));
+			if (error < bestError)
+			{
+				bestError = error;
+				bestColors[0] = c0;
+				bestColors[1] = c1;
+				memcpy(bestIndices, indices, 16);
+			}
+			if (error == 0 || c0 == c1) break;
+
+			float weights[16];
+			for (int i = 0; i < 16; ++i)
+				weights[i] = c_weights[indices[i]];
+			float palette0[3] = { float(palette[0]), float(palette[1]), float(palette[2]) };
+			float palette1[3] = { float(palette[4]), float(palette[5]), float(palette[6]) };
+			memcpy(e0, palette0, sizeof(palette0));
+			memcpy(e1, palette1, sizeof(palette1));
+			if (!refineEndpoints(texels, 3, weights, e0, e1)) break;
+		}
+
+		uint32_t indexBits = 0;
+		for (int i = 0; i < 16; ++i)
+			indexBits |= uint32_t(bestIndices[i]) << (2 * i);
+		memcpy(output, bestColors, 4);
+		memcpy(output + 4, &indexBits, 4);
+		return bestError;
+	}
+
+	//Single channel block of BC3 (alpha), BC4 and BC5, in the 8 values mode
+	uint32_t encodeChannelBlock(const Block texels, int channel, bool high, uint8_t* output)
+	{
+		int lo = 255, hi = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			lo = std::min(lo, int(texels[4 * i + channel]));
+			hi = std::max(hi, int(texels[4 * i + channel]));
+		}
+
+		uint32_t bestError = UINT32_MAX;
+		uint64_t bestBits = 0;
+		//The extremes are often outliers: a narrower range can fit the other values better
+		const int inset = high ? std::min(2, (hi - lo) / 4) : 0;
+		for (int hiInset = 0; hiInset <= inset; ++hiInset)
+		{
+			for (int loInset = 0; loInset <= inset; ++loInset)
+			{
+				const int a0 = hi - hiInset, a1 = lo + loInset;
+				int palette[8] = { a0, a1 };
+				for (int i = 1; i < 7; ++i)
+					palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+				uint32_t error = 0;
+				uint64_t bits = uint64_t(a0) | (uint64_t(a1) << 8);
+				for (int i = 0; i < 16 && a0 != a1; ++i)
+				{
+					const int value = texels[4 * i + channel];
+					int bestIndex = 0, best = INT32_MAX;
+					for (int p = 0; p < 8; ++p)
+					{
+						const int diff = value - palette[p];
+						if (diff * diff < best) { best = diff * diff; bestIndex = p; }
+					}
+					error += best;
+					bits |= uint64_t(bestIndex) << (16 + 3 * i);
+				}
+				if (a0 == a1)
+				{
+					for (int i = 0; i < 16; ++i)
+						error += (texels[4 * i + channel] - a0) * (texels[4 * i + channel] - a0);
+				}
+				if (error < bestError)
+				{
+					bestError = error;
+					bestBits = bits;
+				}
+			}
+		}
+		memcpy(output, &bestBits, 8);
+		return bestError;
+	}
+
+	struct BitWriter {
+		uint64_t bits[2] = {};
+		uint32_t position = 0;
+		void write(uint32_t value, uint32_t count)
+		{
+			for (uint32_t i = 0; i < count; ++i, ++position)
+				bits[position / 64] |= uint64_t((value >> i) & 1) << (position % 64);
+		}
+	};
+
+	//BC7 mode 6: one subset, RGBA 7 bits endpoints with a p-bit each, 16 interpolated colors
+	uint32_t encodeBc7Mode6(const Block texels, bool high, uint8_t* output)
+	{
+		static constexpr int c_weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+		float e0[4], e1[4];
+		principalEndpoints(texels, 4, e0, e1);
+
+		uint32_t bestError = UINT32_MAX;
+		uint8_t bestEndpoints[2][4] = {}; //7 bits
+		int bestPBits[2] = {};
+		uint8_t bestIndices[16] = {};
+		for (int iteration = 0; iteration < (high ? 3 : 1); ++iteration)
+		{
+			uint8_t indices[16];
+			uint8_t palette[64];
+			bool improved = false;
+			for (int pBits = 0; pBits < 4; ++pBits)
+			{
+				const int p[2] = { pBits & 1, pBits >> 1 };
+				uint8_t endpoints[2][4];
+				uint8_t colors[2][4];
+				for (int c = 0; c < 4; ++c)
+				{
+					endpoints[0][c] = static_cast<uint8_t>(std::clamp((int(e0[c] + 0.5f) - p[0] + 1) >> 1, 0, 127));
+					endpoints[1][c] = static_cast<uint8_t>(std::clamp((int(e1[c] + 0.5f) - p[1] + 1) >> 1, 0, 127));
+					colors[0][c] = static_cast<uint8_t>((endpoints[0][c] << 1) | p[0]);
+					colors[1][c] = static_cast<uint8_t>((endpoints[1][c] << 1) | p[1]);
+				}
+				for (int i = 0; i < 16; ++i)
+					for (int c = 0; c < 4; ++c)
+						palette[4 * i + c] = static_cast<uint8_t>(((64 - c_weights[i]) * colors[0][c] + c_weights[i] * colors[1][c] + 32) >> 6);
+				const uint32_t error = findIndices(texels, palette, 16, indices);
+				if (error < bestError)
+				{
+					bestError = error;
+					memcpy(bestEndpoints, endpoints, sizeof(endpoints));
+					bestPBits[0] = p[0];
+					bestPBits[1] = p[1];
+					memcpy(bestIndices, indices, 16);
+					improved = true;
+				}
+			}
+			if (!improved || bestError == 0) break;
+
+			float weights[16];
+			for (int i = 0; i < 16; ++i)
+				weights[i] = c_weights[bestIndices[i]] / 64.0f;
+			if (!refineEndpoints(texels, 4, weights, e0, e1)) break;
+		}
+
+		//The most significant bit of the first index is implicit: 0
+		if (bestIndices[0] & 8)
+		{
+			std::swap(bestEndpoints[0], bestEndpoints[1]);
+			std::swap(bestPBits[0], bestPBits[1]);
+			for (auto& index : bestIndices)
+				index = static_cast<uint8_t>(15 - index);
+		}
+
+		BitWriter writer;
+		writer.write(1 << 6, 7);
+		for (int c = 0; c < 4; ++c)
+		{
+			writer.write(bestEndpoints[0][c], 7);
+			writer.write(bestEndpoints[1][c], 7);
+		}
+		writer.write(bestPBits[0], 1);
+		writer.write(bestPBits[1], 1);
+		writer.write(bestIndices[0], 3);
+		for (int i = 1; i < 16; ++i)
+			writer.write(bestIndices[i], 4);
+		memcpy(output, writer.bits, 16);
+		return bestError;
+	}
+
+	//Subset 1 texels of the BC7 two subsets partitions (bit i: texel i), and the anchor texel of the subset 1
+	constexpr uint16_t c_bc7Partitions[64] = {
+		0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80,
+		0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+		0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce,
+		0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+		0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a,
+		0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+		0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c,
+		0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+	};
+	constexpr uint8_t c_bc7Anchors[64] = {
+		15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+		15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+		15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6,
+		6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15,
+	};
+	constexpr int c_bc7PartitionCandidates = 2; //Fully encoded, of the partitions ranked by their estimated error
+
+	//RGB sums of a set of texels: count, x (3), then xx, yy, zz, xy, xz, yz
+	using Moments = float[10];
+
+	//Sum of the squared distances of the texels to their principal axis: the scatter minus its largest eigenvalue
+	float getLineError(const Moments moments)
+	{
+		if (moments[0] < 1.0f) return 0.0f;
+		const float n = moments[0];
+		const float xx = moments[4] - moments[1] * moments[1] / n, yy = moments[5] - moments[2] * moments[2] / n, zz = moments[6] - moments[3] * moments[3] / n;
+		const float xy = moments[7] - moments[1] * moments[2] / n, xz = moments[8] - moments[1] * moments[3] / n, yz = moments[9] - moments[2] * moments[3] / n;
+		float axis[3] = { 1.0f, 1.0f, 1.0f };
+		float eigenvalue = 0.0f;
+		for (int iteration = 0; iteration < 4; ++iteration)
+		{
+			const float next[3] = { xx * axis[0] + xy * axis[1] + xz * axis[2], xy * axis[0] + yy * axis[1] + yz * axis[2], xz * axis[0] + yz * axis[1] + zz * axis[2] };
+			const float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+			if (length < 1e-6f) return 0.0f; //Flat
+			const float squaredAxis = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+			eigenvalue = (axis[0] * next[0] + axis[1] * next[1] + axis[2] * next[2]) / squaredAxis;
+			for (int c = 0; c < 3; ++c)
+				axis[c] = next[c] / length;
+		}
+		return std::max(xx + yy + zz - eigenvalue, 0.0f);
+	}
+
+	//Nearest of the count palette entries for the texels of mask, on the given channels. Returns the sum of the squared errors.
+	uint32_t findSubsetIndices(const Block texels, const int palette[][4], int count, int firstChannel, int channelCount, uint16_t mask, uint8_t indices[16])
+	{
+		uint32_t total = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			if (!((mask >> i) & 1)) continue;
+			uint32_t best = UINT32_MAX;
+			for (int p = 0; p < count; ++p)
+			{
+				uint32_t error = 0;
+				for (int c = firstChannel; c < firstChannel + channelCount; ++c)
+				{
+					const int diff = int(texels[4 * i + c]) - palette[p][c];
+					error += diff * diff;
+				}
+				if (error < best) { best = error; indices[i] = static_cast<uint8_t>(p); }
+			}
+			total += best;
+		}
+		return total;
+	}
+
+	//One subset of BC7 mode 1: RGB 6 bits endpoints, the p-bit shared by both, 8 interpolated colors
+	struct Bc7Subset {
+		uint8_t endpoints[2][3] = {};
+		int pBit = 0;
+		uint32_t error = UINT32_MAX;
+	};
+
+	Bc7Subset encodeBc7Mode1Subset(const Block texels, uint16_t mask, uint8_t indices[16])
+	{
+		static constexpr int c_weights[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+		float e0[4], e1[4];
+		principalEndpoints(texels, 3, e0, e1, mask);
+
+		Bc7Subset best;
+		uint8_t subsetIndices[16];
+		for (int iteration = 0; iteration < 3; ++iteration)
+		{
+			bool improved = false;
+			for (int pBit = 0; pBit < 2; ++pBit)
+			{
+				uint8_t endpoints[2][3];
+				int colors[2][4];
+				for (int c = 0; c < 3; ++c)
+				{
+					endpoints[0][c] = static_cast<uint8_t>(std::clamp((int(e0[c] + 0.5f) - 2 * pBit + 2) >> 2, 0, 63));
+					endpoints[1][c] = static_cast<uint8_t>(std::clamp((int(e1[c] + 0.5f) - 2 * pBit + 2) >> 2, 0, 63));
+					for (int e = 0; e < 2; ++e)
+					{
+						const int value = (endpoints[e][c] << 1) | pBit; //7 bits, expanded to 8
+						colors[e][c] = (value << 1) | (value >> 6);
+					}
+				}
+				int palette[8][4];
+				for (int i = 0; i < 8; ++i)
+				{
+					for (int c = 0; c < 3; ++c)
+						palette[i][c] = ((64 - c_weights[i]) * colors[0][c] + c_weights[i] * colors[1][c] + 32) >> 6;
+					palette[i][3] = 255;
+				}
+				const uint32_t error = findSubsetIndices(texels, palette, 8, 0, 4, mask, subsetIndices);
+				if (error < best.error)
+				{
+					best.error = error;
+					memcpy(best.endpoints, endpoints, sizeof(endpoints));
+					best.pBit = pBit;
+					for (int i = 0; i < 16; ++i)
+						if ((mask >> i) & 1) indices[i] = subsetIndices[i];
+					improved = true;
+				}
+			}
+			if (!improved || best.error == 0) break;
+
+			float weights[16] = {};
+			for (int i = 0; i < 16; ++i)
+				weights[i] = c_weights[indices[i]] / 64.0f;
+			if (!refineEndpoints(texels, 3, weights, e0, e1, mask)) break;
+		}
+		return best;
+	}
+
+	//BC7 mode 1: two subsets of RGB (opaque), the partition among the 64 of the format.
+	//The partitions are ranked by the distance of their texels to the principal axis of each subset, the best ones are encoded.
+	//UINT32_MAX, without encoding, when the error of the alpha alone reaches maxError.
+	uint32_t encodeBc7Mode1(const Block texels, uint32_t maxError, uint8_t* output)
+	{
+		uint32_t alphaError = 0;
+		for (int i = 0; i < 16; ++i)
+			alphaError += (255 - texels[4 * i + 3]) * (255 - texels[4 * i + 3]);
+		if (alphaError >= maxError) return UINT32_MAX;
+
+		Moments texelMoments[16];
+		Moments total = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			const float x = texels[4 * i], y = texels[4 * i + 1], z = texels[4 * i + 2];
+			const Moments moments = { 1.0f, x, y, z, x * x, y * y, z * z, x * y, x * z, y * z };
+			for (int k = 0; k < 10; ++k)
+			{
+				texelMoments[i][k] = moments[k];
+				total[k] += moments[k];
+			}
+		}
+		std::pair<float, int> ranking[64];
+		for (int partition = 0; partition < 64; ++partition)
+		{
+			Moments subset0, subset1 = {};
+			for (int i = 0; i < 16; ++i)
+			{
+				if (!((c_bc7Partitions[partition] >> i) & 1)) continue;
+				for (int k = 0; k < 10; ++k)
+					subset1[k] += texelMoments[i][k];
+			}
+			for (int k = 0; k < 10; ++k)
+				subset0[k] = total[k] - subset1[k];
+			ranking[partition] = { getLineError(subset0) + getLineError(subset1), partition };
+		}
+		std::partial_sort(ranking, ranking + c_bc7PartitionCandidates, ranking + 64);
+
+		uint32_t bestError = UINT32_MAX;
+		int bestPartition = 0;
+		Bc7Subset bestSubsets[2];
+		uint8_t bestIndices[16] = {};
+		for (int candidate = 0; candidate < c_bc7PartitionCandidates; ++candidate)
+		{
+			const int partition = ranking[candidate].second;
+			uint8_t indices[16] = {};
+			const Bc7Subset subsets[2] = {
+				encodeBc7Mode1Subset(texels, static_cast<uint16_t>(~c_bc7Partitions[partition]), indices),
+				encodeBc7Mode1Subset(texels, c_bc7Partitions[partition], indices) };
+			const uint32_t error = subsets[0].error + subsets[1].error;
+			if (error < bestError)
+			{
+				bestError = error;
+				bestPartition = partition;
+				bestSubsets[0] = subsets[0];
+				bestSubsets[1] = subsets[1];
+				memcpy(bestIndices, indices, 16);
+			}
+		}
+
+		//The most significant bit of the index of each anchor texel is implicit: 0
+		const int anchors[2] = { 0, c_bc7Anchors[bestPartition] };
+		for (int subset = 0; subset < 2; ++subset)
+		{
+			if (!(bestIndices[anchors[subset]] & 4)) continue;
+			std::swap(bestSubsets[subset].endpoints[0], bestSubsets[subset].endpoints[1]);
+			for (int i = 0; i < 16; ++i)
+				if (((c_bc7Partitions[bestPartition] >> i) & 1) == subset) bestIndices[i] = static_cast<uint8_t>(7 - bestIndices[i]);
+		}
+
+		BitWriter writer;
+		writer.write(1 << 1, 2);
+		writer.write(bestPartition, 6);
+		for (int c = 0; c < 3; ++c)
+		{
+			for (const Bc7Subset& subset : bestSubsets)
+			{
+				writer.write(subset.endpoints[0][c], 6);
+				writer.write(subset.endpoints[1][c], 6);
+			}
+		}
+		writer.write(bestSubsets[0].pBit, 1);
+		writer.write(bestSubsets[1].pBit, 1);
+		for (int i = 0; i < 16; ++i)
+			writer.write(bestIndices[i], i == anchors[0] || i == anchors[1] ? 2 : 3);
+		memcpy(output, writer.bits, 16);
+		return bestError;
+	}
+
+	//BC7 mode 5: one subset, RGB 7 bits and alpha 8 bits endpoints with their own 4 values indices (no rotation)
+	uint32_t encodeBc7Mode5(const Block texels, uint32_t /*maxError*/, uint8_t* output)
+	{
+		static constexpr int c_weights[4] = { 0, 21, 43, 64 };
+		float e0[4], e1[4];
+		principalEndpoints(texels, 3, e0, e1);
+
+		uint32_t colorError = UINT32_MAX;
+		uint8_t colorEndpoints[2][3] = {};
+		uint8_t colorIndices[16] = {};
+		for (int iteration = 0; iteration < 3; ++iteration)
+		{
+			uint8_t endpoints[2][3];
+			int palette[4][4] = {};
+			for (int c = 0; c < 3; ++c)
+			{
+				endpoints[0][c] = static_cast<uint8_t>(std::clamp(int(e0[c] * 127.0f / 255.0f + 0.5f), 0, 127));
+				endpoints[1][c] = static_cast<uint8_t>(std::clamp(int(e1[c] * 127.0f / 255.0f + 0.5f), 0, 127));
+				const int color0 = (endpoints[0][c] << 1) | (endpoints[0][c] >> 6), color1 = (endpoints[1][c] << 1) | (endpoints[1][c] >> 6);
+				for (int i = 0; i < 4; ++i)
+					palette[i][c] = ((64 - c_weights[i]) * color0 + c_weights[i] * color1 + 32) >> 6;
+			}
+			uint8_t indices[16];
+			const uint32_t error = findSubsetIndices(texels, palette, 4, 0, 3, 0xffff, indices);
+			if (error >= colorError) break;
+			colorError = error;
+			memcpy(colorEndpoints, endpoints, sizeof(endpoints));
+			memcpy(colorIndices, indices, 16);
+			if (error == 0) break;
+
+			float weights[16];
+			for (int i = 0; i < 16; ++i)
+				weights[i] = c_weights[indices[i]] / 64.0f;
+			if (!refineEndpoints(texels, 3, weights, e0, e1)) break;
+		}
+
+		//The alpha between its extremes, exact for the opaque blocks
+		int alphaEndpoints[2] = { 255, 0 };
+		for (int i = 0; i < 16; ++i)
+		{
+			alphaEndpoints[0] = std::min(alphaEndpoints[0], int(texels[4 * i + 3]));
+			alphaEndpoints[1] = std::max(alphaEndpoints[1], int(texels[4 * i + 3]));
+		}
+		int alphaPalette[4][4] = {};
+		for (int i = 0; i < 4; ++i)
+			alphaPalette[i][3] = ((64 - c_weights[i]) * alphaEndpoints[0] + c_weights[i] * alphaEndpoints[1] + 32) >> 6;
+		uint8_t alphaIndices[16];
+		const uint32_t alphaError = findSubsetIndices(texels, alphaPalette, 4, 3, 1, 0xffff, alphaIndices);
+
+		//The most significant bit of the first index of each is implicit: 0
+		if (colorIndices[0] & 2)
+		{
+			std::swap(colorEndpoints[0], colorEndpoints[1]);
+			for (auto& index : colorIndices)
+				index = static_cast<uint8_t>(3 - index);
+		}
+		if (alphaIndices[0] & 2)
+		{
+			std::swap(alphaEndpoints[0], alphaEndpoints[1]);
+			for (auto& index : alphaIndices)
+				index = static_cast<uint8_t>(3 - index);
+		}
+
+		BitWriter writer;
+		writer.write(1 << 5, 6);
+		writer.write(0, 2);
+		for (int c = 0; c < 3; ++c)
+		{
+			writer.write(colorEndpoints[0][c], 7);
+			writer.write(colorEndpoints[1][c], 7);
+		}
+		writer.write(alphaEndpoints[0], 8);
+		writer.write(alphaEndpoints[1], 8);
+		for (int i = 0; i < 16; ++i)
+			writer.write(colorIndices[i], i == 0 ? 1 : 2);
+		for (int i = 0; i < 16; ++i)
+			writer.write(alphaIndices[i], i == 0 ? 1 : 2);
+		memcpy(output, writer.bits, 16);
+		return colorError + alphaError;
+	}
+
+	//Mode 6 in Fast quality. High also tries the modes 5 (separate alpha) and 1 (two subsets), the lowest error wins.
+	uint32_t encodeBc7Block(const Block texels, bool high, uint8_t* output)
+	{
+		uint32_t bestError = encodeBc7Mode6(texels, high, output);
+		if (!high || bestError == 0) return bestError;
+		uint8_t candidate[16];
+		for (auto encodeMode : { encodeBc7Mode5, encodeBc7Mode1 })
+		{
+			const uint32_t error = encodeMode(texels, bestError, candidate);
+			if (error < bestError)
+			{
+				bestError = error;
+				memcpy(output, candidate, 16);
+			}
+		}
+		return bestError;
+	}
+
+	uint32_t encodeBlock(const Block texels, TextureFormat format, bool high, uint8_t* output)
+	{
+		switch (format)
+		{
+		case TextureFormat::BC1RGBAUnorm:
+			return encodeColorBlock(texels, high, output);
+		case TextureFormat::BC3RGBAUnorm:
+			return encodeChannelBlock(texels, 3, high, output) + encodeColorBlock(texels, high, output + 8);
+		case TextureFormat::BC4RUnorm:
+			return encodeChannelBlock(texels, 0, high, output);
+		case TextureFormat::BC5RGUnorm:
+			return encodeChannelBlock(texels, 0, high, output) + encodeChannelBlock(texels, 1, high, output + 8);
+		case TextureFormat::BC7RGBAUnorm:
+			return encodeBc7Block(texels, high, output);
+		default:
+			return 0;
+		}
+	}
+
+	int getChannelCount(TextureFormat format)
+	{
+		switch (format)
+		{
+		case TextureFormat::BC1RGBAUnorm: return 3;
+		case TextureFormat::BC4RUnorm: return 1;
+		case TextureFormat::BC5RGUnorm: return 2;
+		default: return 4;
+		}
+	}
+}
+
+double BcEncoder::Stats::getPsnr() const
+{
+	if (sampleCount == 0) return 0.0;
+	const double meanError = squaredError / sampleCount;
+	return meanError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / meanError) : 99.0;
+}
+
+TextureFormat BcEncoder::selectFormat(const Utils::ImageData& image, Role role, Quality quality)
+{
+	switch (role)
+	{
+	case Role::MetallicRoughness:
+		return TextureFormat::BC1RGBAUnorm;
+	case Role::Normal:
+		return TextureFormat::BC5RGUnorm;
+	case Role::Mask:
+		return TextureFormat::BC4RUnorm;
+	default:
+		break;
+	}
+	if (quality == Quality::High)
+		return TextureFormat::BC7RGBAUnorm;
+	if (!image.levels.empty())
+	{
+		const std::vector<uint8_t>& pixels = image.levels[0];
+		for (size_t i = 3; i < pixels.size(); i += 4)
+		{
+			if (pixels[i] != 255)
+				return TextureFormat::BC3RGBAUnorm;
+		}
+	}
+	return TextureFormat::BC1RGBAUnorm;
+}
+
+bool BcEncoder::compress(Utils::ImageData& image, TextureFormat format, Quality quality, Stats* stats)
+{
+	if (image.format != TextureFormat::RGBA8Unorm || image.levels.empty() || image.width % 4 != 0 || image.height % 4 != 0)
+		return false;
+	auto start = std::chrono::steady_clock::now();
+	const Utils::FormatBlock block = Utils::getFormatBlock(format);
+	const bool high = quality == Quality::High;
+
+	std::vector<std::vector<uint8_t>> levels(image.levels.size());
+	double squaredError = 0.0;
+	size_t texelCount = 0;
+	for (size_t level = 0; level < levels.size(); ++level)
+	{
+		const uint32_t width = std::max(uint32_t(image.width) >> level, 1u);
+		const uint32_t height = std::max(uint32_t(image.height) >> level, 1u);
+		const uint32_t blocksWide = (width + 3) / 4;
+		const uint32_t blocksHigh = (height + 3) / 4;
+		levels[level].resize(size_t(blocksWide) * blocksHigh * block.bytes);
+		texelCount += size_t(width) * height;
+
+		const uint8_t* pixels = image.levels[level].data();
+		uint8_t* blocks = levels[level].data();
+		std::vector<double> rowErrors(blocksHigh);
+		ThreadPool::getInstance().parallelFor(blocksHigh, [&](size_t by) {
+			Block texels;
+			double error = 0.0;
+			for (uint32_t bx = 0; bx < blocksWide; ++bx)
+			{
+				loadBlock(pixels, width, height, bx, static_cast<uint32_t>(by), texels);
+				error += encodeBlock(texels, format, high, blocks + (by * blocksWide + bx) * block.bytes);
+			}
+			rowErrors[by] = error;
+		});
+		if (level == 0)
+		{
+			for (double error : rowErrors)
+				squaredError += error;
+		}
+	}
+
+	image.levels = std::move(levels);
+	image.format = format;
+	if (stats)
+	{
+		stats->squaredError += squaredError;
+		stats->sampleCount += size_t(image.width) * image.height * getChannelCount(format);
+		stats->texelCount += texelCount;
+		stats->milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+	return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "utils.h"
+
+// CPU block compression of RGBA8 images into BC1, BC3, BC4, BC5 and BC7 (mode 6, and the modes 1 and 5 in High quality),
+// for the textures cooked at import.
+// Endpoints along the principal axis of each 4x4 block, refined by least squares in High quality.
+// The rows of blocks are encoded in parallel on the ThreadPool, the palette searches use SSE2 when available.
+// tests/bcEncoderTest.cpp checks the blocks with reference decoders and reports the PSNR and throughput of each format.
+class BcEncoder
+{
+public:
+	//What the texture holds, it selects the format (see selectFormat)
+	enum class Role { BaseColor, MetallicRoughness, Normal, Mask };
+	enum class Quality { Fast, High };
+
+	struct Stats {
+		double squaredError = 0.0; //Over the encoded channels of the level 0
+		size_t sampleCount = 0;    //Texels times encoded channels of the level 0
+		double milliseconds = 0.0;
+		size_t texelCount = 0;     //All the levels
+		double getPsnr() const;
+	};
+
+	//BaseColor: BC7 in High quality, else BC1 when opaque or BC3.
+	//MetallicRoughness: BC1 (the green and blue channels are read). Normal: BC5 (x, y). Mask: BC4 (red).
+	static TextureFormat selectFormat(const Utils::ImageData& image, Role role, Quality quality);
+
+	//Replaces the RGBA8 levels by their blocks. False, with the image untouched, when the image is not RGBA8
+	//or its size is not a multiple of 4 (the block compressed textures need whole blocks at level 0).
+	static bool compress(Utils::ImageData& image, TextureFormat format, Quality quality, Stats* stats = nullptr);
+};
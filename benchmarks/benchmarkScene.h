@@ -0,0 +1,189 @@
+#pragma once
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_FORCE_LEFT_HANDED
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "context.h"
+#include "shader.h"
+#include "pipeline.h"
+#include "pass.h"
+#include "renderer.h"
+#include "utils.h"
+
+// Headless setup shared by the GPU benchmarks: a device without window or surface, one offscreen SCENE pass drawing
+// the entities filtered "bench" with data/benchmark.wgsl (it reads every vertex attribute), and a camera.
+// The time of a frame is the wall clock from the recording of a run of frames until the queue is idle, divided by their count.
+class BenchmarkScene
+{
+public:
+	BenchmarkScene(uint32_t width, uint32_t height) :
+		m_width(width),
+		m_height(height)
+	{
+		Context::getInstance().initGraphics(nullptr, static_cast<uint16_t>(width), static_cast<uint16_t>(height), c_colorFormat);
+
+		m_shader = new Shader();
+		m_shader->setUserCode(Utils::loadFile(DATA_DIR "/benchmark.wgsl"));
+		m_shader->addVertexInput("position", VertexSemantic::Position);
+		m_shader->addVertexInput("normal", VertexSemantic::Normal);
+		m_shader->addVertexInput("tangent", VertexSemantic::Tangent);
+		m_shader->addVertexInput("uv", VertexSemantic::TexCoord);
+		m_shader->addVertexOutput("color", 0, VertexFormat::Float32x3);
+
+		Issam::AttributeGroup materialAttributes(Issam::Binding::Material);
+		materialAttributes.addAttribute("colorFactor", glm::vec4(1.0f));
+		Issam::AttributedManager::getInstance().add(c_materialAttributes, materialAttributes);
+		Issam::AttributeGroup sceneAttributes(Issam::Binding::Scene);
+		sceneAttributes.addAttribute("view", glm::mat4(1.0));
+		sceneAttributes.addAttribute("projection", glm::mat4(1.0));
+		Issam::AttributedManager::getInstance().add(c_sceneAttributes, sceneAttributes);
+		Issam::AttributeGroup nodeAttributes(Issam::Binding::Node);
+		nodeAttributes.addAttribute("model", glm::mat4(1.0));
+		Issam::AttributedManager::getInstance().add(c_nodeAttributes, nodeAttributes);
+		m_shader->addGroup(c_materialAttributes);
+		m_shader->addGroup(c_sceneAttributes);
+		m_shader->addGroup(c_nodeAttributes);
+
+		//After the attribute groups, the scene creates their runtimes
+		m_scene = new Issam::Scene();
+		m_depthBuffer = createTarget(c_depthFormat);
+		m_colorBuffer = createTarget(c_colorFormat);
+
+		m_pass = new Pass();
+		m_pass->setShader(m_shader);
+		setTopology(PrimitiveTopology::TriangleList);
+		m_pass->setDepthBuffer(m_depthBuffer);
+		m_pass->setColorBuffer(m_colorBuffer);
+		m_pass->setImpostors(false);
+		m_pass->addFilter("bench");
+
+		m_renderer = new Renderer();
+		m_renderer->addPass(m_pass);
+		m_renderer->setScene(m_scene);
+		m_renderer->setViewportSize(width, height);
+		m_renderer->getMeshletCuller().setDepthBuffer(m_depthBuffer, width, height);
+
+		m_camera = m_scene->addEntity();
+		Issam::Camera camera;
+		camera.m_projection = glm::perspective(glm::radians(60.0f), float(width) / float(height), 0.01f, 1000.0f);
+		m_scene->addComponent<Issam::Camera>(m_camera, camera);
+		setCamera(glm::vec3(0.0f, 0.0f, -3.0f), glm::vec3(0.0f));
+	}
+
+	~BenchmarkScene()
+	{
+		delete m_renderer;
+		delete m_pass;
+		delete m_pipeline;
+		delete m_scene;
+		delete m_shader;
+	}
+
+	Issam::Scene* getScene() { return m_scene; }
+	Renderer& getRenderer() { return *m_renderer; }
+	Pass* getPass() { return m_pass; }
+
+	void setTopology(PrimitiveTopology topology)
+	{
+		delete m_pipeline;
+		m_pipeline = new Pipeline("benchmark", m_shader, c_colorFormat, c_depthFormat, Pipeline::BlendingMode::Replace, topology);
+		m_pass->setPipeline(m_pipeline);
+	}
+
+	void setCamera(const glm::vec3& position, const glm::vec3& target)
+	{
+		auto& camera = m_scene->getComponent<Issam::Camera>(m_camera);
+		camera.m_pos = position;
+		camera.m_view = glm::lookAt(position, target, glm::vec3(0.0f, 1.0f, 0.0f));
+		m_scene->update<Issam::Camera>(m_camera);
+	}
+
+	//An entity drawn by the pass, with a material of the benchmark shader
+	entt::entity addMesh(MeshPtr mesh, const glm::mat4& transform = glm::mat4(1.0f))
+	{
+		entt::entity entity = m_scene->addEntity(transform);
+		Issam::MeshRenderer meshRenderer;
+		meshRenderer.mesh = mesh;
+		Material* material = new Material();
+		material->setAttribute(c_materialAttributes, "colorFactor", glm::vec4(1.0f));
+		meshRenderer.material = material;
+		m_scene->addComponent<Issam::MeshRenderer>(entity, meshRenderer);
+		Issam::Filters filters;
+		filters.add("bench");
+		m_scene->addComponent<Issam::Filters>(entity, filters);
+		return entity;
+	}
+
+	void removeMeshes()
+	{
+		std::vector<entt::entity> entities;
+		for (auto entity : m_scene->getRegistry().view<const Issam::MeshRenderer>())
+			entities.push_back(entity);
+		for (auto entity : entities)
+		{
+			delete m_scene->getComponent<Issam::MeshRenderer>(entity).material;
+			m_scene->removeEntity(entity);
+		}
+	}
+
+	//Milliseconds per frame, the best of runCount runs of frameCount frames after a warm up. 0 when the GPU failed.
+	double measureFrames(int frameCount, int runCount = 3)
+	{
+		for (int i = 0; i < 3; ++i)
+			m_renderer->draw();
+		if (!Context::getInstance().waitForGpu())
+			return 0.0;
+
+		double best = 0.0;
+		for (int run = 0; run < runCount; ++run)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			for (int i = 0; i < frameCount; ++i)
+				m_renderer->draw();
+			if (!Context::getInstance().waitForGpu())
+				return 0.0;
+			const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frameCount;
+			best = run == 0 ? milliseconds : std::min(best, milliseconds);
+		}
+		return best;
+	}
+
+	static constexpr TextureFormat c_colorFormat = TextureFormat::RGBA8Unorm;
+	static constexpr TextureFormat c_depthFormat = TextureFormat::Depth24Plus;
+
+private:
+	TextureView createTarget(TextureFormat format)
+	{
+		TextureDescriptor textureDesc;
+		textureDesc.dimension = TextureDimension::e2D;
+		textureDesc.format = format;
+		textureDesc.mipLevelCount = 1;
+		textureDesc.sampleCount = 1;
+		textureDesc.size = { m_width, m_height, 1 };
+		//The depth is read by the Hi-Z of the meshlet culling
+		textureDesc.usage = TextureUsage::RenderAttachment | TextureUsage::TextureBinding;
+		return Context::getInstance().getDevice().CreateTexture(&textureDesc).CreateView();
+	}
+
+	const std::string c_materialAttributes = "benchmarkMaterial";
+	const std::string c_sceneAttributes = "benchmarkScene";
+	const std::string c_nodeAttributes = "benchmarkNode";
+
+	uint32_t m_width;
+	uint32_t m_height;
+	Shader* m_shader{ nullptr };
+	Pipeline* m_pipeline{ nullptr };
+	Pass* m_pass{ nullptr };
+	Renderer* m_renderer{ nullptr };
+	Issam::Scene* m_scene{ nullptr };
+	TextureView m_depthBuffer{ nullptr };
+	TextureView m_colorBuffer{ nullptr };
+	entt::entity m_camera = entt::null;
+};
@@ -0,0 +1,102 @@
+// Import time of glTF files by GltfLoader::load against the worker count of the ThreadPool, without the asset cache.
+// The time of a file is the wall clock from load until the queue is idle (the uploads are done), the best of 3 loads.
+// gltfLoadBench <directory|file.gltf|file.glb>... : the directories are searched recursively (the glTF sample set).
+
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include "benchmarkScene.h"
+#include "gltfLoader.h"
+#include "threadPool.h"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	std::vector<std::string> getFiles(int argc, char** argv)
+	{
+		std::vector<std::string> files;
+		for (int i = 1; i < argc; ++i)
+		{
+			if (fs::is_directory(argv[i]))
+			{
+				for (const auto& entry : fs::recursive_directory_iterator(argv[i]))
+				{
+					if (entry.is_regular_file() && (entry.path().extension() == ".gltf" || entry.path().extension() == ".glb"))
+						files.push_back(entry.path().string());
+				}
+			}
+			else
+			{
+				files.push_back(argv[i]);
+			}
+		}
+		std::sort(files.begin(), files.end());
+		return files;
+	}
+
+	double measureLoad(GltfLoader& loader, const std::string& file)
+	{
+		double best = 0.0;
+		for (int run = 0; run < 3; ++run)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			loader.load(file);
+			Context::getInstance().waitForGpu();
+			const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			best = run == 0 ? milliseconds : std::min(best, milliseconds);
+			loader.unload();
+		}
+		return best;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::vector<std::string> files = getFiles(argc, argv);
+	if (files.empty())
+	{
+		std::cerr << "Usage: gltfLoadBench <directory|file.gltf|file.glb>..." << std::endl;
+		return 1;
+	}
+
+	BenchmarkScene bench(64, 64);
+	GltfLoader loader(bench.getScene());
+	loader.setAssetCache(false);
+
+	//1, 2, 4... workers up to the core count, the loading thread also takes its share of the parallel loops
+	std::vector<size_t> threadCounts;
+	const size_t coreCount = std::max(1u, std::thread::hardware_concurrency());
+	for (size_t threadCount = 1; threadCount < coreCount; threadCount *= 2)
+		threadCounts.push_back(threadCount);
+	threadCounts.push_back(coreCount);
+
+	std::vector<double> totals(threadCounts.size(), 0.0);
+	std::cout << std::fixed << std::setprecision(1) << "workers:";
+	for (size_t threadCount : threadCounts)
+		std::cout << std::setw(10) << threadCount;
+	std::cout << std::endl;
+	for (const std::string& file : files)
+	{
+		std::cout << fs::path(file).filename().string() << ":";
+		for (size_t i = 0; i < threadCounts.size(); ++i)
+		{
+			ThreadPool::getInstance().setThreadCount(threadCounts[i]);
+			const double milliseconds = measureLoad(loader, file);
+			totals[i] += milliseconds;
+			std::cout << std::setw(10) << milliseconds;
+		}
+		std::cout << " ms" << std::endl;
+	}
+
+	std::cout << "total:";
+	for (double total : totals)
+		std::cout << std::setw(10) << total;
+	std::cout << " ms" << std::endl << "speedup:";
+	for (double total : totals)
+		std::cout << std::setw(9) << (total > 0.0 ? totals[0] / total : 0.0) << "x";
+	std::cout << std::endl;
+	return 0;
+}
@@ -0,0 +1,180 @@
+// GPU meshlet culling (see MeshletCuller) against the direct draws, on the GPU without a window.
+// Each view is drawn without culling, then with the frustum, normal cone and Hi-Z tests added one after the other.
+// The triangles kept by the culling are read back from the indirect draw arguments.
+// meshletCullingBench [file.gltf|file.glb]: a glTF scan, with its meshlets generated at load. Without a file, a grid of
+// dense spheres where the front row hides most of the others.
+
+#include <cmath>
+#include <iostream>
+
+#include "benchmarkScene.h"
+#include "gltfLoader.h"
+#include "meshlet.h"
+
+namespace
+{
+	//UV sphere of radius 1, rings x segments quads
+	MeshPtr createSphere(uint32_t rings, uint32_t segments)
+	{
+		std::vector<Vertex> vertices;
+		for (uint32_t r = 0; r <= rings; ++r)
+		{
+			const float theta = glm::pi<float>() * r / rings;
+			for (uint32_t s = 0; s <= segments; ++s)
+			{
+				const float phi = 2.0f * glm::pi<float>() * s / segments;
+				Vertex vertex;
+				vertex.normal = glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+				vertex.position = vertex.normal;
+				vertex.tangent = glm::vec3(-std::sin(phi), 0.0f, std::cos(phi));
+				vertex.uv = glm::vec2(float(s) / segments, float(r) / rings);
+				vertices.push_back(vertex);
+			}
+		}
+		std::vector<uint32_t> indices;
+		for (uint32_t r = 0; r < rings; ++r)
+		{
+			for (uint32_t s = 0; s < segments; ++s)
+			{
+				const uint32_t i = r * (segments + 1) + s;
+				indices.insert(indices.end(), { i, i + segments + 1, i + 1, i + 1, i + segments + 1, i + segments + 2 });
+			}
+		}
+		MeshPtr mesh = std::make_shared<Mesh>();
+		mesh->setVertices(vertices);
+		mesh->setIndices(indices);
+		mesh->setMeshlets(MeshletBuilder::build(vertices, indices));
+		return mesh;
+	}
+
+	//Index count of the indirect draws written by the culling of the last frame
+	size_t readVisibleTriangles(BenchmarkScene& bench)
+	{
+		Device device = Context::getInstance().getDevice();
+		std::vector<entt::entity> entities;
+		for (auto entity : bench.getScene()->getRegistry().view<const Issam::MeshRenderer>())
+		{
+			if (bench.getRenderer().getMeshletCuller().getTarget(entity))
+				entities.push_back(entity);
+		}
+		if (entities.empty()) return 0;
+
+		BufferDescriptor bufferDesc;
+		bufferDesc.size = entities.size() * 5 * sizeof(uint32_t);
+		bufferDesc.usage = BufferUsage::MapRead | BufferUsage::CopyDst;
+		Buffer buffer = device.CreateBuffer(&bufferDesc);
+		CommandEncoder encoder = device.CreateCommandEncoder();
+		for (size_t i = 0; i < entities.size(); ++i)
+			encoder.CopyBufferToBuffer(bench.getRenderer().getMeshletCuller().getTarget(entities[i])->drawArgs, 0, buffer, i * 5 * sizeof(uint32_t), 5 * sizeof(uint32_t));
+		CommandBuffer command = encoder.Finish();
+		device.GetQueue().Submit(1, &command);
+		if (!Context::getInstance().waitForGpu())
+			return 0;
+
+		bool mapped = false;
+		auto onMapped = [](WGPUBufferMapAsyncStatus status, void* userdata) {
+			*static_cast<bool*>(userdata) = status == WGPUBufferMapAsyncStatus_Success;
+		};
+		buffer.MapAsync(MapMode::Read, 0, bufferDesc.size, onMapped, &mapped);
+		//The copy is done, the mapping only needs the callbacks to be processed
+		for (int i = 0; i < 1000 && !mapped; ++i)
+			device.Tick();
+		if (!mapped) return 0;
+		const uint32_t* drawArgs = static_cast<const uint32_t*>(buffer.GetConstMappedRange(0, bufferDesc.size));
+		size_t indexCount = 0;
+		for (size_t i = 0; i < entities.size(); ++i)
+			indexCount += drawArgs[i * 5];
+		buffer.Unmap();
+		return indexCount / 3;
+	}
+
+	void runView(BenchmarkScene& bench, const char* view, const glm::vec3& position, const glm::vec3& target)
+	{
+		bench.setCamera(position, target);
+		MeshletCuller& culler = bench.getRenderer().getMeshletCuller();
+		struct Mode {
+			const char* name;
+			bool culling, frustum, cone, occlusion;
+		};
+		const Mode modes[] = {
+			{ "direct draws", false, false, false, false },
+			{ "frustum", true, true, false, false },
+			{ "frustum + cone", true, true, true, false },
+			{ "frustum + cone + Hi-Z", true, true, true, true },
+		};
+		for (const Mode& mode : modes)
+		{
+			bench.getPass()->setMeshletCulling(mode.culling);
+			culler.setFrustumCulling(mode.frustum);
+			culler.setConeCulling(mode.cone);
+			culler.setOcclusionCulling(mode.occlusion);
+			//The Hi-Z of a frame is used by the next one: the warm up frames of measureFrames build it
+			const double milliseconds = bench.measureFrames(20);
+			std::cout << view << ", " << mode.name << ": ";
+			if (milliseconds <= 0.0)
+			{
+				std::cout << "GPU failure" << std::endl;
+				continue;
+			}
+			std::cout << milliseconds << " ms/frame, ";
+			if (mode.culling)
+				std::cout << culler.getStats().meshlets << " meshlets tested, " << readVisibleTriangles(bench) << " / " << culler.getStats().triangles << " triangles drawn" << std::endl;
+			else
+				std::cout << bench.getRenderer().getStats().triangles << " triangles drawn" << std::endl;
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	BenchmarkScene bench(1280, 720);
+	//The entities of the glTF loader are filtered "pbr"
+	bench.getPass()->addFilter("pbr");
+
+	glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+	GltfLoader loader(bench.getScene());
+	if (argc > 1)
+	{
+		loader.setMeshOptimization(true);
+		loader.setMeshletGeneration(true);
+		loader.load(argv[1]);
+		bool first = true;
+		auto view = bench.getScene()->getRegistry().view<const Issam::WorldTransform, const Issam::MeshRenderer>();
+		for (auto entity : view)
+		{
+			const Issam::MeshRenderer& meshRenderer = view.get<const Issam::MeshRenderer>(entity);
+			if (!meshRenderer.mesh) continue;
+			const glm::mat4& transform = view.get<const Issam::WorldTransform>(entity).getTransform();
+			const auto box = meshRenderer.mesh->getBoundingBox();
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				const glm::vec3 point = glm::vec3(transform * glm::vec4(corner & 1 ? box.second.x : box.first.x, corner & 2 ? box.second.y : box.first.y, corner & 4 ? box.second.z : box.first.z, 1.0f));
+				boundsMin = first ? point : glm::min(boundsMin, point);
+				boundsMax = first ? point : glm::max(boundsMax, point);
+				first = false;
+			}
+		}
+		if (first)
+		{
+			std::cerr << "No mesh in " << argv[1] << std::endl;
+			return 1;
+		}
+	}
+	else
+	{
+		//8 x 8 spheres of 130k triangles, in rows along z
+		MeshPtr sphere = createSphere(256, 256);
+		for (int z = 0; z < 8; ++z)
+			for (int x = 0; x < 8; ++x)
+				bench.addMesh(sphere, glm::translate(glm::mat4(1.0f), glm::vec3(2.5f * (x - 3.5f), 0.0f, 2.5f * z)));
+		boundsMin = glm::vec3(-10.0f, -1.0f, -1.0f);
+		boundsMax = glm::vec3(10.0f, 1.0f, 19.0f);
+	}
+
+	const glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	const float radius = glm::length(boundsMax - boundsMin) * 0.5f;
+	//The whole model, then a close up where most of it is out of the frustum
+	runView(bench, "whole view", center - glm::vec3(0.0f, -0.3f, 2.0f) * radius, center);
+	runView(bench, "close up", center - glm::vec3(0.0f, 0.0f, 0.4f) * radius, center);
+	return 0;
+}
@@ -0,0 +1,119 @@
+// Vertex fetch of the layouts of VertexLayout, on the GPU without a window.
+// points: non indexed points behind the camera, each vertex is fetched and shaded once then clipped (vertex fetch only).
+// grid: an indexed grid of triangles on screen, with the post transform cache and the rasterization of a real mesh.
+// vertexFetchBench [vertex count in millions, 4 by default]
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include "benchmarkScene.h"
+
+namespace
+{
+	struct Layout {
+		const char* name;
+		VertexLayout layout;
+	};
+
+	std::vector<Vertex> createPoints(size_t count)
+	{
+		std::mt19937 random(12345);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		std::vector<Vertex> vertices(count);
+		for (Vertex& vertex : vertices)
+		{
+			vertex.position = glm::vec3(unit(random), unit(random), unit(random));
+			vertex.normal = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.0f, 0.0f, 2.0f));
+			vertex.tangent = glm::normalize(glm::cross(vertex.normal, glm::vec3(0.0f, 1.0f, 0.0f)));
+			vertex.uv = glm::vec2(unit(random), unit(random)) * 0.5f + 0.5f;
+		}
+		return vertices;
+	}
+
+	//side x side vertices in [-1, 1]^2, with a relief so that the normals vary
+	void createGrid(uint32_t side, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+	{
+		vertices.resize(size_t(side) * side);
+		for (uint32_t y = 0; y < side; ++y)
+		{
+			for (uint32_t x = 0; x < side; ++x)
+			{
+				const float u = float(x) / (side - 1), v = float(y) / (side - 1);
+				Vertex& vertex = vertices[size_t(y) * side + x];
+				const float height = 0.05f * std::sin(40.0f * u) * std::cos(40.0f * v);
+				vertex.position = glm::vec3(2.0f * u - 1.0f, 2.0f * v - 1.0f, height);
+				vertex.normal = glm::normalize(glm::vec3(-2.0f * std::cos(40.0f * u) * std::cos(40.0f * v), 2.0f * std::sin(40.0f * u) * std::sin(40.0f * v), -1.0f));
+				vertex.tangent = glm::vec3(1.0f, 0.0f, 0.0f);
+				vertex.uv = glm::vec2(u, v);
+			}
+		}
+		indices.clear();
+		indices.reserve(size_t(side - 1) * (side - 1) * 6);
+		for (uint32_t y = 0; y + 1 < side; ++y)
+		{
+			for (uint32_t x = 0; x + 1 < side; ++x)
+			{
+				const uint32_t i = y * side + x;
+				indices.insert(indices.end(), { i, i + 1, i + side, i + 1, i + side + 1, i + side });
+			}
+		}
+	}
+
+	void run(BenchmarkScene& bench, const char* scenario, const std::vector<Layout>& layouts, const std::vector<Vertex>& vertices,
+		const std::vector<uint32_t>& indices, const glm::mat4& transform)
+	{
+		for (const Layout& layout : layouts)
+		{
+			MeshPtr mesh = std::make_shared<Mesh>();
+			mesh->setVertices(vertices, layout.layout);
+			if (!indices.empty())
+				mesh->setIndices(indices);
+			bench.addMesh(mesh, transform);
+
+			const double milliseconds = bench.measureFrames(20);
+			const Renderer::Stats& stats = bench.getRenderer().getStats();
+			std::cout << scenario << ", " << layout.name << " (" << layout.layout.getVertexSize() << " B/vertex): ";
+			if (milliseconds > 0.0)
+			{
+				std::cout << milliseconds << " ms/frame, " << stats.vertexCount / 1000.0 / milliseconds << " Mvertices/s, "
+					<< stats.vertexBytes / 1.0e6 / milliseconds << " GB/s fetched" << std::endl;
+			}
+			else
+			{
+				std::cout << "GPU failure" << std::endl;
+			}
+			bench.removeMeshes();
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const double millions = argc > 1 ? std::atof(argv[1]) : 4.0;
+	const size_t vertexCount = static_cast<size_t>(std::max(millions, 0.01) * 1.0e6);
+
+	BenchmarkScene bench(1280, 720);
+
+	//The UVs of the test meshes are in [0, 1]: both UV encodings of the quantized layout apply
+	const std::vector<Layout> layouts = {
+		{ "float32", VertexLayout::getStandard() },
+		{ "float32, split positions", VertexLayout::getStandardSplit() },
+		{ "quantized, float16 UVs", VertexLayout::getQuantized(false) },
+		{ "quantized, unorm16 UVs", VertexLayout::getQuantized(true) },
+	};
+
+	//Behind the camera, at (0, 0, -3) looking to the origin
+	bench.setTopology(PrimitiveTopology::PointList);
+	run(bench, "points", layouts, createPoints(vertexCount), {}, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -10.0f)));
+
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	createGrid(static_cast<uint32_t>(std::sqrt(double(vertexCount))), vertices, indices);
+	bench.setTopology(PrimitiveTopology::TriangleList);
+	run(bench, "grid", layouts, vertices, indices, glm::mat4(1.0f));
+
+	return 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+
+#include "context.h"
+
+using namespace wgpu;
+
+// A WGSL compute entry point and its pipeline.
+// The bind group layouts are deduced from the shader code (auto layout), get them with getBindGroupLayout().
+class ComputeShader
+{
+public:
+	ComputeShader(std::string label, const std::string& code, std::string entryPoint = "cs_main") :
+		m_label(label),
+		m_entryPoint(entryPoint)
+	{
+		ShaderModuleDescriptor shaderDesc;
+		ShaderModuleWGSLDescriptor shaderCodeDesc;
+		shaderDesc.nextInChain = &shaderCodeDesc;
+		shaderCodeDesc.code = code.c_str();
+		ShaderModule shaderModule = Context::getInstance().getDevice().CreateShaderModule(&shaderDesc);
+
+		auto callback = [](WGPUCompilationInfoRequestStatus status, struct WGPUCompilationInfo const* compilationInfo, void* userdata) {
+			if (status == WGPUCompilationInfoRequestStatus::WGPUCompilationInfoRequestStatus_Success) {
+				for (size_t i = 0; i < compilationInfo->messageCount; ++i) {
+					const WGPUCompilationMessage& message = compilationInfo->messages[i];
+					std::cerr << "Compute shader " << static_cast<const char*>(userdata) << ": " << message.message << std::endl;
+					std::cerr << " - Line: " << message.lineNum << ", Column: " << message.linePos << std::endl;
+				}
+			}
+		};
+		shaderModule.GetCompilationInfo(callback, const_cast<char*>(m_label.c_str()));
+		assert(shaderModule);
+
+		ComputePipelineDescriptor pipelineDesc;
+		pipelineDesc.label = m_label.c_str();
+		pipelineDesc.layout = nullptr; //auto
+		pipelineDesc.compute.module = shaderModule;
+		pipelineDesc.compute.entryPoint = m_entryPoint.c_str();
+		pipelineDesc.compute.constantCount = 0;
+		pipelineDesc.compute.constants = nullptr;
+		m_pipeline = Context::getInstance().getDevice().CreateComputePipeline(&pipelineDesc);
+	};
+	~ComputeShader() = default;
+
+	const ComputePipeline& getComputePipeline() const { return m_pipeline; }
+	BindGroupLayout getBindGroupLayout(uint32_t group = 0) const { return m_pipeline.GetBindGroupLayout(group); }
+
+	//Workgroups needed to cover count invocations
+	static uint32_t getGroupCount(uint32_t count, uint32_t groupSize) { return (count + groupSize - 1) / groupSize; }
+
+private:
+	std::string m_label;
+	std::string m_entryPoint;
+	ComputePipeline m_pipeline{ nullptr };
+};
@@ -5,7 +5,9 @@
 #include <webgpu/webgpu_cpp.h>
 
 #include "webgpu-utils.h"
+#include <chrono>
 #include <iostream>
+#include <thread>
 
 using namespace wgpu;
 
@@ -21,6 +23,7 @@ public:
 	~Context() = default;
 
 
+	//Without a window (the benchmarks), there is no surface: the passes need their own color buffers
 	void initGraphics(GLFWwindow* window, uint16_t width, uint16_t height, TextureFormat swapChainFormat)
 	{
 		m_instance = CreateInstance();
@@ -46,9 +49,17 @@ public:
 		deviceDesc.requiredLimits = nullptr;
 		deviceDesc.defaultQueue.label = "The default queue";
 		
-		std::vector<FeatureName> requiredFeatures = {
-		    FeatureName::Float32Filterable
-		};
+		//The HDR images are RGB9E5Ufloat or RGBA16Float (see HdrEncoder), filterable without Float32Filterable.
+		//It is only requested for the RGBA32Float ones, when available.
+		std::vector<FeatureName> requiredFeatures;
+		if (m_adapter.HasFeature(FeatureName::Float32Filterable))
+			requiredFeatures.push_back(FeatureName::Float32Filterable);
+		//Block compressed textures, uploaded as they are stored in the files (see Ktx2Reader)
+		for (FeatureName feature : { FeatureName::TextureCompressionBC, FeatureName::TextureCompressionETC2, FeatureName::TextureCompressionASTC })
+		{
+			if (m_adapter.HasFeature(feature))
+				requiredFeatures.push_back(feature);
+		}
 
 		deviceDesc.requiredFeatures = requiredFeatures.data();
 		deviceDesc.requiredFeatureCount = static_cast<uint32_t>(requiredFeatures.size());
@@ -68,6 +79,7 @@ public:
 		m_device.SetUncapturedErrorCallback(onUncapturedError, nullptr);
 
 	//	//Creating swapchain...
+		if (!window) return;
 		m_surface = glfw::CreateSurfaceForWindow(m_instance, window);
 		SurfaceConfiguration config;
 		config.device = m_device;
@@ -90,6 +102,47 @@ public:
 
 	Device getDevice() { return m_device; }
 
+	bool hasFeature(FeatureName feature) const { return m_device && m_device.HasFeature(feature); }
+
+	//Blocks until the GPU has finished the work submitted so far. False when it failed or took more than timeoutMs.
+	bool waitForGpu(double timeoutMs = 10000.0)
+	{
+		//On the heap: after a timeout, the callback still comes later and frees it
+		struct WorkDone {
+			bool done = false;
+			bool success = false;
+			bool abandoned = false;
+		};
+		WorkDone* workDone = new WorkDone();
+		auto onWorkDone = [](WGPUQueueWorkDoneStatus status, void* userdata) {
+			WorkDone* workDone = static_cast<WorkDone*>(userdata);
+			if (workDone->abandoned)
+			{
+				delete workDone;
+				return;
+			}
+			workDone->done = true;
+			workDone->success = status == WGPUQueueWorkDoneStatus_Success;
+		};
+		m_device.GetQueue().OnSubmittedWorkDone(onWorkDone, workDone);
+
+		const auto start = std::chrono::steady_clock::now();
+		while (!workDone->done)
+		{
+			m_device.Tick();
+			if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() > timeoutMs)
+			{
+				std::cerr << "The GPU did not finish its work in " << timeoutMs << " ms" << std::endl;
+				workDone->abandoned = true;
+				return false;
+			}
+			std::this_thread::yield();
+		}
+		const bool success = workDone->success;
+		delete workDone;
+		return success;
+	}
+
 private:
 	Device RequestDevice(Adapter& instance, DeviceDescriptor const* descriptor) {
 		struct UserData {
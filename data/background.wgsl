@@ -1,6 +1,7 @@
 
 @vertex
-fn vs_main(in: VertexInput) -> VertexOutput {
+fn vs_main(input: VertexInput) -> VertexOutput {
+	let in = decodeVertex(input);
 	var out: VertexOutput;
 	out.position = vec4f(in.position, 1.0);
 	out.tangent = in.tangent;
@@ -0,0 +1,15 @@
+//Used by the benchmarks (see benchmarks/benchmarkScene.h): every vertex attribute reaches the fragment stage,
+//so that none of them is skipped by the compiler and the vertex fetch is the one of the whole layout
+@vertex
+fn vs_main(input: VertexInput) -> VertexOutput {
+	let in = decodeVertex(input);
+	var out: VertexOutput;
+	out.position = u_scene.projection * u_scene.view * u_node.model * vec4f(in.position, 1.0);
+	out.color = in.normal * 0.5 + 0.5 + in.tangent * 0.25 + vec3f(in.uv, 0.0) * 0.25;
+	return out;
+}
+
+@fragment
+fn fs_main(in: VertexOutput) -> @location(0) vec4f {
+	return vec4f(in.color, 1.0) * u_material.colorFactor;
+}
@@ -0,0 +1,46 @@
+//Feedback of the texture streaming (see TextureStreamer), rendered at 1/FEEDBACK_SCALE of the viewport:
+//each pixel records the streamed texture sampled there and the finest mip level the full resolution pass would use.
+//rg: id (16 bits), b: level, a: 1 when written. The two textures of the material alternate on a checkerboard.
+
+const FEEDBACK_SCALE = 8.0; //TextureStreamer::c_feedbackScale
+
+@vertex
+fn vs_main(input: VertexInput) -> VertexOutput {
+	let in = decodeVertex(input);
+	var out: VertexOutput;
+	out.position = u_scene.projection * u_scene.view * u_node.model * vec4f(in.position, 1.0);
+	out.uv = in.uv;
+	return out;
+}
+
+//streaming: (id, width, height) of the texture, id 0 when it is not streamed
+fn getLevel(streaming: vec4f, dx: vec2f, dy: vec2f) -> f32 {
+	let texelDx = dx * streaming.yz;
+	let texelDy = dy * streaming.yz;
+	let footprint = max(dot(texelDx, texelDx), dot(texelDy, texelDy));
+	//The derivatives are FEEDBACK_SCALE times those of the full resolution pixels
+	return max(0.5 * log2(max(footprint, 1e-8)) - log2(FEEDBACK_SCALE), 0.0);
+}
+
+@fragment
+fn fs_main(in: VertexOutput) -> @location(0) vec4f {
+	//In uniform control flow, before the discards
+	let dx = dpdx(in.uv);
+	let dy = dpdy(in.uv);
+
+	let checker = (u32(in.position.x) + u32(in.position.y)) & 1u;
+	var streaming = u_material.baseColorStreaming;
+	if (checker == 1u || streaming.x == 0.0) {
+		streaming = u_material.metallicRoughnessStreaming;
+	}
+	if (streaming.x == 0.0) {
+		streaming = u_material.baseColorStreaming;
+	}
+	if (streaming.x == 0.0) {
+		discard;
+	}
+
+	let id = u32(streaming.x);
+	let level = min(floor(getLevel(streaming, dx, dy)), 255.0);
+	return vec4f(f32(id & 255u), f32(id >> 8u), level, 255.0) / 255.0;
+}
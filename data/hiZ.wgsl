@@ -0,0 +1,36 @@
+// Hierarchical depth: every texel keeps the farthest depth of the texels it covers.
+// cs_copyDepth fills the level 0 from the depth buffer, cs_downsample builds the next levels one by one.
+
+@group(0) @binding(0) var source: texture_2d<f32>;
+@group(0) @binding(1) var destination: texture_storage_2d<r32float, write>;
+@group(0) @binding(2) var depth: texture_depth_2d;
+
+@compute @workgroup_size(8, 8)
+fn cs_copyDepth(@builtin(global_invocation_id) id: vec3u) {
+    let size = textureDimensions(destination);
+    if (id.x >= size.x || id.y >= size.y) {
+        return;
+    }
+    textureStore(destination, vec2i(id.xy), vec4f(textureLoad(depth, vec2i(id.xy), 0), 0.0, 0.0, 1.0));
+}
+
+@compute @workgroup_size(8, 8)
+fn cs_downsample(@builtin(global_invocation_id) id: vec3u) {
+    let size = textureDimensions(destination);
+    if (id.x >= size.x || id.y >= size.y) {
+        return;
+    }
+    let sourceSize = vec2i(textureDimensions(source));
+    // With odd source sizes the last texels also cover the extra column / row
+    let extraX = select(0, 1, id.x == size.x - 1u && (sourceSize.x & 1) == 1);
+    let extraY = select(0, 1, id.y == size.y - 1u && (sourceSize.y & 1) == 1);
+
+    var farthest = 0.0;
+    for (var y = 0; y <= 1 + extraY; y++) {
+        for (var x = 0; x <= 1 + extraX; x++) {
+            let texel = min(vec2i(id.xy) * 2 + vec2i(x, y), sourceSize - 1);
+            farthest = max(farthest, textureLoad(source, texel, 0).r);
+        }
+    }
+    textureStore(destination, vec2i(id.xy), vec4f(farthest, 0.0, 0.0, 1.0));
+}
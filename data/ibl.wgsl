@@ -0,0 +1,176 @@
+// Image based lighting, precomputed from an equirectangular environment (see EnvironmentLighting):
+// cs_specular: GGX prefiltered cubemap, one dispatch per level (roughness = level / (levelCount - 1))
+// cs_irradianceSh: irradiance in 9 spherical harmonics, cosine lobe convolved and divided by PI
+// cs_brdfLut: split sum scale and bias of F0 per (N.V, roughness)
+
+const PI = 3.14159265359;
+const WORKGROUP_SIZE = 256u;
+
+struct Params {
+    roughness: f32,
+    faceSize: u32,
+    sampleCount: u32,
+    sourceLevel: u32, //Of the environment, for the irradiance
+    sourceSize: vec2f,
+};
+
+@group(0) @binding(0) var environment: texture_2d<f32>;
+@group(0) @binding(1) var environmentSampler: sampler;
+@group(0) @binding(2) var specular: texture_storage_2d_array<rgba16float, write>;
+@group(0) @binding(3) var<uniform> params: Params;
+@group(0) @binding(4) var brdfLut: texture_storage_2d<rgba16float, write>;
+@group(0) @binding(5) var<storage, read_write> irradianceSh: array<vec4f, 9>;
+
+// Direction of a texel of a cubemap face, faces in the order +X, -X, +Y, -Y, +Z, -Z
+fn cubeDirection(face: u32, uv: vec2f) -> vec3f {
+    let p = uv * 2.0 - 1.0;
+    switch face {
+        case 0u: { return normalize(vec3f(1.0, -p.y, -p.x)); }
+        case 1u: { return normalize(vec3f(-1.0, -p.y, p.x)); }
+        case 2u: { return normalize(vec3f(p.x, 1.0, p.y)); }
+        case 3u: { return normalize(vec3f(p.x, -1.0, -p.y)); }
+        case 4u: { return normalize(vec3f(p.x, -p.y, 1.0)); }
+        default: { return normalize(vec3f(-p.x, -p.y, -1.0)); }
+    }
+}
+
+fn equirectUv(direction: vec3f) -> vec2f {
+    return vec2f(atan2(direction.z, direction.x) / (2.0 * PI) + 0.5, acos(clamp(direction.y, -1.0, 1.0)) / PI);
+}
+
+fn equirectDirection(uv: vec2f) -> vec3f {
+    let phi = (uv.x - 0.5) * 2.0 * PI;
+    let theta = uv.y * PI;
+    return vec3f(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+}
+
+fn hammersley(i: u32, count: u32) -> vec2f {
+    return vec2f(f32(i) / f32(count), f32(reverseBits(i)) * 2.3283064365386963e-10);
+}
+
+// Half vector around N, distributed as D(h) (N.H)
+fn importanceSampleGGX(xi: vec2f, N: vec3f, a: f32) -> vec3f {
+    let phi = 2.0 * PI * xi.x;
+    let cosTheta = sqrt((1.0 - xi.y) / (1.0 + (a * a - 1.0) * xi.y));
+    let sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+    let h = vec3f(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
+    let up = select(vec3f(1.0, 0.0, 0.0), vec3f(0.0, 0.0, 1.0), abs(N.z) < 0.999);
+    let tangent = normalize(cross(up, N));
+    let bitangent = cross(N, tangent);
+    return normalize(tangent * h.x + bitangent * h.y + N * h.z);
+}
+
+fn distributionGGX(NdotH: f32, a: f32) -> f32 {
+    let a2 = a * a;
+    let d = NdotH * NdotH * (a2 - 1.0) + 1.0;
+    return a2 / (PI * d * d);
+}
+
+@compute @workgroup_size(8, 8, 1)
+fn cs_specular(@builtin(global_invocation_id) id: vec3u) {
+    if (id.x >= params.faceSize || id.y >= params.faceSize) {
+        return;
+    }
+    let N = cubeDirection(id.z, (vec2f(id.xy) + 0.5) / f32(params.faceSize));
+    if (params.roughness == 0.0) {
+        let color = textureSampleLevel(environment, environmentSampler, equirectUv(N), 0.0).rgb;
+        textureStore(specular, vec2i(id.xy), i32(id.z), vec4f(color, 1.0));
+        return;
+    }
+
+    // N = V = R, the samples read a level of the environment matching their solid angle
+    let a = params.roughness * params.roughness;
+    let texelSolidAngle = 4.0 * PI / (params.sourceSize.x * params.sourceSize.y);
+    var color = vec3f(0.0);
+    var weight = 0.0;
+    for (var i = 0u; i < params.sampleCount; i++) {
+        let H = importanceSampleGGX(hammersley(i, params.sampleCount), N, a);
+        let L = 2.0 * dot(N, H) * H - N;
+        let NdotL = dot(N, L);
+        if (NdotL > 0.0) {
+            let pdf = distributionGGX(max(dot(N, H), 0.0), a) / 4.0 + 0.0001;
+            let sampleSolidAngle = 1.0 / (f32(params.sampleCount) * pdf);
+            let level = max(0.5 * log2(sampleSolidAngle / texelSolidAngle) + 1.0, 0.0);
+            color += textureSampleLevel(environment, environmentSampler, equirectUv(L), level).rgb * NdotL;
+            weight += NdotL;
+        }
+    }
+    textureStore(specular, vec2i(id.xy), i32(id.z), vec4f(color / max(weight, 0.0001), 1.0));
+}
+
+fn shBasis(d: vec3f) -> array<f32, 9> {
+    return array<f32, 9>(
+        0.282095,
+        0.488603 * d.y, 0.488603 * d.z, 0.488603 * d.x,
+        1.092548 * d.x * d.y, 1.092548 * d.y * d.z, 0.315392 * (3.0 * d.z * d.z - 1.0),
+        1.092548 * d.x * d.z, 0.546274 * (d.x * d.x - d.y * d.y));
+}
+
+var<workgroup> partialSums: array<vec3f, WORKGROUP_SIZE>;
+
+// One workgroup, each invocation sums a share of the texels, then one reduction per coefficient
+@compute @workgroup_size(WORKGROUP_SIZE)
+fn cs_irradianceSh(@builtin(local_invocation_index) local: u32) {
+    let size = vec2u(textureDimensions(environment, params.sourceLevel));
+    var sums: array<vec3f, 9>;
+    for (var i = local; i < size.x * size.y; i += WORKGROUP_SIZE) {
+        let texel = vec2u(i % size.x, i / size.x);
+        let uv = (vec2f(texel) + 0.5) / vec2f(size);
+        let direction = equirectDirection(uv);
+        let solidAngle = (2.0 * PI / f32(size.x)) * (PI / f32(size.y)) * sin(uv.y * PI);
+        let radiance = textureLoad(environment, vec2i(texel), i32(params.sourceLevel)).rgb * solidAngle;
+        let basis = shBasis(direction);
+        for (var c = 0u; c < 9u; c++) {
+            sums[c] += radiance * basis[c];
+        }
+    }
+
+    // Cosine lobe per band (PI, 2 PI / 3, PI / 4), divided by PI for the Lambert BRDF
+    let bandScale = array<f32, 9>(1.0, 2.0 / 3.0, 2.0 / 3.0, 2.0 / 3.0, 0.25, 0.25, 0.25, 0.25, 0.25);
+    for (var c = 0u; c < 9u; c++) {
+        partialSums[local] = sums[c];
+        workgroupBarrier();
+        for (var stride = WORKGROUP_SIZE / 2u; stride > 0u; stride >>= 1u) {
+            if (local < stride) {
+                partialSums[local] += partialSums[local + stride];
+            }
+            workgroupBarrier();
+        }
+        if (local == 0u) {
+            irradianceSh[c] = vec4f(partialSums[0] * bandScale[c], 0.0);
+        }
+        workgroupBarrier();
+    }
+}
+
+@compute @workgroup_size(8, 8, 1)
+fn cs_brdfLut(@builtin(global_invocation_id) id: vec3u) {
+    let size = textureDimensions(brdfLut);
+    if (id.x >= size.x || id.y >= size.y) {
+        return;
+    }
+    let NdotV = (f32(id.x) + 0.5) / f32(size.x);
+    let roughness = (f32(id.y) + 0.5) / f32(size.y);
+    let a = roughness * roughness;
+    let k = a / 2.0;
+    let V = vec3f(sqrt(1.0 - NdotV * NdotV), 0.0, NdotV);
+    let N = vec3f(0.0, 0.0, 1.0);
+    let sampleCount = 512u;
+    var scale = 0.0;
+    var bias = 0.0;
+    for (var i = 0u; i < sampleCount; i++) {
+        let H = importanceSampleGGX(hammersley(i, sampleCount), N, a);
+        let L = 2.0 * dot(V, H) * H - V;
+        let NdotL = max(L.z, 0.0);
+        if (NdotL > 0.0) {
+            let NdotH = max(H.z, 0.0);
+            let VdotH = max(dot(V, H), 0.0);
+            let G = (NdotV / (NdotV * (1.0 - k) + k)) * (NdotL / (NdotL * (1.0 - k) + k));
+            let visibility = G * VdotH / (NdotH * NdotV);
+            let fresnel = pow(1.0 - VdotH, 5.0);
+            scale += (1.0 - fresnel) * visibility;
+            bias += fresnel * visibility;
+        }
+    }
+    textureStore(brdfLut, vec2i(id.xy), vec4f(vec2f(scale, bias) / f32(sampleCount), 0.0, 1.0));
+}
@@ -0,0 +1,76 @@
+//Far entities drawn as one quad per instance, in the plane of the atlas frame closest to the view direction
+
+struct Uniforms {
+	viewProj: mat4x4f,
+	lightDirection: vec4f,
+};
+
+@group(0) @binding(0) var<uniform> u_impostor: Uniforms;
+@group(1) @binding(0) var albedoAtlas: texture_2d<f32>;
+@group(1) @binding(1) var normalDepthAtlas: texture_2d<f32>;
+@group(1) @binding(2) var atlasSampler: sampler;
+
+//Per instance, the axes are the frame basis in world space, scaled by the radius of the bounding sphere
+struct InstanceInput {
+	@builtin(vertex_index) vertex: u32,
+	@location(0) center: vec4f,
+	@location(1) axisX: vec4f,
+	@location(2) axisY: vec4f,
+	@location(3) axisZ: vec4f,
+	@location(4) frame: vec4f, //xy: origin of the frame in the atlas, z: size of a frame
+};
+
+struct VertexOutput {
+	@builtin(position) position: vec4f,
+	@location(0) uv: vec2f,
+	@location(1) worldPosition: vec3f,
+	@location(2) @interpolate(flat) axisX: vec3f,
+	@location(3) @interpolate(flat) axisY: vec3f,
+	@location(4) @interpolate(flat) axisZ: vec3f,
+};
+
+struct FragmentOutput {
+	@location(0) color: vec4f,
+	@builtin(frag_depth) depth: f32,
+};
+
+const corners = array<vec2f, 6>(
+	vec2f(-1.0, -1.0), vec2f(1.0, -1.0), vec2f(-1.0, 1.0),
+	vec2f(-1.0, 1.0), vec2f(1.0, -1.0), vec2f(1.0, 1.0)
+);
+
+@vertex
+fn vs_main(in: InstanceInput) -> VertexOutput {
+	let corner = corners[in.vertex];
+	let worldPosition = in.center.xyz + in.axisX.xyz * corner.x + in.axisY.xyz * corner.y;
+	var out: VertexOutput;
+	out.position = u_impostor.viewProj * vec4f(worldPosition, 1.0);
+	out.uv = in.frame.xy + vec2f(corner.x * 0.5 + 0.5, 0.5 - corner.y * 0.5) * in.frame.z;
+	out.worldPosition = worldPosition;
+	out.axisX = in.axisX.xyz;
+	out.axisY = in.axisY.xyz;
+	out.axisZ = in.axisZ.xyz;
+	return out;
+}
+
+@fragment
+fn fs_main(in: VertexOutput) -> FragmentOutput {
+	let albedo = textureSampleLevel(albedoAtlas, atlasSampler, in.uv, 0.0);
+	if (albedo.a < 0.5) {
+		discard;
+	}
+	let normalDepth = textureSampleLevel(normalDepthAtlas, atlasSampler, in.uv, 0.0);
+	let n = normalDepth.xyz * 2.0 - 1.0;
+	let N = normalize(in.axisX * n.x + in.axisY * n.y + in.axisZ * n.z);
+	let L = u_impostor.lightDirection.xyz;
+	let color = albedo.rgb * (0.2 + max(dot(N, L), 0.0));
+
+	//The depth of the frame goes from the front of the bounding sphere (0) to its back (1)
+	let surface = in.worldPosition + in.axisZ * (normalDepth.a * 2.0 - 1.0);
+	let clip = u_impostor.viewProj * vec4f(surface, 1.0);
+
+	var out: FragmentOutput;
+	out.color = vec4f(color, 1.0);
+	out.depth = clamp(clip.z / clip.w, 0.0, 1.0);
+	return out;
+}
@@ -0,0 +1,54 @@
+//Renders a mesh in one frame of the impostor atlases, the frame is selected by the instance index
+
+struct Frame {
+	viewProj: mat4x4f,
+	view: mat4x4f,
+};
+
+@group(0) @binding(0) var<storage, read> frames: array<Frame>;
+@group(0) @binding(1) var<uniform> baseColorFactor: vec4f;
+@group(0) @binding(2) var baseColorTexture: texture_2d<f32>;
+@group(0) @binding(3) var textureSampler: sampler;
+
+struct VertexInput {
+	@builtin(instance_index) frame: u32,
+	@location(0) position: vec3f,
+	@location(1) normal: vec3f,
+	@location(3) uv: vec2f,
+};
+
+struct VertexOutput {
+	@builtin(position) position: vec4f,
+	@location(0) normal: vec3f,
+	@location(1) uv: vec2f,
+	@location(2) depth: f32,
+};
+
+struct FragmentOutput {
+	@location(0) albedo: vec4f,
+	@location(1) normalDepth: vec4f,
+};
+
+@vertex
+fn vs_main(in: VertexInput) -> VertexOutput {
+	let frame = frames[in.frame];
+	var out: VertexOutput;
+	out.position = frame.viewProj * vec4f(in.position, 1.0);
+	out.normal = (frame.view * vec4f(in.normal, 0.0)).xyz;
+	out.uv = in.uv;
+	out.depth = out.position.z;
+	return out;
+}
+
+@fragment
+fn fs_main(in: VertexOutput) -> FragmentOutput {
+	let color = textureSample(baseColorTexture, textureSampler, in.uv) * baseColorFactor;
+	if (color.a < 0.5) {
+		discard;
+	}
+	var out: FragmentOutput;
+	out.albedo = vec4f(color.rgb, 1.0);
+	//View space normal, the runtime rotates it with the axes of the frame
+	out.normalDepth = vec4f(normalize(in.normal) * 0.5 + 0.5, clamp(in.depth, 0.0, 1.0));
+	return out;
+}
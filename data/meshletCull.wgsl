@@ -0,0 +1,130 @@
+// One workgroup per meshlet: the first invocation tests the meshlet, the whole group copies
+// the indices of the visible ones to the compacted index buffer drawn with DrawIndexedIndirect.
+
+struct CullUniforms {
+    model: mat4x4f,
+    hiZViewProj: mat4x4f,   // View projection of the frame the Hi-Z was built from
+    planes: array<vec4f, 6>, // World space frustum planes, pointing inward
+    cameraPosition: vec4f,  // w: largest scale of the model matrix
+    hiZSize: vec2f,
+    hiZMipCount: u32,
+    flags: u32,
+    meshletCount: u32,
+};
+
+struct Meshlet {
+    sphere: vec4f,
+    cone: vec4f,
+    indexOffset: u32,
+    triangleCount: u32,
+    vertexCount: u32,
+    padding: u32,
+};
+
+const FRUSTUM_CULLING: u32 = 1u;
+const CONE_CULLING: u32 = 2u;
+const OCCLUSION_CULLING: u32 = 4u;
+const WORKGROUP_SIZE: u32 = 64u;
+const MAX_DISPATCH: u32 = 65535u;
+
+@group(0) @binding(0) var<uniform> uniforms: CullUniforms;
+@group(0) @binding(1) var<storage, read> meshlets: array<Meshlet>;
+@group(0) @binding(2) var<storage, read> meshletIndices: array<u32>;
+@group(0) @binding(3) var<storage, read_write> outIndices: array<u32>;
+// indexCount, instanceCount, firstIndex, baseVertex, firstInstance
+@group(0) @binding(4) var<storage, read_write> drawArgs: array<atomic<u32>, 5>;
+@group(0) @binding(5) var hiZ: texture_2d<f32>;
+
+var<workgroup> visible: u32;
+var<workgroup> outOffset: u32;
+
+fn isOccluded(center: vec3f, radius: f32) -> bool {
+    // Screen rectangle and nearest depth of the box around the sphere
+    var minUV = vec2f(1.0);
+    var maxUV = vec2f(0.0);
+    var minDepth = 1.0;
+    for (var i = 0u; i < 8u; i++) {
+        let corner = center + radius * vec3f(
+            select(-1.0, 1.0, (i & 1u) != 0u),
+            select(-1.0, 1.0, (i & 2u) != 0u),
+            select(-1.0, 1.0, (i & 4u) != 0u));
+        let clip = uniforms.hiZViewProj * vec4f(corner, 1.0);
+        if (clip.w <= 0.0) {
+            return false; // Crosses the camera plane
+        }
+        let ndc = clip.xyz / clip.w;
+        let uv = vec2f(ndc.x * 0.5 + 0.5, 0.5 - ndc.y * 0.5);
+        minUV = min(minUV, uv);
+        maxUV = max(maxUV, uv);
+        minDepth = min(minDepth, ndc.z);
+    }
+    minUV = clamp(minUV, vec2f(0.0), vec2f(1.0));
+    maxUV = clamp(maxUV, vec2f(0.0), vec2f(1.0));
+
+    // Level where the rectangle covers at most 2x2 texels
+    let size = (maxUV - minUV) * uniforms.hiZSize;
+    let level = u32(clamp(ceil(log2(max(max(size.x, size.y), 1.0))), 0.0, f32(uniforms.hiZMipCount - 1u)));
+    let levelSize = vec2i(textureDimensions(hiZ, level));
+    let minTexel = clamp(vec2i(minUV * vec2f(levelSize)), vec2i(0), levelSize - 1);
+    let maxTexel = clamp(vec2i(maxUV * vec2f(levelSize)), vec2i(0), levelSize - 1);
+
+    var maxDepth = 0.0;
+    for (var y = minTexel.y; y <= maxTexel.y; y++) {
+        for (var x = minTexel.x; x <= maxTexel.x; x++) {
+            maxDepth = max(maxDepth, textureLoad(hiZ, vec2i(x, y), i32(level)).r);
+        }
+    }
+    return minDepth > maxDepth;
+}
+
+fn isVisible(meshlet: Meshlet) -> bool {
+    let center = (uniforms.model * vec4f(meshlet.sphere.xyz, 1.0)).xyz;
+    let radius = meshlet.sphere.w * uniforms.cameraPosition.w;
+
+    if ((uniforms.flags & FRUSTUM_CULLING) != 0u) {
+        for (var i = 0u; i < 6u; i++) {
+            if (dot(uniforms.planes[i].xyz, center) + uniforms.planes[i].w < -radius) {
+                return false;
+            }
+        }
+    }
+
+    // All the triangles face away from the camera
+    if ((uniforms.flags & CONE_CULLING) != 0u && meshlet.cone.w < 1.0) {
+        let axis = normalize((uniforms.model * vec4f(meshlet.cone.xyz, 0.0)).xyz);
+        let toCenter = center - uniforms.cameraPosition.xyz;
+        if (dot(toCenter, axis) >= meshlet.cone.w * length(toCenter) + radius) {
+            return false;
+        }
+    }
+
+    if ((uniforms.flags & OCCLUSION_CULLING) != 0u && isOccluded(center, radius)) {
+        return false;
+    }
+    return true;
+}
+
+@compute @workgroup_size(64)
+fn cs_main(@builtin(workgroup_id) workgroupId: vec3u, @builtin(local_invocation_index) localIndex: u32) {
+    let meshletIndex = workgroupId.x + workgroupId.y * MAX_DISPATCH;
+    if (meshletIndex >= uniforms.meshletCount) {
+        return;
+    }
+    let meshlet = meshlets[meshletIndex];
+
+    if (localIndex == 0u) {
+        visible = select(0u, 1u, isVisible(meshlet));
+        if (visible != 0u) {
+            outOffset = atomicAdd(&drawArgs[0], meshlet.triangleCount * 3u);
+        }
+    }
+    workgroupBarrier();
+    if (visible == 0u) {
+        return;
+    }
+
+    let indexCount = meshlet.triangleCount * 3u;
+    for (var i = localIndex; i < indexCount; i += WORKGROUP_SIZE) {
+        outIndices[outOffset + i] = meshletIndices[meshlet.indexOffset + i];
+    }
+}
@@ -0,0 +1,90 @@
+// Mip level generation: every destination texel is the average of the source texels it covers.
+// With an odd source size, three texels per axis are weighted by their coverage, so that the non power of two
+// textures keep their last row and column. One entry point per storage format, the sRGB one averages in linear space.
+
+@group(0) @binding(0) var source: texture_2d<f32>;
+@group(0) @binding(1) var destination8: texture_storage_2d<rgba8unorm, write>;
+@group(0) @binding(2) var destination16: texture_storage_2d<rgba16float, write>;
+@group(0) @binding(3) var destination32: texture_storage_2d<rgba32float, write>;
+
+// Weights of the source texels 2x, 2x + 1 and 2x + 2 along one axis
+fn axisWeights(x: u32, sourceSize: u32, size: u32) -> vec3f {
+    if (sourceSize == 1u) {
+        return vec3f(1.0, 0.0, 0.0);
+    }
+    if ((sourceSize & 1u) == 0u) {
+        return vec3f(0.5, 0.5, 0.0);
+    }
+    let n = f32(size);
+    let i = f32(x);
+    return vec3f(n - i, n, i + 1.0) / (2.0 * n + 1.0);
+}
+
+fn srgbToLinear(c: vec3f) -> vec3f {
+    return select(pow((c + 0.055) / 1.055, vec3f(2.4)), c / 12.92, c <= vec3f(0.04045));
+}
+
+fn linearToSrgb(c: vec3f) -> vec3f {
+    return select(1.055 * pow(c, vec3f(1.0 / 2.4)) - 0.055, c * 12.92, c <= vec3f(0.0031308));
+}
+
+fn average(id: vec2u, size: vec2u, srgb: bool) -> vec4f {
+    let sourceSize = textureDimensions(source);
+    let wx = axisWeights(id.x, sourceSize.x, size.x);
+    let wy = axisWeights(id.y, sourceSize.y, size.y);
+    var sum = vec4f(0.0);
+    for (var y = 0u; y < 3u; y++) {
+        for (var x = 0u; x < 3u; x++) {
+            let weight = wx[x] * wy[y];
+            if (weight == 0.0) {
+                continue;
+            }
+            let texel = min(id * 2u + vec2u(x, y), sourceSize - 1u);
+            var value = textureLoad(source, vec2i(texel), 0);
+            if (srgb) {
+                value = vec4f(srgbToLinear(value.rgb), value.a);
+            }
+            sum += weight * value;
+        }
+    }
+    if (srgb) {
+        return vec4f(linearToSrgb(sum.rgb), sum.a);
+    }
+    return sum;
+}
+
+@compute @workgroup_size(8, 8)
+fn cs_downsample8(@builtin(global_invocation_id) id: vec3u) {
+    let size = textureDimensions(destination8);
+    if (id.x >= size.x || id.y >= size.y) {
+        return;
+    }
+    textureStore(destination8, vec2i(id.xy), average(id.xy, size, false));
+}
+
+@compute @workgroup_size(8, 8)
+fn cs_downsample8Srgb(@builtin(global_invocation_id) id: vec3u) {
+    let size = textureDimensions(destination8);
+    if (id.x >= size.x || id.y >= size.y) {
+        return;
+    }
+    textureStore(destination8, vec2i(id.xy), average(id.xy, size, true));
+}
+
+@compute @workgroup_size(8, 8)
+fn cs_downsample16(@builtin(global_invocation_id) id: vec3u) {
+    let size = textureDimensions(destination16);
+    if (id.x >= size.x || id.y >= size.y) {
+        return;
+    }
+    textureStore(destination16, vec2i(id.xy), average(id.xy, size, false));
+}
+
+@compute @workgroup_size(8, 8)
+fn cs_downsample32(@builtin(global_invocation_id) id: vec3u) {
+    let size = textureDimensions(destination32);
+    if (id.x >= size.x || id.y >= size.y) {
+        return;
+    }
+    textureStore(destination32, vec2i(id.xy), average(id.xy, size, false));
+}
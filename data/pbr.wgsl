@@ -2,7 +2,8 @@
 const PI = 3.14159265359;
 
 @vertex
-fn vs_main(in: VertexInput) -> VertexOutput {
+fn vs_main(input: VertexInput) -> VertexOutput {
+	let in = decodeVertex(input);
 	var out: VertexOutput;
 	out.position = u_scene.projection * u_scene.view * u_node.model * vec4f(in.position, 1.0);
 	out.color = in.color;
@@ -54,6 +55,26 @@ fn fresnelSchlick(cosTheta : f32, F0 : vec3f) -> vec3f
     return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
 }
 
+fn fresnelSchlickRoughness(cosTheta : f32, F0 : vec3f, roughness : f32) -> vec3f
+{
+    return F0 + (max(vec3f(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
+
+//Diffuse irradiance from the 9 SH coefficients of EnvironmentLighting (already convolved and divided by PI)
+fn irradianceSH(N : vec3f) -> vec3f
+{
+	var irradiance = u_scene.irradianceSh0.rgb * 0.282095;
+	irradiance += u_scene.irradianceSh1.rgb * (0.488603 * N.y);
+	irradiance += u_scene.irradianceSh2.rgb * (0.488603 * N.z);
+	irradiance += u_scene.irradianceSh3.rgb * (0.488603 * N.x);
+	irradiance += u_scene.irradianceSh4.rgb * (1.092548 * N.x * N.y);
+	irradiance += u_scene.irradianceSh5.rgb * (1.092548 * N.y * N.z);
+	irradiance += u_scene.irradianceSh6.rgb * (0.315392 * (3.0 * N.z * N.z - 1.0));
+	irradiance += u_scene.irradianceSh7.rgb * (1.092548 * N.x * N.z);
+	irradiance += u_scene.irradianceSh8.rgb * (0.546274 * (N.x * N.x - N.y * N.y));
+	return max(irradiance, vec3f(0.0));
+}
+
 @fragment
 fn fs_main(in: VertexOutput) -> @location(0) vec4f {
     //let lightDirection = vec3f(0.5, -0.9, 0.1);
@@ -67,11 +88,16 @@ fn fs_main(in: VertexOutput) -> @location(0) vec4f {
 	let L = lightDirection;
 	let H = normalize(V + L);
 	
-	//let reflectedDir = reflect(V, N);
-	//let envmap = textureSample(environmentMap, defaultSampler, reflectedDir.xy).rgb;
-	
-	let baseColor = textureSample(baseColorTexture, defaultSampler, in.uv) * u_material.baseColorFactor;
-	let metallicRoughnessTex = textureSample(metallicRoughnessTexture, defaultSampler, in.uv);
+	//A layer of a texture array when the material was packed (see MaterialPacker), the layers are uniform
+	var baseColorTex = textureSample(baseColorTexture, defaultSampler, in.uv);
+	if (u_material.textureLayers.x >= 0.0) {
+		baseColorTex = textureSample(baseColorArray, defaultSampler, in.uv, i32(u_material.textureLayers.x));
+	}
+	var metallicRoughnessTex = textureSample(metallicRoughnessTexture, defaultSampler, in.uv);
+	if (u_material.textureLayers.y >= 0.0) {
+		metallicRoughnessTex = textureSample(metallicRoughnessArray, defaultSampler, in.uv, i32(u_material.textureLayers.y));
+	}
+	let baseColor = baseColorTex * u_material.baseColorFactor;
 	let metallic = metallicRoughnessTex.b * u_material.metallicFactor.x;
 	let roughness = metallicRoughnessTex.g * u_material.roughnessFactor.x;
 	
@@ -102,10 +128,19 @@ fn fs_main(in: VertexOutput) -> @location(0) vec4f {
 
     // add to outgoing radiance Lo
     let Lo = (kD * baseColor.rgb / PI + specular) * NdotL; //* radiance
+
+	// Image based lighting, split sum: prefiltered radiance * (F0 * scale + bias)
+	let NdotV = max(dot(N, V), 0.0);
+	let R = reflect(-V, N);
+	let prefiltered = textureSampleLevel(specularMap, iblSampler, R, roughness * u_scene.iblParams.x).rgb;
+	let brdf = textureSampleLevel(brdfLut, iblSampler, vec2f(NdotV, roughness), 0.0).rg;
+	let kSAmbient = fresnelSchlickRoughness(NdotV, F0, roughness);
+	let kDAmbient = (1.0 - kSAmbient) * (1.0 - metallic);
+	let ambient = (kDAmbient * baseColor.rgb * irradianceSH(N) + prefiltered * (F0 * brdf.x + brdf.y)) * u_scene.iblParams.y;
 	
 	
 	// Gamma-correction
 //	let srgb_color = pow(baseColor.rgb * shading, vec3f(2.2));
 	//return vec4f(srgb_color, baseColor.a);
-	return vec4f(Lo, 1.0);
+	return vec4f(Lo + ambient, 1.0);
 }
\ No newline at end of file
@@ -1,12 +1,10 @@
 
 @vertex
-fn vs_main(in: VertexInput) -> VertexOutput {
+fn vs_main(input: VertexInput) -> VertexOutput {
+	let in = decodeVertex(input);
 	var out: VertexOutput;
 
 	out.position = u_scene.projection * u_scene.view * u_node.model * vec4f(in.position, 1.0);
-	out.color = in.color;
-	out.normal = in.normal;
-	out.uv = in.uv;
 	
 	return out;
 }
@@ -0,0 +1,411 @@
+#include "environmentLighting.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "assetCache.h"
+#include "computeShader.h"
+#include "utils.h"
+
+namespace
+{
+	//Mirrors Params in ibl.wgsl
+	struct BakeParams {
+		float roughness;
+		uint32_t faceSize;
+		uint32_t sampleCount;
+		uint32_t sourceLevel;
+		glm::vec2 sourceSize;
+		glm::vec2 padding;
+	};
+
+	constexpr TextureFormat c_format = TextureFormat::RGBA16Float;
+	constexpr uint32_t c_texelBytes = 8;
+	constexpr uint32_t c_groupSize = 8;
+	constexpr uint32_t c_sampleCount = 64;
+	constexpr uint32_t c_shSourceWidth = 128; //Widest level of the environment read for the irradiance
+	constexpr uint32_t c_cacheVersion = 1;
+	constexpr uint64_t c_shBytes = 9 * sizeof(glm::vec4);
+	constexpr double c_readBackTimeoutMs = 10000.0;
+	const std::string c_cacheEntry = "ibl";
+
+	uint32_t getLevelSize(uint32_t level) { return std::max(EnvironmentLighting::c_specularSize >> level, 1u); }
+
+	//The buffer rows of the texture copies are multiples of 256 bytes
+	uint32_t getPaddedRowBytes(uint32_t width) { return (width * c_texelBytes + 255) & ~255u; }
+
+	uint64_t getSpecularBytes()
+	{
+		uint64_t bytes = 0;
+		for (uint32_t level = 0; level < EnvironmentLighting::c_specularLevelCount; ++level)
+			bytes += uint64_t(getLevelSize(level)) * getLevelSize(level) * c_texelBytes * 6;
+		return bytes;
+	}
+
+	//The settings of the bake are part of the key, a change of any of them is a miss
+	uint64_t getCacheSeed()
+	{
+		const uint32_t key[] = { c_cacheVersion, EnvironmentLighting::c_specularSize, EnvironmentLighting::c_specularLevelCount,
+			EnvironmentLighting::c_brdfLutSize, c_sampleCount, c_shSourceWidth };
+		return AssetCache::hashBytes({ reinterpret_cast<const uint8_t*>(key), sizeof(key) });
+	}
+
+	Buffer createBuffer(const char* label, BufferUsage usage, uint64_t size)
+	{
+		BufferDescriptor bufferDesc;
+		bufferDesc.label = label;
+		bufferDesc.usage = usage;
+		bufferDesc.size = std::max<uint64_t>((size + 3) & ~uint64_t(3), 4);
+		bufferDesc.mappedAtCreation = false;
+		return Context::getInstance().getDevice().CreateBuffer(&bufferDesc);
+	}
+
+	Texture createTexture(const char* label, uint32_t size, uint32_t layerCount, uint32_t levelCount)
+	{
+		TextureDescriptor textureDesc;
+		textureDesc.label = label;
+		textureDesc.dimension = TextureDimension::e2D;
+		textureDesc.format = c_format;
+		textureDesc.mipLevelCount = levelCount;
+		textureDesc.sampleCount = 1;
+		textureDesc.size = { size, size, layerCount };
+		textureDesc.usage = TextureUsage::StorageBinding | TextureUsage::TextureBinding | TextureUsage::CopySrc | TextureUsage::CopyDst;
+		textureDesc.viewFormatCount = 0;
+		textureDesc.viewFormats = nullptr;
+		return Context::getInstance().getDevice().CreateTexture(&textureDesc);
+	}
+
+	TextureView createView(const Texture& texture, TextureViewDimension dimension, uint32_t baseLevel, uint32_t levelCount, uint32_t layerCount)
+	{
+		TextureViewDescriptor viewDesc;
+		viewDesc.format = c_format;
+		viewDesc.dimension = dimension;
+		viewDesc.baseMipLevel = baseLevel;
+		viewDesc.mipLevelCount = levelCount;
+		viewDesc.baseArrayLayer = 0;
+		viewDesc.arrayLayerCount = layerCount;
+		viewDesc.aspect = TextureAspect::All;
+		return texture.CreateView(&viewDesc);
+	}
+
+	Sampler createSampler(AddressMode addressModeU, float lodMaxClamp)
+	{
+		SamplerDescriptor samplerDesc;
+		samplerDesc.addressModeU = addressModeU;
+		samplerDesc.addressModeV = AddressMode::ClampToEdge;
+		samplerDesc.addressModeW = AddressMode::ClampToEdge;
+		samplerDesc.magFilter = FilterMode::Linear;
+		samplerDesc.minFilter = FilterMode::Linear;
+		samplerDesc.mipmapFilter = MipmapFilterMode::Linear;
+		samplerDesc.lodMinClamp = 0.0f;
+		samplerDesc.lodMaxClamp = lodMaxClamp;
+		samplerDesc.compare = CompareFunction::Undefined;
+		samplerDesc.maxAnisotropy = 1;
+		return Context::getInstance().getDevice().CreateSampler(&samplerDesc);
+	}
+
+	BindGroup createBindGroup(const ComputeShader& shader, std::vector<BindGroupEntry>& entries)
+	{
+		BindGroupDescriptor bindGroupDesc;
+		bindGroupDesc.label = "ibl";
+		bindGroupDesc.layout = shader.getBindGroupLayout();
+		bindGroupDesc.entryCount = entries.size();
+		bindGroupDesc.entries = entries.data();
+		return Context::getInstance().getDevice().CreateBindGroup(&bindGroupDesc);
+	}
+
+	BindGroupEntry textureEntry(uint32_t binding, TextureView view)
+	{
+		BindGroupEntry entry;
+		entry.binding = binding;
+		entry.textureView = view;
+		return entry;
+	}
+
+	BindGroupEntry bufferEntry(uint32_t binding, Buffer buffer, uint64_t size)
+	{
+		BindGroupEntry entry;
+		entry.binding = binding;
+		entry.buffer = buffer;
+		entry.size = size;
+		return entry;
+	}
+
+	//Repacks the padded rows of a buffer copy
+	void appendRows(const uint8_t* data, uint32_t width, uint32_t rowCount, std::vector<uint8_t>& destination)
+	{
+		const uint32_t paddedRowBytes = getPaddedRowBytes(width);
+		for (uint32_t row = 0; row < rowCount; ++row)
+			destination.insert(destination.end(), data + size_t(row) * paddedRowBytes, data + size_t(row) * paddedRowBytes + width * c_texelBytes);
+	}
+}
+
+bool EnvironmentLighting::build(const std::string& path)
+{
+	auto start = std::chrono::steady_clock::now();
+	createTextures();
+
+	const uint64_t asset = AssetCache::hashFile(path, getCacheSeed());
+	m_cached = false;
+	if (asset)
+	{
+		MappedFile file;
+		ByteSpan payload;
+		if (AssetCache::getInstance().load(asset, c_cacheEntry, file, payload))
+		{
+			BlobReader reader(payload);
+			uint32_t specularSize = 0, levelCount = 0, brdfLutSize = 0;
+			std::vector<uint8_t> specular, brdfLut;
+			std::vector<glm::vec4> sh;
+			reader.read(specularSize);
+			reader.read(levelCount);
+			reader.read(brdfLutSize);
+			reader.read(specular);
+			reader.read(brdfLut);
+			reader.read(sh);
+			m_cached = reader.isValid() && reader.isAtEnd() && specularSize == c_specularSize && levelCount == c_specularLevelCount &&
+				brdfLutSize == c_brdfLutSize && specular.size() == getSpecularBytes() &&
+				brdfLut.size() == size_t(c_brdfLutSize) * c_brdfLutSize * c_texelBytes && sh.size() == m_irradianceSh.size();
+			if (m_cached)
+			{
+				upload(specular, brdfLut);
+				std::copy(sh.begin(), sh.end(), m_irradianceSh.begin());
+			}
+		}
+	}
+
+	if (!m_cached && !bake(path))
+	{
+		std::cerr << "EnvironmentLighting: cannot bake " << path << std::endl;
+		return false;
+	}
+
+	//The SH are scene uniforms: read back on their own, whether the bake gets cached or not
+	if (!m_cached && !readBackSh())
+		std::cerr << "EnvironmentLighting: cannot read back the irradiance of " << path << ", the diffuse lighting is black" << std::endl;
+
+	if (asset && !m_cached)
+	{
+		std::vector<uint8_t> specular, brdfLut;
+		if (readBack(specular, brdfLut))
+		{
+			const std::vector<glm::vec4> sh(m_irradianceSh.begin(), m_irradianceSh.end());
+			BlobWriter writer;
+			writer.write(c_specularSize);
+			writer.write(c_specularLevelCount);
+			writer.write(c_brdfLutSize);
+			writer.write(specular);
+			writer.write(brdfLut);
+			writer.write(sh);
+			AssetCache::getInstance().save(asset, c_cacheEntry, writer.getBytes());
+		}
+		else
+			std::cerr << "EnvironmentLighting: cannot read back the bake of " << path << std::endl;
+	}
+	if (asset)
+		AssetCache::getInstance().touch(asset);
+
+	m_buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "EnvironmentLighting: " << path << (m_cached ? " read from the cache" : " baked") << " in " << m_buildMilliseconds << " ms" << std::endl;
+	return true;
+}
+
+void EnvironmentLighting::createTextures()
+{
+	m_specular = createTexture("iblSpecular", c_specularSize, 6, c_specularLevelCount);
+	m_specularView = createView(m_specular, TextureViewDimension::Cube, 0, c_specularLevelCount, 6);
+	m_brdfLut = createTexture("brdfLut", c_brdfLutSize, 1, 1);
+	m_brdfLutView = createView(m_brdfLut, TextureViewDimension::e2D, 0, 1, 1);
+	m_shBuffer = createBuffer("irradianceSh", BufferUsage::Storage | BufferUsage::CopySrc, c_shBytes);
+	m_sampler = createSampler(AddressMode::ClampToEdge, float(c_specularLevelCount));
+	m_irradianceSh = {};
+}
+
+bool EnvironmentLighting::bake(const std::string& path)
+{
+	//RGB9E5Ufloat with its mips, the prefiltering reads the coarse levels for the wide lobes
+	Utils::ImageData image = Utils::decodeImageFromPath(path, true);
+	if (image.levels.empty()) return false;
+	//The view and then the submitted passes reference the texture, its handle is not kept
+	TextureView sourceView = nullptr;
+	Utils::uploadImageData(image, &sourceView);
+	uint32_t shLevel = 0;
+	while (shLevel + 1 < image.levels.size() && (uint32_t(image.width) >> shLevel) > c_shSourceWidth)
+		shLevel++;
+
+	const std::string code = Utils::loadFile(DATA_DIR "/ibl.wgsl");
+	ComputeShader specularShader("iblSpecular", code, "cs_specular");
+	ComputeShader irradianceShader("iblIrradianceSh", code, "cs_irradianceSh");
+	ComputeShader brdfLutShader("iblBrdfLut", code, "cs_brdfLut");
+	//Wraps around the horizon, clamped at the poles
+	Sampler sourceSampler = createSampler(AddressMode::Repeat, float(image.levels.size()));
+
+	Device device = Context::getInstance().getDevice();
+	CommandEncoder encoder = device.CreateCommandEncoder();
+	ComputePassDescriptor computePassDesc;
+	computePassDesc.label = "ibl";
+	ComputePassEncoder computePass = encoder.BeginComputePass(&computePassDesc);
+
+	//One uniform buffer per dispatch, they are all written before the submit
+	computePass.SetPipeline(specularShader.getComputePipeline());
+	for (uint32_t level = 0; level < c_specularLevelCount; ++level)
+	{
+		const uint32_t size = getLevelSize(level);
+		BakeParams params = { float(level) / float(c_specularLevelCount - 1), size, c_sampleCount, 0, glm::vec2(image.width, image.height), glm::vec2(0.0f) };
+		Buffer paramsBuffer = createBuffer("iblParams", BufferUsage::Uniform | BufferUsage::CopyDst, sizeof(BakeParams));
+		device.GetQueue().WriteBuffer(paramsBuffer, 0, &params, sizeof(BakeParams));
+
+		std::vector<BindGroupEntry> entries = { textureEntry(0, sourceView), BindGroupEntry(),
+			textureEntry(2, createView(m_specular, TextureViewDimension::e2DArray, level, 1, 6)), bufferEntry(3, paramsBuffer, sizeof(BakeParams)) };
+		entries[1].binding = 1;
+		entries[1].sampler = sourceSampler;
+		computePass.SetBindGroup(0, createBindGroup(specularShader, entries), 0, nullptr);
+		computePass.DispatchWorkgroups(ComputeShader::getGroupCount(size, c_groupSize), ComputeShader::getGroupCount(size, c_groupSize), 6);
+	}
+
+	BakeParams params = { 0.0f, 0, 0, shLevel, glm::vec2(image.width, image.height), glm::vec2(0.0f) };
+	Buffer paramsBuffer = createBuffer("iblParams", BufferUsage::Uniform | BufferUsage::CopyDst, sizeof(BakeParams));
+	device.GetQueue().WriteBuffer(paramsBuffer, 0, &params, sizeof(BakeParams));
+	std::vector<BindGroupEntry> entries = { textureEntry(0, sourceView), bufferEntry(3, paramsBuffer, sizeof(BakeParams)), bufferEntry(5, m_shBuffer, c_shBytes) };
+	computePass.SetPipeline(irradianceShader.getComputePipeline());
+	computePass.SetBindGroup(0, createBindGroup(irradianceShader, entries), 0, nullptr);
+	computePass.DispatchWorkgroups(1, 1, 1);
+
+	entries = { textureEntry(4, m_brdfLutView) };
+	computePass.SetPipeline(brdfLutShader.getComputePipeline());
+	computePass.SetBindGroup(0, createBindGroup(brdfLutShader, entries), 0, nullptr);
+	computePass.DispatchWorkgroups(ComputeShader::getGroupCount(c_brdfLutSize, c_groupSize), ComputeShader::getGroupCount(c_brdfLutSize, c_groupSize), 1);
+
+	computePass.End();
+	CommandBuffer command = encoder.Finish();
+	device.GetQueue().Submit(1, &command);
+	return true;
+}
+
+//Blocks until the GPU has copied the results (false after c_readBackTimeoutMs), only after a bake, to fill the AssetCache
+bool EnvironmentLighting::readBackSh()
+{
+	Device device = Context::getInstance().getDevice();
+	Buffer buffer = createBuffer("iblShReadback", BufferUsage::MapRead | BufferUsage::CopyDst, c_shBytes);
+	CommandEncoder encoder = device.CreateCommandEncoder();
+	encoder.CopyBufferToBuffer(m_shBuffer, 0, buffer, 0, c_shBytes);
+	CommandBuffer command = encoder.Finish();
+	device.GetQueue().Submit(1, &command);
+	if (!mapBuffer(buffer, c_shBytes)) return false;
+
+	const glm::vec4* coefficients = static_cast<const glm::vec4*>(buffer.GetConstMappedRange(0, c_shBytes));
+	std::copy(coefficients, coefficients + m_irradianceSh.size(), m_irradianceSh.begin());
+	buffer.Unmap();
+	return true;
+}
+
+bool EnvironmentLighting::readBack(std::vector<uint8_t>& specular, std::vector<uint8_t>& brdfLut)
+{
+	Device device = Context::getInstance().getDevice();
+	std::vector<uint64_t> levelOffsets(c_specularLevelCount);
+	uint64_t bytes = 0;
+	for (uint32_t level = 0; level < c_specularLevelCount; ++level)
+	{
+		levelOffsets[level] = bytes;
+		bytes += uint64_t(getPaddedRowBytes(getLevelSize(level))) * getLevelSize(level) * 6;
+	}
+	const uint64_t brdfLutOffset = bytes;
+	bytes += uint64_t(getPaddedRowBytes(c_brdfLutSize)) * c_brdfLutSize;
+	Buffer buffer = createBuffer("iblReadback", BufferUsage::MapRead | BufferUsage::CopyDst, bytes);
+
+	CommandEncoder encoder = device.CreateCommandEncoder();
+	auto copyTexture = [&](const Texture& texture, uint32_t level, uint32_t size, uint32_t layerCount, uint64_t offset) {
+		ImageCopyTexture source;
+		source.texture = texture;
+		source.mipLevel = level;
+		ImageCopyBuffer destination;
+		destination.buffer = buffer;
+		destination.layout.offset = offset;
+		destination.layout.bytesPerRow = getPaddedRowBytes(size);
+		destination.layout.rowsPerImage = size;
+		Extent3D extent = { size, size, layerCount };
+		encoder.CopyTextureToBuffer(&source, &destination, &extent);
+	};
+	for (uint32_t level = 0; level < c_specularLevelCount; ++level)
+		copyTexture(m_specular, level, getLevelSize(level), 6, levelOffsets[level]);
+	copyTexture(m_brdfLut, 0, c_brdfLutSize, 1, brdfLutOffset);
+	CommandBuffer command = encoder.Finish();
+	device.GetQueue().Submit(1, &command);
+	if (!mapBuffer(buffer, bytes)) return false;
+
+	const uint8_t* data = static_cast<const uint8_t*>(buffer.GetConstMappedRange(0, bytes));
+	specular.clear();
+	specular.reserve(getSpecularBytes());
+	for (uint32_t level = 0; level < c_specularLevelCount; ++level)
+		appendRows(data + levelOffsets[level], getLevelSize(level), getLevelSize(level) * 6, specular);
+	brdfLut.clear();
+	appendRows(data + brdfLutOffset, c_brdfLutSize, c_brdfLutSize, brdfLut);
+	buffer.Unmap();
+	return true;
+}
+
+bool EnvironmentLighting::mapBuffer(Buffer buffer, uint64_t bytes)
+{
+	Device device = Context::getInstance().getDevice();
+	//On the heap like in Context::waitForGpu: after a timeout, the callback still comes later and frees it
+	struct MapRequest {
+		bool done = false;
+		bool success = false;
+		bool abandoned = false;
+	};
+	MapRequest* request = new MapRequest();
+	auto onMapped = [](WGPUBufferMapAsyncStatus status, void* userdata) {
+		MapRequest* request = static_cast<MapRequest*>(userdata);
+		if (request->abandoned)
+		{
+			delete request;
+			return;
+		}
+		request->done = true;
+		request->success = status == WGPUBufferMapAsyncStatus_Success;
+	};
+	buffer.MapAsync(MapMode::Read, 0, bytes, onMapped, request);
+	const auto start = std::chrono::steady_clock::now();
+	while (!request->done)
+	{
+		device.Tick();
+		if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() > c_readBackTimeoutMs)
+		{
+			std::cerr << "The IBL read back did not complete in " << c_readBackTimeoutMs << " ms" << std::endl;
+			request->abandoned = true;
+			return false;
+		}
+		std::this_thread::yield();
+	}
+	const bool success = request->success;
+	delete request;
+	return success;
+}
+
+void EnvironmentLighting::upload(const std::vector<uint8_t>& specular, const std::vector<uint8_t>& brdfLut)
+{
+	Queue queue = Context::getInstance().getDevice().GetQueue();
+	auto writeTexture = [&queue](const Texture& texture, uint32_t level, uint32_t size, uint32_t layerCount, const uint8_t* data) {
+		ImageCopyTexture destination;
+		destination.texture = texture;
+		destination.mipLevel = level;
+		destination.origin = { 0, 0, 0 };
+		destination.aspect = TextureAspect::All;
+		TextureDataLayout source;
+		source.offset = 0;
+		source.bytesPerRow = size * c_texelBytes;
+		source.rowsPerImage = size;
+		Extent3D extent = { size, size, layerCount };
+		queue.WriteTexture(&destination, data, size_t(size) * size * c_texelBytes * layerCount, &source, &extent);
+	};
+	size_t offset = 0;
+	for (uint32_t level = 0; level < c_specularLevelCount; ++level)
+	{
+		const uint32_t size = getLevelSize(level);
+		writeTexture(m_specular, level, size, 6, specular.data() + offset);
+		offset += size_t(size) * size * c_texelBytes * 6;
+	}
+	writeTexture(m_brdfLut, 0, c_brdfLutSize, 1, brdfLut.data());
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <string>
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_FORCE_LEFT_HANDED
+#include <glm/glm.hpp>
+
+#include "context.h"
+
+using namespace wgpu;
+
+// Image based lighting of an equirectangular HDR environment, precomputed once by compute passes (see ibl.wgsl):
+// a GGX prefiltered specular cubemap (one roughness per level), the irradiance in 9 spherical harmonics and the
+// split sum BRDF LUT. The results are read back and kept in the AssetCache, keyed by the hash of the source file,
+// so that the next runs only upload them. The PBR shader then costs one cubemap sample, one LUT sample and
+// an SH evaluation per pixel.
+class EnvironmentLighting
+{
+public:
+	static constexpr uint32_t c_specularSize = 256;
+	static constexpr uint32_t c_specularLevelCount = 6; //Roughness 0, 0.2 ... 1
+	static constexpr uint32_t c_brdfLutSize = 128;
+
+	EnvironmentLighting() = default;
+	~EnvironmentLighting() = default;
+
+	//From the AssetCache, or baked (and cached). False when the file cannot be decoded, the views are then black.
+	bool build(const std::string& path);
+
+	TextureView getSpecularView() const { return m_specularView; } //Cube
+	TextureView getBrdfLutView() const { return m_brdfLutView; }
+	Sampler getSampler() const { return m_sampler; } //Clamped, trilinear
+	//RGB of the 9 coefficients, convolved by the cosine lobe and divided by PI: evaluated at N, the diffuse irradiance
+	const std::array<glm::vec4, 9>& getIrradianceSh() const { return m_irradianceSh; }
+	float getMaxLod() const { return float(c_specularLevelCount - 1); }
+	double getBuildMilliseconds() const { return m_buildMilliseconds; }
+	bool isCached() const { return m_cached; }
+
+private:
+	void createTextures();
+	bool bake(const std::string& path);
+	//The SH into m_irradianceSh, once the bake is done
+	bool readBackSh();
+	//The textures, for the AssetCache
+	bool readBack(std::vector<uint8_t>& specular, std::vector<uint8_t>& brdfLut);
+	//Bounded wait, false on a failure or a timeout
+	bool mapBuffer(Buffer buffer, uint64_t bytes);
+	void upload(const std::vector<uint8_t>& specular, const std::vector<uint8_t>& brdfLut);
+
+	Texture m_specular{ nullptr };
+	Texture m_brdfLut{ nullptr };
+	Buffer m_shBuffer{ nullptr };
+	TextureView m_specularView{ nullptr };
+	TextureView m_brdfLutView{ nullptr };
+	Sampler m_sampler{ nullptr };
+	std::array<glm::vec4, 9> m_irradianceSh{};
+	double m_buildMilliseconds = 0.0;
+	bool m_cached = false;
+};
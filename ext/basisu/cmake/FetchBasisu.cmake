@@ -0,0 +1,22 @@
+# Prevent multiple includes
+if (TARGET basisu_transcoder)
+  return()
+endif()
+
+include(FetchContent)
+
+FetchContent_Declare(
+  basisu
+  # Manual download mode, like Dawn: only the tagged commit
+  DOWNLOAD_COMMAND
+    cd ${FETCHCONTENT_BASE_DIR}/basisu-src &&
+    git init &&
+    git fetch --depth=1 https://github.com/BinomialLLC/basis_universal v1_16_4 &&
+    git reset --hard FETCH_HEAD
+)
+
+# Its CMakeLists builds the command line encoder: only the sources are used, see ../CMakeLists.txt
+FetchContent_GetProperties(basisu)
+if (NOT basisu_POPULATED)
+  FetchContent_Populate(basisu)
+endif ()
@@ -0,0 +1,35 @@
+# Prevent multiple includes
+if (TARGET draco_static OR TARGET draco)
+  return()
+endif()
+
+include(FetchContent)
+
+FetchContent_Declare(
+  draco
+  # Manual download mode, like Dawn: only the tagged commit
+  DOWNLOAD_COMMAND
+    cd ${FETCHCONTENT_BASE_DIR}/draco-src &&
+    git init &&
+    git fetch --depth=1 https://github.com/google/draco 1.5.7 &&
+    git reset --hard FETCH_HEAD
+)
+
+FetchContent_GetProperties(draco)
+if (NOT draco_POPULATED)
+  FetchContent_Populate(draco)
+
+  # Only the decoder library is used
+  set(DRACO_TESTS OFF)
+  set(DRACO_JS_GLUE OFF)
+  set(DRACO_TRANSCODER_SUPPORTED OFF)
+  set(DRACO_INSTALL OFF)
+
+  add_subdirectory(${draco_SOURCE_DIR} ${draco_BINARY_DIR} EXCLUDE_FROM_ALL)
+endif ()
+
+foreach (Target draco draco_static draco_decoder draco_encoder)
+  if (TARGET ${Target})
+    set_property(TARGET ${Target} PROPERTY FOLDER "Draco")
+  endif()
+endforeach()
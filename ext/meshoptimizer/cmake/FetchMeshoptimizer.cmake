@@ -0,0 +1,29 @@
+# Prevent multiple includes
+if (TARGET meshoptimizer)
+  return()
+endif()
+
+include(FetchContent)
+
+FetchContent_Declare(
+  meshoptimizer
+  # Manual download mode, like Dawn: only the tagged commit
+  DOWNLOAD_COMMAND
+    cd ${FETCHCONTENT_BASE_DIR}/meshoptimizer-src &&
+    git init &&
+    git fetch --depth=1 https://github.com/zeux/meshoptimizer v0.21 &&
+    git reset --hard FETCH_HEAD
+)
+
+FetchContent_GetProperties(meshoptimizer)
+if (NOT meshoptimizer_POPULATED)
+  FetchContent_Populate(meshoptimizer)
+
+  # Only the library, for its encoders
+  set(MESHOPT_BUILD_DEMO OFF)
+  set(MESHOPT_BUILD_GLTFPACK OFF)
+  set(MESHOPT_BUILD_SHARED_LIBS OFF)
+  set(MESHOPT_INSTALL OFF)
+
+  add_subdirectory(${meshoptimizer_SOURCE_DIR} ${meshoptimizer_BINARY_DIR} EXCLUDE_FROM_ALL)
+endif ()
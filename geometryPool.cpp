@@ -0,0 +1,372 @@
+#include "geometryPool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+constexpr uint32_t c_initialArenaCapacity = 1 << 16;
+
+bool OffsetAllocator::allocate(uint32_t count, uint32_t& offset)
+{
+	for (auto it = m_freeBlocks.begin(); it != m_freeBlocks.end(); ++it)
+	{
+		if (it->second < count) continue;
+		offset = it->first;
+		uint32_t remaining = it->second - count;
+		m_freeBlocks.erase(it);
+		if (remaining > 0)
+			m_freeBlocks[offset + count] = remaining;
+		m_used += count;
+		return true;
+	}
+	return false;
+}
+
+void OffsetAllocator::free(uint32_t offset, uint32_t count)
+{
+	assert(m_used >= count);
+	m_used -= count;
+	auto next = m_freeBlocks.lower_bound(offset);
+	//Merge with the following free block
+	if (next != m_freeBlocks.end() && offset + count == next->first)
+	{
+		count += next->second;
+		next = m_freeBlocks.erase(next);
+	}
+	//Merge with the previous free block
+	if (next != m_freeBlocks.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset)
+		{
+			previous->second += count;
+			return;
+		}
+	}
+	m_freeBlocks[offset] = count;
+}
+
+void OffsetAllocator::grow(uint32_t capacity)
+{
+	assert(capacity >= m_capacity);
+	uint32_t offset = m_capacity;
+	uint32_t count = capacity - m_capacity;
+	m_capacity = capacity;
+	if (count == 0) return;
+	//Extend the last free block if it ends at the old capacity
+	if (!m_freeBlocks.empty())
+	{
+		auto last = std::prev(m_freeBlocks.end());
+		if (last->first + last->second == offset)
+		{
+			last->second += count;
+			return;
+		}
+	}
+	m_freeBlocks[offset] = count;
+}
+
+void OffsetAllocator::reset(uint32_t capacity, uint32_t used)
+{
+	m_freeBlocks.clear();
+	m_capacity = capacity;
+	m_used = used;
+	if (capacity > used)
+		m_freeBlocks[used] = capacity - used;
+}
+
+uint32_t OffsetAllocator::getLargestFreeBlock() const
+{
+	uint32_t largest = 0;
+	for (const auto& block : m_freeBlocks)
+		largest = std::max(largest, block.second);
+	return largest;
+}
+
+const Buffer& GeometryRange::getBuffer(uint32_t stream) const
+{
+	return arena->getBuffer(stream);
+}
+
+uint32_t GeometryRange::getElementSize(uint32_t stream) const
+{
+	return arena->getElementSize(stream);
+}
+
+GeometryArena::GeometryArena(const std::vector<uint32_t>& elementSizes, BufferUsage usage, uint32_t capacity, uint32_t maxCapacity) :
+	m_usage(usage | BufferUsage::CopyDst | BufferUsage::CopySrc),
+	m_elementSizes(elementSizes),
+	m_maxCapacity(maxCapacity),
+	m_allocator(capacity)
+{
+	for (uint32_t stream = 0; stream < m_elementSizes.size(); ++stream)
+		m_buffers.push_back(createBuffer(stream, capacity));
+}
+
+GeometryArena::~GeometryArena()
+{
+	for (GeometryRange* range : m_ranges)
+		range->arena = nullptr;
+	for (Buffer& buffer : m_buffers)
+		buffer.Destroy();
+}
+
+uint32_t GeometryArena::getTotalElementSize() const
+{
+	uint32_t size = 0;
+	for (uint32_t elementSize : m_elementSizes)
+		size += elementSize;
+	return size;
+}
+
+//WriteBuffer and CopyBufferToBuffer work with multiples of 4 bytes, in every stream
+uint32_t GeometryArena::alignCount(uint32_t count) const
+{
+	uint32_t granularity = 1;
+	auto aligned = [this](uint32_t granularity) {
+		return std::all_of(m_elementSizes.begin(), m_elementSizes.end(), [granularity](uint32_t elementSize) {
+			return (granularity * elementSize) % 4 == 0;
+		});
+	};
+	while (!aligned(granularity)) granularity++;
+	return (count + granularity - 1) / granularity * granularity;
+}
+
+Buffer GeometryArena::createBuffer(uint32_t stream, uint32_t capacity)
+{
+	BufferDescriptor bufferDesc;
+	bufferDesc.label = "geometryArena";
+	bufferDesc.size = static_cast<uint64_t>(capacity) * m_elementSizes[stream];
+	bufferDesc.usage = m_usage;
+	bufferDesc.mappedAtCreation = false;
+	return Context::getInstance().getDevice().CreateBuffer(&bufferDesc);
+}
+
+GeometryRange* GeometryArena::allocate(const std::vector<const void*>& data, uint32_t count)
+{
+	assert(data.size() == m_elementSizes.size());
+	uint32_t allocatedCount = alignCount(std::max(count, 1u));
+	uint32_t offset = 0;
+	if (!m_allocator.allocate(allocatedCount, offset))
+	{
+		if (!grow(allocatedCount) || !m_allocator.allocate(allocatedCount, offset))
+			return nullptr;
+	}
+
+	GeometryRange* range = new GeometryRange();
+	range->arena = this;
+	range->offset = offset;
+	range->count = count;
+	range->allocatedCount = allocatedCount;
+	m_ranges.insert(range);
+
+	for (uint32_t stream = 0; stream < data.size(); ++stream)
+	{
+		if (data[stream] && count > 0)
+			write(stream, offset, data[stream], count);
+	}
+	return range;
+}
+
+void GeometryArena::release(GeometryRange* range)
+{
+	assert(range->arena == this);
+	m_allocator.free(range->offset, range->allocatedCount);
+	m_ranges.erase(range);
+	delete range;
+	m_fragmented = true;
+}
+
+void GeometryArena::write(uint32_t stream, uint32_t offset, const void* data, uint32_t count)
+{
+	Queue queue = Context::getInstance().getDevice().GetQueue();
+	const uint32_t elementSize = m_elementSizes[stream];
+	size_t size = static_cast<size_t>(count) * elementSize;
+	size_t alignedSize = (size + 3) & ~static_cast<size_t>(3); // round up to the next multiple of 4
+	if (alignedSize == size)
+	{
+		queue.WriteBuffer(m_buffers[stream], static_cast<uint64_t>(offset) * elementSize, data, size);
+	}
+	else
+	{
+		std::vector<uint8_t> padded(alignedSize, 0);
+		memcpy(padded.data(), data, size);
+		queue.WriteBuffer(m_buffers[stream], static_cast<uint64_t>(offset) * elementSize, padded.data(), alignedSize);
+	}
+}
+
+bool GeometryArena::grow(uint32_t count)
+{
+	uint32_t oldCapacity = m_allocator.getCapacity();
+	if (oldCapacity >= m_maxCapacity) return false;
+	uint64_t capacity = std::max<uint64_t>(oldCapacity, 1);
+	while (capacity < static_cast<uint64_t>(oldCapacity) + count) capacity *= 2;
+	capacity = std::min<uint64_t>(capacity, m_maxCapacity);
+	if (capacity < static_cast<uint64_t>(oldCapacity) + count) return false;
+
+	Device device = Context::getInstance().getDevice();
+	CommandEncoder encoder = device.CreateCommandEncoder();
+	std::vector<Buffer> buffers;
+	for (uint32_t stream = 0; stream < m_buffers.size(); ++stream)
+	{
+		buffers.push_back(createBuffer(stream, static_cast<uint32_t>(capacity)));
+		encoder.CopyBufferToBuffer(m_buffers[stream], 0, buffers.back(), 0, static_cast<uint64_t>(oldCapacity) * m_elementSizes[stream]);
+	}
+	CommandBuffer command = encoder.Finish();
+	device.GetQueue().Submit(1, &command);
+
+	for (Buffer& buffer : m_buffers)
+		buffer.Destroy();
+	m_buffers = buffers;
+	m_allocator.grow(static_cast<uint32_t>(capacity));
+	return true;
+}
+
+void GeometryArena::defragment()
+{
+	std::vector<GeometryRange*> ranges(m_ranges.begin(), m_ranges.end());
+	std::sort(ranges.begin(), ranges.end(), [](const GeometryRange* a, const GeometryRange* b) {
+		return a->offset < b->offset;
+	});
+
+	uint32_t used = 0;
+	for (const GeometryRange* range : ranges)
+		used += range->allocatedCount;
+
+	//Keep some room for the next loads, but give back the memory of the unloaded ones
+	uint64_t capacity = c_initialArenaCapacity;
+	while (capacity < static_cast<uint64_t>(used) * 2 && capacity < m_maxCapacity) capacity *= 2;
+	capacity = std::max<uint64_t>(std::min<uint64_t>(capacity, m_maxCapacity), used);
+
+	Device device = Context::getInstance().getDevice();
+	CommandEncoder encoder = device.CreateCommandEncoder();
+	std::vector<Buffer> buffers;
+	for (uint32_t stream = 0; stream < m_buffers.size(); ++stream)
+	{
+		buffers.push_back(createBuffer(stream, static_cast<uint32_t>(capacity)));
+		const uint64_t elementSize = m_elementSizes[stream];
+		uint32_t offset = 0;
+		for (const GeometryRange* range : ranges)
+		{
+			encoder.CopyBufferToBuffer(m_buffers[stream], range->offset * elementSize, buffers.back(), offset * elementSize, range->allocatedCount * elementSize);
+			offset += range->allocatedCount;
+		}
+	}
+	CommandBuffer command = encoder.Finish();
+	device.GetQueue().Submit(1, &command);
+
+	uint32_t offset = 0;
+	for (GeometryRange* range : ranges)
+	{
+		range->offset = offset;
+		offset += range->allocatedCount;
+	}
+
+	for (Buffer& buffer : m_buffers)
+		buffer.Destroy();
+	m_buffers = buffers;
+	m_allocator.reset(static_cast<uint32_t>(capacity), used);
+	m_fragmented = false;
+}
+
+GeometryRange* GeometryPool::allocate(std::vector<std::unique_ptr<GeometryArena>>& arenas, BufferUsage usage, const std::vector<const void*>& data, const std::vector<uint32_t>& elementSizes, uint32_t count)
+{
+	for (auto& arena : arenas)
+	{
+		GeometryRange* range = arena->allocate(data, count);
+		if (range) return range;
+	}
+
+	//All the arenas reached the max buffer size, start a new one
+	SupportedLimits limits;
+	Context::getInstance().getDevice().GetLimits(&limits);
+	const uint32_t largestElement = *std::max_element(elementSizes.begin(), elementSizes.end());
+	uint32_t maxCapacity = static_cast<uint32_t>(std::min<uint64_t>(limits.limits.maxBufferSize / largestElement, std::numeric_limits<uint32_t>::max()));
+	uint32_t capacity = c_initialArenaCapacity;
+	while (capacity < count && capacity < maxCapacity) capacity *= 2;
+	capacity = std::min(capacity, maxCapacity);
+
+	arenas.push_back(std::make_unique<GeometryArena>(elementSizes, usage, capacity, maxCapacity));
+	GeometryRange* range = arenas.back()->allocate(data, count);
+	assert(range); //Mesh bigger than maxBufferSize
+	return range;
+}
+
+GeometryRange* GeometryPool::allocateVertices(const void* data, uint32_t vertexSize, uint32_t vertexCount)
+{
+	return allocateVertices(std::vector<const void*>{ data }, std::vector<uint32_t>{ vertexSize }, vertexCount);
+}
+
+GeometryRange* GeometryPool::allocateVertices(const std::vector<const void*>& streams, const std::vector<uint32_t>& vertexSizes, uint32_t vertexCount)
+{
+	return allocate(m_vertexArenas[vertexSizes], BufferUsage::Vertex, streams, vertexSizes, vertexCount);
+}
+
+GeometryRange* GeometryPool::allocateIndices(const void* data, IndexFormat format, uint32_t indexCount)
+{
+	uint32_t indexSize = format == IndexFormat::Uint32 ? sizeof(uint32_t) : sizeof(uint16_t);
+	return allocate(m_indexArenas[format], BufferUsage::Index, { data }, { indexSize }, indexCount);
+}
+
+void GeometryPool::release(GeometryRange* range)
+{
+	if (!range) return;
+	if (range->arena)
+		range->arena->release(range);
+	else
+		delete range;
+}
+
+bool GeometryPool::defragment(double budgetMs)
+{
+	auto start = std::chrono::steady_clock::now();
+	auto inBudget = [budgetMs, start]() {
+		return budgetMs <= 0.0 || std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() < budgetMs;
+	};
+	//The copies of an arena are encoded at once, the budget is checked between the arenas
+	auto defragmentArenas = [&inBudget](std::vector<std::unique_ptr<GeometryArena>>& arenas) {
+		//Empty arenas are dropped, except the first one which is reused by the next load
+		for (size_t i = arenas.size(); i-- > 1;)
+		{
+			if (arenas[i]->isEmpty())
+				arenas.erase(arenas.begin() + i);
+		}
+		for (auto& arena : arenas)
+		{
+			if (!arena->isFragmented()) continue;
+			if (!inBudget()) return false;
+			arena->defragment();
+		}
+		return true;
+	};
+	for (auto& [vertexSizes, arenas] : m_vertexArenas)
+	{
+		if (!defragmentArenas(arenas)) return false;
+	}
+	for (auto& [format, arenas] : m_indexArenas)
+	{
+		if (!defragmentArenas(arenas)) return false;
+	}
+	return true;
+}
+
+GeometryPool::Stats GeometryPool::getStats() const
+{
+	Stats stats;
+	auto addArenas = [&stats](const std::vector<std::unique_ptr<GeometryArena>>& arenas) {
+		for (const auto& arena : arenas)
+		{
+			//One buffer per stream, the split arenas count all of them
+			stats.bufferCount += arena->getStreamCount();
+			stats.usedBytes += static_cast<size_t>(arena->getAllocator().getUsed()) * arena->getTotalElementSize();
+			stats.capacityBytes += static_cast<size_t>(arena->getAllocator().getCapacity()) * arena->getTotalElementSize();
+		}
+	};
+	for (const auto& [vertexSizes, arenas] : m_vertexArenas)
+		addArenas(arenas);
+	for (const auto& [format, arenas] : m_indexArenas)
+		addArenas(arenas);
+	return stats;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "context.h"
+
+using namespace wgpu;
+
+// First fit free list allocator, offsets and sizes are expressed in elements (vertices or indices)
+class OffsetAllocator
+{
+public:
+	OffsetAllocator(uint32_t capacity = 0) : m_capacity(capacity) {
+		if (capacity > 0) m_freeBlocks[0] = capacity;
+	};
+	~OffsetAllocator() = default;
+
+	bool allocate(uint32_t count, uint32_t& offset);
+	void free(uint32_t offset, uint32_t count);
+	void grow(uint32_t capacity);
+	void reset(uint32_t capacity, uint32_t used);
+
+	uint32_t getCapacity() const { return m_capacity; }
+	uint32_t getUsed() const { return m_used; }
+	uint32_t getLargestFreeBlock() const;
+
+private:
+	std::map<uint32_t, uint32_t> m_freeBlocks; //offset -> count
+	uint32_t m_capacity = 0;
+	uint32_t m_used = 0;
+};
+
+class GeometryArena;
+
+// A range of elements sub-allocated in shared GPU buffers, at the same offset in every stream
+// The offset is updated when the arena is defragmented, never cache it.
+struct GeometryRange
+{
+	GeometryArena* arena = nullptr;
+	uint32_t offset = 0;
+	uint32_t count = 0;
+	uint32_t allocatedCount = 0;
+
+	const Buffer& getBuffer(uint32_t stream = 0) const;
+	uint32_t getElementSize(uint32_t stream = 0) const;
+};
+
+// GPU buffers holding the ranges of many meshes, one buffer per stream.
+// An element (vertex) has the same index in all the streams, so one baseVertex addresses all of them.
+class GeometryArena
+{
+public:
+	GeometryArena(const std::vector<uint32_t>& elementSizes, BufferUsage usage, uint32_t capacity, uint32_t maxCapacity);
+	~GeometryArena();
+
+	//One data pointer per stream
+	GeometryRange* allocate(const std::vector<const void*>& data, uint32_t count);
+	void release(GeometryRange* range);
+	//Moves the live ranges to the beginning of a new buffer, without holes
+	void defragment();
+
+	const Buffer& getBuffer(uint32_t stream = 0) const { return m_buffers[stream]; }
+	uint32_t getElementSize(uint32_t stream = 0) const { return m_elementSizes[stream]; }
+	//All streams together
+	uint32_t getTotalElementSize() const;
+	uint32_t getStreamCount() const { return static_cast<uint32_t>(m_buffers.size()); }
+	const OffsetAllocator& getAllocator() const { return m_allocator; }
+	bool isEmpty() const { return m_ranges.empty(); }
+	//A range was released since the last defragment
+	bool isFragmented() const { return m_fragmented; }
+
+private:
+	uint32_t alignCount(uint32_t count) const;
+	bool grow(uint32_t count);
+	void write(uint32_t stream, uint32_t offset, const void* data, uint32_t count);
+	Buffer createBuffer(uint32_t stream, uint32_t capacity);
+
+	std::vector<Buffer> m_buffers{};
+	BufferUsage m_usage;
+	std::vector<uint32_t> m_elementSizes{};
+	uint32_t m_maxCapacity = 0;
+	OffsetAllocator m_allocator;
+	std::unordered_set<GeometryRange*> m_ranges;
+	bool m_fragmented = false;
+};
+
+// Owns the arenas of all the meshes, one family of arenas per stream sizes and usage
+class GeometryPool
+{
+public:
+	GeometryPool() = default;
+	~GeometryPool() = default;
+
+	static GeometryPool& getInstance() {
+		static GeometryPool geometryPool;
+		return geometryPool;
+	};
+
+	GeometryRange* allocateVertices(const void* data, uint32_t vertexSize, uint32_t vertexCount);
+	//Split vertices, one data pointer and one vertex size per stream
+	GeometryRange* allocateVertices(const std::vector<const void*>& streams, const std::vector<uint32_t>& vertexSizes, uint32_t vertexCount);
+	GeometryRange* allocateIndices(const void* data, IndexFormat format, uint32_t indexCount);
+	void release(GeometryRange* range);
+
+	//Compacts the fragmented arenas one at a time for about budgetMs milliseconds (0: all of them).
+	//Returns true once none is left.
+	bool defragment(double budgetMs = 0.0);
+
+	struct Stats {
+		size_t bufferCount = 0;
+		size_t usedBytes = 0;
+		size_t capacityBytes = 0;
+	};
+	Stats getStats() const;
+
+private:
+	GeometryRange* allocate(std::vector<std::unique_ptr<GeometryArena>>& arenas, BufferUsage usage, const std::vector<const void*>& data, const std::vector<uint32_t>& elementSizes, uint32_t count);
+
+	std::map<std::vector<uint32_t>, std::vector<std::unique_ptr<GeometryArena>>> m_vertexArenas{}; //by vertex size of each stream
+	std::map<IndexFormat, std::vector<std::unique_ptr<GeometryArena>>> m_indexArenas{};
+};
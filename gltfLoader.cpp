@@ -1,23 +1,331 @@
 #include "gltfLoader.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
+#include "assetCache.h"
+#include "ktx2.h"
 #include "material.h"
+#include "materialPacker.h"
 #include "utils.h"
+#include "staticBatcher.h"
+#include "textureStreamer.h"
+#include "meshOptimizer.h"
+#include "meshoptDecoder.h"
+#include "mipBuilder.h"
+#include "meshSimplifier.h"
+#include "threadPool.h"
 #include "stb_image.h"
 
-void GltfLoader::load(const std::string& filepath) {
-	entt::entity gltfEntity = m_scene->addEntity();
+#ifdef USE_DRACO
+#include <draco/compression/decode.h>
+#endif
+
+static bool skipImageData(tinygltf::Image*, const int, std::string*, std::string*, int, int, const unsigned char*, int, void*)
+{
+	return true;
+}
+
+//tinygltf copies the BIN chunk into tinygltf::Buffer::data, so it is only given the JSON chunk, edited:
+//the buffer of the BIN chunk becomes a 3 bytes placeholder, and the images of the BIN chunk point to a placeholder view
+//(tinygltf reads their first byte), their own view is kept in extras.glbBufferView.
+//binaryBuffer is the index of the buffer of the BIN chunk, -1 if there is none.
+//The EXT_meshopt_compression fallback buffers may have no data (or no file): they are never read,
+//a placeholder keeps tinygltf from rejecting or loading them
+static void stubFallbackBuffers(nlohmann::json& document)
+{
+	auto buffers = document.find("buffers");
+	for (size_t i = 0; buffers != document.end() && buffers->is_array() && i < buffers->size(); ++i)
+	{
+		nlohmann::json& buffer = (*buffers)[i];
+		auto extensions = buffer.find("extensions");
+		if (extensions == buffer.end() || !extensions->is_object()) continue;
+		auto meshopt = extensions->find("EXT_meshopt_compression");
+		if (meshopt == extensions->end() || !meshopt->is_object() || !meshopt->value("fallback", false)) continue;
+		buffer["uri"] = "data:application/octet-stream;base64,AAAA";
+		buffer["byteLength"] = 3;
+	}
+}
+
+static std::string detachBinaryChunk(ByteSpan json, ByteSpan binary, int& binaryBuffer)
+{
+	binaryBuffer = -1;
+	nlohmann::json document = nlohmann::json::parse(json.data, json.data + json.size, nullptr, false);
+	if (document.is_discarded() || !document.is_object())
+	{
+		std::cerr << "ERR: invalid JSON chunk" << std::endl;
+		return {};
+	}
+	stubFallbackBuffers(document);
+
+	//operator[] would add the missing members, tinygltf rejects them when null
+	auto buffers = document.find("buffers");
+	for (size_t i = 0; buffers != document.end() && buffers->is_array() && i < buffers->size(); ++i)
+	{
+		if (!(*buffers)[i].contains("uri"))
+		{
+			binaryBuffer = static_cast<int>(i);
+			break;
+		}
+	}
+	if (binaryBuffer < 0)
+		return document.dump();
+
+	nlohmann::json& buffer = (*buffers)[binaryBuffer];
+	if (!buffer.contains("byteLength") || !buffer["byteLength"].is_number_unsigned() || buffer["byteLength"].get<size_t>() > binary.size)
+	{
+		std::cerr << "ERR: the BIN chunk is smaller than its buffer" << std::endl;
+		binaryBuffer = -1;
+		return {};
+	}
+	buffer["uri"] = "data:application/octet-stream;base64,AAAA";
+	buffer["byteLength"] = 3;
+
+	auto bufferViews = document.find("bufferViews");
+	auto images = document.find("images");
+	if (bufferViews == document.end() || !bufferViews->is_array() || images == document.end() || !images->is_array())
+		return document.dump();
+	int placeholderView = -1;
+	for (nlohmann::json& image : *images)
+	{
+		if (!image.contains("bufferView") || !image["bufferView"].is_number_integer()) continue;
+		const int view = image["bufferView"].get<int>();
+		if (view < 0 || view >= static_cast<int>(bufferViews->size())) continue;
+		const nlohmann::json& bufferView = (*bufferViews)[view];
+		if (!bufferView.contains("buffer") || bufferView["buffer"] != binaryBuffer) continue;
+		if (placeholderView < 0)
+		{
+			placeholderView = static_cast<int>(bufferViews->size());
+			bufferViews->push_back({ { "buffer", binaryBuffer }, { "byteLength", 3 } });
+		}
+		if (!image.contains("extras") || !image["extras"].is_object())
+			image["extras"] = nlohmann::json::object();
+		image["extras"]["glbBufferView"] = view;
+		image["bufferView"] = placeholderView;
+	}
+	return document.dump();
+}
+
+//Cooked image: its mip chain as uploaded
+static bool readCookedImage(uint64_t asset, const std::string& entry, Utils::ImageData& image)
+{
+	MappedFile file;
+	ByteSpan payload;
+	if (!AssetCache::getInstance().load(asset, entry, file, payload)) return false;
+	BlobReader reader(payload);
+	uint64_t levelCount = 0;
+	reader.read(image.width);
+	reader.read(image.height);
+	reader.read(image.format);
+	reader.read(levelCount);
+	if (!reader.isValid() || levelCount == 0 || levelCount > 32) return false;
+	image.levels.resize(static_cast<size_t>(levelCount));
+	for (auto& level : image.levels)
+		reader.read(level);
+	return reader.isValid() && reader.isAtEnd();
+}
+
+//The cooked image depends on the compression settings
+static std::string getCookedImageEntry(int source, bool compress, BcEncoder::Role role, BcEncoder::Quality quality)
+{
+	return "image" + std::to_string(source) + (compress ? "bc" + std::to_string(static_cast<int>(role)) + std::to_string(static_cast<int>(quality)) : "");
+}
+
+static void writeCookedImage(uint64_t asset, const std::string& entry, const Utils::ImageData& image)
+{
+	BlobWriter writer;
+	writer.write(image.width);
+	writer.write(image.height);
+	writer.write(image.format);
+	writer.write<uint64_t>(image.levels.size());
+	for (const auto& level : image.levels)
+		writer.write(level);
+	AssetCache::getInstance().save(asset, entry, writer.getBytes());
+}
+
+//A primitive to upload, decoded and processed on the workers
+struct GltfLoader::MeshJob {
+	int mesh = -1;
+	int primitive = -1;
+	std::string sourceKey;
+	uint64_t contentHash = 0;
+	MeshPtr cached;  //Same source or same content as a mesh already loaded
+	int sameAs = -1; //Same content as a previous job of this file
+	bool inPlace = false; //Vertices uploaded from the file buffers, only the indices are decoded
+	bool cooked = false; //Geometry read from the AssetCache, not decoded
+	bool processed = false; //Meshlets and LODs built (or read from the AssetCache)
+	VertexStreams streams;
+	MeshData meshData;
+	MeshletData meshlets;
+	MeshLods lods;
+	MeshOptimizer::Stats before;
+	MeshOptimizer::Stats after;
+};
+
+struct GltfLoader::AsyncLoad {
+	std::shared_ptr<LoadStatus> status;
+	std::atomic<bool> canceled{ false };
+	std::chrono::steady_clock::time_point startTime;
 	tinygltf::Model model;
+	std::string baseDir;
+	std::future<bool> prepared; //Set by prepare, on a worker
+	uint64_t assetHash = 0; //Content of the sources, key of the AssetCache (0: not cached)
+	std::atomic<size_t> cookedImages{ 0 };
+	bool cookedMeshes = false;
+
+	//Filled by prepare, read by advance once prepared is ready
+	std::vector<int> textureSources; //Image of each texture (see findTextureSource)
+	std::vector<int> imageSources;
+	std::unordered_map<int, BcEncoder::Role> imageRoles; //Per image source, for the texture compression and the sRGB mips
+	std::vector<std::future<Utils::ImageData>> images;
+	bool compressTextures = false; //Asked and supported by the device
+	std::mutex encodeMutex;
+	BcEncoder::Stats encodeStats;
+	double mipMilliseconds = 0.0; //CPU mips of the compressed images
+	std::vector<MeshJob> jobs;
+
+	//Steps done by advance
+	size_t uploadedImages = 0;
+	size_t compressedImages = 0;
+	size_t textureBytes = 0;
+	size_t uploadedJobs = 0;
+	bool nodesQueued = false;
+	std::vector<std::pair<int, entt::entity>> nodes; //glTF node and its entity, created in order
+	size_t createdNodes = 0;
+	std::unordered_map<int, Texture> sourceTextures; //Per image source uploaded whole, for the MaterialPacker
+	std::unique_ptr<MaterialPacker> packer; //Filled by loadMaterial, packed once the nodes are created
+	bool packed = false;
+	bool batched = false;
+
+	//Totals of the uploaded meshes, for the logs
+	MeshOptimizer::Stats before, after;
+	size_t triangleCount = 0;
+	size_t meshletCount = 0;
+	size_t lodCount = 0;
+	size_t reusedCount = 0;
+	size_t inPlaceCount = 0;
+	size_t geometryBytes = 0;
+
+	//The workers use the loader and the model until their tasks are done
+	~AsyncLoad()
+	{
+		if (prepared.valid())
+			prepared.wait();
+		for (auto& image : images)
+		{
+			if (image.valid())
+				image.wait();
+		}
+	}
+};
+
+//Out of line, AsyncLoad is only complete here
+GltfLoader::GltfLoader(Issam::Scene* scene) : m_scene(scene) {}
+
+GltfLoader::~GltfLoader() = default;
+
+void GltfLoader::load(const std::string& filepath) {
+	loadAsync(filepath);
+	update(0.0);
+}
+
+GltfLoader::LoadHandle GltfLoader::loadAsync(const std::string& filepath)
+{
+	if (m_pending)
+	{
+		m_pending->m_async->canceled = true;
+		m_pending->m_async->status->failed = true;
+		m_pending->m_async->status->done = true;
+		//Waits for its tasks on the workers before removing what it created
+		m_pending->m_async.reset();
+		m_pending->unload();
+		m_pending.reset();
+		m_defragmentPool = true;
+	}
+
+	m_pending = std::make_unique<GltfLoader>(m_scene);
+	GltfLoader& pending = *m_pending;
+	pending.m_staticBatching = m_staticBatching;
+	pending.m_quantizeVertices = m_quantizeVertices;
+	pending.m_splitPositions = m_splitPositions;
+	pending.m_optimizeMeshes = m_optimizeMeshes;
+	pending.m_generateMeshlets = m_generateMeshlets;
+	pending.m_generateLods = m_generateLods;
+	pending.m_generateImpostors = m_generateImpostors;
+	pending.m_assetCache = m_assetCache;
+	pending.m_compressTextures = m_compressTextures;
+	pending.m_textureQuality = m_textureQuality;
+	pending.m_streamTextures = m_streamTextures;
+	pending.m_packTextures = m_packTextures;
+	pending.m_filepath = filepath;
+
+	pending.m_async = std::make_unique<AsyncLoad>();
+	AsyncLoad& load = *pending.m_async;
+	load.status = std::make_shared<LoadStatus>();
+	load.status->filepath = filepath;
+	load.startTime = std::chrono::steady_clock::now();
+	load.prepared = ThreadPool::getInstance().submit([&pending]() { return pending.prepare(); });
+	return load.status;
+}
+
+void GltfLoader::update(double budgetMs)
+{
+	if (m_pending)
+	{
+		if (m_pending->advance(budgetMs))
+			finish();
+		//The frames of the load are already taken by its steps
+		if (budgetMs > 0.0) return;
+	}
+	//The geometry of the unloaded model is compacted over the next frames
+	if (m_defragmentPool)
+		m_defragmentPool = !GeometryPool::getInstance().defragment(budgetMs);
+}
+
+bool GltfLoader::prepare()
+{
+	AsyncLoad& load = *m_async;
+	tinygltf::Model& model = load.model;
 	tinygltf::TinyGLTF loader;
 	std::string err;
 	std::string warn;
+	const std::string& filepath = m_filepath;
 	std::string extension = Utils::getFileExtension(filepath);
+	load.baseDir = Utils::GetBaseDir(filepath);
+	const std::string& baseDir = load.baseDir;
+	//The images are decoded by decodeImageFrom*, tinygltf only keeps their source
+	loader.SetImageLoader(skipImageData, nullptr);
+	int binaryBuffer = -1;
 	bool ret = false;
 	if (extension == "gltf")
-		ret = loader.LoadASCIIFromFile(&model, &err, &warn, filepath);
+	{
+		std::string json = Utils::loadFile(filepath);
+		if (json.find("EXT_meshopt_compression") != std::string::npos)
+		{
+			nlohmann::json document = nlohmann::json::parse(json, nullptr, false);
+			if (!document.is_discarded() && document.is_object())
+			{
+				stubFallbackBuffers(document);
+				json = document.dump();
+			}
+		}
+		ret = loader.LoadASCIIFromString(&model, &err, &warn, json.data(), static_cast<unsigned int>(json.size()), baseDir);
+	}
 	else if (extension == "glb")
-		ret = loader.LoadBinaryFromFile(&model, &err, &warn, filepath);
+	{
+		//The file is mapped, tinygltf parses the JSON chunk and the BIN chunk is read in place
+		m_glb = std::make_unique<GlbFile>();
+		if (m_glb->open(filepath))
+		{
+			std::string json = detachBinaryChunk(m_glb->getJson(), m_glb->getBinary(), binaryBuffer);
+			if (!json.empty())
+				ret = loader.LoadASCIIFromString(&model, &err, &warn, json.data(), static_cast<unsigned int>(json.size()), baseDir);
+		}
+	}
 	else
-		assert(false);
+		std::cerr << "ERR: " << filepath << " is not a glTF file" << std::endl;
 
 	if (!warn.empty()) {
 		std::cout << "WARN: " << warn << std::endl;
@@ -27,63 +335,425 @@ void GltfLoader::load(const std::string& filepath) {
 		std::cerr << "ERR: " << err << std::endl;
 	}
 
-	if (!ret) {
-		return;
+	if (!ret || load.canceled) {
+		m_glb.reset();
+		return false;
+	}
+
+	m_buffers.clear();
+	for (int i = 0; i < static_cast<int>(model.buffers.size()); ++i)
+	{
+		if (i == binaryBuffer)
+			m_buffers.push_back(m_glb->getBinary());
+		else
+			m_buffers.push_back({ model.buffers[i].data.data(), model.buffers[i].data.size() });
+	}
+	if (!decodeCompressedGeometry(load))
+	{
+		m_glb.reset();
+		return false;
+	}
+	if (m_assetCache)
+	{
+		//Everything the import reads: the .glb, or the .gltf and its external buffers and images.
+		//Keyed on the file stamps, hashing the content would read every page of a cooked file on each load.
+		load.assetHash = AssetCache::hashFileStamp(filepath);
+		if (!m_glb)
+		{
+			for (const auto& buffer : model.buffers)
+			{
+				if (!buffer.uri.empty() && buffer.uri.rfind("data:", 0) != 0)
+					load.assetHash = AssetCache::hashFileStamp(baseDir + "/" + buffer.uri, load.assetHash);
+			}
+			for (const auto& image : model.images)
+			{
+				if (!image.uri.empty() && image.uri.rfind("data:", 0) != 0)
+					load.assetHash = AssetCache::hashFileStamp(baseDir + "/" + image.uri, load.assetHash);
+			}
+		}
 	}
+	load.status->progress = 0.1f;
 
-	std::string baseDir = Utils::GetBaseDir(filepath);
+	//The images are decoded (and block compressed) on the workers, while the meshes are processed on this one.
+	//advance creates the textures and generates their mips, each one as soon as it is ready (its pixels are freed right after the upload)
 	for (auto& gltfTexture : model.textures)
 	{
-		const tinygltf::Image& gltfImage = model.images[gltfTexture.source];
+		const int source = findTextureSource(model, gltfTexture, baseDir);
+		load.textureSources.push_back(source);
+		if (source >= 0 && std::find(load.imageSources.begin(), load.imageSources.end(), source) == load.imageSources.end())
+			load.imageSources.push_back(source);
+	}
+	load.compressTextures = m_compressTextures && Context::getInstance().hasFeature(FeatureName::TextureCompressionBC);
+	const bool compressTextures = load.compressTextures;
+	//A texture used as base color keeps the base color quality (and its sRGB filtering)
+	auto setRole = [&load, &model](int textureIndex, BcEncoder::Role role) {
+		if (textureIndex < 0 || textureIndex >= static_cast<int>(load.textureSources.size()) || load.textureSources[textureIndex] < 0) return;
+		auto inserted = load.imageRoles.insert({ load.textureSources[textureIndex], role });
+		if (role == BcEncoder::Role::BaseColor)
+			inserted.first->second = role;
+	};
+	for (const auto& gltfMaterial : model.materials)
+	{
+		setRole(gltfMaterial.pbrMetallicRoughness.baseColorTexture.index, BcEncoder::Role::BaseColor);
+		setRole(gltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture.index, BcEncoder::Role::MetallicRoughness);
+		setRole(gltfMaterial.normalTexture.index, BcEncoder::Role::Normal);
+		setRole(gltfMaterial.occlusionTexture.index, BcEncoder::Role::Mask);
+	}
+	for (int source : load.imageSources)
+	{
+		load.images.push_back(ThreadPool::getInstance().submit([this, &load, &model, &baseDir, source, compressTextures]() {
+			//A canceled load waits for its tasks on the main thread (see ~AsyncLoad): each step returns as soon as it can
+			if (load.canceled) return Utils::ImageData();
+			//The streamed textures need their whole chain on the CPU, the cooked images keep their level 0 only
+			auto buildStreamedMips = [this, &load](Utils::ImageData& image) {
+				if (!m_streamTextures || image.levels.size() != 1 || load.canceled) return;
+				double mipMilliseconds = 0.0;
+				MipBuilder::build(image, MipBuilder::Filter::Box, &mipMilliseconds);
+				std::lock_guard<std::mutex> lock(load.encodeMutex);
+				load.mipMilliseconds += mipMilliseconds;
+			};
+			auto role = load.imageRoles.find(source);
+			const BcEncoder::Role imageRole = role != load.imageRoles.end() ? role->second : BcEncoder::Role::BaseColor;
+			const std::string entry = getCookedImageEntry(source, compressTextures, imageRole, m_textureQuality);
+			Utils::ImageData image;
+			if (load.assetHash && readCookedImage(load.assetHash, entry, image))
+			{
+				image.srgb = imageRole == BcEncoder::Role::BaseColor;
+				load.cookedImages++;
+				buildStreamedMips(image);
+				return image;
+			}
+
+			const tinygltf::Image& gltfImage = model.images[source];
+			std::string storage;
+			ByteSpan header = readEncodedImage(model, gltfImage, baseDir, storage, Ktx2Reader::c_headerSize);
+			if (Ktx2Reader::isKtx2(header)) {
+				//Block compressed, the levels are uploaded as they are (Basis Universal payloads transcoded here, for the role)
+				ByteSpan encoded = readEncodedImage(model, gltfImage, baseDir, storage);
+				image = Ktx2Reader::decode(encoded, gltfImage.uri.empty() ? "image " + std::to_string(source) : gltfImage.uri, nullptr, imageRole);
+				if (m_glb)
+					m_glb->getMapping().release(encoded);
+			}
+			else if (!gltfImage.uri.empty()) {
+				std::smatch matches;
+				if (std::regex_search(gltfImage.uri, matches, base64Pattern)) {
+					//Base64
+					image = decodeImageFromBase64(gltfImage.uri);
+				}
+				else {
+					//Relative path
+					std::string texturePath = baseDir + "/" + gltfImage.uri;
+					image = Utils::decodeImageFromPath(texturePath);
+				}
+			}
+			//else if (!gltfImage.image.empty()) {
+			//	//Load image from a vector of unsigned char
+			//	image = decodeImageFromVector(gltfImage.image);
+			//}
+			else
+			{
+				//Buffer
+				image = decodeImageFromBuffer(model, gltfImage);
+			}
+			image.srgb = imageRole == BcEncoder::Role::BaseColor;
+			if (load.canceled) return Utils::ImageData();
+			if (compressTextures && image.format == TextureFormat::RGBA8Unorm)
+			{
+				//The blocks of every level are encoded here, the other images get their mips on the GPU at upload
+				const MipBuilder::Filter filter = m_textureQuality == BcEncoder::Quality::High ? MipBuilder::Filter::Kaiser : MipBuilder::Filter::Box;
+				double mipMilliseconds = 0.0;
+				MipBuilder::build(image, filter, &mipMilliseconds);
+				if (load.canceled) return Utils::ImageData();
+				BcEncoder::Stats stats;
+				if (BcEncoder::compress(image, BcEncoder::selectFormat(image, imageRole, m_textureQuality), m_textureQuality, &stats))
+				{
+					std::lock_guard<std::mutex> lock(load.encodeMutex);
+					load.mipMilliseconds += mipMilliseconds;
+					load.encodeStats.squaredError += stats.squaredError;
+					load.encodeStats.sampleCount += stats.sampleCount;
+					load.encodeStats.texelCount += stats.texelCount;
+					load.encodeStats.milliseconds += stats.milliseconds;
+				}
+			}
+			if (load.canceled) return Utils::ImageData();
+			if (load.assetHash && !image.levels.empty())
+				writeCookedImage(load.assetHash, entry, image);
+			buildStreamedMips(image);
+			return image;
+		}));
+	}
+
+	if (!load.canceled)
+		prepareMeshes(load);
+	load.status->progress = 0.3f;
+	return !load.canceled;
+}
+
+bool GltfLoader::advance(double budgetMs)
+{
+	AsyncLoad& load = *m_async;
+	const tinygltf::Model& model = load.model;
+	auto stepStart = std::chrono::steady_clock::now();
+	//Without budget, the steps wait for the workers instead of returning
+	auto isReady = [budgetMs](auto& future) {
+		if (budgetMs <= 0.0)
+			future.wait();
+		return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	};
+	auto inBudget = [budgetMs, stepStart]() {
+		return budgetMs <= 0.0 || std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stepStart).count() < budgetMs;
+	};
+
+	if (load.prepared.valid())
+	{
+		if (!isReady(load.prepared)) return false;
+		if (!load.prepared.get())
+		{
+			load.status->failed = true;
+			return true;
+		}
+	}
 
-		unsigned char* pixelData;
-		TextureView textureView = nullptr;
+	const size_t stepCount = load.images.size() + load.jobs.size() + std::max<size_t>(model.nodes.size(), 1);
+	while (inBudget())
+	{
+		if (load.uploadedImages < load.images.size() && (load.uploadedJobs == load.jobs.size() || isReady(load.images[load.uploadedImages])))
+		{
+			//Texture creation, in the order of the sources
+			const int source = load.imageSources[load.uploadedImages];
+			std::future<Utils::ImageData>& image = load.images[load.uploadedImages];
+			if (!isReady(image)) break;
+			const tinygltf::Image& gltfImage = model.images[source];
+			Utils::ImageData imageData = image.get();
+			//An image that failed to decode leaves the default texture of its materials
+			if (!imageData.levels.empty())
+			{
+				m_sourceToId[source] = generateTextureId(gltfImage.uri, load.baseDir, source);
+				if (Utils::getFormatBlock(imageData.format).width > 1)
+					load.compressedImages++;
+				size_t imageBytes = 0;
+				for (const auto& level : imageData.levels)
+					imageBytes += level.size();
+				load.textureBytes += imageBytes;
 
-		if (!gltfImage.uri.empty()) {
-			std::smatch matches;
-			if (std::regex_search(gltfImage.uri, matches, base64Pattern)) {
-				//Base64
-				loadImageFromBase64(gltfImage.uri, &textureView);
+				//Only the coarse levels are uploaded for now, the images the streamer does not take are uploaded whole
+				TextureStreamer& streamer = TextureStreamer::getInstance();
+				const uint32_t streamedId = m_streamTextures ? streamer.add(std::move(imageData), m_sourceToId[source]) : 0;
+				if (streamedId)
+				{
+					m_streamedIds[source] = streamedId;
+					m_textureViews[source] = streamer.getTextureView(streamedId);
+				}
+				else
+				{
+					TextureView textureView = nullptr;
+					Texture texture = Utils::uploadImageData(imageData, &textureView);
+					m_textureViews[source] = textureView;
+					if (m_packTextures)
+						load.sourceTextures[source] = texture;
+					m_textures[source] = texture;
+					m_textureLoaders[source] = createTextureLoader(load, source);
+				}
+			}
+			if (++load.uploadedImages == load.images.size())
+			{
+				double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load.startTime).count();
+				std::cout << "Image import: " << load.images.size() << " images (" << load.compressedImages << " block compressed, "
+					<< load.textureBytes / (1024 * 1024) << " MB) in " << milliseconds << " ms on "
+					<< ThreadPool::getInstance().getThreadCount() << " workers" << std::endl;
+				const BcEncoder::Stats& stats = load.encodeStats;
+				if (stats.texelCount)
+					std::cout << "Texture compression: " << stats.texelCount / 1.0e6 << " Mtexels in " << stats.milliseconds << " ms ("
+						<< stats.texelCount / 1.0e3 / stats.milliseconds << " Mtexels/s), PSNR " << stats.getPsnr() << " dB, CPU mips in "
+						<< load.mipMilliseconds << " ms" << std::endl;
+			}
+		}
+		else if (load.uploadedJobs < load.jobs.size())
+		{
+			uploadMesh(load, load.uploadedJobs++);
+		}
+		else if (!load.nodesQueued)
+		{
+			//The entities are created once the meshes and textures they use are on the GPU
+			load.nodesQueued = true;
+			m_entity = m_scene->addEntity();
+			if (model.defaultScene >= 0 && model.defaultScene < static_cast<int>(model.scenes.size()))
+			{
+				for (const auto& sceneNodeIndex : model.scenes[model.defaultScene].nodes) {
+					entt::entity rootNode = m_scene->addEntity();
+					m_scene->addChild(m_entity, rootNode);
+					load.nodes.push_back({ sceneNodeIndex, rootNode });
+				}
+			}
+		}
+		else if (load.createdNodes < load.nodes.size())
+		{
+			auto [nodeIndex, entity] = load.nodes[load.createdNodes++];
+			loadNode(model, model.nodes[nodeIndex], entity, m_scene, nodeIndex);
+		}
+		else if (load.packer && !load.packed)
+		{
+			load.packed = true;
+			MaterialPacker::Stats stats = load.packer->pack();
+			//The packed sources are only in their arrays, the 2D textures are freed with the AsyncLoad
+			for (const auto& [source, texture] : load.sourceTextures)
+			{
+				if (load.packer->isPacked(texture))
+				{
+					m_textureViews.erase(source);
+					m_textures.erase(source);
+					m_textureLoaders.erase(source);
+				}
 			}
-			else {
-				//Relative path
-				std::string texturePath = baseDir + "/" + gltfImage.uri;
-				Utils::loadImageFromPath(texturePath, &textureView);
+			std::cout << "Texture packing: " << stats.textures << " textures in " << stats.arrays << " arrays (" << stats.arrayBytes / (1024 * 1024)
+				<< " MB), " << stats.materials << " materials in " << stats.bindGroups << " bind groups" << std::endl;
+		}
+		else if (m_staticBatching && !load.batched)
+		{
+			//The batcher reads the filters of the entities: they are set for the build, then the sources and the batches
+			//are hidden again until finish
+			load.batched = true;
+			for (const auto& [entity, filters] : m_hiddenFilters)
+				m_scene->addComponent<Issam::Filters>(entity, filters);
+			StaticBatcher batcher(m_scene);
+			std::vector<entt::entity> batches = batcher.build(m_entity);
+			for (entt::entity batch : batches)
+				m_hiddenFilters.push_back({ batch, Issam::Filters() });
+			for (auto& [entity, filters] : m_hiddenFilters)
+			{
+				filters = m_scene->getComponent<Issam::Filters>(entity);
+				m_scene->removeComponent<Issam::Filters>(entity);
 			}
+			std::cout << "Static batching: " << batches.size() << " batches created" << std::endl;
 		}
-		//else if (!gltfImage.image.empty()) {
-		//	//Load image from a vector of unsigned char
-		//	loadImageFromVector(gltfImage.image, &textureView);
-		//}
 		else
 		{
-			//Buffer
-			loadImageFromBuffer(model, gltfImage, &textureView);
+			//Everything is uploaded, the spans die with the mapping
+			m_buffers.clear();
+			m_decodedBuffers.clear();
+			m_glb.reset();
+			return true;
 		}
-		std::string imageId = generateTextureId(gltfImage.uri, baseDir, gltfTexture.source);
-		TextureManager().getInstance().add(imageId, textureView);
-		m_sourceToId[gltfTexture.source] = imageId;
 	}
 
-	for (const auto& sceneNodeIndex : model.scenes[model.defaultScene].nodes) {
-		entt::entity rootNode = m_scene->addEntity();
-		m_scene->addChild(gltfEntity, rootNode);
-		loadNode(model, model.nodes[sceneNodeIndex], rootNode, m_scene, sceneNodeIndex);
-		//scene.push_back(rootNode);
+	const size_t stepsDone = load.uploadedImages + load.uploadedJobs + load.createdNodes;
+	load.status->progress = 0.3f + 0.7f * std::min(1.0f, static_cast<float>(stepsDone) / stepCount);
+	return false;
+}
+
+void GltfLoader::finish()
+{
+	std::unique_ptr<GltfLoader> next = std::move(m_pending);
+	std::shared_ptr<LoadStatus> status = next->m_async->status;
+	if (status->failed)
+	{
+		status->done = true;
+		return;
+	}
+
+	unload();
+	m_entity = next->m_entity;
+	m_sourceToId = std::move(next->m_sourceToId);
+	m_textureViews = std::move(next->m_textureViews);
+	m_streamedIds = std::move(next->m_streamedIds);
+	m_textures = std::move(next->m_textures);
+	m_textureLoaders = std::move(next->m_textureLoaders);
+	m_materials = std::move(next->m_materials);
+	m_meshes = std::move(next->m_meshes);
+	m_impostors = std::move(next->m_impostors);
+	m_filepath = next->m_filepath;
+	std::vector<std::pair<entt::entity, Issam::Filters>> hiddenFilters = std::move(next->m_hiddenFilters);
+
+	//Shown at once, the previous model is gone
+	const AsyncLoad& load = *next->m_async;
+	for (auto& [source, textureView] : m_textureViews)
+	{
+		//The streamed textures may have changed of view since their upload, their size is in the TextureStreamer stats
+		auto streamed = m_streamedIds.find(source);
+		if (streamed != m_streamedIds.end())
+			TextureManager().getInstance().add(m_sourceToId[source], TextureStreamer::getInstance().getTextureView(streamed->second));
+		else
+			TextureManager().getInstance().addTexture(m_sourceToId[source], m_textures[source], textureView, m_textureLoaders[source]);
 	}
+	m_texturesRegistered = true;
+	//From now on the materials reference their textures, the ones no material uses can be evicted.
+	//The packed materials sample the texture arrays, their sources are not in the TextureManager.
+	auto setTexture = [this, &load](Material* material, const std::string& name, int textureIndex) {
+		if (textureIndex < 0 || textureIndex >= static_cast<int>(load.textureSources.size())) return;
+		const int source = load.textureSources[textureIndex];
+		if (m_textureViews.count(source))
+			material->setTexture(name, m_sourceToId[source]);
+	};
+	for (auto& [materialIndex, material] : m_materials)
+	{
+		if (material->isShared()) continue;
+		const tinygltf::PbrMetallicRoughness& pbr = load.model.materials[materialIndex].pbrMetallicRoughness;
+		setTexture(material, "baseColorTexture", pbr.baseColorTexture.index);
+		setTexture(material, "metallicRoughnessTexture", pbr.metallicRoughnessTexture.index);
+	}
+	//Owned by the TextureManager: a view or texture kept here would keep an evicted texture in memory
+	m_textureViews.clear();
+	m_textures.clear();
+	m_textureLoaders.clear();
+	for (auto& [entity, filters] : hiddenFilters)
+		m_scene->addComponent<Issam::Filters>(entity, filters);
 
-	//return scene;
-	//return gltfEntity;
-	m_entity = gltfEntity;
-};
+	if (next->m_generateImpostors)
+	{
+		size_t impostorCount = 0;
+		for (const auto& impostors : m_impostors)
+			impostorCount += std::count_if(impostors.begin(), impostors.end(), [](const ImpostorPtr& impostor) { return impostor != nullptr; });
+		std::cout << "Impostors: " << impostorCount << " ready" << std::endl;
+	}
+
+	if (load.assetHash)
+	{
+		std::cout << "Asset cache: " << load.cookedImages << " of " << load.images.size() << " images cooked, meshes "
+			<< (load.cookedMeshes ? "cooked" : "processed") << std::endl;
+		//Directory walk and eviction off the main thread
+		const uint64_t assetHash = load.assetHash;
+		ThreadPool::getInstance().submit([assetHash]() { AssetCache::getInstance().touch(assetHash); });
+	}
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load.startTime).count();
+	std::cout << "Loaded " << m_filepath << " in " << milliseconds << " ms" << std::endl;
+	status->progress = 1.0f;
+	status->done = true;
+}
 
 void GltfLoader::unload()
 {
-	for (auto& texId : m_sourceToId)
+	if (m_texturesRegistered)
 	{
-		TextureManager().getInstance().remove(texId.second);
+		for (auto& texId : m_sourceToId)
+		{
+			TextureManager().getInstance().remove(texId.second);
+		}
 	}
 	m_scene->removeEntity(m_entity);
+	m_entity = entt::null;
+
+	//Before the materials, they are users of the streamed textures
+	for (auto& [source, streamedId] : m_streamedIds)
+		TextureStreamer::getInstance().remove(streamedId);
+	m_streamedIds.clear();
+	for (auto& material : m_materials)
+	{
+		delete material.second;
+	}
+	m_materials.clear();
+	m_sourceToId.clear();
+	m_textureViews.clear();
+	m_textures.clear();
+	m_textureLoaders.clear();
+	m_texturesRegistered = false;
+	m_hiddenFilters.clear();
+	m_meshes.clear();
+	m_impostors.clear();
+	MeshManager::getInstance().purge();
+
+	//The shared geometry buffers are compacted by update, now that the meshes of this file are gone
+	m_defragmentPool = true;
 }
 
 
@@ -109,7 +779,7 @@ std::string base64_decode(const std::string& in) {
 
 
 
-Texture GltfLoader::loadImageFromBase64(const std::string& base64, TextureView* pTextureView) {
+Utils::ImageData GltfLoader::decodeImageFromBase64(const std::string& base64) const {
 	int width, height, channels;
 	std::string base64Data = base64.substr(base64.find(",") + 1);
 	std::string decodedData = base64_decode(base64Data);
@@ -117,31 +787,172 @@ Texture GltfLoader::loadImageFromBase64(const std::string& base64, TextureView*
 	if (!data) {
 		std::cerr << "Failed to load image from Base64 data" << std::endl;
 	}
-	return Utils::loadTexture(data, width, height, channels, TextureFormat::RGBA8Unorm, pTextureView);
+	return Utils::createImageData(data, width, height, TextureFormat::RGBA8Unorm);
 }
 
-Texture GltfLoader::loadImageFromVector(const std::vector<unsigned char>& imageVector, TextureView* pTextureView) {
+Utils::ImageData GltfLoader::decodeImageFromVector(const std::vector<unsigned char>& imageVector) const {
 	int width, height, channels;
 	unsigned char* data = stbi_load_from_memory(imageVector.data(), imageVector.size(), &width, &height, &channels, 4);
 	if (!data) {
 		std::cerr << "Failed to load image from vector data" << std::endl;
 	}
-	return Utils::loadTexture(data, width, height, channels, TextureFormat::RGBA8Unorm, pTextureView);
+	return Utils::createImageData(data, width, height, TextureFormat::RGBA8Unorm);
 }
 
 // Load image from GLTF buffer
-Texture GltfLoader::loadImageFromBuffer(const tinygltf::Model& model, const tinygltf::Image& image, TextureView* pTextureView) {
+Utils::ImageData GltfLoader::decodeImageFromBuffer(const tinygltf::Model& model, const tinygltf::Image& image) const {
 	int width, height, channels;
-	const tinygltf::BufferView& bufferView = model.bufferViews[image.bufferView];
-	const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
-	const unsigned char* dataBuffer = buffer.data.data() + bufferView.byteOffset;
-	size_t size = bufferView.byteLength;
-	unsigned char* data = stbi_load_from_memory(dataBuffer, size, &width, &height, &channels, 4);
+	//The images of the BIN chunk keep their own view in extras (see detachBinaryChunk)
+	int bufferViewIndex = image.bufferView;
+	if (image.extras.Has("glbBufferView"))
+		bufferViewIndex = image.extras.Get("glbBufferView").GetNumberAsInt();
+	const tinygltf::BufferView& bufferView = model.bufferViews[bufferViewIndex];
+	ByteSpan encoded = { m_buffers[bufferView.buffer].data + bufferView.byteOffset, bufferView.byteLength };
+	unsigned char* data = stbi_load_from_memory(encoded.data, static_cast<int>(encoded.size), &width, &height, &channels, 4);
 	if (!data) {
 		std::cerr << "Failed to load image from GLTF buffer" << std::endl;
 	}
+	//Decoded, the encoded image can leave memory
+	if (m_glb)
+		m_glb->getMapping().release(encoded);
+
+	return Utils::createImageData(data, width, height, TextureFormat::RGBA8Unorm);
+}
+
+ByteSpan GltfLoader::readEncodedImage(const tinygltf::Model& model, const tinygltf::Image& image, const std::string& baseDir, std::string& storage, size_t maxSize) const {
+	if (image.uri.empty())
+	{
+		int bufferViewIndex = image.bufferView;
+		if (image.extras.Has("glbBufferView"))
+			bufferViewIndex = image.extras.Get("glbBufferView").GetNumberAsInt();
+		if (bufferViewIndex < 0 || bufferViewIndex >= static_cast<int>(model.bufferViews.size()))
+			return {};
+		const tinygltf::BufferView& bufferView = model.bufferViews[bufferViewIndex];
+		return { m_buffers[bufferView.buffer].data + bufferView.byteOffset, std::min(bufferView.byteLength, maxSize) };
+	}
 
-	return Utils::loadTexture(data, width, height, channels, TextureFormat::RGBA8Unorm, pTextureView);
+	std::smatch matches;
+	if (std::regex_search(image.uri, matches, base64Pattern))
+		storage = base64_decode(image.uri.substr(image.uri.find(",") + 1));
+	else
+	{
+		std::ifstream file(baseDir + "/" + image.uri, std::ios::binary);
+		if (maxSize == SIZE_MAX)
+			storage.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		else
+		{
+			storage.resize(maxSize);
+			file.read(&storage[0], maxSize);
+			storage.resize(static_cast<size_t>(file.gcount()));
+		}
+	}
+	return { reinterpret_cast<const uint8_t*>(storage.data()), std::min(storage.size(), maxSize) };
+}
+
+TextureManager::Loader GltfLoader::createTextureLoader(const AsyncLoad& load, int source) const {
+	const tinygltf::Model& model = load.model;
+	const tinygltf::Image& gltfImage = model.images[source];
+	std::string path;
+	size_t offset = 0;
+	size_t size = SIZE_MAX; //The whole file
+	auto bytes = std::make_shared<std::string>();
+	if (!gltfImage.uri.empty())
+	{
+		if (gltfImage.uri.rfind("data:", 0) == 0)
+			*bytes = base64_decode(gltfImage.uri.substr(gltfImage.uri.find(",") + 1));
+		else
+			path = load.baseDir + "/" + gltfImage.uri;
+	}
+	else
+	{
+		int bufferViewIndex = gltfImage.bufferView;
+		if (gltfImage.extras.Has("glbBufferView"))
+			bufferViewIndex = gltfImage.extras.Get("glbBufferView").GetNumberAsInt();
+		if (bufferViewIndex < 0 || bufferViewIndex >= static_cast<int>(model.bufferViews.size()))
+			return nullptr;
+		const tinygltf::BufferView& bufferView = model.bufferViews[bufferViewIndex];
+		const std::string& bufferUri = model.buffers[bufferView.buffer].uri;
+		offset = bufferView.byteOffset;
+		size = bufferView.byteLength;
+		if (m_glb && m_buffers[bufferView.buffer].data == m_glb->getBinary().data)
+		{
+			//The BIN chunk, in the mapping of the whole .glb
+			path = m_filepath;
+			offset += static_cast<size_t>(m_glb->getBinary().data - m_glb->getMapping().getBytes().data);
+		}
+		else if (!bufferUri.empty() && bufferUri.rfind("data:", 0) != 0)
+			path = load.baseDir + "/" + bufferUri;
+		else
+		{
+			bytes->assign(reinterpret_cast<const char*>(m_buffers[bufferView.buffer].data) + offset, size);
+			offset = 0;
+		}
+	}
+
+	auto role = load.imageRoles.find(source);
+	const BcEncoder::Role imageRole = role != load.imageRoles.end() ? role->second : BcEncoder::Role::BaseColor;
+	const bool compress = load.compressTextures;
+	const BcEncoder::Quality quality = m_textureQuality;
+	const uint64_t assetHash = load.assetHash;
+	const std::string entry = getCookedImageEntry(source, compress, imageRole, quality);
+	const std::string name = path.empty() ? m_filepath + " image " + std::to_string(source) : path;
+	//Same steps as the import, on the main thread as the TextureManager loads its files
+	return [=](TextureView* textureView) -> Texture {
+		Utils::ImageData image;
+		if (!assetHash || !readCookedImage(assetHash, entry, image))
+		{
+			std::string storage;
+			ByteSpan encoded = { reinterpret_cast<const uint8_t*>(bytes->data()), bytes->size() };
+			if (!path.empty())
+			{
+				std::ifstream file(path, std::ios::binary);
+				file.seekg(static_cast<std::streamoff>(offset));
+				if (size == SIZE_MAX)
+					storage.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+				else
+				{
+					storage.resize(size);
+					file.read(&storage[0], static_cast<std::streamsize>(size));
+					storage.resize(static_cast<size_t>(file.gcount()));
+				}
+				encoded = { reinterpret_cast<const uint8_t*>(storage.data()), storage.size() };
+			}
+			if (Ktx2Reader::isKtx2(encoded))
+				image = Ktx2Reader::decode(encoded, name, nullptr, imageRole);
+			else
+			{
+				int width = 0, height = 0, channels = 0;
+				unsigned char* data = stbi_load_from_memory(encoded.data, static_cast<int>(encoded.size), &width, &height, &channels, 4);
+				if (!data)
+					std::cerr << "Failed to load the image " << name << " again" << std::endl;
+				image = Utils::createImageData(data, width, height, TextureFormat::RGBA8Unorm);
+			}
+			if (compress && image.format == TextureFormat::RGBA8Unorm)
+			{
+				MipBuilder::build(image, quality == BcEncoder::Quality::High ? MipBuilder::Filter::Kaiser : MipBuilder::Filter::Box);
+				BcEncoder::compress(image, BcEncoder::selectFormat(image, imageRole, quality), quality);
+			}
+		}
+		image.srgb = imageRole == BcEncoder::Role::BaseColor;
+		return image.levels.empty() ? nullptr : Utils::uploadImageData(image, textureView);
+	};
+}
+
+//KHR_texture_basisu: the KTX2 image when the device can upload its blocks or it can be transcoded (see Ktx2Reader),
+//else the fallback source (-1 if there is none)
+int GltfLoader::findTextureSource(const tinygltf::Model& model, const tinygltf::Texture& texture, const std::string& baseDir) const {
+	auto extension = texture.extensions.find("KHR_texture_basisu");
+	if (extension == texture.extensions.end() || !extension->second.Has("source"))
+		return texture.source;
+	const int source = extension->second.Get("source").GetNumberAsInt();
+	if (source < 0 || source >= static_cast<int>(model.images.size()))
+		return texture.source;
+	std::string storage;
+	if (Ktx2Reader::getFormat(readEncodedImage(model, model.images[source], baseDir, storage, Ktx2Reader::c_headerSize)) != TextureFormat::Undefined)
+		return source;
+	if (texture.source < 0)
+		std::cerr << "KTX2 image " << source << " cannot be uploaded on this device (or needs the transcoder of USE_BASISU) and has no fallback" << std::endl;
+	return texture.source;
 }
 
 std::string GltfLoader::generateTextureId(const std::string& uri, const std::string& baseDir, int source)
@@ -166,162 +977,793 @@ std::string GltfLoader::generateTextureId(const std::string& uri, const std::str
 	}
 }
 
-void GltfLoader::loadMesh(const tinygltf::Model& model, const tinygltf::Mesh& mesh, entt::entity parent, Issam::Scene* scene)
+//Returns nullptr when the primitive has no such attribute or when it is not backed by a buffer
+static const tinygltf::Accessor* findAttribute(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const std::string& name)
+{
+	auto it = primitive.attributes.find(name);
+	if (it == primitive.attributes.end()) return nullptr;
+	const tinygltf::Accessor& accessor = model.accessors[it->second];
+	if (accessor.bufferView == -1) return nullptr;
+	return &accessor;
+}
+
+//Reads the element i of an accessor as floats.
+//Integer components come from KHR_mesh_quantization, normalized or not.
+static glm::vec4 readAccessor(const tinygltf::Model& model, const BufferSpans& buffers, const tinygltf::Accessor& accessor, size_t i)
 {
-	int primitiveIdx = 0;
-	for (const auto& primitive : mesh.primitives)
+	const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+	const int components = tinygltf::GetNumComponentsInType(accessor.type);
+	const int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+	const size_t stride = accessor.ByteStride(bufferView);
+	const unsigned char* data = buffers[bufferView.buffer].data + bufferView.byteOffset + accessor.byteOffset + i * stride;
+
+	glm::vec4 value(0.0f);
+	for (int c = 0; c < components && c < 4; ++c)
 	{
-		entt::entity entity = scene->addEntity();
-		scene->addChild(parent, entity);
-		std::vector<Vertex> vertices;
-		std::vector<uint16_t> indices;
-		// Process vertex attributes
-		const tinygltf::Accessor& posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
-		if (posAccessor.bufferView == -1) return;
-		const tinygltf::BufferView& posBufferView = model.bufferViews[posAccessor.bufferView];
-		const tinygltf::Buffer& posBuffer = model.buffers[posBufferView.buffer];
-
-		const tinygltf::Accessor* normAccessor = nullptr;
-		const tinygltf::BufferView* normBufferView = nullptr;
-		const tinygltf::Buffer* normBuffer = nullptr;
-
-		const tinygltf::Accessor* uvAccessor = nullptr;
-		const tinygltf::BufferView* uvBufferView = nullptr;
-		const tinygltf::Buffer* uvBuffer = nullptr;
-
-		const tinygltf::Accessor* tangentAccessor = nullptr;
-		const tinygltf::BufferView* tangentBufferView = nullptr;
-		const tinygltf::Buffer* tangentBuffer = nullptr;
-
-		if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
-			normAccessor = &model.accessors[primitive.attributes.find("NORMAL")->second];
-			normBufferView = &model.bufferViews[normAccessor->bufferView];
-			normBuffer = &model.buffers[normBufferView->buffer];
-		}
-
-		if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-			uvAccessor = &model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-			uvBufferView = &model.bufferViews[uvAccessor->bufferView];
-			uvBuffer = &model.buffers[uvBufferView->buffer];
-		}
-
-		if (primitive.attributes.find("TANGENT") != primitive.attributes.end()) {
-			tangentAccessor = &model.accessors[primitive.attributes.find("TANGENT")->second];
-			tangentBufferView = &model.bufferViews[tangentAccessor->bufferView];
-			tangentBuffer = &model.buffers[tangentBufferView->buffer];
-		}
-
-		for (size_t i = 0; i < posAccessor.count; ++i) {
-			Vertex vertex = {};
-
-			size_t posIndex = i * posAccessor.ByteStride(posBufferView) + posAccessor.byteOffset + posBufferView.byteOffset;
-			vertex.position = glm::vec3(
-				*reinterpret_cast<const float*>(&posBuffer.data[posIndex + 0 * sizeof(float)]),
-				*reinterpret_cast<const float*>(&posBuffer.data[posIndex + 1 * sizeof(float)]),
-				*reinterpret_cast<const float*>(&posBuffer.data[posIndex + 2 * sizeof(float)]));
-
-			if (normAccessor) {
-				size_t normIndex = i * normAccessor->ByteStride(*normBufferView) + normAccessor->byteOffset + normBufferView->byteOffset;
-				vertex.normal = glm::vec3(
-					*reinterpret_cast<const float*>(&normBuffer->data[normIndex + 0 * sizeof(float)]),
-					*reinterpret_cast<const float*>(&normBuffer->data[normIndex + 1 * sizeof(float)]),
-					*reinterpret_cast<const float*>(&normBuffer->data[normIndex + 2 * sizeof(float)]));
-			}
+		const unsigned char* component = data + c * componentSize;
+		switch (accessor.componentType)
+		{
+		case TINYGLTF_COMPONENT_TYPE_FLOAT:
+			memcpy(&value[c], component, sizeof(float));
+			break;
+		case TINYGLTF_COMPONENT_TYPE_BYTE:
+		{
+			int8_t v = *reinterpret_cast<const int8_t*>(component);
+			value[c] = accessor.normalized ? std::max(v / 127.0f, -1.0f) : v;
+			break;
+		}
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+		{
+			uint8_t v = *component;
+			value[c] = accessor.normalized ? v / 255.0f : v;
+			break;
+		}
+		case TINYGLTF_COMPONENT_TYPE_SHORT:
+		{
+			int16_t v;
+			memcpy(&v, component, sizeof(int16_t));
+			value[c] = accessor.normalized ? std::max(v / 32767.0f, -1.0f) : v;
+			break;
+		}
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+		{
+			uint16_t v;
+			memcpy(&v, component, sizeof(uint16_t));
+			value[c] = accessor.normalized ? v / 65535.0f : v;
+			break;
+		}
+		default:
+			throw std::runtime_error("Unsupported vertex component type");
+		}
+	}
+	return value;
+}
 
-			if (uvAccessor) {
-				size_t uvIndex = i * uvAccessor->ByteStride(*uvBufferView) + uvAccessor->byteOffset + uvBufferView->byteOffset;
-				vertex.uv = glm::vec2(
-					*reinterpret_cast<const float*>(&uvBuffer->data[uvIndex + 0 * sizeof(float)]),
-					*reinterpret_cast<const float*>(&uvBuffer->data[uvIndex + 1 * sizeof(float)]));
-			}
+Material* GltfLoader::loadMaterial(const tinygltf::Model& model, int materialIndex)
+{
+	//Primitives sharing a glTF material share the Material, this is what allows static batching
+	auto it = m_materials.find(materialIndex);
+	if (it != m_materials.end())
+		return it->second;
 
-			if (tangentAccessor) {
-				size_t tangentIndex = i * tangentAccessor->ByteStride(*tangentBufferView) + tangentAccessor->byteOffset + tangentBufferView->byteOffset;
-				vertex.tangent = glm::vec3(
-					*reinterpret_cast<const float*>(&tangentBuffer->data[tangentIndex + 0 * sizeof(float)]),
-					*reinterpret_cast<const float*>(&tangentBuffer->data[tangentIndex + 1 * sizeof(float)]),
-					*reinterpret_cast<const float*>(&tangentBuffer->data[tangentIndex + 2 * sizeof(float)]));
-			}
+	Material* material = new Material();
+	if (m_packTextures && !m_async->packer)
+	{
+		m_async->packer = std::make_unique<MaterialPacker>("pbrMaterialModel", "textureLayers",
+			std::vector<MaterialPacker::Slot>{ { "baseColorTexture", "baseColorArray" }, { "metallicRoughnessTexture", "metallicRoughnessArray" } });
+	}
+	if (m_async->packer)
+		m_async->packer->addMaterial(material);
+	//The textures uploaded whole, in the order of the slots of the packer
+	auto addPackedTexture = [this, material](uint32_t slot, int source) {
+		auto texture = m_async->sourceTextures.find(source);
+		if (m_async->packer && texture != m_async->sourceTextures.end())
+			m_async->packer->addTexture(material, slot, texture->second);
+	};
+	auto& gltfMaterial = model.materials[materialIndex];
+	auto& baseColorFactor = gltfMaterial.pbrMetallicRoughness.baseColorFactor;
+	material->setAttribute("baseColorFactor", glm::make_vec4(baseColorFactor.data()));
 
-			vertices.push_back(vertex);
-		}
-		MeshPtr myMesh = std::make_shared<Mesh>();
-		myMesh->setVertices(vertices);
-
-		if (primitive.indices != -1)
-		{
-			// Process indices
-			const tinygltf::Accessor& indexAccessor = model.accessors[primitive.indices];
-			const tinygltf::BufferView& indexBufferView = model.bufferViews[indexAccessor.bufferView];
-			const tinygltf::Buffer& indexBuffer = model.buffers[indexBufferView.buffer];
-
-			for (size_t i = 0; i < indexAccessor.count; ++i) {
-				size_t index = i * indexAccessor.ByteStride(indexBufferView) + indexAccessor.byteOffset + indexBufferView.byteOffset;
-				uint32_t indexValue;
-				switch (indexAccessor.componentType) {
-				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-					indexValue = *reinterpret_cast<const uint8_t*>(&indexBuffer.data[index]);
-					break;
-				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-					indexValue = *reinterpret_cast<const uint16_t*>(&indexBuffer.data[index]);
-					break;
-				case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-					assert(false); //NOT SUPPORTED
-					indexValue = *reinterpret_cast<const uint32_t*>(&indexBuffer.data[index]);
-					break;
-				default:
-					throw std::runtime_error("Unsupported index component type");
-				}
-				indices.push_back(indexValue);
-			}
-			myMesh->setIndices(indices);
+	int baseColorTextureIndex = gltfMaterial.pbrMetallicRoughness.baseColorTexture.index;
+	if (baseColorTextureIndex >= 0 && baseColorTextureIndex < static_cast<int>(model.textures.size()))
+	{
+		auto textureView = m_textureViews.find(m_async->textureSources[baseColorTextureIndex]);
+		if (textureView != m_textureViews.end())
+			material->setAttribute("baseColorTexture", textureView->second);
+		addPackedTexture(0, m_async->textureSources[baseColorTextureIndex]);
+		auto streamed = m_streamedIds.find(m_async->textureSources[baseColorTextureIndex]);
+		if (streamed != m_streamedIds.end())
+			TextureStreamer::getInstance().addUser(streamed->second, material, "baseColorTexture", "baseColorStreaming");
+	}
+
+	int metallicRoughnessIndex = gltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture.index;
+	if (metallicRoughnessIndex >= 0 && metallicRoughnessIndex < static_cast<int>(model.textures.size()))
+	{
+		auto textureView = m_textureViews.find(m_async->textureSources[metallicRoughnessIndex]);
+		if (textureView != m_textureViews.end())
+			material->setAttribute("metallicRoughnessTexture", textureView->second);
+		addPackedTexture(1, m_async->textureSources[metallicRoughnessIndex]);
+		auto streamed = m_streamedIds.find(m_async->textureSources[metallicRoughnessIndex]);
+		if (streamed != m_streamedIds.end())
+			TextureStreamer::getInstance().addUser(streamed->second, material, "metallicRoughnessTexture", "metallicRoughnessStreaming");
+	}
+
+	auto& metallicFactor = gltfMaterial.pbrMetallicRoughness.metallicFactor;
+	material->setAttribute("metallicFactor", (float)metallicFactor);
+
+	auto& roughnessFactor = gltfMaterial.pbrMetallicRoughness.roughnessFactor;
+	material->setAttribute("roughnessFactor", (float)roughnessFactor);
+
+	material->setAttribute("unlitMaterialModel", "colorFactor", glm::vec4(1.0, 0.5, 0.0, 1.0), 0);
+	material->setAttribute("unlitMaterialModel", "colorFactor", glm::vec4(0.0), 1);
+
+	m_materials[materialIndex] = material;
+	return material;
+}
+
+//Copies an attribute into a member of the vertices. The float accessors are copied element by element
+//with their stride, the quantized ones are converted by readAccessor.
+static void gatherAccessor(const tinygltf::Model& model, const BufferSpans& buffers, const tinygltf::Accessor& accessor, std::vector<Vertex>& vertices, size_t memberOffset, size_t memberSize)
+{
+	const size_t count = std::min(accessor.count, vertices.size());
+	uint8_t* dst = reinterpret_cast<uint8_t*>(vertices.data()) + memberOffset;
+	if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			glm::vec4 value = readAccessor(model, buffers, accessor, i);
+			memcpy(dst + i * sizeof(Vertex), &value, memberSize);
 		}
+		return;
+	}
 
+	const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+	const size_t stride = accessor.ByteStride(bufferView);
+	const size_t size = std::min<size_t>(tinygltf::GetNumComponentsInType(accessor.type) * sizeof(float), memberSize);
+	const unsigned char* src = buffers[bufferView.buffer].data + bufferView.byteOffset + accessor.byteOffset;
+	for (size_t i = 0; i < count; ++i)
+		memcpy(dst + i * sizeof(Vertex), src + i * stride, size);
+}
 
-		Issam::MeshRenderer meshRenderer;
-		meshRenderer.mesh = myMesh;
-		if (primitive.material != -1)
+static void decodeIndices(const tinygltf::Model& model, const BufferSpans& buffers, const tinygltf::Primitive& primitive, std::vector<uint32_t>& indices)
+{
+	if (primitive.indices == -1) return;
+	const tinygltf::Accessor& indexAccessor = model.accessors[primitive.indices];
+	const tinygltf::BufferView& indexBufferView = model.bufferViews[indexAccessor.bufferView];
+	const size_t stride = indexAccessor.ByteStride(indexBufferView);
+	const unsigned char* data = buffers[indexBufferView.buffer].data + indexBufferView.byteOffset + indexAccessor.byteOffset;
+
+	indices.resize(indexAccessor.count);
+	switch (indexAccessor.componentType) {
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+		for (size_t i = 0; i < indices.size(); ++i)
+			indices[i] = data[i * stride];
+		break;
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+		if (stride == sizeof(uint16_t))
+		{
+			const uint16_t* indices16 = reinterpret_cast<const uint16_t*>(data);
+			std::copy(indices16, indices16 + indices.size(), indices.begin());
+			break;
+		}
+		for (size_t i = 0; i < indices.size(); ++i)
 		{
-			Material* material = new Material();
-			auto& gltfMaterial = model.materials[primitive.material];
-			auto& baseColorFactor = gltfMaterial.pbrMetallicRoughness.baseColorFactor;
-			material->setAttribute("baseColorFactor", glm::make_vec4(baseColorFactor.data()));
+			uint16_t index;
+			memcpy(&index, data + i * stride, sizeof(uint16_t));
+			indices[i] = index;
+		}
+		break;
+	case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+		if (stride == sizeof(uint32_t))
+		{
+			memcpy(indices.data(), data, indices.size() * sizeof(uint32_t));
+			break;
+		}
+		for (size_t i = 0; i < indices.size(); ++i)
+			memcpy(&indices[i], data + i * stride, sizeof(uint32_t));
+		break;
+	default:
+		throw std::runtime_error("Unsupported index component type");
+	}
+}
 
-			int baseColorTextureIndex = gltfMaterial.pbrMetallicRoughness.baseColorTexture.index;
-			if (baseColorTextureIndex >= 0 && baseColorTextureIndex < model.textures.size())
-			{
-				const tinygltf::Texture& gltfTexture = model.textures[baseColorTextureIndex];
-				//	const tinygltf::Image& gltfImage = model.images[gltfTexture.source];
-				std::string id = m_sourceToId.find(gltfTexture.source)->second;
-				material->setAttribute("baseColorTexture", TextureManager::getInstance().getTextureView(id));
-			}
+//Indices past the vertices of a malformed file would be read and written out of bounds by the optimizer and the meshlets
+static bool checkIndexRange(const std::vector<uint32_t>& indices, size_t vertexCount)
+{
+	uint32_t maxIndex = 0;
+	for (uint32_t index : indices)
+		maxIndex = std::max(maxIndex, index);
+	return indices.empty() || maxIndex < vertexCount;
+}
 
-			int metallicRoughnessIndex = gltfMaterial.pbrMetallicRoughness.metallicRoughnessTexture.index;
-			if (metallicRoughnessIndex >= 0 && metallicRoughnessIndex < model.textures.size())
+//Decodes a primitive into CPU data, touches neither the scene nor the GPU so it can run on a worker thread.
+//False with no data when the indices are out of the vertices.
+static bool decodePrimitive(const tinygltf::Model& model, const BufferSpans& buffers, const tinygltf::Primitive& primitive, MeshData& meshData)
+{
+	// Process vertex attributes
+	const tinygltf::Accessor* posAccessor = findAttribute(model, primitive, "POSITION");
+	if (!posAccessor) return true;
+	const tinygltf::Accessor* normAccessor = findAttribute(model, primitive, "NORMAL");
+	const tinygltf::Accessor* uvAccessor = findAttribute(model, primitive, "TEXCOORD_0");
+	const tinygltf::Accessor* tangentAccessor = findAttribute(model, primitive, "TANGENT");
+
+	std::vector<Vertex>& vertices = meshData.vertices;
+	vertices.assign(posAccessor->count, Vertex{});
+	gatherAccessor(model, buffers, *posAccessor, vertices, offsetof(Vertex, position), sizeof(glm::vec3));
+	if (normAccessor)
+		gatherAccessor(model, buffers, *normAccessor, vertices, offsetof(Vertex, normal), sizeof(glm::vec3));
+	if (uvAccessor)
+		gatherAccessor(model, buffers, *uvAccessor, vertices, offsetof(Vertex, uv), sizeof(glm::vec2));
+	if (tangentAccessor)
+		gatherAccessor(model, buffers, *tangentAccessor, vertices, offsetof(Vertex, tangent), sizeof(glm::vec3));
+
+	decodeIndices(model, buffers, primitive, meshData.indices);
+	if (checkIndexRange(meshData.indices, vertices.size())) return true;
+	meshData = MeshData();
+	return false;
+}
+
+//The vertices are uploaded in place when all the attributes are float vectors, the layout follows the file:
+//one stream per buffer view, the accessors interleaved in a view share its stream.
+//With splitPositions, the positions must be alone in their stream.
+static bool findVertexStreams(const tinygltf::Model& model, const BufferSpans& buffers, const tinygltf::Primitive& primitive, bool splitPositions, VertexStreams& streams)
+{
+	struct Input {
+		const char* name;
+		VertexSemantic semantic;
+		int type;
+		VertexFormat format;
+	};
+	const Input inputs[] = {
+		{ "POSITION", VertexSemantic::Position, TINYGLTF_TYPE_VEC3, VertexFormat::Float32x3 },
+		{ "NORMAL", VertexSemantic::Normal, TINYGLTF_TYPE_VEC3, VertexFormat::Float32x3 },
+		{ "TANGENT", VertexSemantic::Tangent, TINYGLTF_TYPE_VEC4, VertexFormat::Float32x4 }, //w (handedness) is ignored by the shaders
+		{ "TEXCOORD_0", VertexSemantic::TexCoord, TINYGLTF_TYPE_VEC2, VertexFormat::Float32x2 },
+	};
+	constexpr size_t c_maxStride = 2048; //maxVertexBufferArrayStride
+
+	const tinygltf::Accessor* position = findAttribute(model, primitive, "POSITION");
+	if (!position || position->minValues.size() < 3 || position->maxValues.size() < 3) return false;
+
+	struct Stream {
+		int bufferView;
+		size_t byteOffset; //Of the first attribute, in the view
+		size_t stride;
+		uint32_t attributeCount;
+	};
+	std::vector<Stream> fileStreams;
+	streams.layout = VertexLayout();
+	for (const Input& input : inputs)
+	{
+		const tinygltf::Accessor* accessor = findAttribute(model, primitive, input.name);
+		if (!accessor) continue;
+		if (accessor->componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || accessor->type != input.type
+			|| accessor->sparse.isSparse || accessor->count != position->count)
+			return false;
+		const tinygltf::BufferView& bufferView = model.bufferViews[accessor->bufferView];
+		const size_t stride = accessor->ByteStride(bufferView);
+		const size_t size = getVertexFormatSize(input.format);
+		if (stride == 0 || stride % 4 != 0 || stride > c_maxStride) return false;
+
+		auto stream = std::find_if(fileStreams.begin(), fileStreams.end(), [&](const Stream& candidate) {
+			return bufferView.byteStride != 0 && candidate.bufferView == accessor->bufferView && candidate.stride == stride
+				&& accessor->byteOffset >= candidate.byteOffset && accessor->byteOffset + size <= candidate.byteOffset + stride;
+		});
+		if (stream == fileStreams.end())
+			stream = fileStreams.insert(fileStreams.end(), { accessor->bufferView, accessor->byteOffset, stride, 0 });
+		stream->attributeCount++;
+		const uint32_t streamIndex = static_cast<uint32_t>(stream - fileStreams.begin());
+		streams.layout.addAttribute(input.semantic, input.format, streamIndex, static_cast<uint32_t>(accessor->byteOffset - stream->byteOffset));
+	}
+	if (splitPositions && fileStreams[0].attributeCount > 1) return false;
+
+	streams.data.clear();
+	for (uint32_t i = 0; i < fileStreams.size(); ++i)
+	{
+		const Stream& stream = fileStreams[i];
+		const tinygltf::BufferView& bufferView = model.bufferViews[stream.bufferView];
+		const ByteSpan& buffer = buffers[bufferView.buffer];
+		//The pool copies count * stride bytes, the padding after the last vertex must be in the buffer
+		const size_t start = bufferView.byteOffset + stream.byteOffset;
+		if (start + position->count * stream.stride > buffer.size) return false;
+		streams.layout.setStride(i, static_cast<uint32_t>(stream.stride));
+		streams.data.push_back(buffer.data + start);
+	}
+	streams.vertexCount = static_cast<uint32_t>(position->count);
+	streams.boxMin = glm::vec3(position->minValues[0], position->minValues[1], position->minValues[2]);
+	streams.boxMax = glm::vec3(position->maxValues[0], position->maxValues[1], position->maxValues[2]);
+	return true;
+}
+
+#ifdef USE_DRACO
+struct DracoAccessor {
+	int accessor;
+	int componentType;
+	size_t count;
+	std::vector<uint8_t> data;
+};
+
+//The attributes as floats and the indices as 32 bits, whatever their quantization in the Draco stream
+static bool decodeDracoPrimitive(const tinygltf::Model& model, const BufferSpans& buffers, const tinygltf::Primitive& primitive, std::vector<DracoAccessor>& accessors)
+{
+	const tinygltf::Value& extension = primitive.extensions.at("KHR_draco_mesh_compression");
+	const int viewIndex = extension.Get("bufferView").GetNumberAsInt();
+	if (viewIndex < 0 || viewIndex >= static_cast<int>(model.bufferViews.size())) return false;
+	const tinygltf::BufferView& view = model.bufferViews[viewIndex];
+	draco::DecoderBuffer buffer;
+	buffer.Init(reinterpret_cast<const char*>(buffers[view.buffer].data + view.byteOffset), view.byteLength);
+	draco::Decoder decoder;
+	auto decoded = decoder.DecodeMeshFromBuffer(&buffer);
+	if (!decoded.ok())
+	{
+		std::cerr << "Draco: " << decoded.status().error_msg_string() << std::endl;
+		return false;
+	}
+	std::unique_ptr<draco::Mesh> mesh = std::move(decoded).value();
+
+	const tinygltf::Value& attributes = extension.Get("attributes");
+	for (const std::string& name : attributes.Keys())
+	{
+		auto gltfAttribute = primitive.attributes.find(name);
+		if (gltfAttribute == primitive.attributes.end()) continue;
+		const draco::PointAttribute* attribute = mesh->GetAttributeByUniqueId(attributes.Get(name).GetNumberAsInt());
+		if (!attribute) return false;
+		const int components = tinygltf::GetNumComponentsInType(model.accessors[gltfAttribute->second].type);
+		DracoAccessor accessor{ gltfAttribute->second, TINYGLTF_COMPONENT_TYPE_FLOAT, mesh->num_points() };
+		accessor.data.resize(accessor.count * components * sizeof(float));
+		float* values = reinterpret_cast<float*>(accessor.data.data());
+		for (draco::PointIndex i(0); i < mesh->num_points(); ++i)
+			attribute->ConvertValue<float>(attribute->mapped_index(i), static_cast<int8_t>(components), values + i.value() * components);
+		accessors.push_back(std::move(accessor));
+	}
+	if (primitive.indices >= 0)
+	{
+		DracoAccessor accessor{ primitive.indices, TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT, mesh->num_faces() * size_t(3) };
+		accessor.data.resize(accessor.count * sizeof(uint32_t));
+		uint32_t* indices = reinterpret_cast<uint32_t*>(accessor.data.data());
+		for (draco::FaceIndex f(0); f < mesh->num_faces(); ++f)
+		{
+			const draco::Mesh::Face& face = mesh->face(f);
+			for (int k = 0; k < 3; ++k)
+				indices[f.value() * 3 + k] = face[k].value();
+		}
+		accessors.push_back(std::move(accessor));
+	}
+	return true;
+}
+#endif
+
+bool GltfLoader::decodeCompressedGeometry(AsyncLoad& load)
+{
+	tinygltf::Model& model = load.model;
+	auto start = std::chrono::steady_clock::now();
+	auto appendBuffer = [this](std::vector<uint8_t>&& data) {
+		m_decodedBuffers.push_back(std::move(data));
+		m_buffers.push_back({ m_decodedBuffers.back().data(), m_decodedBuffers.back().size() });
+		return static_cast<int>(m_buffers.size() - 1);
+	};
+
+	//EXT_meshopt_compression: one task per view
+	std::vector<int> views;
+	for (int i = 0; i < static_cast<int>(model.bufferViews.size()); ++i)
+	{
+		if (model.bufferViews[i].extensions.count("EXT_meshopt_compression"))
+			views.push_back(i);
+	}
+	std::vector<std::vector<uint8_t>> decodedViews(views.size());
+	std::atomic<bool> failed{ false };
+	const BufferSpans& buffers = m_buffers;
+	ThreadPool::getInstance().parallelFor(views.size(), [&](size_t i) {
+		//A canceled load fails, the views left are not decoded
+		if (load.canceled)
+		{
+			failed = true;
+			return;
+		}
+		const tinygltf::Value& extension = model.bufferViews[views[i]].extensions.at("EXT_meshopt_compression");
+		const int buffer = extension.Get("buffer").GetNumberAsInt();
+		const size_t byteOffset = extension.Has("byteOffset") ? static_cast<size_t>(extension.Get("byteOffset").GetNumberAsDouble()) : 0;
+		const size_t byteLength = static_cast<size_t>(extension.Get("byteLength").GetNumberAsDouble());
+		const size_t stride = static_cast<size_t>(extension.Get("byteStride").GetNumberAsInt());
+		const size_t count = static_cast<size_t>(extension.Get("count").GetNumberAsDouble());
+		const std::string mode = extension.Get("mode").Get<std::string>();
+		const std::string filter = extension.Has("filter") ? extension.Get("filter").Get<std::string>() : "NONE";
+		if (buffer < 0 || buffer >= static_cast<int>(buffers.size()) || byteOffset > buffers[buffer].size || byteLength > buffers[buffer].size - byteOffset)
+		{
+			failed = true;
+			return;
+		}
+		const ByteSpan encoded = { buffers[buffer].data + byteOffset, byteLength };
+		std::vector<uint8_t>& decoded = decodedViews[i];
+		decoded.resize(count * stride);
+		bool ok = false;
+		if (mode == "ATTRIBUTES")
+		{
+			MeshoptDecoder::Filter decodeFilter = filter == "OCTAHEDRAL" ? MeshoptDecoder::Filter::Octahedral
+				: filter == "QUATERNION" ? MeshoptDecoder::Filter::Quaternion
+				: filter == "EXPONENTIAL" ? MeshoptDecoder::Filter::Exponential : MeshoptDecoder::Filter::None;
+			ok = MeshoptDecoder::decodeVertexBuffer(decoded.data(), count, stride, encoded)
+				&& MeshoptDecoder::applyFilter(decoded.data(), count, stride, decodeFilter);
+		}
+		else if (mode == "TRIANGLES")
+			ok = MeshoptDecoder::decodeIndexBuffer(decoded.data(), count, stride, encoded);
+		else if (mode == "INDICES")
+			ok = MeshoptDecoder::decodeIndexSequence(decoded.data(), count, stride, encoded);
+		if (!ok)
+		{
+			std::cerr << "ERR: cannot decode the EXT_meshopt_compression buffer view " << views[i] << " (" << mode << ")" << std::endl;
+			failed = true;
+		}
+	});
+	if (failed) return false;
+	for (size_t i = 0; i < views.size(); ++i)
+	{
+		tinygltf::BufferView& bufferView = model.bufferViews[views[i]];
+		bufferView.byteLength = decodedViews[i].size();
+		bufferView.byteOffset = 0;
+		bufferView.buffer = appendBuffer(std::move(decodedViews[i]));
+	}
+
+	//KHR_draco_mesh_compression: one task per primitive
+	std::vector<tinygltf::Primitive*> dracoPrimitives;
+	for (auto& mesh : model.meshes)
+	{
+		for (auto& primitive : mesh.primitives)
+		{
+			if (primitive.extensions.count("KHR_draco_mesh_compression"))
+				dracoPrimitives.push_back(&primitive);
+		}
+	}
+#ifdef USE_DRACO
+	std::vector<std::vector<DracoAccessor>> dracoAccessors(dracoPrimitives.size());
+	ThreadPool::getInstance().parallelFor(dracoPrimitives.size(), [&](size_t i) {
+		if (load.canceled || !decodeDracoPrimitive(model, buffers, *dracoPrimitives[i], dracoAccessors[i]))
+			failed = true;
+	});
+	if (failed) return false;
+	for (auto& primitiveAccessors : dracoAccessors)
+	{
+		for (DracoAccessor& decoded : primitiveAccessors)
+		{
+			tinygltf::BufferView bufferView;
+			bufferView.byteLength = decoded.data.size();
+			bufferView.buffer = appendBuffer(std::move(decoded.data));
+			model.bufferViews.push_back(bufferView);
+			tinygltf::Accessor& accessor = model.accessors[decoded.accessor];
+			accessor.bufferView = static_cast<int>(model.bufferViews.size() - 1);
+			accessor.byteOffset = 0;
+			accessor.componentType = decoded.componentType;
+			accessor.normalized = false;
+			accessor.count = decoded.count;
+		}
+	}
+#else
+	//Without the decoder (configured with USE_DRACO OFF), the primitives have no data: they are skipped, with one warning per file
+	for (tinygltf::Primitive* primitive : dracoPrimitives)
+		primitive->attributes.clear();
+	if (!dracoPrimitives.empty())
+		std::cerr << "WARN: " << load.status->filepath << ": " << dracoPrimitives.size()
+			<< " KHR_draco_mesh_compression primitives skipped, this build has no Draco decoder (configure with -DUSE_DRACO=ON)" << std::endl;
+	dracoPrimitives.clear();
+#endif
+
+	if (!views.empty() || !dracoPrimitives.empty())
+	{
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Compressed geometry: " << views.size() << " meshopt views, " << dracoPrimitives.size() << " Draco primitives decoded in "
+			<< milliseconds << " ms" << std::endl;
+	}
+	return true;
+}
+
+void GltfLoader::prepareMeshes(AsyncLoad& load)
+{
+	const tinygltf::Model& model = load.model;
+	//Without any processing needing the vertices on the CPU, they go from the file to the GPU
+	const bool inPlace = !m_optimizeMeshes && !m_generateMeshlets && !m_generateLods && !m_quantizeVertices && !m_staticBatching && !m_generateImpostors;
+	//The options change the uploaded mesh, a mesh is only shared between loads with the same options.
+	//The in place meshes have no vertices on the CPU, the batching and the impostors cannot use them.
+	const uint64_t options = (m_quantizeVertices ? 1 : 0) | (m_splitPositions ? 2 : 0) | (m_optimizeMeshes ? 4 : 0)
+		| (m_generateMeshlets ? 8 : 0) | (m_generateLods ? 16 : 0) | (inPlace ? 32 : 0);
+
+	std::vector<MeshJob>& jobs = load.jobs;
+	m_meshes.resize(model.meshes.size());
+	m_impostors.resize(model.meshes.size());
+	for (int meshIdx = 0; meshIdx < static_cast<int>(model.meshes.size()); ++meshIdx)
+	{
+		m_meshes[meshIdx].resize(model.meshes[meshIdx].primitives.size());
+		m_impostors[meshIdx].resize(model.meshes[meshIdx].primitives.size());
+		for (int primitiveIdx = 0; primitiveIdx < static_cast<int>(model.meshes[meshIdx].primitives.size()); ++primitiveIdx)
+		{
+			MeshJob job;
+			job.mesh = meshIdx;
+			job.primitive = primitiveIdx;
+			job.sourceKey = m_filepath + "#" + std::to_string(meshIdx) + "#" + std::to_string(primitiveIdx) + "#" + std::to_string(options);
+			job.cached = MeshManager::getInstance().find(job.sourceKey);
+			jobs.push_back(std::move(job));
+		}
+	}
+	const std::string cookedEntry = "meshes" + std::to_string(options);
+	load.cookedMeshes = load.assetHash && readCookedMeshes(load, cookedEntry);
+	std::atomic<bool> changed{ false }; //Geometry decoded or processed, the cooked meshes are written again
+
+	//Decoding and optimization on the workers, the GPU uploads are done by uploadMesh on the main thread
+	const bool optimize = m_optimizeMeshes;
+	const bool generateMeshlets = m_generateMeshlets;
+	const bool generateLods = m_generateLods;
+	const bool splitPositions = m_splitPositions;
+	const BufferSpans& buffers = m_buffers;
+	ThreadPool::getInstance().parallelFor(jobs.size(), [&load, &jobs, &model, &buffers, &changed, optimize, options, inPlace, splitPositions](size_t i) {
+		MeshJob& job = jobs[i];
+		if (job.cached || job.cooked || load.canceled) return;
+		const tinygltf::Primitive& primitive = model.meshes[job.mesh].primitives[job.primitive];
+		//Skipped like the primitives without data, the others of the mesh are still loaded
+		auto skip = [&load, &job]() {
+			std::cerr << "WARN: " << load.status->filepath << ": mesh " << job.mesh << " primitive " << job.primitive
+				<< " skipped, its indices are out of its vertices" << std::endl;
+		};
+		if (inPlace && findVertexStreams(model, buffers, primitive, splitPositions, job.streams))
+		{
+			decodeIndices(model, buffers, primitive, job.meshData.indices);
+			if (checkIndexRange(job.meshData.indices, job.streams.vertexCount))
 			{
-				const tinygltf::Texture& gltfTexture = model.textures[metallicRoughnessIndex];
-				//const tinygltf::Image& gltfImage = model.images[gltfTexture.source];
-				std::string id = m_sourceToId.find(gltfTexture.source)->second;
-				material->setAttribute("metallicRoughnessTexture", TextureManager::getInstance().getTextureView(id));
+				job.inPlace = true;
+				return;
 			}
+			job.meshData = MeshData();
+			job.streams = VertexStreams();
+			skip();
+			return;
+		}
+		if (!decodePrimitive(model, buffers, primitive, job.meshData))
+		{
+			skip();
+			return;
+		}
+		if (optimize)
+			MeshOptimizer::optimize(job.meshData, &job.before, &job.after);
+		job.contentHash = MeshManager::hash(job.meshData, options | (static_cast<uint64_t>(primitive.mode + 1) << 8));
+		changed = true;
+	});
 
-			auto& metallicFactor = gltfMaterial.pbrMetallicRoughness.metallicFactor;
-			material->setAttribute("metallicFactor", (float)metallicFactor);
+	//Identical primitives (other meshes of the file, other files) share one mesh
+	auto sameGeometry = [](const MeshData& a, const MeshData& b) {
+		return a.indices == b.indices && a.vertices.size() == b.vertices.size()
+			&& memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(Vertex)) == 0;
+	};
+	std::unordered_multimap<uint64_t, int> jobsByContent;
+	for (int i = 0; i < static_cast<int>(jobs.size()); ++i)
+	{
+		MeshJob& job = jobs[i];
+		if (job.cached || job.meshData.vertices.empty()) continue;
+		job.cached = MeshManager::getInstance().findByContent(job.contentHash, job.meshData);
+		if (job.cached) continue;
+		auto range = jobsByContent.equal_range(job.contentHash);
+		for (auto it = range.first; it != range.second && job.sameAs < 0; ++it)
+		{
+			if (sameGeometry(jobs[it->second].meshData, job.meshData))
+				job.sameAs = it->second;
+		}
+		if (job.sameAs < 0)
+			jobsByContent.emplace(job.contentHash, i);
+	}
+
+	//The meshlets and LODs only for the meshes that will be uploaded
+	ThreadPool::getInstance().parallelFor(jobs.size(), [&load, &jobs, &model, &changed, generateMeshlets, generateLods](size_t i) {
+		MeshJob& job = jobs[i];
+		if (job.cached || job.sameAs >= 0 || job.processed || load.canceled) return;
+		const tinygltf::Primitive& primitive = model.meshes[job.mesh].primitives[job.primitive];
+		bool triangles = primitive.mode == TINYGLTF_MODE_TRIANGLES || primitive.mode == -1;
+		if (generateMeshlets && triangles && !job.meshData.indices.empty())
+			job.meshlets = MeshletBuilder::build(job.meshData.vertices, job.meshData.indices);
+		if (generateLods && triangles)
+			job.lods = MeshSimplifier::generateLods(job.meshData);
+		job.processed = true;
+		if (!job.inPlace) changed = true;
+	});
+
+	if (load.assetHash && changed && !load.canceled)
+		writeCookedMeshes(load, cookedEntry);
+}
+
+//Cooked meshes, per job: the decoded and optimized geometry, then its meshlets and LODs when they were built.
+//The jobs without geometry (mesh already loaded, in place upload, invalid primitive) are decoded again on a hit.
+bool GltfLoader::readCookedMeshes(AsyncLoad& load, const std::string& entry)
+{
+	MappedFile file;
+	ByteSpan payload;
+	if (!AssetCache::getInstance().load(load.assetHash, entry, file, payload)) return false;
+	BlobReader reader(payload);
+	uint64_t jobCount = 0;
+	reader.read(jobCount);
+	if (!reader.isValid() || jobCount != load.jobs.size()) return false;
 
-			auto& roughnessFactor = gltfMaterial.pbrMetallicRoughness.roughnessFactor;
-			material->setAttribute("roughnessFactor", (float)roughnessFactor);
+	std::vector<MeshJob> cooked(load.jobs.size());
+	for (size_t i = 0; i < cooked.size() && reader.isValid(); ++i)
+	{
+		MeshJob& job = cooked[i];
+		uint8_t hasGeometry = 0;
+		uint8_t processed = 0;
+		reader.read(job.mesh);
+		reader.read(job.primitive);
+		reader.read(hasGeometry);
+		if (job.mesh != load.jobs[i].mesh || job.primitive != load.jobs[i].primitive) return false;
+		if (!hasGeometry) continue;
+		job.cooked = true;
+		reader.read(job.contentHash);
+		reader.read(job.meshData.vertices);
+		reader.read(job.meshData.indices);
+		reader.read(job.before);
+		reader.read(job.after);
+		reader.read(processed);
+		if (!processed) continue;
+		job.processed = true;
+		uint64_t lodCount = 0;
+		reader.read(job.meshlets.meshlets);
+		reader.read(job.meshlets.indices);
+		reader.read(lodCount);
+		if (lodCount > MeshSimplifier::c_lodCount + 1) return false;
+		job.lods.indices.resize(static_cast<size_t>(lodCount));
+		for (auto& lod : job.lods.indices)
+			reader.read(lod);
+		reader.read(job.lods.errors);
+	}
+	if (!reader.isValid() || !reader.isAtEnd()) return false;
+
+	//The meshes found in the MeshManager keep their reference and need nothing
+	for (size_t i = 0; i < cooked.size(); ++i)
+	{
+		if (load.jobs[i].cached || !cooked[i].cooked) continue;
+		cooked[i].sourceKey = std::move(load.jobs[i].sourceKey);
+		load.jobs[i] = std::move(cooked[i]);
+	}
+	return true;
+}
 
-			material->setAttribute("unlitMaterialModel", "colorFactor", glm::vec4(1.0, 0.5, 0.0, 1.0), 0);
-			material->setAttribute("unlitMaterialModel", "colorFactor", glm::vec4(0.0), 1);
+void GltfLoader::writeCookedMeshes(const AsyncLoad& load, const std::string& entry) const
+{
+	BlobWriter writer;
+	writer.write<uint64_t>(load.jobs.size());
+	for (const MeshJob& job : load.jobs)
+	{
+		const bool hasGeometry = !job.inPlace && !job.meshData.vertices.empty();
+		writer.write(job.mesh);
+		writer.write(job.primitive);
+		writer.write<uint8_t>(hasGeometry ? 1 : 0);
+		if (!hasGeometry) continue;
+		writer.write(job.contentHash);
+		writer.write(job.meshData.vertices);
+		writer.write(job.meshData.indices);
+		writer.write(job.before);
+		writer.write(job.after);
+		//Shared meshes skip the processing, they are processed on a hit if they are no longer shared
+		writer.write<uint8_t>(job.processed ? 1 : 0);
+		if (!job.processed) continue;
+		writer.write(job.meshlets.meshlets);
+		writer.write(job.meshlets.indices);
+		writer.write<uint64_t>(job.lods.indices.size());
+		for (const auto& lod : job.lods.indices)
+			writer.write(lod);
+		writer.write(job.lods.errors);
+	}
+	AssetCache::getInstance().save(load.assetHash, entry, writer.getBytes());
+}
 
+void GltfLoader::uploadMesh(AsyncLoad& load, size_t jobIndex)
+{
+	std::vector<MeshJob>& jobs = load.jobs;
+	MeshJob& job = jobs[jobIndex];
+	if (job.cached || job.sameAs >= 0)
+	{
+		MeshPtr mesh = job.cached ? job.cached : m_meshes[jobs[job.sameAs].mesh][jobs[job.sameAs].primitive];
+		m_meshes[job.mesh][job.primitive] = mesh;
+		if (!job.meshData.vertices.empty()) //Found by content, not decoded when found by source
+			MeshManager::getInstance().add(job.sourceKey, job.contentHash, mesh);
+		load.reusedCount++;
+	}
+	else if (!job.meshData.vertices.empty() || job.inPlace)
+	{
+		MeshPtr mesh = std::make_shared<Mesh>();
+		if (job.inPlace)
+		{
+			mesh->setVertexStreams(job.streams);
+			load.inPlaceCount++;
+		}
+		else
+			mesh->setVertices(job.meshData.vertices, VertexLayout::select(job.meshData.vertices, m_quantizeVertices, m_splitPositions));
+		if (job.lods.indices.size() > 1)
+		{
+			mesh->setLods(job.lods.indices, job.lods.errors);
+			load.lodCount += job.lods.indices.size() - 1;
+		}
+		else if (!job.meshData.indices.empty())
+			mesh->setIndices(job.meshData.indices);
+		if (!job.meshlets.meshlets.empty())
+		{
+			mesh->setMeshlets(job.meshlets);
+			load.meshletCount += job.meshlets.meshlets.size();
+		}
+		m_meshes[job.mesh][job.primitive] = mesh;
+		MeshManager::getInstance().add(job.sourceKey, job.contentHash, mesh);
+		load.geometryBytes += static_cast<size_t>(mesh->getVertexRange()->count) * mesh->getVertexLayout().getVertexSize();
+		if (mesh->getIndexRange())
+			load.geometryBytes += static_cast<size_t>(mesh->getIndexRange()->count) * (mesh->getIndexFormat() == IndexFormat::Uint16 ? 2 : 4);
+
+		//Weighted by the triangles, the ATVR by the vertices would favour the small meshes
+		size_t triangles = job.meshData.indices.size() / 3;
+		load.triangleCount += triangles;
+		load.before.acmr += job.before.acmr * triangles;
+		load.before.atvr += job.before.atvr * triangles;
+		load.after.acmr += job.after.acmr * triangles;
+		load.after.atvr += job.after.atvr * triangles;
+	}
+	//On the GPU, the CPU copy can go (the later jobs only need the indices of their source)
+	job.meshData = MeshData();
+	job.streams = VertexStreams();
+	job.meshlets = MeshletData();
+	job.lods = MeshLods();
+	if (jobIndex + 1 < jobs.size()) return;
+
+	std::cout << "Mesh cache: " << load.reusedCount << " of " << jobs.size() << " primitives reused" << std::endl;
+	//Decoding, processing and upload of the geometry, to compare the import paths
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - load.startTime).count();
+	double megabytes = load.geometryBytes / (1024.0 * 1024.0);
+	std::cout << "Geometry import: " << megabytes << " MB in " << milliseconds << " ms (" << (milliseconds > 0.0 ? megabytes * 1000.0 / milliseconds : 0.0)
+		<< " MB/s), " << load.inPlaceCount << " primitives uploaded in place" << std::endl;
+	if (m_optimizeMeshes && load.triangleCount > 0)
+	{
+		std::cout << "Mesh optimization: ACMR " << load.before.acmr / load.triangleCount << " -> " << load.after.acmr / load.triangleCount
+			<< ", ATVR " << load.before.atvr / load.triangleCount << " -> " << load.after.atvr / load.triangleCount << std::endl;
+	}
+	if (m_generateMeshlets)
+		std::cout << "Meshlets: " << load.meshletCount << " built" << std::endl;
+	if (m_generateLods)
+		std::cout << "LODs: " << load.lodCount << " generated" << std::endl;
+}
+
+void GltfLoader::loadMesh(const tinygltf::Model& model, int meshIndex, entt::entity parent, Issam::Scene* scene)
+{
+	const tinygltf::Mesh& mesh = model.meshes[meshIndex];
+	for (size_t primitiveIdx = 0; primitiveIdx < mesh.primitives.size(); ++primitiveIdx)
+	{
+		const tinygltf::Primitive& primitive = mesh.primitives[primitiveIdx];
+		MeshPtr myMesh = m_meshes[meshIndex][primitiveIdx];
+		//Skipped primitive (no data, e.g. Draco without the decoder): the others of the mesh are still loaded
+		if (!myMesh) continue;
+		entt::entity entity = scene->addEntity();
+		scene->addChild(parent, entity);
+
+		Issam::MeshRenderer meshRenderer;
+		meshRenderer.mesh = myMesh;
+		if (primitive.material != -1)
+		{
+			Material* material = loadMaterial(model, primitive.material);
 			meshRenderer.material = material;
 
+			//Added by finish, with the previous model gone
 			Issam::Filters filters;
 			filters.add("pbr");
-			scene->addComponent<Issam::Filters>(entity, filters);
+			m_hiddenFilters.push_back({ entity, filters });
 
+			bool triangles = primitive.mode == TINYGLTF_MODE_TRIANGLES || primitive.mode == -1;
+			if (m_generateImpostors && triangles)
+			{
+				ImpostorPtr& impostor = m_impostors[meshIndex][primitiveIdx];
+				if (!impostor)
+				{
+					//In the asset of the file (its stamp and the ones of its buffers and images), evicted with it
+					const uint64_t assetHash = m_async ? m_async->assetHash : 0;
+					std::string entry = "impostor" + std::to_string(meshIndex) + "_" + std::to_string(primitiveIdx) + "_" + std::to_string(primitive.material);
+					impostor = ImpostorBaker::getInstance().bake(*myMesh, material, assetHash, entry);
+				}
+				if (impostor)
+					scene->addComponent<Issam::Impostor>(entity, Issam::Impostor{ impostor });
+			}
 		}
 
+		if (m_staticBatching)
+			scene->addComponent<Issam::Static>(entity, Issam::Static());
+
 		scene->addComponent<Issam::MeshRenderer>(entity, meshRenderer);
 	}
 }
@@ -359,13 +1801,13 @@ void GltfLoader::loadNode(const tinygltf::Model& model, const tinygltf::Node& gl
 	}
 
 	if (gltfNode.mesh >= 0) {
-		loadMesh(model, model.meshes[gltfNode.mesh], entity, scene);
+		loadMesh(model, gltfNode.mesh, entity, scene);
 	}
 
 	for (int childIndex : gltfNode.children) {
 		entt::entity childEntity = scene->addEntity();
-		loadNode(model, model.nodes[childIndex], childEntity, scene, childIndex);
 		scene->addChild(entity, childEntity);
+		m_async->nodes.push_back({ childIndex, childEntity });
 		//node->children.push_back(childNode);
 	}
 }
@@ -1,39 +1,149 @@
 #pragma once
 
 #include <iostream>
+#include <atomic>
 #include <cassert>
 #include <fstream>
+#include <memory>
 #include <regex>
 
 #include <entt/entt.hpp>
 #include "tiny_gltf.h"
 
 #include "scene.h"
+#include "impostor.h"
+#include "bcEncoder.h"
+#include "mappedFile.h"
+#include "utils.h"
 
 const std::regex base64Pattern(R"(data:image/(\w+);base64,)");
 
+//Bytes of each glTF buffer, in tinygltf::Buffer::data or in the mapping of a .glb
+using BufferSpans = std::vector<ByteSpan>;
+
 class GltfLoader
 {
 public:
+	//Progress of a loadAsync, written by the loader and polled by the caller
+	struct LoadStatus {
+		std::string filepath;
+		std::atomic<float> progress{ 0.0f };
+		std::atomic<bool> done{ false };
+		std::atomic<bool> failed{ false }; //The file could not be read, or a later load canceled this one
+	};
+	using LoadHandle = std::shared_ptr<const LoadStatus>;
+
 	GltfLoader() = delete;
-	GltfLoader(Issam::Scene* scene) : m_scene(scene) {};
-	~GltfLoader() = default;
+	GltfLoader(Issam::Scene* scene);
+	~GltfLoader();
 
+	//Blocking version of loadAsync
 	void load(const std::string& filepath);
+	//Parsing, decoding and mesh processing run on the workers, the uploads and the entities are done by update.
+	//The current model stays in the scene until the new one is complete, it is then replaced at once.
+	//A load still pending is canceled. The options are those set when the load starts.
+	LoadHandle loadAsync(const std::string& filepath);
+	//Advances the pending load for about budgetMs milliseconds of the main thread (0: until it is complete)
+	void update(double budgetMs);
+	bool isLoading() const { return m_pending != nullptr; }
 	void unload();
 
+	//Flag the loaded entities as static and merge their meshes by material
+	void setStaticBatching(bool staticBatching) { m_staticBatching = staticBatching; }
+	//Store the vertices in the quantized layout (20 bytes per vertex instead of 44)
+	void setVertexQuantization(bool quantize) { m_quantizeVertices = quantize; }
+	//Store the positions in their own vertex stream, for the passes reading only the positions
+	void setSplitPositions(bool splitPositions) { m_splitPositions = splitPositions; }
+	//Weld and reorder the triangles for the vertex cache, overdraw and vertex fetch (see MeshOptimizer)
+	void setMeshOptimization(bool optimize) { m_optimizeMeshes = optimize; }
+	//Split the triangle meshes in meshlets, for the passes culling them on the GPU
+	void setMeshletGeneration(bool generateMeshlets) { m_generateMeshlets = generateMeshlets; }
+	//Simplified versions of the triangle meshes, selected per frame by the Renderer
+	void setLodGeneration(bool generateLods) { m_generateLods = generateLods; }
+	//Octahedral impostors of the triangle meshes, baked offscreen or read from the disk cache
+	void setImpostorGeneration(bool generateImpostors) { m_generateImpostors = generateImpostors; }
+	//Decoded images and processed meshes read from the AssetCache, written there on a miss
+	void setAssetCache(bool useAssetCache) { m_assetCache = useAssetCache; }
+	//PNG/JPG images encoded to BC formats at import (see BcEncoder), when the device supports them.
+	//With the asset cache, the blocks are cooked and the encoding only happens once.
+	void setTextureCompression(bool compress, BcEncoder::Quality quality) { m_compressTextures = compress; m_textureQuality = quality; }
+	//The textures of the materials get their finer mips as the camera comes close (see TextureStreamer)
+	void setTextureStreaming(bool streamTextures) { m_streamTextures = streamTextures; }
+	//The textures of the same size and format are copied into texture arrays, the materials with the same textures
+	//then share one bind group (see MaterialPacker)
+	void setTexturePacking(bool packTextures) { m_packTextures = packTextures; }
+
 private:
-	Texture loadImageFromBase64(const std::string& base64, TextureView* pTextureView = nullptr);
-	Texture loadImageFromVector(const std::vector<unsigned char>& imageVector, TextureView* pTextureView = nullptr);
-	Texture loadImageFromBuffer(const tinygltf::Model& model, const tinygltf::Image& image, TextureView* pTextureView = nullptr);
+	//Decoding and mips on the CPU only, called from the workers (see Utils::ImageData)
+	Utils::ImageData decodeImageFromBase64(const std::string& base64) const;
+	Utils::ImageData decodeImageFromVector(const std::vector<unsigned char>& imageVector) const;
+	Utils::ImageData decodeImageFromBuffer(const tinygltf::Model& model, const tinygltf::Image& image) const;
+	//KTX2 images (KHR_texture_basisu): the encoded bytes, kept in storage unless they are in the file buffers.
+	//maxSize limits the bytes read, for the header.
+	ByteSpan readEncodedImage(const tinygltf::Model& model, const tinygltf::Image& image, const std::string& baseDir, std::string& storage, size_t maxSize = SIZE_MAX) const;
+	int findTextureSource(const tinygltf::Model& model, const tinygltf::Texture& texture, const std::string& baseDir) const;
 
 	std::string generateTextureId(const std::string& uri, const std::string& baseDir, int source);
 
-	void loadMesh(const tinygltf::Model& model, const tinygltf::Mesh& mesh, entt::entity parent, Issam::Scene* scene);
+	struct MeshJob;
+	struct AsyncLoad; //State of a pending load, see gltfLoader.cpp
+
+	//For the TextureManager, an image uploaded whole: the cooked image, or the encoded image read again from the range
+	//of the file it is in (the data URIs are in no file, their bytes are kept)
+	TextureManager::Loader createTextureLoader(const AsyncLoad& load, int source) const;
+
+	//On a worker: parses the file, submits the image decodes and processes the meshes
+	bool prepare();
+	//On the main thread, returns true once everything is uploaded and created (or the preparation failed)
+	bool advance(double budgetMs);
+	//Replaces the current model by the pending one
+	void finish();
+
+	Material* loadMaterial(const tinygltf::Model& model, int materialIndex);
+	//Decodes (and optimizes) all the primitives of the file on the thread pool, uploadMesh then uploads them one by one.
+	//The primitives already loaded, from the same source or with the same content, reuse the mesh (see MeshManager)
+	//EXT_meshopt_compression views and KHR_draco_mesh_compression primitives, decoded in parallel into m_decodedBuffers.
+	//The views and accessors are redirected to the decoded buffers, the mesh path then reads them as the other ones.
+	bool decodeCompressedGeometry(AsyncLoad& load);
+	void prepareMeshes(AsyncLoad& load);
+	void uploadMesh(AsyncLoad& load, size_t jobIndex);
+	//False on a miss: the jobs are then untouched
+	bool readCookedMeshes(AsyncLoad& load, const std::string& entry);
+	void writeCookedMeshes(const AsyncLoad& load, const std::string& entry) const;
+	void loadMesh(const tinygltf::Model& model, int meshIndex, entt::entity parent, Issam::Scene* scene);
+	//The children are queued in the pending load, created by the next steps
 	void loadNode(const tinygltf::Model& model, const tinygltf::Node& gltfNode, entt::entity entity, Issam::Scene* scene, int idx);
 
 private:
 	Issam::Scene* m_scene;
-	entt::entity m_entity;
+	entt::entity m_entity = entt::null;
 	std::unordered_map<int, std::string> m_sourceToId;
+	std::unordered_map<int, TextureView> m_textureViews; //Per image source, until the TextureManager takes them when the model is shown
+	std::unordered_map<int, uint32_t> m_streamedIds; //Per image source, the TextureStreamer ids
+	std::unordered_map<int, Texture> m_textures; //Per image source uploaded whole, until the TextureManager takes them
+	std::unordered_map<int, TextureManager::Loader> m_textureLoaders; //Same sources, to load them again after an eviction
+	bool m_texturesRegistered = false;
+	std::vector<std::pair<entt::entity, Issam::Filters>> m_hiddenFilters; //Without filters, no pass draws the entities yet
+	std::unordered_map<int, Material*> m_materials;
+	std::vector<std::vector<MeshPtr>> m_meshes; //Per glTF mesh and primitive, shared by the nodes
+	std::vector<std::vector<ImpostorPtr>> m_impostors; //Same indexing, baked on first use
+	std::string m_filepath;
+	std::unique_ptr<GlbFile> m_glb; //Mapped while a .glb loads
+	BufferSpans m_buffers;
+	std::vector<std::vector<uint8_t>> m_decodedBuffers; //Compressed geometry, decoded and appended to m_buffers
+	std::unique_ptr<GltfLoader> m_pending; //Load in progress, replaces this model when complete
+	std::unique_ptr<AsyncLoad> m_async; //Only set on a pending loader
+	bool m_staticBatching = false;
+	bool m_quantizeVertices = false;
+	bool m_splitPositions = false;
+	bool m_optimizeMeshes = false;
+	bool m_generateMeshlets = false;
+	bool m_generateLods = false;
+	bool m_generateImpostors = false;
+	bool m_assetCache = true;
+	bool m_compressTextures = false;
+	BcEncoder::Quality m_textureQuality = BcEncoder::Quality::High;
+	bool m_streamTextures = false;
+	bool m_packTextures = false;
+	bool m_defragmentPool = false; //Meshes were released, the GeometryPool is compacted by update
 };
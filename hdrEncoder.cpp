@@ -0,0 +1,188 @@
+#include "hdrEncoder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "mipBuilder.h"
+#include "threadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define HDR_ENCODER_SSE2
+#endif
+
+namespace
+{
+	constexpr float c_rgb9e5Max = 65408.0f; //(2^9 - 1) / 2^9 * 2^(31 - 15)
+
+	uint16_t floatToHalf(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, 4);
+		const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+		const float magnitude = std::abs(value);
+		if (value != value) return sign | 0x7e00;
+		if (magnitude >= 65520.0f) return sign | 0x7c00;
+		if (magnitude < 6.103515625e-05f) return sign | static_cast<uint16_t>(std::lrint(magnitude * 16777216.0f));
+		//Round to nearest even on the 13 dropped bits, a carry goes into the exponent
+		uint32_t magnitudeBits = bits & 0x7fffffffu;
+		magnitudeBits += 0xfffu + ((magnitudeBits >> 13) & 1u);
+		return sign | static_cast<uint16_t>((magnitudeBits >> 13) - (112u << 10));
+	}
+
+#ifdef HDR_ENCODER_SSE2
+	//Same rounding as floatToHalf, for 4 positive floats (the colors are clamped at 0 before)
+	__m128i floatToHalf4(__m128 values)
+	{
+		const __m128i bits = _mm_castps_si128(values);
+		//Normal halves: round to nearest even on the 13 dropped bits, rebias the exponent
+		const __m128i odd = _mm_and_si128(_mm_srli_epi32(bits, 13), _mm_set1_epi32(1));
+		const __m128i rounded = _mm_add_epi32(_mm_add_epi32(bits, _mm_set1_epi32(0xfff)), odd);
+		const __m128i normal = _mm_srli_epi32(_mm_sub_epi32(rounded, _mm_set1_epi32(112 << 23)), 13);
+		//Subnormal halves: multiples of 2^-24, rounded to nearest even by the conversion
+		const __m128i subnormal = _mm_cvtps_epi32(_mm_mul_ps(values, _mm_set1_ps(16777216.0f)));
+		const __m128i isSubnormal = _mm_cmplt_epi32(bits, _mm_set1_epi32(0x38800000));
+		const __m128i isInfinite = _mm_cmpgt_epi32(bits, _mm_set1_epi32(0x477fefff));
+		const __m128i isNan = _mm_cmpgt_epi32(bits, _mm_set1_epi32(0x7f800000));
+		__m128i halves = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+		halves = _mm_or_si128(_mm_and_si128(isInfinite, _mm_set1_epi32(0x7c00)), _mm_andnot_si128(isInfinite, halves));
+		return _mm_or_si128(_mm_and_si128(isNan, _mm_set1_epi32(0x7e00)), _mm_andnot_si128(isNan, halves));
+	}
+
+	//4 texels, one channel per register
+	__m128i encodeRgb9e54(__m128 r, __m128 g, __m128 b)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 maxValue = _mm_set1_ps(c_rgb9e5Max);
+		//max(x, 0) returns 0 for NaN
+		r = _mm_min_ps(_mm_max_ps(r, zero), maxValue);
+		g = _mm_min_ps(_mm_max_ps(g, zero), maxValue);
+		b = _mm_min_ps(_mm_max_ps(b, zero), maxValue);
+		const __m128 maxChannel = _mm_max_ps(_mm_max_ps(r, g), b);
+
+		//Shared exponent: max(floor(log2(maxChannel)), -16) + 16, from the float exponent
+		__m128i exponent = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(maxChannel), 23), _mm_set1_epi32(127 - 16));
+		exponent = _mm_and_si128(exponent, _mm_cmpgt_epi32(exponent, _mm_setzero_si128()));
+		//Scale 2^(24 - exponent), built from its bits
+		__m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(127 + 24), exponent), 23));
+		const __m128 half = _mm_set1_ps(0.5f);
+		//The rounding of the largest channel can reach 512, the exponent is then one more
+		const __m128i maxMantissa = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(maxChannel, scale), half));
+		const __m128i overflow = _mm_cmpeq_epi32(maxMantissa, _mm_set1_epi32(512));
+		exponent = _mm_sub_epi32(exponent, overflow);
+		scale = _mm_mul_ps(scale, _mm_or_ps(_mm_and_ps(_mm_castsi128_ps(overflow), half), _mm_andnot_ps(_mm_castsi128_ps(overflow), _mm_set1_ps(1.0f))));
+
+		const __m128i red = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(r, scale), half));
+		const __m128i green = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(g, scale), half));
+		const __m128i blue = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(b, scale), half));
+		return _mm_or_si128(_mm_or_si128(red, _mm_slli_epi32(green, 9)), _mm_or_si128(_mm_slli_epi32(blue, 18), _mm_slli_epi32(exponent, 27)));
+	}
+#endif
+
+	void encodeRowHalf(const float* source, uint16_t* destination, size_t count)
+	{
+		size_t i = 0;
+#ifdef HDR_ENCODER_SSE2
+		const __m128 zero = _mm_setzero_ps();
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m128i low = floatToHalf4(_mm_max_ps(_mm_loadu_ps(source + i), zero));
+			const __m128i high = floatToHalf4(_mm_max_ps(_mm_loadu_ps(source + i + 4), zero));
+			//The halves are sign extended so that the signed saturation keeps their bits
+			const __m128i packed = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(low, 16), 16), _mm_srai_epi32(_mm_slli_epi32(high, 16), 16));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i), packed);
+		}
+#endif
+		for (; i < count; ++i)
+			destination[i] = floatToHalf(source[i] > 0.0f ? source[i] : 0.0f);
+	}
+
+	void encodeRowRgb9e5(const float* source, uint32_t* destination, size_t texelCount)
+	{
+		size_t x = 0;
+#ifdef HDR_ENCODER_SSE2
+		for (; x + 4 <= texelCount; x += 4)
+		{
+			__m128 r = _mm_loadu_ps(source + 4 * x);
+			__m128 g = _mm_loadu_ps(source + 4 * x + 4);
+			__m128 b = _mm_loadu_ps(source + 4 * x + 8);
+			__m128 a = _mm_loadu_ps(source + 4 * x + 12);
+			_MM_TRANSPOSE4_PS(r, g, b, a);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x), encodeRgb9e54(r, g, b));
+		}
+#endif
+		for (; x < texelCount; ++x)
+			destination[x] = HdrEncoder::encodeRgb9e5(source[4 * x], source[4 * x + 1], source[4 * x + 2]);
+	}
+}
+
+bool HdrEncoder::supports(TextureFormat format)
+{
+	return format == TextureFormat::RGB9E5Ufloat || format == TextureFormat::RGBA16Float || format == TextureFormat::RGBA32Float;
+}
+
+uint32_t HdrEncoder::encodeRgb9e5(float r, float g, float b)
+{
+	//EXT_texture_shared_exponent, with the rounding of the largest channel checked
+	r = std::min(r > 0.0f ? r : 0.0f, c_rgb9e5Max);
+	g = std::min(g > 0.0f ? g : 0.0f, c_rgb9e5Max);
+	b = std::min(b > 0.0f ? b : 0.0f, c_rgb9e5Max);
+	const float maxChannel = std::max({ r, g, b });
+	uint32_t bits;
+	memcpy(&bits, &maxChannel, 4);
+	int exponent = std::max(int(bits >> 23) - 127, -16) + 16;
+	float scale = std::ldexp(1.0f, 24 - exponent);
+	if (static_cast<uint32_t>(maxChannel * scale + 0.5f) == 512)
+	{
+		exponent++;
+		scale *= 0.5f;
+	}
+	const uint32_t red = static_cast<uint32_t>(r * scale + 0.5f);
+	const uint32_t green = static_cast<uint32_t>(g * scale + 0.5f);
+	const uint32_t blue = static_cast<uint32_t>(b * scale + 0.5f);
+	return red | (green << 9) | (blue << 18) | (uint32_t(exponent) << 27);
+}
+
+void HdrEncoder::decodeRgb9e5(uint32_t packed, float* rgb)
+{
+	const float scale = std::ldexp(1.0f, int(packed >> 27) - 24);
+	rgb[0] = (packed & 0x1ff) * scale;
+	rgb[1] = ((packed >> 9) & 0x1ff) * scale;
+	rgb[2] = ((packed >> 18) & 0x1ff) * scale;
+}
+
+bool HdrEncoder::encode(Utils::ImageData& image, TextureFormat format, double* pMilliseconds)
+{
+	if (image.format != TextureFormat::RGBA32Float || !supports(format) || image.levels.empty())
+		return false;
+	if (format == TextureFormat::RGBA32Float)
+		return true;
+	auto start = std::chrono::steady_clock::now();
+	//No storage binding for RGB9E5Ufloat, so no GPU mips
+	if (format == TextureFormat::RGB9E5Ufloat && image.levels.size() == 1)
+		MipBuilder::build(image);
+
+	const uint32_t texelBytes = Utils::getFormatBlock(format).bytes;
+	for (uint32_t level = 0; level < image.levels.size(); ++level)
+	{
+		const uint32_t width = std::max(uint32_t(image.width) >> level, 1u);
+		const uint32_t height = std::max(uint32_t(image.height) >> level, 1u);
+		const std::vector<uint8_t>& source = image.levels[level];
+		std::vector<uint8_t> destination(size_t(width) * height * texelBytes);
+		ThreadPool::getInstance().parallelFor(height, [&](size_t y) {
+			const float* sourceRow = reinterpret_cast<const float*>(source.data()) + y * width * 4;
+			if (format == TextureFormat::RGB9E5Ufloat)
+				encodeRowRgb9e5(sourceRow, reinterpret_cast<uint32_t*>(destination.data()) + y * width, width);
+			else
+				encodeRowHalf(sourceRow, reinterpret_cast<uint16_t*>(destination.data()) + y * width * 4, size_t(width) * 4);
+		});
+		image.levels[level] = std::move(destination);
+	}
+	image.format = format;
+
+	if (pMilliseconds)
+		*pMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "utils.h"
+
+// Compact formats for the HDR images (environment maps), decoded by stb_image as RGBA32Float:
+// RGB9E5Ufloat (4 bytes, shared exponent, no alpha) or RGBA16Float (8 bytes). Both are filterable without the
+// Float32Filterable feature. The rows are converted in parallel on the ThreadPool, the texels with SSE2 when available.
+// RGB9E5Ufloat is not a storage format, its mips are built on the CPU in float before the conversion
+// (RGBA16Float gets them from MipGenerator at upload).
+class HdrEncoder
+{
+public:
+	//RGB9E5Ufloat, RGBA16Float, or RGBA32Float to keep the image as it is
+	static bool supports(TextureFormat format);
+
+	//Converts every level of an RGBA32Float image. False, with the image untouched, when it is not RGBA32Float or
+	//the format is not supported. The negative and NaN colors become 0. The milliseconds spent are added to pMilliseconds.
+	static bool encode(Utils::ImageData& image, TextureFormat format, double* pMilliseconds = nullptr);
+
+	static uint32_t encodeRgb9e5(float r, float g, float b);
+	static void decodeRgb9e5(uint32_t packed, float* rgb);
+};
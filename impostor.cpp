@@ -0,0 +1,666 @@
+#include "impostor.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+#include "assetCache.h"
+#include "material.h"
+#include "utils.h"
+
+namespace
+{
+	//Mirrors Frame in impostorBake.wgsl
+	struct BakeFrame {
+		glm::mat4 viewProj;
+		glm::mat4 view;
+	};
+
+	//Mirrors Uniforms in impostor.wgsl
+	struct ImpostorUniforms {
+		glm::mat4 viewProj;
+		glm::vec4 lightDirection;
+	};
+
+	//The AssetCache checks its entries, the header only has to match the atlas layout of this build
+	struct CacheHeader {
+		uint32_t version;
+		uint32_t grid;
+		uint32_t frameSize;
+		float center[3];
+		float radius;
+	};
+
+	constexpr uint32_t c_cacheVersion = 2;
+	constexpr TextureFormat c_atlasFormat = TextureFormat::RGBA8Unorm;
+	constexpr TextureFormat c_bakeDepthFormat = TextureFormat::Depth24Plus;
+	constexpr uint64_t c_atlasBytes = uint64_t(ImpostorAtlas::c_atlasSize) * ImpostorAtlas::c_atlasSize * 4;
+
+	float signNotZero(float value) { return value >= 0.0f ? 1.0f : -1.0f; }
+
+	Buffer createBuffer(const char* label, BufferUsage usage, uint64_t size)
+	{
+		BufferDescriptor bufferDesc;
+		bufferDesc.label = label;
+		bufferDesc.usage = usage;
+		bufferDesc.size = std::max<uint64_t>((size + 3) & ~uint64_t(3), 4);
+		bufferDesc.mappedAtCreation = false;
+		return Context::getInstance().getDevice().CreateBuffer(&bufferDesc);
+	}
+
+	Texture createAtlasTexture(const char* label, TextureFormat format, TextureUsage usage)
+	{
+		TextureDescriptor textureDesc;
+		textureDesc.label = label;
+		textureDesc.dimension = TextureDimension::e2D;
+		textureDesc.format = format;
+		textureDesc.mipLevelCount = 1;
+		textureDesc.sampleCount = 1;
+		textureDesc.size = { ImpostorAtlas::c_atlasSize, ImpostorAtlas::c_atlasSize, 1 };
+		textureDesc.usage = usage;
+		textureDesc.viewFormatCount = 0;
+		textureDesc.viewFormats = nullptr;
+		return Context::getInstance().getDevice().CreateTexture(&textureDesc);
+	}
+
+	Sampler createClampSampler()
+	{
+		SamplerDescriptor samplerDesc;
+		samplerDesc.addressModeU = AddressMode::ClampToEdge;
+		samplerDesc.addressModeV = AddressMode::ClampToEdge;
+		samplerDesc.addressModeW = AddressMode::ClampToEdge;
+		samplerDesc.magFilter = FilterMode::Linear;
+		samplerDesc.minFilter = FilterMode::Linear;
+		samplerDesc.mipmapFilter = MipmapFilterMode::Nearest;
+		samplerDesc.lodMinClamp = 0.0f;
+		samplerDesc.lodMaxClamp = 1.0f;
+		samplerDesc.compare = CompareFunction::Undefined;
+		samplerDesc.maxAnisotropy = 1;
+		return Context::getInstance().getDevice().CreateSampler(&samplerDesc);
+	}
+
+	ShaderModule createShaderModule(const std::string& code)
+	{
+		ShaderModuleDescriptor shaderDesc;
+		ShaderModuleWGSLDescriptor shaderCodeDesc;
+		shaderDesc.nextInChain = &shaderCodeDesc;
+		shaderCodeDesc.code = code.c_str();
+		ShaderModule shaderModule = Context::getInstance().getDevice().CreateShaderModule(&shaderDesc);
+		assert(shaderModule);
+		return shaderModule;
+	}
+
+	//Blocks until the GPU has copied the atlas, only used to fill the disk cache
+	bool readAtlas(const Texture& texture, std::vector<uint8_t>& pixels)
+	{
+		Device device = Context::getInstance().getDevice();
+		Buffer buffer = createBuffer("impostorReadback", BufferUsage::MapRead | BufferUsage::CopyDst, c_atlasBytes);
+
+		ImageCopyTexture source;
+		source.texture = texture;
+		ImageCopyBuffer destination;
+		destination.buffer = buffer;
+		destination.layout.bytesPerRow = ImpostorAtlas::c_atlasSize * 4; //Multiple of 256
+		destination.layout.rowsPerImage = ImpostorAtlas::c_atlasSize;
+		Extent3D size = { ImpostorAtlas::c_atlasSize, ImpostorAtlas::c_atlasSize, 1 };
+		CommandEncoder encoder = device.CreateCommandEncoder();
+		encoder.CopyTextureToBuffer(&source, &destination, &size);
+		CommandBuffer command = encoder.Finish();
+		device.GetQueue().Submit(1, &command);
+
+		struct MapRequest {
+			bool done = false;
+			bool success = false;
+		} request;
+		auto onMapped = [](WGPUBufferMapAsyncStatus status, void* userdata) {
+			MapRequest* request = static_cast<MapRequest*>(userdata);
+			request->done = true;
+			request->success = status == WGPUBufferMapAsyncStatus_Success;
+		};
+		buffer.MapAsync(MapMode::Read, 0, c_atlasBytes, onMapped, &request);
+		while (!request.done)
+			device.Tick();
+		if (!request.success) return false;
+
+		const uint8_t* data = static_cast<const uint8_t*>(buffer.GetConstMappedRange(0, c_atlasBytes));
+		pixels.assign(data, data + c_atlasBytes);
+		buffer.Unmap();
+		return true;
+	}
+
+	void writeAtlas(const Texture& texture, const uint8_t* pixels)
+	{
+		ImageCopyTexture destination;
+		destination.texture = texture;
+		destination.mipLevel = 0;
+		destination.origin = { 0, 0, 0 };
+		destination.aspect = TextureAspect::All;
+		TextureDataLayout source;
+		source.offset = 0;
+		source.bytesPerRow = ImpostorAtlas::c_atlasSize * 4;
+		source.rowsPerImage = ImpostorAtlas::c_atlasSize;
+		Extent3D size = { ImpostorAtlas::c_atlasSize, ImpostorAtlas::c_atlasSize, 1 };
+		Context::getInstance().getDevice().GetQueue().WriteTexture(&destination, pixels, c_atlasBytes, &source, &size);
+	}
+}
+
+//Octahedral mapping of the sphere on the square, the lower hemisphere is folded on the corners
+glm::vec3 ImpostorAtlas::getFrameDirection(uint32_t x, uint32_t y)
+{
+	glm::vec2 p = (glm::vec2(x, y) + 0.5f) / float(c_grid) * 2.0f - 1.0f;
+	glm::vec3 direction(p.x, 1.0f - std::abs(p.x) - std::abs(p.y), p.y);
+	if (direction.y < 0.0f)
+	{
+		direction.x = (1.0f - std::abs(p.y)) * signNotZero(p.x);
+		direction.z = (1.0f - std::abs(p.x)) * signNotZero(p.y);
+	}
+	return glm::normalize(direction);
+}
+
+glm::uvec2 ImpostorAtlas::getNearestFrame(const glm::vec3& direction)
+{
+	glm::vec3 d = direction / (std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z));
+	glm::vec2 p(d.x, d.z);
+	if (d.y < 0.0f)
+		p = glm::vec2((1.0f - std::abs(d.z)) * signNotZero(d.x), (1.0f - std::abs(d.x)) * signNotZero(d.z));
+	glm::vec2 uv = p * 0.5f + 0.5f;
+	return glm::uvec2(glm::min(glm::uvec2(glm::max(uv, 0.0f) * float(c_grid)), glm::uvec2(c_grid - 1)));
+}
+
+glm::mat3 ImpostorAtlas::getFrameBasis(const glm::vec3& direction)
+{
+	glm::vec3 forward = -direction;
+	glm::vec3 up = std::abs(direction.y) > 0.999f ? glm::vec3(0.0, 0.0, 1.0) : glm::vec3(0.0, 1.0, 0.0);
+	glm::vec3 right = glm::normalize(glm::cross(up, forward));
+	up = glm::cross(forward, right);
+	return glm::mat3(right, up, forward);
+}
+
+glm::mat4 ImpostorAtlas::getFrameViewProj(uint32_t x, uint32_t y) const
+{
+	glm::mat3 basis = getFrameBasis(getFrameDirection(x, y));
+	glm::mat4 viewProj(1.0);
+	for (int i = 0; i < 3; ++i)
+		viewProj[i] = glm::vec4(basis[0][i] / radius, basis[1][i] / radius, basis[2][i] / (2.0f * radius), 0.0f);
+	viewProj[3] = glm::vec4(-glm::dot(basis[0], center) / radius, -glm::dot(basis[1], center) / radius, (radius - glm::dot(basis[2], center)) / (2.0f * radius), 1.0f);
+	return viewProj;
+}
+
+ImpostorBaker::ImpostorBaker()
+{
+	Device device = Context::getInstance().getDevice();
+	ShaderModule shaderModule = createShaderModule(Utils::loadFile(DATA_DIR "/impostorBake.wgsl"));
+
+	//The standard layout, whatever the layout of the pooled vertices
+	std::vector<VertexAttribute> vertexAttributes(3);
+	vertexAttributes[0].shaderLocation = VertexLayout::getShaderLocation(VertexSemantic::Position);
+	vertexAttributes[0].format = VertexFormat::Float32x3;
+	vertexAttributes[0].offset = offsetof(Vertex, position);
+	vertexAttributes[1].shaderLocation = VertexLayout::getShaderLocation(VertexSemantic::Normal);
+	vertexAttributes[1].format = VertexFormat::Float32x3;
+	vertexAttributes[1].offset = offsetof(Vertex, normal);
+	vertexAttributes[2].shaderLocation = VertexLayout::getShaderLocation(VertexSemantic::TexCoord);
+	vertexAttributes[2].format = VertexFormat::Float32x2;
+	vertexAttributes[2].offset = offsetof(Vertex, uv);
+	VertexBufferLayout vertexBufferLayout;
+	vertexBufferLayout.attributeCount = vertexAttributes.size();
+	vertexBufferLayout.attributes = vertexAttributes.data();
+	vertexBufferLayout.arrayStride = sizeof(Vertex);
+	vertexBufferLayout.stepMode = VertexStepMode::Vertex;
+
+	RenderPipelineDescriptor pipelineDesc;
+	pipelineDesc.label = "impostorBake";
+	pipelineDesc.layout = nullptr; //auto
+	pipelineDesc.vertex.module = shaderModule;
+	pipelineDesc.vertex.entryPoint = "vs_main";
+	pipelineDesc.vertex.constantCount = 0;
+	pipelineDesc.vertex.constants = nullptr;
+	pipelineDesc.vertex.bufferCount = 1;
+	pipelineDesc.vertex.buffers = &vertexBufferLayout;
+
+	pipelineDesc.primitive.topology = PrimitiveTopology::TriangleList;
+	pipelineDesc.primitive.stripIndexFormat = IndexFormat::Undefined;
+	pipelineDesc.primitive.frontFace = FrontFace::CCW;
+	pipelineDesc.primitive.cullMode = CullMode::None;
+
+	std::vector<ColorTargetState> colorTargets(2);
+	colorTargets[0].format = c_atlasFormat;
+	colorTargets[0].writeMask = ColorWriteMask::All;
+	colorTargets[1].format = c_atlasFormat;
+	colorTargets[1].writeMask = ColorWriteMask::All;
+	FragmentState fragmentState;
+	fragmentState.module = shaderModule;
+	fragmentState.entryPoint = "fs_main";
+	fragmentState.constantCount = 0;
+	fragmentState.constants = nullptr;
+	fragmentState.targetCount = colorTargets.size();
+	fragmentState.targets = colorTargets.data();
+	pipelineDesc.fragment = &fragmentState;
+
+	DepthStencilState depthStencilState = {};
+	depthStencilState.depthCompare = CompareFunction::Less;
+	depthStencilState.depthWriteEnabled = true;
+	depthStencilState.format = c_bakeDepthFormat;
+	pipelineDesc.depthStencil = &depthStencilState;
+
+	pipelineDesc.multisample.count = 1;
+	pipelineDesc.multisample.mask = ~0u;
+	pipelineDesc.multisample.alphaToCoverageEnabled = false;
+	m_pipeline = device.CreateRenderPipeline(&pipelineDesc);
+
+	m_sampler = Utils::createDefaultSampler();
+	Utils::CreateWhiteTexture(&m_whiteTexture);
+	m_depthBuffer = createAtlasTexture("impostorBakeDepth", c_bakeDepthFormat, TextureUsage::RenderAttachment);
+}
+
+ImpostorPtr ImpostorBaker::bake(const Mesh& mesh, Material* material, uint64_t asset, const std::string& entry)
+{
+	if (mesh.getVertices().empty()) return nullptr;
+
+	glm::vec3 boxMin = glm::vec3(std::numeric_limits<float>::max());
+	glm::vec3 boxMax = glm::vec3(std::numeric_limits<float>::lowest());
+	for (const Vertex& vertex : mesh.getVertices())
+	{
+		boxMin = glm::min(boxMin, vertex.position);
+		boxMax = glm::max(boxMax, vertex.position);
+	}
+	glm::vec3 center = (boxMin + boxMax) * 0.5f;
+	float radius = 0.0f;
+	for (const Vertex& vertex : mesh.getVertices())
+		radius = std::max(radius, glm::length(vertex.position - center));
+	if (radius <= 0.0f) return nullptr;
+
+	ImpostorPtr atlas = createAtlas(center, radius);
+	if (asset && loadFromCache(asset, entry, *atlas))
+		return atlas;
+
+	render(mesh, material, *atlas);
+	if (asset)
+		saveToCache(asset, entry, *atlas);
+	return atlas;
+}
+
+ImpostorPtr ImpostorBaker::createAtlas(const glm::vec3& center, float radius)
+{
+	ImpostorPtr atlas = std::make_shared<ImpostorAtlas>();
+	atlas->center = center;
+	atlas->radius = radius;
+	TextureUsage usage = TextureUsage::RenderAttachment | TextureUsage::TextureBinding | TextureUsage::CopySrc | TextureUsage::CopyDst;
+	atlas->albedo = createAtlasTexture("impostorAlbedo", c_atlasFormat, usage);
+	atlas->normalDepth = createAtlasTexture("impostorNormalDepth", c_atlasFormat, usage);
+	atlas->albedoView = atlas->albedo.CreateView();
+	atlas->normalDepthView = atlas->normalDepth.CreateView();
+	return atlas;
+}
+
+void ImpostorBaker::render(const Mesh& mesh, Material* material, ImpostorAtlas& atlas)
+{
+	Device device = Context::getInstance().getDevice();
+	Queue queue = device.GetQueue();
+
+	//Own copies in the standard layout, the pooled vertices may be quantized or split in streams
+	const std::vector<Vertex>& vertices = mesh.getVertices();
+	const std::vector<uint32_t>& indices = mesh.getIndices();
+	Buffer vertexBuffer = createBuffer("impostorVertices", BufferUsage::Vertex | BufferUsage::CopyDst, vertices.size() * sizeof(Vertex));
+	queue.WriteBuffer(vertexBuffer, 0, vertices.data(), vertices.size() * sizeof(Vertex));
+	Buffer indexBuffer{ nullptr };
+	if (!indices.empty())
+	{
+		indexBuffer = createBuffer("impostorIndices", BufferUsage::Index | BufferUsage::CopyDst, indices.size() * sizeof(uint32_t));
+		queue.WriteBuffer(indexBuffer, 0, indices.data(), indices.size() * sizeof(uint32_t));
+	}
+
+	std::vector<BakeFrame> frames;
+	for (uint32_t y = 0; y < ImpostorAtlas::c_grid; ++y)
+	{
+		for (uint32_t x = 0; x < ImpostorAtlas::c_grid; ++x)
+		{
+			glm::mat3 basis = ImpostorAtlas::getFrameBasis(ImpostorAtlas::getFrameDirection(x, y));
+			BakeFrame frame;
+			frame.viewProj = atlas.getFrameViewProj(x, y);
+			frame.view = glm::mat4(glm::transpose(basis));
+			frames.push_back(frame);
+		}
+	}
+	Buffer frameBuffer = createBuffer("impostorFrames", BufferUsage::Storage | BufferUsage::CopyDst, frames.size() * sizeof(BakeFrame));
+	queue.WriteBuffer(frameBuffer, 0, frames.data(), frames.size() * sizeof(BakeFrame));
+
+	glm::vec4 baseColorFactor = glm::vec4(1.0);
+	TextureView baseColorTexture = m_whiteTexture;
+	if (material && material->hasAttribute("baseColorFactor"))
+		baseColorFactor = std::get<glm::vec4>(material->getUniform("baseColorFactor"));
+	if (material && material->hasAttribute("baseColorTexture"))
+		baseColorTexture = std::get<TextureView>(material->getAttribute("baseColorTexture").value);
+	Buffer materialBuffer = createBuffer("impostorMaterial", BufferUsage::Uniform | BufferUsage::CopyDst, sizeof(glm::vec4));
+	queue.WriteBuffer(materialBuffer, 0, &baseColorFactor, sizeof(glm::vec4));
+
+	std::vector<BindGroupEntry> entries(4);
+	entries[0].binding = 0;
+	entries[0].buffer = frameBuffer;
+	entries[0].size = frames.size() * sizeof(BakeFrame);
+	entries[1].binding = 1;
+	entries[1].buffer = materialBuffer;
+	entries[1].size = sizeof(glm::vec4);
+	entries[2].binding = 2;
+	entries[2].textureView = baseColorTexture;
+	entries[3].binding = 3;
+	entries[3].sampler = m_sampler;
+	BindGroupDescriptor bindGroupDesc;
+	bindGroupDesc.label = "impostorBake";
+	bindGroupDesc.layout = m_pipeline.GetBindGroupLayout(0);
+	bindGroupDesc.entryCount = entries.size();
+	bindGroupDesc.entries = entries.data();
+	BindGroup bindGroup = device.CreateBindGroup(&bindGroupDesc);
+
+	std::vector<RenderPassColorAttachment> colorAttachments(2);
+	colorAttachments[0].view = atlas.albedoView;
+	colorAttachments[0].loadOp = LoadOp::Clear;
+	colorAttachments[0].storeOp = StoreOp::Store;
+	colorAttachments[0].clearValue = Color{ 0.0, 0.0, 0.0, 0.0 };
+	colorAttachments[1].view = atlas.normalDepthView;
+	colorAttachments[1].loadOp = LoadOp::Clear;
+	colorAttachments[1].storeOp = StoreOp::Store;
+	colorAttachments[1].clearValue = Color{ 0.5, 0.5, 0.5, 1.0 };
+
+	RenderPassDepthStencilAttachment depthAttachment;
+	depthAttachment.view = m_depthBuffer.CreateView();
+	depthAttachment.depthClearValue = 1.0f;
+	depthAttachment.depthLoadOp = LoadOp::Clear;
+	depthAttachment.depthStoreOp = StoreOp::Discard;
+	depthAttachment.depthReadOnly = false;
+	depthAttachment.stencilLoadOp = LoadOp::Undefined;
+	depthAttachment.stencilStoreOp = StoreOp::Undefined;
+	depthAttachment.stencilReadOnly = true;
+
+	RenderPassDescriptor renderPassDesc;
+	renderPassDesc.label = "impostorBake";
+	renderPassDesc.colorAttachmentCount = colorAttachments.size();
+	renderPassDesc.colorAttachments = colorAttachments.data();
+	renderPassDesc.depthStencilAttachment = &depthAttachment;
+	renderPassDesc.timestampWrites = nullptr;
+
+	CommandEncoder encoder = device.CreateCommandEncoder();
+	RenderPassEncoder renderPass = encoder.BeginRenderPass(&renderPassDesc);
+	renderPass.SetPipeline(m_pipeline);
+	renderPass.SetBindGroup(0, bindGroup, 0, nullptr);
+	renderPass.SetVertexBuffer(0, vertexBuffer);
+	if (indexBuffer)
+		renderPass.SetIndexBuffer(indexBuffer, IndexFormat::Uint32);
+	//One viewport per frame, the instance index selects the matrices of the frame
+	for (uint32_t y = 0; y < ImpostorAtlas::c_grid; ++y)
+	{
+		for (uint32_t x = 0; x < ImpostorAtlas::c_grid; ++x)
+		{
+			const float size = static_cast<float>(ImpostorAtlas::c_frameSize);
+			renderPass.SetViewport(x * size, y * size, size, size, 0.0f, 1.0f);
+			const uint32_t frame = y * ImpostorAtlas::c_grid + x;
+			if (indexBuffer)
+				renderPass.DrawIndexed(static_cast<uint32_t>(indices.size()), 1, 0, 0, frame);
+			else
+				renderPass.Draw(static_cast<uint32_t>(vertices.size()), 1, 0, frame);
+		}
+	}
+	renderPass.End();
+	CommandBuffer command = encoder.Finish();
+	queue.Submit(1, &command);
+}
+
+bool ImpostorBaker::loadFromCache(uint64_t asset, const std::string& entry, ImpostorAtlas& atlas)
+{
+	MappedFile file;
+	ByteSpan payload;
+	if (!AssetCache::getInstance().load(asset, entry, file, payload)) return false;
+
+	BlobReader reader(payload);
+	CacheHeader header;
+	reader.read(header);
+	if (!reader.isValid() || header.version != c_cacheVersion || header.grid != ImpostorAtlas::c_grid
+		|| header.frameSize != ImpostorAtlas::c_frameSize || payload.size != sizeof(header) + c_atlasBytes * 2)
+		return false;
+
+	const uint8_t* pixels = payload.data + sizeof(header);
+	atlas.center = glm::vec3(header.center[0], header.center[1], header.center[2]);
+	atlas.radius = header.radius;
+	writeAtlas(atlas.albedo, pixels);
+	writeAtlas(atlas.normalDepth, pixels + c_atlasBytes);
+	return true;
+}
+
+void ImpostorBaker::saveToCache(uint64_t asset, const std::string& entry, const ImpostorAtlas& atlas)
+{
+	std::vector<uint8_t> albedo, normalDepth;
+	if (!readAtlas(atlas.albedo, albedo) || !readAtlas(atlas.normalDepth, normalDepth))
+	{
+		std::cerr << "Impostor: cannot read back the atlas " << entry << std::endl;
+		return;
+	}
+
+	BlobWriter writer;
+	CacheHeader header = { c_cacheVersion, ImpostorAtlas::c_grid, ImpostorAtlas::c_frameSize,
+		{ atlas.center.x, atlas.center.y, atlas.center.z }, atlas.radius };
+	writer.write(header);
+	std::vector<uint8_t> payload = writer.getBytes();
+	payload.insert(payload.end(), albedo.begin(), albedo.end());
+	payload.insert(payload.end(), normalDepth.begin(), normalDepth.end());
+	if (!AssetCache::getInstance().save(asset, entry, payload))
+		std::cerr << "Impostor: cannot write the atlas " << entry << std::endl;
+}
+
+ImpostorRenderer::ImpostorRenderer()
+{
+	Device device = Context::getInstance().getDevice();
+	m_shaderModule = createShaderModule(Utils::loadFile(DATA_DIR "/impostor.wgsl"));
+
+	//Explicit layouts, so that the atlas bind groups work with the pipelines of all the target formats
+	BindGroupLayoutEntry uniformsEntry;
+	uniformsEntry.binding = 0;
+	uniformsEntry.visibility = ShaderStage::Vertex | ShaderStage::Fragment;
+	uniformsEntry.buffer.type = BufferBindingType::Uniform;
+	uniformsEntry.buffer.minBindingSize = sizeof(ImpostorUniforms);
+	BindGroupLayoutDescriptor layoutDesc;
+	layoutDesc.label = "impostorUniforms";
+	layoutDesc.entryCount = 1;
+	layoutDesc.entries = &uniformsEntry;
+	m_uniformsLayout = device.CreateBindGroupLayout(&layoutDesc);
+
+	std::vector<BindGroupLayoutEntry> atlasEntries(3);
+	for (uint32_t binding = 0; binding < 2; ++binding)
+	{
+		atlasEntries[binding].binding = binding;
+		atlasEntries[binding].visibility = ShaderStage::Fragment;
+		atlasEntries[binding].texture.sampleType = TextureSampleType::Float;
+		atlasEntries[binding].texture.viewDimension = TextureViewDimension::e2D;
+	}
+	atlasEntries[2].binding = 2;
+	atlasEntries[2].visibility = ShaderStage::Fragment;
+	atlasEntries[2].sampler.type = SamplerBindingType::Filtering;
+	layoutDesc.label = "impostorAtlas";
+	layoutDesc.entryCount = atlasEntries.size();
+	layoutDesc.entries = atlasEntries.data();
+	m_atlasLayout = device.CreateBindGroupLayout(&layoutDesc);
+
+	std::vector<BindGroupLayout> layouts = { m_uniformsLayout, m_atlasLayout };
+	PipelineLayoutDescriptor pipelineLayoutDesc{};
+	pipelineLayoutDesc.bindGroupLayoutCount = layouts.size();
+	pipelineLayoutDesc.bindGroupLayouts = layouts.data();
+	m_pipelineLayout = device.CreatePipelineLayout(&pipelineLayoutDesc);
+
+	m_sampler = createClampSampler();
+	m_uniforms = createBuffer("impostorUniforms", BufferUsage::Uniform | BufferUsage::CopyDst, sizeof(ImpostorUniforms));
+	BindGroupEntry entry;
+	entry.binding = 0;
+	entry.buffer = m_uniforms;
+	entry.size = sizeof(ImpostorUniforms);
+	BindGroupDescriptor bindGroupDesc;
+	bindGroupDesc.label = "impostorUniforms";
+	bindGroupDesc.layout = m_uniformsLayout;
+	bindGroupDesc.entryCount = 1;
+	bindGroupDesc.entries = &entry;
+	m_uniformsBindGroup = device.CreateBindGroup(&bindGroupDesc);
+}
+
+void ImpostorRenderer::beginFrame(const glm::mat4& viewProj, const glm::vec3& cameraPosition, const glm::vec3& lightDirection)
+{
+	ImpostorUniforms uniforms = { viewProj, glm::vec4(lightDirection, 0.0f) };
+	Context::getInstance().getDevice().GetQueue().WriteBuffer(m_uniforms, 0, &uniforms, sizeof(uniforms));
+	m_cameraPosition = cameraPosition;
+	m_instanceOffset = 0;
+	m_instanceCount = 0;
+	m_batches.clear();
+
+	for (auto it = m_atlasBindGroups.begin(); it != m_atlasBindGroups.end();)
+	{
+		if (it->second.first.expired())
+			it = m_atlasBindGroups.erase(it);
+		else
+			++it;
+	}
+}
+
+void ImpostorRenderer::add(const ImpostorPtr& impostor, const glm::mat4& model)
+{
+	const glm::vec3 center = glm::vec3(model * glm::vec4(impostor->center, 1.0f));
+	const glm::mat3 linear = glm::mat3(model);
+
+	//The frame whose direction is the closest to the camera, in object space
+	glm::vec3 direction = glm::inverse(linear) * (m_cameraPosition - center);
+	if (glm::dot(direction, direction) == 0.0f) direction = glm::vec3(0.0, 0.0, -1.0);
+	const glm::uvec2 frame = ImpostorAtlas::getNearestFrame(glm::normalize(direction));
+	const glm::mat3 basis = ImpostorAtlas::getFrameBasis(ImpostorAtlas::getFrameDirection(frame.x, frame.y));
+
+	Instance instance;
+	instance.center = glm::vec4(center, 1.0f);
+	instance.axisX = glm::vec4(linear * basis[0] * impostor->radius, 0.0f);
+	instance.axisY = glm::vec4(linear * basis[1] * impostor->radius, 0.0f);
+	instance.axisZ = glm::vec4(linear * basis[2] * impostor->radius, 0.0f);
+	instance.frame = glm::vec4(glm::vec2(frame) / float(ImpostorAtlas::c_grid), 1.0f / ImpostorAtlas::c_grid, 0.0f);
+
+	Batch& batch = m_batches[impostor.get()];
+	batch.impostor = impostor;
+	batch.instances.push_back(instance);
+}
+
+void ImpostorRenderer::draw(RenderPassEncoder& renderPass, TextureFormat colorFormat, TextureFormat depthFormat)
+{
+	if (m_batches.empty()) return;
+
+	std::vector<Instance> instances;
+	for (const auto& [atlas, batch] : m_batches)
+		instances.insert(instances.end(), batch.instances.begin(), batch.instances.end());
+
+	//Several passes of the frame may draw impostors, each one writes after the previous ones
+	if (m_instanceOffset + instances.size() > m_instanceCapacity)
+	{
+		m_instanceCapacity = std::max<uint64_t>(m_instanceCapacity * 2, m_instanceOffset + instances.size());
+		m_instanceBuffer = createBuffer("impostorInstances", BufferUsage::Vertex | BufferUsage::CopyDst, m_instanceCapacity * sizeof(Instance));
+		m_instanceOffset = 0;
+	}
+	Context::getInstance().getDevice().GetQueue().WriteBuffer(m_instanceBuffer, m_instanceOffset * sizeof(Instance), instances.data(), instances.size() * sizeof(Instance));
+
+	renderPass.SetPipeline(getPipeline(colorFormat, depthFormat));
+	renderPass.SetBindGroup(0, m_uniformsBindGroup, 0, nullptr);
+	renderPass.SetVertexBuffer(0, m_instanceBuffer);
+	uint32_t firstInstance = static_cast<uint32_t>(m_instanceOffset);
+	for (const auto& [atlas, batch] : m_batches)
+	{
+		renderPass.SetBindGroup(1, getAtlasBindGroup(batch.impostor), 0, nullptr);
+		renderPass.Draw(6, static_cast<uint32_t>(batch.instances.size()), 0, firstInstance);
+		firstInstance += static_cast<uint32_t>(batch.instances.size());
+	}
+
+	m_instanceOffset += instances.size();
+	m_instanceCount += instances.size();
+	m_batches.clear();
+}
+
+RenderPipeline ImpostorRenderer::getPipeline(TextureFormat colorFormat, TextureFormat depthFormat)
+{
+	const uint64_t key = (static_cast<uint64_t>(colorFormat) << 32) | static_cast<uint32_t>(depthFormat);
+	auto it = m_pipelines.find(key);
+	if (it != m_pipelines.end())
+		return it->second;
+
+	std::vector<VertexAttribute> instanceAttributes(5);
+	for (uint32_t location = 0; location < instanceAttributes.size(); ++location)
+	{
+		instanceAttributes[location].shaderLocation = location;
+		instanceAttributes[location].format = VertexFormat::Float32x4;
+		instanceAttributes[location].offset = location * sizeof(glm::vec4);
+	}
+	VertexBufferLayout instanceBufferLayout;
+	instanceBufferLayout.attributeCount = instanceAttributes.size();
+	instanceBufferLayout.attributes = instanceAttributes.data();
+	instanceBufferLayout.arrayStride = sizeof(Instance);
+	instanceBufferLayout.stepMode = VertexStepMode::Instance;
+
+	RenderPipelineDescriptor pipelineDesc;
+	pipelineDesc.label = "impostor";
+	pipelineDesc.layout = m_pipelineLayout;
+	pipelineDesc.vertex.module = m_shaderModule;
+	pipelineDesc.vertex.entryPoint = "vs_main";
+	pipelineDesc.vertex.constantCount = 0;
+	pipelineDesc.vertex.constants = nullptr;
+	pipelineDesc.vertex.bufferCount = 1;
+	pipelineDesc.vertex.buffers = &instanceBufferLayout;
+
+	pipelineDesc.primitive.topology = PrimitiveTopology::TriangleList;
+	pipelineDesc.primitive.stripIndexFormat = IndexFormat::Undefined;
+	pipelineDesc.primitive.frontFace = FrontFace::CCW;
+	pipelineDesc.primitive.cullMode = CullMode::None;
+
+	ColorTargetState colorTarget;
+	colorTarget.format = colorFormat;
+	colorTarget.writeMask = ColorWriteMask::All;
+	FragmentState fragmentState;
+	fragmentState.module = m_shaderModule;
+	fragmentState.entryPoint = "fs_main";
+	fragmentState.constantCount = 0;
+	fragmentState.constants = nullptr;
+	fragmentState.targetCount = 1;
+	fragmentState.targets = &colorTarget;
+	pipelineDesc.fragment = &fragmentState;
+
+	DepthStencilState depthStencilState = {};
+	if (depthFormat != TextureFormat::Undefined)
+	{
+		depthStencilState.depthCompare = CompareFunction::Less;
+		depthStencilState.depthWriteEnabled = true;
+		depthStencilState.format = depthFormat;
+		pipelineDesc.depthStencil = &depthStencilState;
+	}
+	else
+	{
+		pipelineDesc.depthStencil = nullptr;
+	}
+
+	pipelineDesc.multisample.count = 1;
+	pipelineDesc.multisample.mask = ~0u;
+	pipelineDesc.multisample.alphaToCoverageEnabled = false;
+
+	RenderPipeline pipeline = Context::getInstance().getDevice().CreateRenderPipeline(&pipelineDesc);
+	m_pipelines[key] = pipeline;
+	return pipeline;
+}
+
+BindGroup ImpostorRenderer::getAtlasBindGroup(const ImpostorPtr& impostor)
+{
+	auto it = m_atlasBindGroups.find(impostor.get());
+	if (it != m_atlasBindGroups.end() && !it->second.first.expired())
+		return it->second.second;
+
+	std::vector<BindGroupEntry> entries(3);
+	entries[0].binding = 0;
+	entries[0].textureView = impostor->albedoView;
+	entries[1].binding = 1;
+	entries[1].textureView = impostor->normalDepthView;
+	entries[2].binding = 2;
+	entries[2].sampler = m_sampler;
+	BindGroupDescriptor bindGroupDesc;
+	bindGroupDesc.label = "impostorAtlas";
+	bindGroupDesc.layout = m_atlasLayout;
+	bindGroupDesc.entryCount = entries.size();
+	bindGroupDesc.entries = entries.data();
+	BindGroup bindGroup = Context::getInstance().getDevice().CreateBindGroup(&bindGroupDesc);
+	m_atlasBindGroups[impostor.get()] = { impostor, bindGroup };
+	return bindGroup;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "context.h"
+#include "mesh.h"
+
+class Material;
+
+// Appearance of a mesh seen from c_grid x c_grid directions spread on the sphere by an octahedral mapping.
+// Each direction is an orthographic view of the bounding sphere, rendered in one frame of two atlases:
+// albedo + coverage, and view space normal + depth (0 at the front of the sphere, 1 at its back).
+class ImpostorAtlas
+{
+public:
+	static constexpr uint32_t c_grid = 8;
+	static constexpr uint32_t c_frameSize = 128;
+	static constexpr uint32_t c_atlasSize = c_grid * c_frameSize;
+
+	glm::vec3 center = glm::vec3(0.0); //Bounding sphere in object space
+	float radius = 1.0f;
+	Texture albedo{ nullptr };
+	Texture normalDepth{ nullptr };
+	TextureView albedoView{ nullptr };
+	TextureView normalDepthView{ nullptr };
+
+	//Direction from the center toward the viewer of the frame
+	static glm::vec3 getFrameDirection(uint32_t x, uint32_t y);
+	static glm::uvec2 getNearestFrame(const glm::vec3& direction);
+	//Columns: right, up and forward (toward the center) of the view from direction
+	static glm::mat3 getFrameBasis(const glm::vec3& direction);
+	//Object space to the frame, x and y in [-1, 1] on the sphere, z in [0, 1] through it
+	glm::mat4 getFrameViewProj(uint32_t x, uint32_t y) const;
+};
+
+using ImpostorPtr = std::shared_ptr<ImpostorAtlas>;
+
+// Bakes the impostors in an offscreen pass, nothing is presented.
+// The atlases are entries of the AssetCache, under the asset of their source file: a cached impostor is only uploaded,
+// an edited source gets another asset and the atlases are evicted with it.
+class ImpostorBaker
+{
+public:
+	static ImpostorBaker& getInstance() {
+		static ImpostorBaker impostorBaker;
+		return impostorBaker;
+	};
+
+	//Asset 0: no cache. The entry names the impostor in the asset (mesh, primitive and material)
+	ImpostorPtr bake(const Mesh& mesh, Material* material, uint64_t asset = 0, const std::string& entry = "");
+
+private:
+	ImpostorBaker();
+	~ImpostorBaker() = default;
+
+	ImpostorPtr createAtlas(const glm::vec3& center, float radius);
+	void render(const Mesh& mesh, Material* material, ImpostorAtlas& atlas);
+	bool loadFromCache(uint64_t asset, const std::string& entry, ImpostorAtlas& atlas);
+	void saveToCache(uint64_t asset, const std::string& entry, const ImpostorAtlas& atlas);
+
+	RenderPipeline m_pipeline{ nullptr };
+	Sampler m_sampler{ nullptr };
+	TextureView m_whiteTexture{ nullptr };
+	Texture m_depthBuffer{ nullptr };
+};
+
+// Draws the far entities of a pass as quads, instanced per atlas.
+// The instances are gathered during the pass (add) and drawn at its end (draw).
+class ImpostorRenderer
+{
+public:
+	ImpostorRenderer();
+	~ImpostorRenderer() = default;
+
+	void beginFrame(const glm::mat4& viewProj, const glm::vec3& cameraPosition, const glm::vec3& lightDirection);
+	void add(const ImpostorPtr& impostor, const glm::mat4& model);
+	//Draws and clears the gathered instances, the pipeline is created per target formats
+	void draw(RenderPassEncoder& renderPass, TextureFormat colorFormat, TextureFormat depthFormat);
+
+	size_t getInstanceCount() const { return m_instanceCount; }
+
+private:
+	//Mirrors InstanceInput in impostor.wgsl
+	struct Instance {
+		glm::vec4 center;
+		glm::vec4 axisX;
+		glm::vec4 axisY;
+		glm::vec4 axisZ;
+		glm::vec4 frame;
+	};
+
+	RenderPipeline getPipeline(TextureFormat colorFormat, TextureFormat depthFormat);
+	BindGroup getAtlasBindGroup(const ImpostorPtr& impostor);
+
+	ShaderModule m_shaderModule{ nullptr };
+	BindGroupLayout m_uniformsLayout{ nullptr };
+	BindGroupLayout m_atlasLayout{ nullptr };
+	PipelineLayout m_pipelineLayout{ nullptr };
+	std::unordered_map<uint64_t, RenderPipeline> m_pipelines;
+	std::unordered_map<const ImpostorAtlas*, std::pair<std::weak_ptr<ImpostorAtlas>, BindGroup>> m_atlasBindGroups;
+	Sampler m_sampler{ nullptr };
+
+	Buffer m_uniforms{ nullptr };
+	BindGroup m_uniformsBindGroup{ nullptr };
+	Buffer m_instanceBuffer{ nullptr };
+	uint64_t m_instanceCapacity = 0;
+	uint64_t m_instanceOffset = 0; //Instances written this frame, several passes share the buffer
+
+	struct Batch {
+		ImpostorPtr impostor;
+		std::vector<Instance> instances;
+	};
+	glm::vec3 m_cameraPosition = glm::vec3(0.0);
+	std::unordered_map<const ImpostorAtlas*, Batch> m_batches;
+	size_t m_instanceCount = 0;
+};
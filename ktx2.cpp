@@ -0,0 +1,342 @@
+#include "ktx2.h"
+
+#include <climits>
+#include <cstring>
+#include <mutex>
+
+#ifdef USE_BASISU
+#include <basisu_transcoder.h>
+#include <zstd.h>
+#endif
+
+namespace
+{
+	struct Header {
+		uint8_t identifier[12];
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		uint64_t sgdByteOffset;
+		uint64_t sgdByteLength;
+	};
+	static_assert(sizeof(Header) == Ktx2Reader::c_headerSize, "Read as is");
+
+	struct LevelIndex {
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+
+	constexpr uint8_t c_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	//supercompressionScheme
+	constexpr uint32_t c_basisLz = 1;
+	constexpr uint32_t c_zstd = 2;
+	constexpr uint32_t c_zlib = 3;
+
+	//The other textures are RGBA8Unorm whatever their color space, the sRGB formats are read the same way
+	struct VkFormat {
+		uint32_t vkFormat;
+		TextureFormat format;
+		FeatureName feature;
+	};
+	constexpr VkFormat c_formats[] = {
+		{ 131, TextureFormat::BC1RGBAUnorm, FeatureName::TextureCompressionBC }, //VK_FORMAT_BC1_RGB_UNORM_BLOCK
+		{ 132, TextureFormat::BC1RGBAUnorm, FeatureName::TextureCompressionBC },
+		{ 133, TextureFormat::BC1RGBAUnorm, FeatureName::TextureCompressionBC },
+		{ 134, TextureFormat::BC1RGBAUnorm, FeatureName::TextureCompressionBC },
+		{ 135, TextureFormat::BC2RGBAUnorm, FeatureName::TextureCompressionBC },
+		{ 136, TextureFormat::BC2RGBAUnorm, FeatureName::TextureCompressionBC },
+		{ 137, TextureFormat::BC3RGBAUnorm, FeatureName::TextureCompressionBC },
+		{ 138, TextureFormat::BC3RGBAUnorm, FeatureName::TextureCompressionBC },
+		{ 139, TextureFormat::BC4RUnorm, FeatureName::TextureCompressionBC },
+		{ 140, TextureFormat::BC4RSnorm, FeatureName::TextureCompressionBC },
+		{ 141, TextureFormat::BC5RGUnorm, FeatureName::TextureCompressionBC },
+		{ 142, TextureFormat::BC5RGSnorm, FeatureName::TextureCompressionBC },
+		{ 143, TextureFormat::BC6HRGBUfloat, FeatureName::TextureCompressionBC },
+		{ 144, TextureFormat::BC6HRGBFloat, FeatureName::TextureCompressionBC },
+		{ 145, TextureFormat::BC7RGBAUnorm, FeatureName::TextureCompressionBC },
+		{ 146, TextureFormat::BC7RGBAUnorm, FeatureName::TextureCompressionBC },
+		{ 147, TextureFormat::ETC2RGB8Unorm, FeatureName::TextureCompressionETC2 }, //VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK
+		{ 148, TextureFormat::ETC2RGB8Unorm, FeatureName::TextureCompressionETC2 },
+		{ 149, TextureFormat::ETC2RGB8A1Unorm, FeatureName::TextureCompressionETC2 },
+		{ 150, TextureFormat::ETC2RGB8A1Unorm, FeatureName::TextureCompressionETC2 },
+		{ 151, TextureFormat::ETC2RGBA8Unorm, FeatureName::TextureCompressionETC2 },
+		{ 152, TextureFormat::ETC2RGBA8Unorm, FeatureName::TextureCompressionETC2 },
+		{ 153, TextureFormat::EACR11Unorm, FeatureName::TextureCompressionETC2 },
+		{ 154, TextureFormat::EACR11Snorm, FeatureName::TextureCompressionETC2 },
+		{ 155, TextureFormat::EACRG11Unorm, FeatureName::TextureCompressionETC2 },
+		{ 156, TextureFormat::EACRG11Snorm, FeatureName::TextureCompressionETC2 },
+		{ 157, TextureFormat::ASTC4x4Unorm, FeatureName::TextureCompressionASTC }, //VK_FORMAT_ASTC_4x4_UNORM_BLOCK
+		{ 158, TextureFormat::ASTC4x4Unorm, FeatureName::TextureCompressionASTC },
+		{ 159, TextureFormat::ASTC5x4Unorm, FeatureName::TextureCompressionASTC },
+		{ 160, TextureFormat::ASTC5x4Unorm, FeatureName::TextureCompressionASTC },
+		{ 161, TextureFormat::ASTC5x5Unorm, FeatureName::TextureCompressionASTC },
+		{ 162, TextureFormat::ASTC5x5Unorm, FeatureName::TextureCompressionASTC },
+		{ 163, TextureFormat::ASTC6x5Unorm, FeatureName::TextureCompressionASTC },
+		{ 164, TextureFormat::ASTC6x5Unorm, FeatureName::TextureCompressionASTC },
+		{ 165, TextureFormat::ASTC6x6Unorm, FeatureName::TextureCompressionASTC },
+		{ 166, TextureFormat::ASTC6x6Unorm, FeatureName::TextureCompressionASTC },
+		{ 167, TextureFormat::ASTC8x5Unorm, FeatureName::TextureCompressionASTC },
+		{ 168, TextureFormat::ASTC8x5Unorm, FeatureName::TextureCompressionASTC },
+		{ 169, TextureFormat::ASTC8x6Unorm, FeatureName::TextureCompressionASTC },
+		{ 170, TextureFormat::ASTC8x6Unorm, FeatureName::TextureCompressionASTC },
+		{ 171, TextureFormat::ASTC8x8Unorm, FeatureName::TextureCompressionASTC },
+		{ 172, TextureFormat::ASTC8x8Unorm, FeatureName::TextureCompressionASTC },
+		{ 173, TextureFormat::ASTC10x5Unorm, FeatureName::TextureCompressionASTC },
+		{ 174, TextureFormat::ASTC10x5Unorm, FeatureName::TextureCompressionASTC },
+		{ 175, TextureFormat::ASTC10x6Unorm, FeatureName::TextureCompressionASTC },
+		{ 176, TextureFormat::ASTC10x6Unorm, FeatureName::TextureCompressionASTC },
+		{ 177, TextureFormat::ASTC10x8Unorm, FeatureName::TextureCompressionASTC },
+		{ 178, TextureFormat::ASTC10x8Unorm, FeatureName::TextureCompressionASTC },
+		{ 179, TextureFormat::ASTC10x10Unorm, FeatureName::TextureCompressionASTC },
+		{ 180, TextureFormat::ASTC10x10Unorm, FeatureName::TextureCompressionASTC },
+		{ 181, TextureFormat::ASTC12x10Unorm, FeatureName::TextureCompressionASTC },
+		{ 182, TextureFormat::ASTC12x10Unorm, FeatureName::TextureCompressionASTC },
+		{ 183, TextureFormat::ASTC12x12Unorm, FeatureName::TextureCompressionASTC },
+		{ 184, TextureFormat::ASTC12x12Unorm, FeatureName::TextureCompressionASTC },
+	};
+
+	bool readHeader(ByteSpan bytes, Header& header)
+	{
+		if (bytes.size < sizeof(Header)) return false;
+		memcpy(&header, bytes.data, sizeof(Header));
+		return memcmp(header.identifier, c_identifier, sizeof(c_identifier)) == 0;
+	}
+
+	bool hasFeature(const Ktx2Reader::FeatureQuery& hasFeature, FeatureName feature)
+	{
+		return hasFeature ? hasFeature(feature) : Context::getInstance().hasFeature(feature);
+	}
+
+#ifdef USE_BASISU
+	//channel0/1: the source channels of the 1 and 2 channels formats, -1 for the default ones
+	struct TranscodeTarget {
+		basist::transcoder_texture_format transcoder;
+		TextureFormat format;
+		int channel0 = -1;
+		int channel1 = -1;
+	};
+
+	//The BC formats of BcEncoder::selectFormat for each role. The Basis Universal normal maps hold X in RGB and Y in alpha,
+	//without alpha they are plain RGB normal maps.
+	TranscodeTarget selectTarget(const Ktx2Reader::FeatureQuery& query, BcEncoder::Role role, bool alpha, uint32_t width, uint32_t height)
+	{
+		using Format = basist::transcoder_texture_format;
+		const bool normalXY = role == BcEncoder::Role::Normal && alpha;
+		//The block compressed textures need whole blocks at level 0
+		if (width % 4 != 0 || height % 4 != 0)
+			return { Format::cTFRGBA32, TextureFormat::RGBA8Unorm };
+		if (hasFeature(query, FeatureName::TextureCompressionBC))
+		{
+			if (role == BcEncoder::Role::MetallicRoughness) return { Format::cTFBC1_RGB, TextureFormat::BC1RGBAUnorm };
+			if (role == BcEncoder::Role::Mask) return { Format::cTFBC4_R, TextureFormat::BC4RUnorm, 0 };
+			if (normalXY) return { Format::cTFBC5_RG, TextureFormat::BC5RGUnorm, 0, 3 };
+			return { Format::cTFBC7_RGBA, TextureFormat::BC7RGBAUnorm };
+		}
+		if (hasFeature(query, FeatureName::TextureCompressionETC2))
+		{
+			if (role == BcEncoder::Role::Mask) return { Format::cTFETC2_EAC_R11, TextureFormat::EACR11Unorm, 0 };
+			if (normalXY) return { Format::cTFETC2_EAC_RG11, TextureFormat::EACRG11Unorm, 0, 3 };
+			if (alpha && role == BcEncoder::Role::BaseColor) return { Format::cTFETC2_RGBA, TextureFormat::ETC2RGBA8Unorm };
+			//ETC1 blocks are ETC2 blocks
+			return { Format::cTFETC1_RGB, TextureFormat::ETC2RGB8Unorm };
+		}
+		if (hasFeature(query, FeatureName::TextureCompressionASTC))
+			return { Format::cTFASTC_4x4_RGBA, TextureFormat::ASTC4x4Unorm };
+		return { Format::cTFRGBA32, TextureFormat::RGBA8Unorm };
+	}
+
+	Utils::ImageData transcode(ByteSpan bytes, const std::string& name, const Ktx2Reader::FeatureQuery& query, BcEncoder::Role role)
+	{
+		static std::once_flag s_initialized;
+		std::call_once(s_initialized, []() { basist::basisu_transcoder_init(); });
+
+		basist::ktx2_transcoder transcoder;
+		if (bytes.size > UINT32_MAX || !transcoder.init(bytes.data, static_cast<uint32_t>(bytes.size)) || !transcoder.start_transcoding())
+		{
+			std::cerr << "Cannot transcode the KTX2 image " << name << ": invalid Basis Universal data" << std::endl;
+			return {};
+		}
+		const TranscodeTarget target = selectTarget(query, role, transcoder.get_has_alpha(), transcoder.get_width(), transcoder.get_height());
+		const bool uncompressed = basist::basis_transcoder_format_is_uncompressed(target.transcoder);
+		const uint32_t unitBytes = basist::basis_get_bytes_per_block_or_pixel(target.transcoder);
+
+		Utils::ImageData image;
+		image.width = static_cast<int>(transcoder.get_width());
+		image.height = static_cast<int>(transcoder.get_height());
+		image.format = target.format;
+		image.levels.resize(std::max(transcoder.get_levels(), 1u));
+		for (uint32_t level = 0; level < image.levels.size(); ++level)
+		{
+			basist::ktx2_image_level_info info;
+			if (!transcoder.get_image_level_info(info, level, 0, 0))
+				return {};
+			//Pixels in rows tightly packed, or the blocks padding the level
+			const uint32_t units = uncompressed ? info.m_orig_width * info.m_orig_height : info.m_total_blocks;
+			image.levels[level].resize(size_t(units) * unitBytes);
+			if (!transcoder.transcode_image_level(level, 0, 0, image.levels[level].data(), units, target.transcoder, 0, 0, 0, target.channel0, target.channel1))
+			{
+				std::cerr << "Cannot transcode the KTX2 image " << name << ": level " << level << " is invalid" << std::endl;
+				return {};
+			}
+		}
+		return image;
+	}
+#endif
+
+	//Undefined with the reason when the levels cannot be uploaded
+	TextureFormat findFormat(const Header& header, const Ktx2Reader::FeatureQuery& query, BcEncoder::Role role, const char*& reason)
+	{
+		if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 || header.pixelHeight == 0)
+		{
+			reason = "not a 2D texture";
+			return TextureFormat::Undefined;
+		}
+		if (header.vkFormat == 0)
+		{
+#ifdef USE_BASISU
+			if (header.supercompressionScheme > c_zstd)
+			{
+				reason = "Basis Universal payload with an unknown supercompression";
+				return TextureFormat::Undefined;
+			}
+			//The alpha is in the data format descriptor, after the header
+			return selectTarget(query, role, true, header.pixelWidth, header.pixelHeight).format;
+#else
+			(void)role;
+			reason = "UASTC or ETC1S, there is no transcoder (USE_BASISU is OFF)";
+			return TextureFormat::Undefined;
+#endif
+		}
+		if (header.supercompressionScheme == c_basisLz || header.supercompressionScheme > c_zlib)
+		{
+			reason = "unknown supercompression";
+			return TextureFormat::Undefined;
+		}
+#ifndef USE_BASISU
+		if (header.supercompressionScheme == c_zstd)
+		{
+			reason = "zstd supercompression, there is no zstd decoder (USE_BASISU is OFF)";
+			return TextureFormat::Undefined;
+		}
+#endif
+		for (const VkFormat& format : c_formats)
+		{
+			if (format.vkFormat != header.vkFormat) continue;
+			if (!hasFeature(query, format.feature))
+			{
+				reason = "its compression is not supported by the device";
+				return TextureFormat::Undefined;
+			}
+			return format.format;
+		}
+		reason = "not block compressed";
+		return TextureFormat::Undefined;
+	}
+
+	//The level as stored, or decompressed to its expected length
+	bool readLevel(ByteSpan bytes, uint32_t supercompressionScheme, const LevelIndex& index, uint64_t expected, std::vector<uint8_t>& level)
+	{
+		if (index.byteOffset > bytes.size || index.byteLength > bytes.size - index.byteOffset)
+			return false;
+		const uint8_t* data = bytes.data + index.byteOffset;
+		switch (supercompressionScheme)
+		{
+		case 0:
+			if (index.byteLength != expected) return false;
+			level.assign(data, data + index.byteLength);
+			return true;
+		case c_zlib:
+			if (index.uncompressedByteLength != expected || expected > INT_MAX || index.byteLength > INT_MAX) return false;
+			level.resize(static_cast<size_t>(expected));
+			return stbi_zlib_decode_buffer(reinterpret_cast<char*>(level.data()), static_cast<int>(expected),
+				reinterpret_cast<const char*>(data), static_cast<int>(index.byteLength)) == static_cast<int>(expected);
+#ifdef USE_BASISU
+		case c_zstd:
+		{
+			if (index.uncompressedByteLength != expected) return false;
+			level.resize(static_cast<size_t>(expected));
+			const size_t size = ZSTD_decompress(level.data(), level.size(), data, static_cast<size_t>(index.byteLength));
+			return !ZSTD_isError(size) && size == expected;
+		}
+#endif
+		default:
+			return false;
+		}
+	}
+}
+
+bool Ktx2Reader::isKtx2(ByteSpan bytes)
+{
+	Header header;
+	return readHeader(bytes, header);
+}
+
+TextureFormat Ktx2Reader::getFormat(ByteSpan bytes, const FeatureQuery& hasFeature, BcEncoder::Role role)
+{
+	Header header;
+	const char* reason = nullptr;
+	return readHeader(bytes, header) ? findFormat(header, hasFeature, role, reason) : TextureFormat::Undefined;
+}
+
+Utils::ImageData Ktx2Reader::decode(ByteSpan bytes, const std::string& name, const FeatureQuery& hasFeature, BcEncoder::Role role)
+{
+	Utils::ImageData image;
+	Header header;
+	if (!readHeader(bytes, header))
+	{
+		std::cerr << name << " is not a KTX2 file" << std::endl;
+		return image;
+	}
+	const char* reason = nullptr;
+	TextureFormat format = findFormat(header, hasFeature, role, reason);
+	if (format == TextureFormat::Undefined)
+	{
+		std::cerr << "Cannot upload the KTX2 image " << name << ": " << reason << std::endl;
+		return image;
+	}
+#ifdef USE_BASISU
+	if (header.vkFormat == 0)
+		return transcode(bytes, name, hasFeature, role);
+#endif
+
+	//The base level must hold whole blocks, the smaller ones are padded to whole blocks by the format
+	const Utils::FormatBlock block = Utils::getFormatBlock(format);
+	const uint32_t levelCount = std::max(header.levelCount, 1u);
+	if (header.pixelWidth % block.width != 0 || header.pixelHeight % block.height != 0
+		|| levelCount > 32 || sizeof(Header) + levelCount * sizeof(LevelIndex) > bytes.size)
+	{
+		std::cerr << "Cannot upload the KTX2 image " << name << ": invalid size or level index" << std::endl;
+		return image;
+	}
+
+	image.width = static_cast<int>(header.pixelWidth);
+	image.height = static_cast<int>(header.pixelHeight);
+	image.format = format;
+	image.levels.resize(levelCount);
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		LevelIndex index;
+		memcpy(&index, bytes.data + sizeof(Header) + level * sizeof(LevelIndex), sizeof(LevelIndex));
+		const uint32_t width = std::max(header.pixelWidth >> level, 1u);
+		const uint32_t height = std::max(header.pixelHeight >> level, 1u);
+		const uint64_t expected = uint64_t((width + block.width - 1) / block.width) * ((height + block.height - 1) / block.height) * block.bytes;
+		if (!readLevel(bytes, header.supercompressionScheme, index, expected, image.levels[level]))
+		{
+			std::cerr << "Cannot upload the KTX2 image " << name << ": level " << level << " is truncated or cannot be decompressed" << std::endl;
+			return {};
+		}
+	}
+	return image;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <functional>
+
+#include "bcEncoder.h"
+#include "mappedFile.h"
+#include "utils.h"
+
+// KTX2 container (KHR_texture_basisu images, .ktx2 files) holding block compressed levels:
+// BC1-7, ETC2/EAC or ASTC, uploaded as they are stored when the device has the matching feature, their levels
+// supercompressed with zstd or zlib are decompressed first.
+// The Basis Universal payloads (ETC1S/BasisLZ and UASTC) are transcoded to the best format of the device for the role
+// of the texture: BC7, BC1, BC5 or BC4, else ETC2/EAC, else ASTC 4x4, else RGBA8.
+// zstd and the transcoder come with USE_BASISU, without it those files are rejected and the glTF textures use their
+// fallback source. Only 2D textures are read (no arrays, cube maps or 3D).
+// Tested on the CPU by tests/ktx2ReaderTest.cpp.
+class Ktx2Reader
+{
+public:
+	//Whether the device can sample a compression feature, by default the features of the Context device
+	using FeatureQuery = std::function<bool(FeatureName)>;
+
+	static bool isKtx2(ByteSpan bytes);
+
+	//Format of the levels when they can be uploaded on this device, Undefined otherwise.
+	//Only needs the 80 bytes of the header: for a Basis Universal payload, the format of a role with alpha.
+	static TextureFormat getFormat(ByteSpan bytes, const FeatureQuery& hasFeature = nullptr, BcEncoder::Role role = BcEncoder::Role::BaseColor);
+
+	//All the levels of the file (level 0 first), empty ImageData when the file cannot be uploaded.
+	//The decompression and the transcoding run on the calling thread, the loaders call it on the workers.
+	static Utils::ImageData decode(ByteSpan bytes, const std::string& name, const FeatureQuery& hasFeature = nullptr,
+		BcEncoder::Role role = BcEncoder::Role::BaseColor);
+
+	static constexpr size_t c_headerSize = 80;
+};
@@ -26,6 +26,8 @@
 #include "renderer.h"
 #include "material.h"
 #include "gltfLoader.h"
+#include "textureStreamer.h"
+#include "environmentLighting.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -225,22 +227,23 @@ int main(int, char**) {
 
 	std::vector<std::string> jpgFiles = GetFiles(DATA_DIR, { ".jpg", ".png" });
 	
-	std::unordered_map<std::string, std::shared_ptr<wgpu::TextureView>> textures{};
+	//Loaded when a material first uses them
 	for (auto& file : jpgFiles)
-	{
-		TextureView textureView =nullptr;
-		Texture gltfTexture = Utils::loadImageFromPath(file, &textureView);
-		TextureManager().getInstance().add(file, textureView);
-	}
+		TextureManager().getInstance().addFile(file, file);
 
-	TextureView hdrTextureView = nullptr;
-	Texture hdrTexture = Utils::loadImageFromPath(DATA_DIR "/venice_sunset_2k.hdr", &hdrTextureView, true);
-	TextureManager().getInstance().add("venice_sunset_2k", hdrTextureView);
+	//Specular cubemap, irradiance SH and BRDF LUT of the environment, baked on the first run then read from the AssetCache
+	EnvironmentLighting environmentLighting;
+	environmentLighting.build(DATA_DIR "/venice_sunset_2k.hdr");
 
 
 	TextureView whiteTextureView = nullptr;
 	Texture  whiteTexture = Utils::CreateWhiteTexture(&whiteTextureView);
 	TextureManager().getInstance().add("whiteTex", whiteTextureView);
+	//Bound by the materials that are not packed in texture arrays (see MaterialPacker)
+	TextureViewDescriptor whiteArrayDesc;
+	whiteArrayDesc.dimension = TextureViewDimension::e2DArray;
+	whiteArrayDesc.arrayLayerCount = 1;
+	TextureView whiteArrayView = whiteTexture.CreateView(&whiteArrayDesc);
 
 	// Create a sampler
 	Sampler defaultSampler = Utils::createDefaultSampler();
@@ -249,10 +252,10 @@ int main(int, char**) {
 
 	Shader* backgroundShader = new Shader();
 	backgroundShader->setUserCode(Utils::loadFile(DATA_DIR  "/background.wgsl"));
-	backgroundShader->addVertexInput("position", 0, VertexFormat::Float32x3);
-	backgroundShader->addVertexInput("normal", 1, VertexFormat::Float32x3);
-	backgroundShader->addVertexInput("tangent", 2, VertexFormat::Float32x3);
-	backgroundShader->addVertexInput("uv", 3, VertexFormat::Float32x2);
+	backgroundShader->addVertexInput("position", VertexSemantic::Position);
+	backgroundShader->addVertexInput("normal", VertexSemantic::Normal);
+	backgroundShader->addVertexInput("tangent", VertexSemantic::Tangent);
+	backgroundShader->addVertexInput("uv", VertexSemantic::TexCoord);
 
 	backgroundShader->addVertexOutput("tangent", 0, VertexFormat::Float32x3);
 	backgroundShader->addVertexOutput("normal", 1, VertexFormat::Float32x3);
@@ -267,10 +270,10 @@ int main(int, char**) {
 
 	Shader* diltationShader = new Shader();
 	diltationShader->setUserCode(Utils::loadFile(DATA_DIR  "/dilatation.wgsl"));
-	diltationShader->addVertexInput("position", 0, VertexFormat::Float32x3);
-	diltationShader->addVertexInput("normal", 1, VertexFormat::Float32x3);
-	diltationShader->addVertexInput("tangent", 2, VertexFormat::Float32x3);
-	diltationShader->addVertexInput("uv", 3, VertexFormat::Float32x2);
+	diltationShader->addVertexInput("position", VertexSemantic::Position);
+	diltationShader->addVertexInput("normal", VertexSemantic::Normal);
+	diltationShader->addVertexInput("tangent", VertexSemantic::Tangent);
+	diltationShader->addVertexInput("uv", VertexSemantic::TexCoord);
 
 	diltationShader->addVertexOutput("tangent", 0, VertexFormat::Float32x3);
 	diltationShader->addVertexOutput("normal", 1, VertexFormat::Float32x3);
@@ -285,25 +288,32 @@ int main(int, char**) {
 
 	Shader* pbrShader = new Shader();
 	pbrShader->setUserCode(Utils::loadFile(DATA_DIR  "/pbr.wgsl"));
-	pbrShader->addVertexInput("position", 0, VertexFormat::Float32x3);
-	pbrShader->addVertexInput("normal", 1, VertexFormat::Float32x3);
-	pbrShader->addVertexInput("color", 2, VertexFormat::Float32x3);
-	pbrShader->addVertexInput("uv", 3, VertexFormat::Float32x2);
+	pbrShader->addVertexInput("position", VertexSemantic::Position);
+	pbrShader->addVertexInput("normal", VertexSemantic::Normal);
+	pbrShader->addVertexInput("color", VertexSemantic::Tangent);
+	pbrShader->addVertexInput("uv", VertexSemantic::TexCoord);
 
 	pbrShader->addVertexOutput("color", 0, VertexFormat::Float32x3);
 	pbrShader->addVertexOutput("normal", 1, VertexFormat::Float32x3);
 	pbrShader->addVertexOutput("uv", 2, VertexFormat::Float32x2);
 	pbrShader->addVertexOutput("worldPosition", 3, VertexFormat::Float32x4);
 
-	Issam::AttributeGroup pbrMaterialAttributes(Issam::Binding::Material);
+	//Dynamic offset: the materials sharing a bind group have their uniforms in its versions (see SharedMaterial)
+	Issam::AttributeGroup pbrMaterialAttributes(Issam::Binding::Material, 1, true);
 	pbrMaterialAttributes.addAttribute("baseColorFactor", glm::vec4(1.0f));
 	pbrMaterialAttributes.addAttribute("metallicFactor", 0.5f);
 	pbrMaterialAttributes.addAttribute("roughnessFactor", 0.5f);
 
 	pbrMaterialAttributes.addAttribute("baseColorTexture", whiteTextureView);
 	pbrMaterialAttributes.addAttribute("metallicRoughnessTexture", whiteTextureView);
-	pbrMaterialAttributes.addAttribute("environmentMap", hdrTextureView);
 	pbrMaterialAttributes.addAttribute("defaultSampler", defaultSampler);
+	//(id, width, height) of the streamed textures, id 0 when not streamed (see TextureStreamer)
+	pbrMaterialAttributes.addAttribute("baseColorStreaming", glm::vec4(0.0f));
+	pbrMaterialAttributes.addAttribute("metallicRoughnessStreaming", glm::vec4(0.0f));
+	//Layers of the textures in baseColorArray and metallicRoughnessArray, -1 to sample the 2D textures (see MaterialPacker)
+	pbrMaterialAttributes.addAttribute("textureLayers", glm::vec4(-1.0f));
+	pbrMaterialAttributes.addAttribute("baseColorArray", whiteArrayView, TextureViewDimension::e2DArray);
+	pbrMaterialAttributes.addAttribute("metallicRoughnessArray", whiteArrayView, TextureViewDimension::e2DArray);
 	Issam::AttributedManager::getInstance().add(c_pbrMaterialAttributes, pbrMaterialAttributes);
 
 	Issam::AttributeGroup pbrSceneAttributes(Issam::Binding::Scene);
@@ -311,6 +321,13 @@ int main(int, char**) {
 	pbrSceneAttributes.addAttribute("projection", mat4(1.0));
 	pbrSceneAttributes.addAttribute("cameraPosition", vec4(0.0));
 	pbrSceneAttributes.addAttribute("lightDirection", vec4(1.0));
+	//Image based lighting (see EnvironmentLighting), iblParams: (max lod of specularMap, intensity)
+	for (size_t i = 0; i < environmentLighting.getIrradianceSh().size(); ++i)
+		pbrSceneAttributes.addAttribute("irradianceSh" + std::to_string(i), environmentLighting.getIrradianceSh()[i]);
+	pbrSceneAttributes.addAttribute("iblParams", vec4(environmentLighting.getMaxLod(), 1.0, 0.0, 0.0));
+	pbrSceneAttributes.addAttribute("specularMap", environmentLighting.getSpecularView(), TextureViewDimension::Cube);
+	pbrSceneAttributes.addAttribute("brdfLut", environmentLighting.getBrdfLutView());
+	pbrSceneAttributes.addAttribute("iblSampler", environmentLighting.getSampler());
 
 	Issam::AttributedManager::getInstance().add(c_pbrSceneAttributes, pbrSceneAttributes);
 
@@ -322,17 +339,19 @@ int main(int, char**) {
 	pbrShader->addGroup(c_pbrSceneAttributes);
 	pbrShader->addGroup(c_pbrNodeAttributes);
 
+	Shader* feedbackShader = new Shader();
+	feedbackShader->setUserCode(Utils::loadFile(DATA_DIR  "/feedback.wgsl"));
+	feedbackShader->addVertexInput("position", VertexSemantic::Position);
+	feedbackShader->addVertexInput("uv", VertexSemantic::TexCoord);
+	feedbackShader->addVertexOutput("uv", 0, VertexFormat::Float32x2);
+	feedbackShader->addGroup(c_pbrMaterialAttributes);
+	feedbackShader->addGroup(c_pbrSceneAttributes);
+	feedbackShader->addGroup(c_pbrNodeAttributes);
+
 	Shader* unlitShader = new Shader();
 	unlitShader->setUserCode(Utils::loadFile(DATA_DIR  "/unlit.wgsl"));
-	unlitShader->addVertexInput("position", 0, VertexFormat::Float32x3);
-	unlitShader->addVertexInput("normal", 1, VertexFormat::Float32x3);
-	unlitShader->addVertexInput("color", 2, VertexFormat::Float32x3);
-	unlitShader->addVertexInput("uv", 3, VertexFormat::Float32x2);
-
-	unlitShader->addVertexOutput("color", 0, VertexFormat::Float32x3);
-	unlitShader->addVertexOutput("normal", 1, VertexFormat::Float32x3);
-	unlitShader->addVertexOutput("uv", 2, VertexFormat::Float32x2);
-	//unlitShader->addVertexOutput("worldPosition", 3, VertexFormat::Float32x4);
+	//Position only, with split vertex streams the highlight and debug passes only fetch the positions
+	unlitShader->addVertexInput("position", VertexSemantic::Position);
 
 	Issam::AttributeGroup unlitMaterialAttributes(Issam::Binding::Material, 2);
 	unlitMaterialAttributes.addAttribute("colorFactor", glm::vec4(1.0f));
@@ -395,6 +414,8 @@ int main(int, char**) {
 					Issam::MeshRenderer meshRenderer = view.get<Issam::MeshRenderer>(entity);
 					auto& entityFilters = scene->getComponent<Issam::Filters>(entity);
 					if (entityFilters.has("debug")) continue;
+					//Pick the source entities, not the merged mesh
+					if (scene->hasComponent<Issam::StaticBatch>(entity)) continue;
 
 					Mesh* mesh = meshRenderer.mesh.get();
 					if (mesh)
@@ -481,6 +502,14 @@ int main(int, char**) {
 	passPbr->setPipeline(pipelinePbr);
 	passPbr->setDepthBuffer(depthBuffer);
 	passPbr->addFilter("pbr");
+
+	//Low resolution, its own targets are set by the TextureStreamer
+	Pass* feedbackPass = new Pass();
+	feedbackPass->setShader(feedbackShader);
+	Pipeline* feedbackPipeline = new Pipeline("feedback", feedbackShader, TextureFormat::RGBA8Unorm, depthTextureFormat, Pipeline::BlendingMode::Replace);
+	feedbackPass->setPipeline(feedbackPipeline);
+	feedbackPass->addFilter("pbr");
+	TextureStreamer::getInstance().setFeedbackPass(feedbackPass, m_winWidth, m_winHeight, depthTextureFormat);
 	
 
 	Pass* unlitPass = new Pass();
@@ -579,6 +608,7 @@ int main(int, char**) {
 
 	Renderer renderer;
 	renderer.addPass(passPbr);
+	renderer.addPass(feedbackPass);
 	renderer.addPass(unlitPass);
  	renderer.addPass(dilatationPass);
 	renderer.addPass(unlit2Pass); //to remove interior
@@ -586,15 +616,28 @@ int main(int, char**) {
 	renderer.addPass(debugPass);
 	renderer.addPass(imGuiPass);
 	renderer.setScene(scene);
+	renderer.getMeshletCuller().setDepthBuffer(depthBuffer, m_winWidth, m_winHeight); //Written by the pbr pass
+	renderer.setViewportSize(m_winWidth, m_winHeight);
 
 	//Issam::Node* selectedNode = nullptr;
 	std::vector<std::string> gltfFiles = GetFiles("C:/Dev/glTF-Sample-Models/2.0", { ".gltf", ".glb" });
 	entt::entity gltfEntity;
 	GltfLoader gltfLoader(scene);
+	GltfLoader::LoadHandle gltfLoad;
+	float loadBudget = 4.0f; //ms of each frame given to the pending load
 
 	while (!glfwWindowShouldClose(window)) {
 		glfwPollEvents();
 
+		gltfLoader.update(loadBudget);
+		if (gltfLoad && gltfLoad->done)
+		{
+			//The picked entity belonged to the previous model
+			if (!gltfLoad->failed)
+				pickedEntity = entt::null;
+			gltfLoad.reset();
+		}
+
 		{
 			imgui->begin();
 			
@@ -602,19 +645,89 @@ int main(int, char**) {
 			ImGui::Begin("Material Editor");
 			{
 				
+				static bool staticBatching = false;
+				if (ImGui::Checkbox("Static batching", &staticBatching))
+					gltfLoader.setStaticBatching(staticBatching);
+
+				static bool quantizeVertices = false;
+				if (ImGui::Checkbox("Quantized vertices", &quantizeVertices))
+					gltfLoader.setVertexQuantization(quantizeVertices);
+
+				static bool splitPositions = false;
+				if (ImGui::Checkbox("Split position stream", &splitPositions))
+					gltfLoader.setSplitPositions(splitPositions);
+
+				static bool optimizeMeshes = false;
+				if (ImGui::Checkbox("Optimize meshes", &optimizeMeshes))
+					gltfLoader.setMeshOptimization(optimizeMeshes);
+
+				static bool generateMeshlets = false;
+				if (ImGui::Checkbox("Generate meshlets", &generateMeshlets))
+					gltfLoader.setMeshletGeneration(generateMeshlets);
+
+				static bool generateLods = false;
+				if (ImGui::Checkbox("Generate LODs", &generateLods))
+					gltfLoader.setLodGeneration(generateLods);
+				static float lodPixelError = 1.0f;
+				if (ImGui::SliderFloat("LOD pixel error", &lodPixelError, 0.0f, 16.0f))
+					renderer.setLodPixelError(lodPixelError);
+
+				static bool generateImpostors = false;
+				if (ImGui::Checkbox("Generate impostors", &generateImpostors))
+					gltfLoader.setImpostorGeneration(generateImpostors);
+				static float impostorPixelSize = 0.0f;
+				if (ImGui::SliderFloat("Impostor below (px)", &impostorPixelSize, 0.0f, 256.0f))
+					renderer.setImpostorPixelSize(impostorPixelSize);
+
+				static bool assetCache = true;
+				if (ImGui::Checkbox("Cooked asset cache", &assetCache))
+					gltfLoader.setAssetCache(assetCache);
+				static bool compressTextures = false;
+				static bool highQualityTextures = true;
+				bool compressionChanged = ImGui::Checkbox("Compress textures (BC)", &compressTextures);
+				compressionChanged |= ImGui::Checkbox("BC7 base color", &highQualityTextures);
+				if (compressionChanged)
+					gltfLoader.setTextureCompression(compressTextures, highQualityTextures ? BcEncoder::Quality::High : BcEncoder::Quality::Fast);
+				static bool streamTextures = false;
+				if (ImGui::Checkbox("Texture streaming", &streamTextures))
+					gltfLoader.setTextureStreaming(streamTextures);
+				static bool packTextures = false;
+				if (ImGui::Checkbox("Pack textures into arrays", &packTextures))
+					gltfLoader.setTexturePacking(packTextures);
+				static bool drawSorting = true;
+				if (ImGui::Checkbox("Sort draws by material", &drawSorting))
+					renderer.setDrawSorting(drawSorting);
+				static int textureBudget = 512;
+				if (ImGui::SliderInt("Texture budget (MB)", &textureBudget, 16, 4096))
+					TextureManager::getInstance().setBudget(size_t(textureBudget) * 1024 * 1024);
+				static int streamingBudget = 256;
+				if (ImGui::SliderInt("Streaming budget (MB)", &streamingBudget, 16, 2048))
+					TextureStreamer::getInstance().setBudget(size_t(streamingBudget) * 1024 * 1024);
+
+				static bool meshletCulling = false;
+				if (ImGui::Checkbox("GPU meshlet culling", &meshletCulling))
+					passPbr->setMeshletCulling(meshletCulling);
+				if (meshletCulling)
+				{
+					static bool frustumCulling = true, coneCulling = true, occlusionCulling = true;
+					if (ImGui::Checkbox("Frustum", &frustumCulling))
+						renderer.getMeshletCuller().setFrustumCulling(frustumCulling);
+					ImGui::SameLine();
+					if (ImGui::Checkbox("Cone", &coneCulling))
+						renderer.getMeshletCuller().setConeCulling(coneCulling);
+					ImGui::SameLine();
+					if (ImGui::Checkbox("Hi-Z", &occlusionCulling))
+						renderer.getMeshletCuller().setOcclusionCulling(occlusionCulling);
+				}
+
 				static int selectedGLTFIndex = -1;
 				if (ImGui::BeginCombo("GLTF Files", selectedGLTFIndex == -1 ? "Select a GLTF" : gltfFiles[selectedGLTFIndex].c_str())) {
 					for (int i = 0; i < gltfFiles.size(); i++) {
 						bool isSelected = (selectedGLTFIndex == i);
 						if (ImGui::Selectable(gltfFiles[i].c_str(), isSelected)) {
-							if (selectedGLTFIndex != -1)
-							{
-								gltfLoader.unload();
-								pickedEntity = entt::null;
-							}
+							//The current model stays until the new one is ready
 							selectedGLTFIndex = i;
-							gltfLoader.load(gltfFiles[i]);
-
+							gltfLoad = gltfLoader.loadAsync(gltfFiles[i]);
 						}
 						if (isSelected) {
 							ImGui::SetItemDefaultFocus();
@@ -622,6 +735,9 @@ int main(int, char**) {
 					}
 					ImGui::EndCombo();
 				}
+				ImGui::SliderFloat("Load budget (ms)", &loadBudget, 1.0f, 16.0f);
+				if (gltfLoad)
+					ImGui::ProgressBar(gltfLoad->progress, ImVec2(-1.0f, 0.0f));
 			}
 			
 
@@ -636,10 +752,9 @@ int main(int, char**) {
 
 				{
 					static int selectedTextureIndex = -1;
-					std::vector<std::string> textureNames;
-					for (const auto& texturePair : TextureManager::getInstance().getAll()) {
-						textureNames.push_back(texturePair.first);
-					}
+					std::vector<std::string> textureNames = TextureManager::getInstance().getIds();
+					if (selectedTextureIndex >= static_cast<int>(textureNames.size()))
+						selectedTextureIndex = -1;
 
 					if (ImGui::BeginCombo("BaseColorTexture", selectedTextureIndex == -1 ? "Select a texture" : textureNames[selectedTextureIndex].c_str())) {
 						for (int i = 0; i < textureNames.size(); i++) {
@@ -647,7 +762,7 @@ int main(int, char**) {
 							if (ImGui::Selectable(textureNames[i].c_str(), isSelected)) {
 								selectedTextureIndex = i;
 								//	std::cout << "Selected texture: " << textureNames[i] << std::endl;
-								selectedMaterial->setAttribute("baseColorTexture", TextureManager::getInstance().getTextureView(textureNames[i]));
+								selectedMaterial->setTexture("baseColorTexture", textureNames[i]);
 								
 								
 							}
@@ -674,6 +789,9 @@ int main(int, char**) {
 				light.m_direction = lightDirection;
 				scene->update<Issam::Light>(lightEnitity);
 			}
+			static float iblIntensity = 1.0f;
+			if (ImGui::SliderFloat("Environment intensity", &iblIntensity, 0.0f, 4.0f))
+				scene->setAttribute("iblParams", vec4(environmentLighting.getMaxLod(), iblIntensity, 0.0f, 0.0f));
 			
 			
 			/*static float translation[3] = { 0.0, 0.0, 0.0 };
@@ -690,10 +808,29 @@ int main(int, char**) {
 
 			ImGuiIO& io = ImGui::GetIO();
 			ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
+
+			GeometryPool::Stats geometryStats = GeometryPool::getInstance().getStats();
+			ImGui::Text("Geometry: %zu buffers, %.1f / %.1f MB", geometryStats.bufferCount, geometryStats.usedBytes / (1024.0f * 1024.0f), geometryStats.capacityBytes / (1024.0f * 1024.0f));
+
+			const Renderer::Stats& renderStats = renderer.getStats();
+			ImGui::Text("Draws: %zu, pipeline changes: %zu, material bind group changes: %zu", renderStats.drawCalls, renderStats.pipelineChanges, renderStats.materialBindGroupChanges);
+			ImGui::Text("Triangles: %zu, impostors: %zu", renderStats.triangles, renderStats.impostors);
+			ImGui::Text("Vertex fetch: %.2f MB/frame (%.1f B/vertex)", renderStats.vertexBytes / (1024.0f * 1024.0f), renderStats.vertexCount > 0 ? float(renderStats.vertexBytes) / renderStats.vertexCount : 0.0f);
+			const MeshletCuller::Stats& meshletStats = renderer.getMeshletCuller().getStats();
+			ImGui::Text("Meshlets culled on GPU: %zu (%zu triangles)", meshletStats.meshlets, meshletStats.triangles);
+			const TextureManager::Stats& textureStats = TextureManager::getInstance().getStats();
+			ImGui::Text("Textures: %zu (%zu resident, %zu coarse mips only, %zu referenced), %.1f / %.1f MB", textureStats.textureCount, textureStats.residentCount,
+				textureStats.lowMipCount, textureStats.referencedCount, textureStats.residentBytes / (1024.0f * 1024.0f), TextureManager::getInstance().getBudget() / (1024.0f * 1024.0f));
+			ImGui::Text("Texture loads: %zu, coarse mip drops: %zu, evictions: %zu", textureStats.loads, textureStats.lowMipDrops, textureStats.evictions);
+			const TextureStreamer::Stats& streamingStats = TextureStreamer::getInstance().getStats();
+			ImGui::Text("Streamed textures: %zu, %.1f / %.1f MB resident, %.1f MB uploaded", streamingStats.textureCount,
+				streamingStats.residentBytes / (1024.0f * 1024.0f), streamingStats.fullBytes / (1024.0f * 1024.0f), streamingStats.uploadedBytes / (1024.0f * 1024.0f));
 			ImGui::End();
 		}
 
+		TextureStreamer::getInstance().update();
 		renderer.draw();
+		TextureStreamer::getInstance().endFrame();
 	}
 
 	Context::getInstance().shutdownGraphics();
@@ -0,0 +1,260 @@
+#include "managers.h"
+
+#include <algorithm>
+
+#include "utils.h"
+
+namespace
+{
+	size_t getTextureBytes(const Texture& texture)
+	{
+		const Utils::FormatBlock block = Utils::getFormatBlock(texture.GetFormat());
+		size_t bytes = 0;
+		for (uint32_t level = 0; level < texture.GetMipLevelCount(); ++level)
+		{
+			const uint32_t blocksWide = (std::max(texture.GetWidth() >> level, 1u) + block.width - 1) / block.width;
+			const uint32_t blocksHigh = (std::max(texture.GetHeight() >> level, 1u) + block.height - 1) / block.height;
+			bytes += size_t(blocksWide) * blocksHigh * block.bytes;
+		}
+		return bytes;
+	}
+
+	TextureView createView(const Texture& texture)
+	{
+		TextureViewDescriptor viewDesc;
+		viewDesc.format = texture.GetFormat();
+		viewDesc.dimension = TextureViewDimension::e2D;
+		viewDesc.baseMipLevel = 0;
+		viewDesc.mipLevelCount = texture.GetMipLevelCount();
+		viewDesc.baseArrayLayer = 0;
+		viewDesc.arrayLayerCount = 1;
+		viewDesc.aspect = TextureAspect::All;
+		return texture.CreateView(&viewDesc);
+	}
+
+	//First level of the texture kept when it is evicted, 0 when it is already small
+	uint32_t getLowMipLevel(const Texture& texture)
+	{
+		uint32_t level = 0;
+		while (level + 1 < texture.GetMipLevelCount() && std::max(texture.GetWidth() >> level, texture.GetHeight() >> level) > TextureManager::c_lowMipSize)
+			level++;
+		return level;
+	}
+}
+
+bool TextureManager::add(const std::string& id, TextureView textureView, size_t bytes)
+{
+	remove(id);
+	Entry& entry = m_textures[id];
+	entry.view = textureView;
+	entry.bytes = bytes;
+	m_residentBytes += bytes;
+	return true;
+}
+
+bool TextureManager::addFile(const std::string& id, const std::string& path, bool hdr)
+{
+	remove(id);
+	Entry& entry = m_textures[id];
+	entry.loader = [path, hdr](TextureView* textureView) -> Texture {
+		Utils::ImageData image = Utils::decodeImageFromPath(path, hdr);
+		return image.levels.empty() ? nullptr : Utils::uploadImageData(image, textureView);
+	};
+	return true;
+}
+
+bool TextureManager::addTexture(const std::string& id, Texture texture, TextureView textureView, Loader loader)
+{
+	remove(id);
+	Entry& entry = m_textures[id];
+	entry.texture = texture;
+	entry.view = textureView;
+	entry.loader = std::move(loader);
+	entry.bytes = getTextureBytes(texture);
+	m_residentBytes += entry.bytes;
+	trim(&entry);
+	return true;
+}
+
+bool TextureManager::update(const std::string& id, TextureView textureView)
+{
+	Entry* entry = find(id);
+	if (!entry) return false;
+	entry->view = textureView;
+	return true;
+}
+
+TextureManager::Entry* TextureManager::find(const std::string& id)
+{
+	auto it = m_textures.find(id);
+	return it != m_textures.end() ? &it->second : nullptr;
+}
+
+TextureView TextureManager::getTextureView(const std::string& id)
+{
+	Entry* entry = find(id);
+	if (!entry) return nullptr;
+	makeResident(*entry);
+	entry->lastUse = ++m_useCount;
+	return entry->view;
+}
+
+TextureView TextureManager::acquire(const std::string& id)
+{
+	Entry* entry = find(id);
+	if (!entry) return nullptr;
+	makeResident(*entry);
+	entry->lastUse = ++m_useCount;
+	entry->refCount++;
+	return entry->view;
+}
+
+void TextureManager::release(const std::string& id)
+{
+	Entry* entry = find(id);
+	if (!entry || entry->refCount == 0) return;
+	entry->refCount--;
+	if (entry->refCount == 0)
+		trim(nullptr);
+}
+
+bool TextureManager::remove(const std::string& id)
+{
+	auto it = m_textures.find(id);
+	if (it == m_textures.end()) return false;
+	m_residentBytes -= it->second.bytes;
+	m_textures.erase(it);
+	return true;
+}
+
+void TextureManager::clear()
+{
+	m_textures.clear();
+	m_residentBytes = 0;
+}
+
+std::vector<std::string> TextureManager::getIds() const
+{
+	std::vector<std::string> ids;
+	ids.reserve(m_textures.size());
+	for (const auto& [id, entry] : m_textures)
+		ids.push_back(id);
+	std::sort(ids.begin(), ids.end());
+	return ids;
+}
+
+void TextureManager::setBudget(size_t bytes)
+{
+	m_budget = bytes;
+	trim(nullptr);
+}
+
+void TextureManager::makeResident(Entry& entry)
+{
+	if (!entry.loader || (entry.view && !entry.lowMips)) return;
+
+	//A texture that fails to load keeps what it had, the next request tries again
+	TextureView view = nullptr;
+	Texture texture = entry.loader(&view);
+	if (!texture) return;
+	m_residentBytes -= entry.bytes;
+	entry.texture = texture;
+	entry.view = view;
+	entry.lowMips = false;
+	entry.bytes = getTextureBytes(texture);
+	m_residentBytes += entry.bytes;
+	m_stats.loads++;
+	trim(&entry);
+}
+
+void TextureManager::dropToLowMips(Entry& entry)
+{
+	const uint32_t firstLevel = getLowMipLevel(entry.texture);
+	assert(firstLevel > 0);
+
+	TextureDescriptor textureDesc;
+	textureDesc.dimension = TextureDimension::e2D;
+	textureDesc.format = entry.texture.GetFormat();
+	textureDesc.size = { std::max(entry.texture.GetWidth() >> firstLevel, 1u), std::max(entry.texture.GetHeight() >> firstLevel, 1u), 1 };
+	textureDesc.mipLevelCount = entry.texture.GetMipLevelCount() - firstLevel;
+	textureDesc.sampleCount = 1;
+	textureDesc.usage = TextureUsage::TextureBinding | TextureUsage::CopyDst | TextureUsage::CopySrc;
+	textureDesc.viewFormatCount = 0;
+	textureDesc.viewFormats = nullptr;
+	Device device = Context::getInstance().getDevice();
+	Texture texture = device.CreateTexture(&textureDesc);
+
+	//Copied on the GPU, the file is only read again when the texture is requested
+	CommandEncoder encoder = device.CreateCommandEncoder();
+	for (uint32_t level = 0; level < textureDesc.mipLevelCount; ++level)
+	{
+		ImageCopyTexture source;
+		source.texture = entry.texture;
+		source.mipLevel = firstLevel + level;
+		ImageCopyTexture destination;
+		destination.texture = texture;
+		destination.mipLevel = level;
+		Extent3D size = { std::max(textureDesc.size.width >> level, 1u), std::max(textureDesc.size.height >> level, 1u), 1 };
+		encoder.CopyTextureToTexture(&source, &destination, &size);
+	}
+	CommandBuffer command = encoder.Finish();
+	device.GetQueue().Submit(1, &command);
+
+	m_residentBytes -= entry.bytes;
+	entry.texture = texture;
+	entry.view = createView(texture);
+	entry.lowMips = true;
+	entry.bytes = getTextureBytes(texture);
+	m_residentBytes += entry.bytes;
+	m_stats.lowMipDrops++;
+}
+
+void TextureManager::evict(Entry& entry)
+{
+	m_residentBytes -= entry.bytes;
+	entry.texture = nullptr;
+	entry.view = nullptr;
+	entry.lowMips = false;
+	entry.bytes = 0;
+	m_stats.evictions++;
+}
+
+void TextureManager::trim(const Entry* inUse)
+{
+	while (m_residentBytes > m_budget)
+	{
+		//The least recently used texture without reference, the coarse levels are kept before unloading any texture
+		Entry* dropped = nullptr;
+		Entry* evicted = nullptr;
+		for (auto& [id, entry] : m_textures)
+		{
+			if (!entry.loader || !entry.view || entry.refCount > 0 || &entry == inUse) continue;
+			if (!entry.lowMips && getLowMipLevel(entry.texture) > 0 && (!dropped || entry.lastUse < dropped->lastUse))
+				dropped = &entry;
+			if (!evicted || entry.lastUse < evicted->lastUse)
+				evicted = &entry;
+		}
+		if (dropped)
+			dropToLowMips(*dropped);
+		else if (evicted)
+			evict(*evicted);
+		else
+			break; //The referenced textures alone are over the budget
+	}
+}
+
+const TextureManager::Stats& TextureManager::getStats()
+{
+	m_stats.textureCount = m_textures.size();
+	m_stats.residentCount = 0;
+	m_stats.lowMipCount = 0;
+	m_stats.referencedCount = 0;
+	for (const auto& [id, entry] : m_textures)
+	{
+		if (entry.view && !entry.lowMips) m_stats.residentCount++;
+		if (entry.lowMips) m_stats.lowMipCount++;
+		if (entry.refCount > 0) m_stats.referencedCount++;
+	}
+	m_stats.residentBytes = m_residentBytes;
+	return m_stats;
+}
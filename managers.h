@@ -1,14 +1,23 @@
 #pragma once
 
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "context.h"
 #include "mesh.h"
-#include "shader.h"
 
 
 
 
 
+//Textures by id. The image files are registered with addFile and decoded on their first request, the textures uploaded
+//elsewhere (the glTF images) with addTexture and the way to load them again. The materials reference them with
+//Material::setTexture (acquire/release). Over the budget, the least recently used textures without reference first keep
+//their coarse levels only (c_lowMipSize), then are unloaded: the next request loads them again.
+//The textures added as views are created and freed elsewhere, they are never evicted.
 class TextureManager
 {
 public:
@@ -20,30 +29,137 @@ public:
 		return textureManager;
 	};
 
-	bool add(const std::string& id, TextureView textureView) {
-		m_textures[id] = textureView;
-		return true; }
-	TextureView getTextureView(const std::string& id) {
-		return  m_textures[id]; 
+	static constexpr uint32_t c_lowMipSize = 64; //Largest side of the levels kept by an evicted texture
+
+	struct Stats {
+		size_t textureCount = 0;
+		size_t residentCount = 0; //Every level on the GPU
+		size_t lowMipCount = 0;   //Coarse levels only
+		size_t referencedCount = 0;
+		size_t residentBytes = 0; //Including the added views given with their size
+		size_t loads = 0;         //Since the start
+		size_t lowMipDrops = 0;
+		size_t evictions = 0;
+	};
+
+	//Decodes and uploads a texture (on the main thread), nullptr when it failed
+	using Loader = std::function<Texture(TextureView* textureView)>;
+
+	//bytes: GPU size of the texture, for the budget and the stats
+	bool add(const std::string& id, TextureView textureView, size_t bytes = 0);
+	//Decoded and uploaded on the first request
+	bool addFile(const std::string& id, const std::string& path, bool hdr = false);
+	//Already uploaded, owned from now on: evicted like the files, loader brings it back
+	bool addTexture(const std::string& id, Texture texture, TextureView textureView, Loader loader);
+	//Replaces the view of an added texture (see TextureStreamer), false when the id is unknown
+	bool update(const std::string& id, TextureView textureView);
+	bool contains(const std::string& id) const { return m_textures.count(id) != 0; }
+
+	//Loads the texture when needed. Without a reference, the view may be evicted by a later load.
+	TextureView getTextureView(const std::string& id);
+	//Loads the texture when needed, it is not evicted until released as many times
+	TextureView acquire(const std::string& id);
+	void release(const std::string& id);
+
+	bool remove(const std::string& id);
+	void clear();
+	std::vector<std::string> getIds() const; //Sorted
+
+	void setBudget(size_t bytes);
+	size_t getBudget() const { return m_budget; }
+	const Stats& getStats();
+
+private:
+	struct Entry {
+		TextureView view{ nullptr };
+		Texture texture{ nullptr }; //Owned, except for the added views
+		Loader loader;              //Empty for the added views
+		bool lowMips = false;
+		size_t bytes = 0;
+		size_t refCount = 0;
+		uint64_t lastUse = 0;
+	};
+
+	Entry* find(const std::string& id);
+	//The evicted textures are loaded whole, the ones with their coarse levels only are loaded again
+	void makeResident(Entry& entry);
+	void dropToLowMips(Entry& entry);
+	void evict(Entry& entry);
+	//Evicts until under the budget, except the entry in use
+	void trim(const Entry* inUse);
+
+	std::unordered_map<std::string, Entry> m_textures{};
+	size_t m_budget = 512ull * 1024 * 1024;
+	size_t m_residentBytes = 0;
+	uint64_t m_useCount = 0; //Clock of the LRU
+	Stats m_stats;
+};
+
+//Meshes shared by the loads, found by source (file, mesh, primitive, load options) or by content.
+//Only weak references are kept, a mesh is released with its last MeshRenderer.
+class MeshManager
+{
+public:
+	MeshManager() = default;
+	~MeshManager() = default;
+
+	static MeshManager& getInstance() {
+		static MeshManager meshManager;
+		return meshManager;
+	};
+
+	MeshPtr find(const std::string& sourceKey) {
+		auto it = m_bySource.find(sourceKey);
+		if (it == m_bySource.end()) return nullptr;
+		MeshPtr mesh = it->second.lock();
+		if (!mesh) m_bySource.erase(it);
+		return mesh;
 	}
 
-	bool remove(const std::string& id)
-	{
-		auto it =m_textures.find(id);
-		if (it != m_textures.end())
+	//The hash is a first filter, the geometry is compared before reusing a mesh
+	MeshPtr findByContent(uint64_t contentHash, const MeshData& meshData) {
+		auto range = m_byContent.equal_range(contentHash);
+		for (auto it = range.first; it != range.second; ++it)
 		{
-			m_textures.erase(it);
-			return true;
+			MeshPtr mesh = it->second.lock();
+			if (mesh && mesh->getIndices() == meshData.indices && mesh->getVertices().size() == meshData.vertices.size()
+				&& memcmp(mesh->getVertices().data(), meshData.vertices.data(), meshData.vertices.size() * sizeof(Vertex)) == 0)
+				return mesh;
 		}
-		return false;
+		return nullptr;
 	}
-	void clear()
-	{
-		m_textures.clear();
+
+	//contentHash 0: only found by source
+	void add(const std::string& sourceKey, uint64_t contentHash, MeshPtr mesh) {
+		m_bySource[sourceKey] = mesh;
+		if (contentHash != 0)
+			m_byContent.emplace(contentHash, mesh);
+	}
+
+	//Forget the released meshes
+	void purge() {
+		for (auto it = m_bySource.begin(); it != m_bySource.end();)
+			it = it->second.expired() ? m_bySource.erase(it) : std::next(it);
+		for (auto it = m_byContent.begin(); it != m_byContent.end();)
+			it = it->second.expired() ? m_byContent.erase(it) : std::next(it);
 	}
-	std::unordered_map<std::string, TextureView>& getAll() { return m_textures; }
+
+	//FNV-1a of the vertices and indices, the load options must be part of the vertices or of the key
+	static uint64_t hash(const MeshData& meshData, uint64_t seed = 0) {
+		uint64_t hash = 14695981039346656037ull ^ seed;
+		auto hashBytes = [&hash](const void* data, size_t size) {
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; ++i)
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+		};
+		hashBytes(meshData.vertices.data(), meshData.vertices.size() * sizeof(Vertex));
+		hashBytes(meshData.indices.data(), meshData.indices.size() * sizeof(uint32_t));
+		return hash;
+	}
+
 private:
-	std::unordered_map<std::string, TextureView> m_textures{};
+	std::unordered_map<std::string, std::weak_ptr<Mesh>> m_bySource{};
+	std::unordered_multimap<uint64_t, std::weak_ptr<Mesh>> m_byContent{};
 };
 
 class SamplerManager
@@ -0,0 +1,183 @@
+#include "mappedFile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path, bool sequential)
+{
+	close();
+	m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		m_file = nullptr;
+		std::cerr << "Failed to open " << path << std::endl;
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+	{
+		std::cerr << "Failed to map " << path << ": empty file" << std::endl;
+		close();
+		return false;
+	}
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping)
+		m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!m_data)
+	{
+		std::cerr << "Failed to map " << path << std::endl;
+		close();
+		return false;
+	}
+	m_size = static_cast<size_t>(size.QuadPart);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data) UnmapViewOfFile(m_data);
+	if (m_mapping) CloseHandle(m_mapping);
+	if (m_file) CloseHandle(m_file);
+	m_data = nullptr;
+	m_size = 0;
+	m_mapping = nullptr;
+	m_file = nullptr;
+}
+
+void MappedFile::willNeed(ByteSpan span) const
+{
+	//The read ahead of FILE_FLAG_SEQUENTIAL_SCAN is enough
+}
+
+void MappedFile::release(ByteSpan span) const
+{
+	//Unlocking pages that are not locked removes them from the working set
+	if (span.size) VirtualUnlock(const_cast<uint8_t*>(span.data), span.size);
+}
+
+#else
+
+bool MappedFile::open(const std::string& path, bool sequential)
+{
+	close();
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		std::cerr << "Failed to open " << path << std::endl;
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		std::cerr << "Failed to map " << path << ": empty file" << std::endl;
+		::close(fd);
+		return false;
+	}
+	void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	//The mapping keeps its own reference to the file
+	::close(fd);
+	if (data == MAP_FAILED)
+	{
+		std::cerr << "Failed to map " << path << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	m_data = static_cast<const uint8_t*>(data);
+	m_size = static_cast<size_t>(info.st_size);
+	madvise(data, m_size, sequential ? MADV_SEQUENTIAL : MADV_NORMAL);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data) munmap(const_cast<uint8_t*>(m_data), m_size);
+	m_data = nullptr;
+	m_size = 0;
+}
+
+//madvise works on whole pages: willNeed rounds the span out, release rounds it in (the pages at its ends may be shared)
+void MappedFile::willNeed(ByteSpan span) const
+{
+	if (!span.size) return;
+	const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+	const uintptr_t begin = reinterpret_cast<uintptr_t>(span.data) & ~(pageSize - 1);
+	const uintptr_t end = reinterpret_cast<uintptr_t>(span.data) + span.size;
+	madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+}
+
+void MappedFile::release(ByteSpan span) const
+{
+	const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+	const uintptr_t begin = (reinterpret_cast<uintptr_t>(span.data) + pageSize - 1) & ~(pageSize - 1);
+	const uintptr_t end = (reinterpret_cast<uintptr_t>(span.data) + span.size) & ~(pageSize - 1);
+	if (end > begin)
+		madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+}
+
+#endif
+
+bool GlbFile::open(const std::string& path)
+{
+	static constexpr uint32_t c_magic = 0x46546C67; //"glTF"
+	static constexpr uint32_t c_jsonChunk = 0x4E4F534A; //"JSON"
+	static constexpr uint32_t c_binaryChunk = 0x004E4942; //"BIN\0"
+
+	m_json = {};
+	m_binary = {};
+	if (!m_file.open(path)) return false;
+
+	ByteSpan bytes = m_file.getBytes();
+	uint32_t header[3];
+	if (bytes.size >= sizeof(header))
+		memcpy(header, bytes.data, sizeof(header));
+	if (bytes.size < sizeof(header) || header[0] != c_magic || header[1] != 2 || header[2] > bytes.size)
+	{
+		std::cerr << path << " is not a glTF 2.0 binary file" << std::endl;
+		m_file.close();
+		return false;
+	}
+
+	//Chunks are 4 bytes aligned, unknown chunks are skipped
+	size_t offset = sizeof(header);
+	while (offset + 8 <= header[2])
+	{
+		uint32_t chunk[2];
+		memcpy(chunk, bytes.data + offset, sizeof(chunk));
+		offset += sizeof(chunk);
+		if (chunk[0] > header[2] - offset) break;
+		ByteSpan span = { bytes.data + offset, chunk[0] };
+		if (chunk[1] == c_jsonChunk && !m_json.data)
+			m_json = span;
+		else if (chunk[1] == c_binaryChunk && !m_binary.data)
+			m_binary = span;
+		offset += (chunk[0] + 3) & ~size_t(3);
+	}
+
+	if (!m_json.data)
+	{
+		std::cerr << path << " has no JSON chunk" << std::endl;
+		m_file.close();
+		return false;
+	}
+	m_file.willNeed(m_json);
+	return true;
+}
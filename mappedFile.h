@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct ByteSpan {
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+};
+
+// Read only mapping of a whole file: the pages are read from the disk on first access
+// and, being clean, can be dropped by the system at any time instead of being swapped.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	//sequential: the file is mostly read in order (more read ahead, pages freed sooner)
+	bool open(const std::string& path, bool sequential = true);
+	void close();
+
+	bool isOpen() const { return m_data != nullptr; }
+	ByteSpan getBytes() const { return { m_data, m_size }; }
+
+	//Starts reading the pages of the span in the background
+	void willNeed(ByteSpan span) const;
+	//The pages of the span are no longer needed, they leave the resident set (read again if accessed)
+	void release(ByteSpan span) const;
+
+private:
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#endif
+};
+
+// Binary glTF (.glb) read through a MappedFile: a 12 bytes header, the JSON chunk and an optional BIN chunk.
+// The chunks are spans into the mapping, nothing is copied.
+class GlbFile
+{
+public:
+	bool open(const std::string& path);
+
+	ByteSpan getJson() const { return m_json; }
+	//Empty when the file has no BIN chunk
+	ByteSpan getBinary() const { return m_binary; }
+	MappedFile& getMapping() { return m_file; }
+
+private:
+	MappedFile m_file;
+	ByteSpan m_json;
+	ByteSpan m_binary;
+};
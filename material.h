@@ -8,11 +8,27 @@ using namespace wgpu;
 #include <glm/ext.hpp>
 using namespace glm;
 
+#include <memory>
+
 #include "uniformsBuffer.h"
 #include "attributed.h"
 #include "managers.h"
 
 
+//One bind group for several materials of an attributes group: their textures and samplers are the same,
+//each one has its uniforms in a version of the buffer, bound with a dynamic offset (see Material::share and MaterialPacker)
+struct SharedMaterial
+{
+	SharedMaterial(const std::string& attributesId, size_t materialCount) :
+		attributesId(attributesId),
+		runtime(attributesId, materialCount)
+	{}
+
+	std::string attributesId;
+	Issam::AttributedRuntime runtime;
+};
+
+
 class Material 
 {
 public:
@@ -25,20 +41,83 @@ public:
 		}
 		
 	};
-	~Material() = default;
+	~Material()
+	{
+		for (auto& [name, textureId] : m_textureIds)
+			TextureManager::getInstance().release(textureId);
+	}
+
+	//Draws with the bind group of shared, with the uniforms of this material in the version slot. Its textures and samplers
+	//must be those of shared: setting one of them afterwards goes back to the bind group of the material.
+	void share(std::shared_ptr<SharedMaterial> shared, uint32_t slot)
+	{
+		Issam::AttributedRuntime* runtime = m_attributeds[shared->attributesId];
+		assert(runtime && runtime->getNumVersions() == 1 && slot < shared->runtime.getNumVersions());
+		for (const auto& attribute : runtime->getAttributes())
+		{
+			if (std::holds_alternative<UniformValue>(attribute.value))
+				shared->runtime.setAttribute(attribute.name, attribute.value, slot);
+			else if (slot == 0)
+				shared->runtime.setAttribute(attribute.name, attribute.value);
+		}
+		m_shared = shared;
+		m_sharedSlot = slot;
+	}
+
+	bool isShared() const { return m_shared != nullptr; }
+
+	//The runtime bound to draw the material, version is replaced by the slot of the material when it is shared
+	Issam::AttributedRuntime* getDrawRuntime(const std::string& attributedId, uint32_t& version)
+	{
+		if (m_shared && m_shared->attributesId == attributedId)
+		{
+			version = m_sharedSlot;
+			return &m_shared->runtime;
+		}
+		return m_attributeds[attributedId];
+	}
+
+	//A texture of the TextureManager, referenced until it is replaced or the material is deleted
+	void setTexture(const std::string& name, const std::string& textureId)
+	{
+		TextureView textureView = TextureManager::getInstance().acquire(textureId);
+		if (!textureView) return;
+		auto previous = m_textureIds.find(name);
+		if (previous != m_textureIds.end())
+			TextureManager::getInstance().release(previous->second);
+		m_textureIds[name] = textureId;
+		setAttribute(name, textureView);
+	}
 
 	void setAttribute(const std::string& name, const Issam::AttributeValue& value)
 	{
 		for (auto attributed : m_attributeds)
 		{
 			if (attributed.second->hasAttribute(name))
-				attributed.second->setAttribute(name, value);
+				setAttribute(attributed.first, name, value);
 		}
 	}
 
 	void setAttribute(const std::string& materialAttributesId, const std::string& name, const  Issam::AttributeValue& value, size_t version = 0)
 	{
 		m_attributeds[materialAttributesId]->setAttribute(name, value, version);
+		if (m_shared && m_shared->attributesId == materialAttributesId)
+		{
+			if (std::holds_alternative<UniformValue>(value))
+				m_shared->runtime.setAttribute(name, value, m_sharedSlot);
+			else
+				m_shared = nullptr;
+		}
+	}
+
+	bool hasAttribute(const std::string& name)
+	{
+		for (auto attributed : m_attributeds)
+		{
+			if (attributed.second->hasAttribute(name))
+				return true;
+		}
+		return false;
 	}
 
 	Issam::Attribute& getAttribute(const std::string& name)
@@ -71,6 +150,9 @@ public:
 
 private:
 	std::unordered_map<std::string, Issam::AttributedRuntime*> m_attributeds{};
+	std::unordered_map<std::string, std::string> m_textureIds{}; //Per texture attribute, see setTexture
+	std::shared_ptr<SharedMaterial> m_shared;
+	uint32_t m_sharedSlot = 0;
 };
 
 
@@ -0,0 +1,190 @@
+#include "materialPacker.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <tuple>
+
+#include "utils.h"
+
+namespace
+{
+	//Textures that fit in the same array
+	struct ArrayKey {
+		uint32_t width;
+		uint32_t height;
+		uint32_t levelCount;
+		TextureFormat format;
+
+		bool operator<(const ArrayKey& other) const
+		{
+			return std::tie(width, height, levelCount, format) < std::tie(other.width, other.height, other.levelCount, other.format);
+		}
+	};
+
+	//The compressed levels are copied in whole blocks, the last ones are larger than the level
+	Extent3D getLevelExtent(const ArrayKey& key, uint32_t level)
+	{
+		const Utils::FormatBlock block = Utils::getFormatBlock(key.format);
+		const uint32_t blocksWide = (std::max(key.width >> level, 1u) + block.width - 1) / block.width;
+		const uint32_t blocksHigh = (std::max(key.height >> level, 1u) + block.height - 1) / block.height;
+		return { blocksWide * block.width, blocksHigh * block.height, 1 };
+	}
+
+	size_t getLayerBytes(const ArrayKey& key)
+	{
+		const Utils::FormatBlock block = Utils::getFormatBlock(key.format);
+		size_t bytes = 0;
+		for (uint32_t level = 0; level < key.levelCount; ++level)
+		{
+			const Extent3D extent = getLevelExtent(key, level);
+			bytes += size_t(extent.width / block.width) * (extent.height / block.height) * block.bytes;
+		}
+		return bytes;
+	}
+}
+
+MaterialPacker::MaterialPacker(const std::string& attributesId, const std::string& layersName, std::vector<Slot> slots) :
+	m_attributesId(attributesId),
+	m_layersName(layersName),
+	m_slots(std::move(slots))
+{
+	assert(m_slots.size() <= 4);
+}
+
+void MaterialPacker::addMaterial(Material* material)
+{
+	m_materials.push_back(material);
+}
+
+void MaterialPacker::addTexture(Material* material, uint32_t slot, const Texture& texture)
+{
+	assert(slot < m_slots.size());
+	m_textures.push_back({ material, slot, texture });
+}
+
+bool MaterialPacker::isPacked(const Texture& texture) const
+{
+	return std::binary_search(m_packed.begin(), m_packed.end(), static_cast<const void*>(texture.Get()));
+}
+
+MaterialPacker::Stats MaterialPacker::pack()
+{
+	Stats stats;
+	stats.materials = m_materials.size();
+
+	//The distinct textures of each size, format and mip count
+	std::map<ArrayKey, std::vector<Texture>> groups;
+	std::set<const void*> grouped;
+	for (const auto& entry : m_textures)
+	{
+		if (!grouped.insert(entry.texture.Get()).second) continue;
+		ArrayKey key = { entry.texture.GetWidth(), entry.texture.GetHeight(), entry.texture.GetMipLevelCount(), entry.texture.GetFormat() };
+		groups[key].push_back(entry.texture);
+	}
+
+	//Array view and layer of each packed texture, copied on the GPU
+	std::map<const void*, std::pair<TextureView, uint32_t>> layers;
+	Device device = Context::getInstance().getDevice();
+	CommandEncoder encoder = device.CreateCommandEncoder();
+	for (const auto& [key, textures] : groups)
+	{
+		//A texture alone would not let any material share its bind group
+		if (textures.size() < 2) continue;
+		for (size_t first = 0; first < textures.size(); first += c_maxLayers)
+		{
+			const uint32_t layerCount = static_cast<uint32_t>(std::min<size_t>(textures.size() - first, c_maxLayers));
+			TextureDescriptor textureDesc;
+			textureDesc.label = "materialArray";
+			textureDesc.dimension = TextureDimension::e2D;
+			textureDesc.format = key.format;
+			textureDesc.size = { key.width, key.height, layerCount };
+			textureDesc.mipLevelCount = key.levelCount;
+			textureDesc.sampleCount = 1;
+			textureDesc.usage = TextureUsage::TextureBinding | TextureUsage::CopyDst;
+			textureDesc.viewFormatCount = 0;
+			textureDesc.viewFormats = nullptr;
+			Texture array = device.CreateTexture(&textureDesc);
+
+			TextureViewDescriptor viewDesc;
+			viewDesc.format = key.format;
+			viewDesc.dimension = TextureViewDimension::e2DArray;
+			viewDesc.baseMipLevel = 0;
+			viewDesc.mipLevelCount = key.levelCount;
+			viewDesc.baseArrayLayer = 0;
+			viewDesc.arrayLayerCount = layerCount;
+			viewDesc.aspect = TextureAspect::All;
+			TextureView arrayView = array.CreateView(&viewDesc);
+
+			for (uint32_t layer = 0; layer < layerCount; ++layer)
+			{
+				const Texture& texture = textures[first + layer];
+				for (uint32_t level = 0; level < key.levelCount; ++level)
+				{
+					ImageCopyTexture source;
+					source.texture = texture;
+					source.mipLevel = level;
+					ImageCopyTexture destination;
+					destination.texture = array;
+					destination.mipLevel = level;
+					destination.origin = { 0, 0, layer };
+					Extent3D extent = getLevelExtent(key, level);
+					encoder.CopyTextureToTexture(&source, &destination, &extent);
+				}
+				layers[texture.Get()] = { arrayView, layer };
+			}
+			stats.textures += layerCount;
+			stats.arrays++;
+			stats.arrayBytes += getLayerBytes(key) * layerCount;
+		}
+	}
+	CommandBuffer command = encoder.Finish();
+	device.GetQueue().Submit(1, &command);
+	m_packed.clear();
+	for (const auto& [handle, layer] : layers)
+		m_packed.push_back(handle);
+
+	//The packed textures are sampled in their array, their 2D attribute goes back to its default so that the 2D texture is freed
+	Issam::AttributeGroup group = Issam::AttributedManager::getInstance().get(m_attributesId);
+	auto getDefault = [&group](const std::string& name) {
+		auto it = std::find_if(group.getAttributes().begin(), group.getAttributes().end(), [&name](const Issam::Attribute& attribute) {
+			return attribute.name == name;
+		});
+		assert(it != group.getAttributes().end());
+		return it->value;
+	};
+	for (const auto& entry : m_textures)
+	{
+		auto layer = layers.find(entry.texture.Get());
+		if (layer == layers.end()) continue;
+		glm::vec4 materialLayers = std::get<glm::vec4>(entry.material->getUniform(m_layersName));
+		materialLayers[entry.slot] = float(layer->second.second);
+		entry.material->setAttribute(m_attributesId, m_layersName, materialLayers);
+		entry.material->setAttribute(m_attributesId, m_slots[entry.slot].array, layer->second.first);
+		entry.material->setAttribute(m_attributesId, m_slots[entry.slot].texture, getDefault(m_slots[entry.slot].texture));
+	}
+
+	//The materials bound to the same textures and samplers share a bind group, their uniforms in its versions
+	std::map<std::vector<const void*>, std::vector<Material*>> bindings;
+	for (Material* material : m_materials)
+	{
+		std::vector<const void*> key;
+		for (const auto& attribute : material->getAttibutedRuntime(m_attributesId)->getAttributes())
+		{
+			if (std::holds_alternative<TextureView>(attribute.value))
+				key.push_back(std::get<TextureView>(attribute.value).Get());
+			else if (std::holds_alternative<Sampler>(attribute.value))
+				key.push_back(std::get<Sampler>(attribute.value).Get());
+		}
+		bindings[key].push_back(material);
+	}
+	for (const auto& [key, materials] : bindings)
+	{
+		if (materials.size() < 2) continue;
+		auto shared = std::make_shared<SharedMaterial>(m_attributesId, materials.size());
+		for (uint32_t slot = 0; slot < materials.size(); ++slot)
+			materials[slot]->share(shared, slot);
+	}
+	stats.bindGroups = bindings.size();
+	return stats;
+}
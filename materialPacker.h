@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "context.h"
+#include "material.h"
+
+// Fewer material bind groups: the 2D textures of the same size, format and mip count are copied into texture arrays,
+// the materials then sample a layer of them (the layer of each texture is a component of a uniform, -1 for the 2D
+// texture), and the materials left with the same textures and samplers share one bind group (see SharedMaterial).
+// With the draws sorted by bind group, the material bind group only changes once per group instead of once per material.
+class MaterialPacker
+{
+public:
+	//A texture attribute that can be packed, and the texture_2d_array attribute sampled instead
+	struct Slot {
+		std::string texture;
+		std::string array;
+	};
+
+	struct Stats {
+		size_t textures = 0; //Copied into a layer
+		size_t arrays = 0;
+		size_t arrayBytes = 0;
+		size_t materials = 0;
+		size_t bindGroups = 0; //Left for the materials, shared or not
+	};
+
+	static constexpr uint32_t c_maxLayers = 256; //maxTextureArrayLayers of the default limits
+
+	//The slots are in the order of the components of the layers uniform (4 at most)
+	MaterialPacker(const std::string& attributesId, const std::string& layersName, std::vector<Slot> slots);
+
+	void addMaterial(Material* material);
+	//The texture bound to the slot of the material, uploaded whole (the streamed textures change of view)
+	void addTexture(Material* material, uint32_t slot, const Texture& texture);
+
+	//The copies are submitted to the queue, the 2D textures are no longer bound by the materials once packed
+	Stats pack();
+	//After pack: the texture is in an array, its 2D texture is unused
+	bool isPacked(const Texture& texture) const;
+
+private:
+	struct MaterialTexture {
+		Material* material;
+		uint32_t slot;
+		Texture texture;
+	};
+
+	std::string m_attributesId;
+	std::string m_layersName;
+	std::vector<Slot> m_slots;
+	std::vector<Material*> m_materials;
+	std::vector<MaterialTexture> m_textures;
+	std::vector<const void*> m_packed; //Handles of the packed textures, sorted
+};
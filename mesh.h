@@ -1,7 +1,13 @@
 #pragma once
 
 
+#include <algorithm>
+#include <limits>
+
 #include "context.h"
+#include "geometryPool.h"
+#include "vertexLayout.h"
+#include "meshlet.h"
 
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_FORCE_LEFT_HANDED
@@ -11,102 +17,147 @@
 using namespace wgpu;
 using namespace glm;
 
-class VertexBuffer
+//CPU geometry of a primitive, as decoded from a file and before the upload
+struct MeshData
 {
-public:
-	VertexBuffer(const void* vertexData, size_t size, int vertexCount) :
-		m_count(vertexCount)
-	{
-		// Create vertex buffer
-		m_size = size;
-		BufferDescriptor bufferDesc;
-		bufferDesc.size = m_size;
-		bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Vertex;
-		bufferDesc.mappedAtCreation = false;
-		m_buffer = Context::getInstance().getDevice().CreateBuffer(&bufferDesc);
-
-		// Upload geometry data to the buffer
-		Context::getInstance().getDevice().GetQueue().WriteBuffer(m_buffer, 0, vertexData, bufferDesc.size);
-	};
-
-	~VertexBuffer() {
-		m_buffer.Destroy();
-	};
-
-	const Buffer& getBuffer()const { return m_buffer; }
-	const uint64_t getSize() const { return m_size; }
-	const int getCount() const { return m_count; }
-
-private:
-	Buffer m_buffer{ nullptr };
-	size_t  m_size;
-	int m_count{ 0 };
-	
-	friend class Mesh;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices; //Empty for non indexed geometry
 };
 
-class IndexBuffer
+//Vertices uploaded as they are stored in a file, one pointer per stream of the layout
+struct VertexStreams
 {
-public:
-	IndexBuffer(const void* indexData, size_t size, int indexCount) :
-		m_count(indexCount)
-	{
-		m_size = size ;
-		BufferDescriptor bufferDesc;
-		bufferDesc.size = m_size;
-		bufferDesc.usage = BufferUsage::CopyDst | BufferUsage::Index;
-
-		bufferDesc.size = (bufferDesc.size + 3) & ~3; // round up to the next multiple of 4
-		m_buffer = Context::getInstance().getDevice().CreateBuffer(&bufferDesc);
-
-		// Upload geometry data to the buffer
-		Context::getInstance().getDevice().GetQueue().WriteBuffer(m_buffer, 0, indexData, bufferDesc.size);
-	};
-	~IndexBuffer() {
-		m_buffer.Destroy();
-	};
-
-	const Buffer& getBuffer()const { return m_buffer; }
-	const size_t getSize() const { return m_size; }
-	const int getCount() const { return m_count; }
-
-private:
-	Buffer m_buffer{ nullptr };
-	size_t  m_size;
-	int m_count{ 0 };
-};
-
-struct Vertex {
-	vec3 position = vec3(0.0, 0.0, 0.0);
-	vec3 normal = vec3(0.0, 0.0, 0.0);;
-	vec3 tangent = vec3(0.0, 0.0, 0.0);;
-	vec2 uv = vec2(0.0, 0.0);;
+	VertexLayout layout;
+	std::vector<const void*> data;
+	uint32_t vertexCount = 0;
+	glm::vec3 boxMin = glm::vec3(0.0);
+	glm::vec3 boxMax = glm::vec3(0.0);
 };
 
-
 class Mesh
 {
 public:
 	Mesh() {};
 	~Mesh() {
-		delete m_vertexBuffer;
-		delete m_indexBuffer;
+		GeometryPool::getInstance().release(m_vertexRange);
+		GeometryPool::getInstance().release(m_indexRange);
 	};
-	void setVertices(const std::vector<Vertex>& vertices) { 
+	//The vertices are encoded in the layout, quantized positions are dequantized by getDequantization()
+	void setVertices(const std::vector<Vertex>& vertices, const VertexLayout& layout = VertexLayout::getStandard()) { 
 		m_vertices = vertices; 
-		int vertexCount = static_cast<int>(vertices.size());
-		m_vertexBuffer = new VertexBuffer(vertices.data(), vertices.size() * sizeof(Vertex), vertexCount);
+		m_vertexCount = static_cast<uint32_t>(vertices.size());
+		m_layout = layout;
+		m_dirtyBoundingBox = true;
+		GeometryPool::getInstance().release(m_vertexRange);
+
+		glm::vec3 boxMin = glm::vec3(0.0);
+		glm::vec3 extent = glm::vec3(1.0);
+		m_dequantization = glm::mat4(1.0);
+		if (m_layout.hasQuantizedPositions())
+		{
+			auto boundingBox = getBoundingBox();
+			boxMin = boundingBox.first;
+			extent = boundingBox.second - boundingBox.first;
+			m_dequantization = glm::translate(glm::mat4(1.0), boxMin) * glm::scale(glm::mat4(1.0), extent);
+		}
+
+		if (m_layout == VertexLayout::getStandard())
+		{
+			m_vertexRange = GeometryPool::getInstance().allocateVertices(vertices.data(), sizeof(Vertex), static_cast<uint32_t>(vertices.size()));
+		}
+		else
+		{
+			//One buffer per stream, all sub-allocated at the same vertex offset
+			std::vector<std::vector<uint8_t>> streams = m_layout.encode(vertices, boxMin, extent);
+			std::vector<const void*> streamsData;
+			for (const auto& stream : streams)
+				streamsData.push_back(stream.data());
+			m_vertexRange = GeometryPool::getInstance().allocateVertices(streamsData, m_layout.getStrides(), static_cast<uint32_t>(vertices.size()));
+		}
 	}
-	void setIndices(const std::vector<uint16_t>& indices) { 
+	//No CPU copy of the vertices is kept, getVertices() stays empty: the meshes needing the vertices
+	//on the CPU (batching, impostors...) must use setVertices
+	void setVertexStreams(const VertexStreams& streams) {
+		assert(streams.data.size() == streams.layout.getStreamCount());
+		m_vertices.clear();
+		m_vertexCount = streams.vertexCount;
+		m_layout = streams.layout;
+		m_dequantization = glm::mat4(1.0);
+		m_boundingBox = std::make_pair(streams.boxMin, streams.boxMax);
+		m_dirtyBoundingBox = false;
+		GeometryPool::getInstance().release(m_vertexRange);
+		m_vertexRange = GeometryPool::getInstance().allocateVertices(streams.data, m_layout.getStrides(), m_vertexCount);
+	}
+	//Uploaded as uint16 whenever the indices fit, uint32 otherwise
+	void setIndices(const std::vector<uint32_t>& indices) { 
 		m_indices = indices; 
-		int indexCount = static_cast<int>(indices.size());
-		m_indexBuffer = new IndexBuffer(indices.data(), indices.size() * sizeof(uint16_t), indexCount);
+		m_lods = { Lod{ 0, static_cast<uint32_t>(indices.size()), 0.0f } };
+		uploadIndices(indices);
+	}
+	void setIndices(const std::vector<uint16_t>& indices) { 
+		setIndices(std::vector<uint32_t>(indices.begin(), indices.end()));
+	}
+	IndexFormat getIndexFormat() const { return m_indexFormat; }
+
+	struct Lod {
+		uint32_t firstIndex = 0; //In the index range of the mesh
+		uint32_t indexCount = 0;
+		float error = 0.0f;      //Object space distance to the full mesh
+	};
+	//Index lists of decreasing detail over the same vertices, all uploaded in one index range.
+	//The CPU indices (getIndices) stay the ones of the LOD 0.
+	void setLods(const std::vector<std::vector<uint32_t>>& lodIndices, const std::vector<float>& errors) {
+		assert(!lodIndices.empty() && lodIndices.size() == errors.size());
+		m_indices = lodIndices[0];
+		m_lods.clear();
+		std::vector<uint32_t> indices;
+		for (size_t lod = 0; lod < lodIndices.size(); ++lod)
+		{
+			m_lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lodIndices[lod].size()), errors[lod] });
+			indices.insert(indices.end(), lodIndices[lod].begin(), lodIndices[lod].end());
+		}
+		uploadIndices(indices);
 	}
+	const std::vector<Lod>& getLods() const { return m_lods; }
 
-	VertexBuffer* getVertexBuffer() { return  m_vertexBuffer; }
-	IndexBuffer* getIndexBuffer() { return m_indexBuffer; };
+	//Clusters of triangles culled on the GPU by the meshlet passes, the indices are relative to the vertex range
+	void setMeshlets(const MeshletData& meshlets) {
+		m_meshlets = meshlets;
+		m_meshletBuffer = nullptr;
+		m_meshletIndexBuffer = nullptr;
+		if (m_meshlets.meshlets.empty()) return;
 
-	int getVertexCount() { return m_vertices.size(); } 
+		Device device = Context::getInstance().getDevice();
+		BufferDescriptor bufferDesc;
+		bufferDesc.label = "meshlets";
+		bufferDesc.usage = BufferUsage::Storage | BufferUsage::CopyDst;
+		bufferDesc.size = m_meshlets.meshlets.size() * sizeof(Meshlet);
+		bufferDesc.mappedAtCreation = false;
+		m_meshletBuffer = device.CreateBuffer(&bufferDesc);
+		device.GetQueue().WriteBuffer(m_meshletBuffer, 0, m_meshlets.meshlets.data(), bufferDesc.size);
+
+		bufferDesc.label = "meshletIndices";
+		bufferDesc.size = m_meshlets.indices.size() * sizeof(uint32_t);
+		m_meshletIndexBuffer = device.CreateBuffer(&bufferDesc);
+		device.GetQueue().WriteBuffer(m_meshletIndexBuffer, 0, m_meshlets.indices.data(), bufferDesc.size);
+	}
+	bool hasMeshlets() const { return !m_meshlets.meshlets.empty(); }
+	const MeshletData& getMeshlets() const { return m_meshlets; }
+	const Buffer& getMeshletBuffer() const { return m_meshletBuffer; }
+	const Buffer& getMeshletIndexBuffer() const { return m_meshletIndexBuffer; }
+
+	//Sub-allocated in the shared buffers of the GeometryPool, draw with firstIndex/baseVertex
+	const GeometryRange* getVertexRange() const { return m_vertexRange; }
+	const GeometryRange* getIndexRange() const { return m_indexRange; }
+
+	const VertexLayout& getVertexLayout() const { return m_layout; }
+	//Maps the quantized positions back to the object space, applied with the model matrix
+	const glm::mat4& getDequantization() const { return m_dequantization; }
+
+	int getVertexCount() { return m_vertexCount; } 
+
+	const std::vector<Vertex>& getVertices() const { return m_vertices; }
+	const std::vector<uint32_t>& getIndices() const { return m_indices; }
 
 	std::pair<glm::vec3, glm::vec3> getBoundingBox() {
 		if (!m_dirtyBoundingBox) return m_boundingBox;
@@ -128,12 +179,37 @@ public:
 	}
 
 private:
+	void uploadIndices(const std::vector<uint32_t>& indices) {
+		GeometryPool::getInstance().release(m_indexRange);
+
+		uint32_t maxIndex = indices.empty() ? 0 : *std::max_element(indices.begin(), indices.end());
+		if (maxIndex <= std::numeric_limits<uint16_t>::max())
+		{
+			std::vector<uint16_t> indices16(indices.begin(), indices.end());
+			m_indexFormat = IndexFormat::Uint16;
+			m_indexRange = GeometryPool::getInstance().allocateIndices(indices16.data(), m_indexFormat, static_cast<uint32_t>(indices16.size()));
+		}
+		else
+		{
+			m_indexFormat = IndexFormat::Uint32;
+			m_indexRange = GeometryPool::getInstance().allocateIndices(indices.data(), m_indexFormat, static_cast<uint32_t>(indices.size()));
+		}
+	}
 
-	VertexBuffer* m_vertexBuffer{ nullptr };
-	IndexBuffer* m_indexBuffer{ nullptr };
+	GeometryRange* m_vertexRange{ nullptr };
+	GeometryRange* m_indexRange{ nullptr };
 
-	std::vector<uint16_t> m_indices;
+	std::vector<uint32_t> m_indices;
+	std::vector<Lod> m_lods;
+	IndexFormat m_indexFormat = IndexFormat::Uint16;
 	std::vector<Vertex> m_vertices;
+	uint32_t m_vertexCount = 0;
+	VertexLayout m_layout = VertexLayout::getStandard();
+	glm::mat4 m_dequantization = glm::mat4(1.0);
+
+	MeshletData m_meshlets;
+	Buffer m_meshletBuffer{ nullptr };
+	Buffer m_meshletIndexBuffer{ nullptr };
 
 	std::pair<glm::vec3, glm::vec3> m_boundingBox;
 	bool m_dirtyBoundingBox = true;;
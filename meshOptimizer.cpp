@@ -0,0 +1,299 @@
+#include "meshOptimizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+void MeshOptimizer::optimize(MeshData& meshData, Stats* before, Stats* after)
+{
+	if (meshData.vertices.empty()) return;
+	if (meshData.indices.empty())
+	{
+		meshData.indices.resize(meshData.vertices.size());
+		std::iota(meshData.indices.begin(), meshData.indices.end(), 0);
+	}
+	//Only triangle lists
+	if (meshData.indices.size() % 3 != 0) return;
+
+	if (before)
+		*before = analyzeVertexCache(meshData.indices, static_cast<uint32_t>(meshData.vertices.size()));
+
+	weld(meshData);
+	std::vector<uint32_t> clusters = optimizeVertexCache(meshData.indices, static_cast<uint32_t>(meshData.vertices.size()));
+	optimizeOverdraw(meshData, clusters);
+	optimizeVertexFetch(meshData);
+
+	if (after)
+		*after = analyzeVertexCache(meshData.indices, static_cast<uint32_t>(meshData.vertices.size()));
+}
+
+void MeshOptimizer::weld(MeshData& meshData)
+{
+	const std::vector<Vertex>& vertices = meshData.vertices;
+	struct Hash {
+		const std::vector<Vertex>* vertices;
+		size_t operator()(uint32_t index) const {
+			//FNV-1a on the bytes of the vertex
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&(*vertices)[index]);
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < sizeof(Vertex); ++i)
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			return static_cast<size_t>(hash);
+		}
+	};
+	struct Equal {
+		const std::vector<Vertex>* vertices;
+		bool operator()(uint32_t a, uint32_t b) const {
+			return memcmp(&(*vertices)[a], &(*vertices)[b], sizeof(Vertex)) == 0;
+		}
+	};
+
+	std::unordered_map<uint32_t, uint32_t, Hash, Equal> uniqueVertices(vertices.size(), Hash{ &vertices }, Equal{ &vertices });
+	std::vector<uint32_t> remap(vertices.size());
+	std::vector<Vertex> welded;
+	welded.reserve(vertices.size());
+	for (uint32_t i = 0; i < vertices.size(); ++i)
+	{
+		auto [it, inserted] = uniqueVertices.emplace(i, static_cast<uint32_t>(welded.size()));
+		if (inserted)
+			welded.push_back(vertices[i]);
+		remap[i] = it->second;
+	}
+
+	for (uint32_t& index : meshData.indices)
+		index = remap[index];
+	meshData.vertices = std::move(welded);
+}
+
+std::vector<uint32_t> MeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+	const size_t triangleCount = indices.size() / 3;
+	std::vector<uint32_t> clusters;
+	if (triangleCount == 0) return clusters;
+
+	//Vertex -> triangles adjacency
+	std::vector<uint32_t> live(vertexCount, 0);
+	for (uint32_t index : indices)
+		live[index]++;
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (uint32_t v = 0; v < vertexCount; ++v)
+		offsets[v + 1] = offsets[v] + live[v];
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); ++i)
+		adjacency[cursors[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnd;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	deadEnd.reserve(indices.size());
+	output.reserve(indices.size());
+
+	uint32_t timestamp = cacheSize + 1;
+	uint32_t cursor = 0;
+	bool newCluster = true;
+	int64_t fanning = 0;
+	while (cursor < vertexCount && live[cursor] == 0) cursor++;
+	fanning = cursor < vertexCount ? cursor : -1;
+
+	while (fanning >= 0)
+	{
+		//Emit all the remaining triangles around the fanning vertex
+		candidates.clear();
+		for (uint32_t k = offsets[fanning]; k < offsets[fanning + 1]; ++k)
+		{
+			uint32_t triangle = adjacency[k];
+			if (emitted[triangle]) continue;
+			if (newCluster)
+			{
+				clusters.push_back(static_cast<uint32_t>(output.size() / 3));
+				newCluster = false;
+			}
+			for (int c = 0; c < 3; ++c)
+			{
+				uint32_t v = indices[triangle * 3 + c];
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (timestamp - cacheTime[v] > cacheSize)
+					cacheTime[v] = timestamp++;
+			}
+			emitted[triangle] = true;
+		}
+
+		//Next fanning vertex: the one staying the longest in the cache among the neighbours
+		int64_t best = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t candidate : candidates)
+		{
+			if (live[candidate] == 0) continue;
+			int64_t priority = 0;
+			if (timestamp - cacheTime[candidate] + 2 * live[candidate] <= cacheSize)
+				priority = timestamp - cacheTime[candidate];
+			if (priority > bestPriority)
+			{
+				best = candidate;
+				bestPriority = priority;
+			}
+		}
+
+		if (best == -1)
+		{
+			//Dead end: go back to a recently used vertex, or to the next vertex in the input order
+			newCluster = true;
+			while (!deadEnd.empty())
+			{
+				uint32_t v = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[v] > 0)
+				{
+					best = v;
+					break;
+				}
+			}
+			if (best == -1)
+			{
+				while (cursor < vertexCount && live[cursor] == 0) cursor++;
+				if (cursor < vertexCount) best = cursor;
+			}
+		}
+		fanning = best;
+	}
+
+	indices = std::move(output);
+	return clusters;
+}
+
+void MeshOptimizer::optimizeOverdraw(MeshData& meshData, const std::vector<uint32_t>& clusters, float threshold)
+{
+	std::vector<uint32_t>& indices = meshData.indices;
+	const std::vector<Vertex>& vertices = meshData.vertices;
+	const uint32_t triangleCount = static_cast<uint32_t>(indices.size() / 3);
+	if (clusters.size() == 0 || triangleCount == 0) return;
+	const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+
+	//Soft boundaries: split the clusters as soon as their local ACMR is close to the mesh one
+	const float meshAcmr = analyzeVertexCache(indices, vertexCount).acmr;
+	std::vector<uint32_t> splitClusters;
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	uint32_t timestamp = c_cacheSize + 1;
+	for (size_t c = 0; c < clusters.size(); ++c)
+	{
+		uint32_t begin = clusters[c];
+		uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+		uint32_t start = begin;
+		uint32_t misses = 0;
+		timestamp += c_cacheSize + 1; //Empty cache
+		splitClusters.push_back(begin);
+		for (uint32_t triangle = begin; triangle < end; ++triangle)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				uint32_t v = indices[triangle * 3 + k];
+				if (timestamp - cacheTime[v] > c_cacheSize)
+				{
+					cacheTime[v] = timestamp++;
+					misses++;
+				}
+			}
+			uint32_t triangles = triangle + 1 - start;
+			if (triangle + 1 < end && float(misses) / triangles <= threshold * meshAcmr)
+			{
+				start = triangle + 1;
+				misses = 0;
+				timestamp += c_cacheSize + 1;
+				splitClusters.push_back(start);
+			}
+		}
+	}
+
+	//Sort the clusters by how much they face outward, seen from the center of the mesh
+	glm::vec3 meshCentroid(0.0f);
+	for (const auto& vertex : vertices)
+		meshCentroid += vertex.position;
+	meshCentroid /= float(std::max<size_t>(vertices.size(), 1));
+
+	struct Cluster {
+		uint32_t begin;
+		uint32_t end;
+		float sortKey;
+	};
+	std::vector<Cluster> sortedClusters;
+	sortedClusters.reserve(splitClusters.size());
+	for (size_t c = 0; c < splitClusters.size(); ++c)
+	{
+		Cluster cluster;
+		cluster.begin = splitClusters[c];
+		cluster.end = c + 1 < splitClusters.size() ? splitClusters[c + 1] : triangleCount;
+
+		glm::vec3 centroid(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0.0f;
+		for (uint32_t triangle = cluster.begin; triangle < cluster.end; ++triangle)
+		{
+			const glm::vec3& p0 = vertices[indices[triangle * 3 + 0]].position;
+			const glm::vec3& p1 = vertices[indices[triangle * 3 + 1]].position;
+			const glm::vec3& p2 = vertices[indices[triangle * 3 + 2]].position;
+			glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+			float triangleArea = glm::length(cross);
+			centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+			normal += cross;
+			area += triangleArea;
+		}
+		centroid = area > 0.0f ? centroid / area : vertices[indices[cluster.begin * 3]].position;
+		float normalLength = glm::length(normal);
+		cluster.sortKey = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+		sortedClusters.push_back(cluster);
+	}
+	std::stable_sort(sortedClusters.begin(), sortedClusters.end(), [](const Cluster& a, const Cluster& b) {
+		return a.sortKey > b.sortKey;
+	});
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	for (const auto& cluster : sortedClusters)
+		output.insert(output.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+	indices = std::move(output);
+}
+
+void MeshOptimizer::optimizeVertexFetch(MeshData& meshData)
+{
+	std::vector<uint32_t> remap(meshData.vertices.size(), std::numeric_limits<uint32_t>::max());
+	std::vector<Vertex> vertices;
+	vertices.reserve(meshData.vertices.size());
+	for (uint32_t& index : meshData.indices)
+	{
+		if (remap[index] == std::numeric_limits<uint32_t>::max())
+		{
+			remap[index] = static_cast<uint32_t>(vertices.size());
+			vertices.push_back(meshData.vertices[index]);
+		}
+		index = remap[index];
+	}
+	meshData.vertices = std::move(vertices);
+}
+
+MeshOptimizer::Stats MeshOptimizer::analyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+	Stats stats;
+	if (indices.empty() || vertexCount == 0) return stats;
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	uint32_t timestamp = cacheSize + 1;
+	uint32_t misses = 0;
+	for (uint32_t index : indices)
+	{
+		if (timestamp - cacheTime[index] > cacheSize)
+		{
+			cacheTime[index] = timestamp++;
+			misses++;
+		}
+	}
+	stats.acmr = float(misses) / (indices.size() / 3);
+	stats.atvr = float(misses) / vertexCount;
+	return stats;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+#include "mesh.h"
+
+// Load time reordering of triangle lists for the GPU:
+// welding, post-transform vertex cache (Tipsify), overdraw and vertex fetch ordering.
+// Everything works on the CPU data and is safe to run from worker threads.
+class MeshOptimizer
+{
+public:
+	struct Stats {
+		float acmr = 0.0f; //Average cache miss ratio: transformed vertices per triangle, 0.5 at best
+		float atvr = 0.0f; //Average transform to vertex ratio: transformed vertices per vertex, 1.0 at best
+	};
+
+	//Runs all the steps, non indexed geometry gets an index buffer
+	static void optimize(MeshData& meshData, Stats* before = nullptr, Stats* after = nullptr);
+
+	//Merges the bitwise identical vertices
+	static void weld(MeshData& meshData);
+	//Tipsify, returns the first triangle of each cluster (hard boundaries of the traversal)
+	static std::vector<uint32_t> optimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = c_cacheSize);
+	//Sorts the clusters so that the outward facing ones are drawn first.
+	//Clusters are further split while their ACMR stays under threshold * the mesh ACMR
+	static void optimizeOverdraw(MeshData& meshData, const std::vector<uint32_t>& clusters, float threshold = 1.05f);
+	//Renumbers the vertices in the order of their first use, drops the unused ones
+	static void optimizeVertexFetch(MeshData& meshData);
+
+	//FIFO cache simulation
+	static Stats analyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = c_cacheSize);
+
+	static constexpr uint32_t c_cacheSize = 16;
+};
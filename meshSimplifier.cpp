@@ -0,0 +1,270 @@
+#include "meshSimplifier.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+#include "meshOptimizer.h"
+
+namespace
+{
+	//Sum of squared distances to planes, weighted by the area of the triangles
+	struct Quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+		double a11 = 0, a12 = 0, a13 = 0;
+		double a22 = 0, a23 = 0;
+		double a33 = 0;
+		double weight = 0;
+
+		void addPlane(const glm::dvec3& n, double d, double w)
+		{
+			a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+			a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+			a22 += w * n.z * n.z; a23 += w * n.z * d;
+			a33 += w * d * d;
+			weight += w;
+		}
+
+		void add(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+			a11 += q.a11; a12 += q.a12; a13 += q.a13;
+			a22 += q.a22; a23 += q.a23;
+			a33 += q.a33;
+			weight += q.weight;
+		}
+
+		//Mean squared distance of p to the planes
+		double evaluate(const glm::dvec3& p) const
+		{
+			double error = a00 * p.x * p.x + 2 * a01 * p.x * p.y + 2 * a02 * p.x * p.z + 2 * a03 * p.x
+				+ a11 * p.y * p.y + 2 * a12 * p.y * p.z + 2 * a13 * p.y
+				+ a22 * p.z * p.z + 2 * a23 * p.z
+				+ a33;
+			return weight > 0 ? std::max(error, 0.0) / weight : 0.0;
+		}
+	};
+
+	struct PositionHash {
+		size_t operator()(const glm::vec3& p) const {
+			uint32_t bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+		}
+	};
+
+	struct Collapse {
+		uint32_t from;
+		uint32_t to;
+		float cost;
+	};
+
+	constexpr int c_maxPasses = 100;
+}
+
+std::vector<uint32_t> MeshSimplifier::simplify(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, size_t targetIndexCount, float maxError, float* resultError)
+{
+	std::vector<uint32_t> result = indices;
+	if (resultError) *resultError = 0.0f;
+	if (indices.size() % 3 != 0 || indices.size() <= targetIndexCount) return result;
+	const uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+
+	//Vertices sharing a position: the first one represents the others
+	std::vector<uint32_t> positionOf(vertexCount);
+	std::vector<uint32_t> wedgeCount(vertexCount, 0);
+	{
+		std::unordered_map<glm::vec3, uint32_t, PositionHash> firstVertex(vertexCount);
+		for (uint32_t v = 0; v < vertexCount; ++v)
+		{
+			positionOf[v] = firstVertex.emplace(vertices[v].position, v).first->second;
+			wedgeCount[positionOf[v]]++;
+		}
+	}
+
+	//Locked: seams, and the borders of the surface (edges without opposite edge, on the positions)
+	std::vector<bool> locked(vertexCount, false);
+	{
+		std::unordered_map<uint64_t, int> halfEdges(indices.size());
+		auto key = [](uint32_t a, uint32_t b) { return (static_cast<uint64_t>(a) << 32) | b; };
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				uint32_t a = positionOf[indices[i + k]];
+				uint32_t b = positionOf[indices[i + (k + 1) % 3]];
+				halfEdges[key(a, b)]++;
+			}
+		}
+		std::vector<bool> lockedPosition(vertexCount, false);
+		for (const auto& [edge, count] : halfEdges)
+		{
+			uint32_t a = static_cast<uint32_t>(edge >> 32);
+			uint32_t b = static_cast<uint32_t>(edge & 0xffffffff);
+			auto opposite = halfEdges.find(key(b, a));
+			if (opposite == halfEdges.end() || opposite->second != count)
+				lockedPosition[a] = lockedPosition[b] = true;
+		}
+		for (uint32_t v = 0; v < vertexCount; ++v)
+			locked[v] = lockedPosition[positionOf[v]] || wedgeCount[positionOf[v]] > 1;
+	}
+
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		const glm::dvec3 p0 = vertices[indices[i + 0]].position;
+		const glm::dvec3 p1 = vertices[indices[i + 1]].position;
+		const glm::dvec3 p2 = vertices[indices[i + 2]].position;
+		glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+		double length = glm::length(normal);
+		if (length == 0.0) continue;
+		normal /= length;
+		const double area = length * 0.5;
+		const double d = -glm::dot(normal, p0);
+		for (int k = 0; k < 3; ++k)
+			quadrics[positionOf[indices[i + k]]].addPlane(normal, d, area);
+	}
+
+	const double maxCost = static_cast<double>(maxError) * maxError;
+	double appliedCost = 0.0;
+	std::vector<uint32_t> offsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+
+	for (int pass = 0; pass < c_maxPasses && result.size() > targetIndexCount; ++pass)
+	{
+		//Vertex -> triangles
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (uint32_t index : result)
+			offsets[index + 1]++;
+		for (uint32_t v = 0; v < vertexCount; ++v)
+			offsets[v + 1] += offsets[v];
+		adjacency.resize(result.size());
+		{
+			std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < result.size(); ++i)
+				adjacency[cursors[result[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				uint32_t a = result[i + k];
+				uint32_t b = result[i + (k + 1) % 3];
+				for (int direction = 0; direction < 2; ++direction, std::swap(a, b))
+				{
+					if (locked[a]) continue;
+					Quadric quadric = quadrics[positionOf[a]];
+					quadric.add(quadrics[positionOf[b]]);
+					const Vertex& va = vertices[a];
+					const Vertex& vb = vertices[b];
+					glm::vec3 edge = vb.position - va.position;
+					float attributeError = glm::dot(va.normal - vb.normal, va.normal - vb.normal) + glm::dot(va.uv - vb.uv, va.uv - vb.uv);
+					double cost = quadric.evaluate(vb.position) + c_attributeWeight * glm::dot(edge, edge) * attributeError;
+					if (cost <= maxCost)
+						collapses.push_back({ a, b, static_cast<float>(cost) });
+				}
+			}
+		}
+		if (collapses.empty()) break;
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+		for (uint32_t v = 0; v < vertexCount; ++v)
+			remap[v] = v;
+		std::fill(touched.begin(), touched.end(), false);
+		size_t indexCount = result.size();
+		size_t applied = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (indexCount <= targetIndexCount) break;
+			const uint32_t a = collapse.from;
+			const uint32_t b = collapse.to;
+			if (touched[a] || touched[b]) continue;
+
+			//Reject the collapses flipping a triangle around a
+			bool flip = false;
+			uint32_t removedTriangles = 0;
+			for (uint32_t k = offsets[a]; k < offsets[a + 1] && !flip; ++k)
+			{
+				const uint32_t* triangle = &result[adjacency[k] * 3];
+				if (triangle[0] == b || triangle[1] == b || triangle[2] == b)
+				{
+					removedTriangles++;
+					continue;
+				}
+				glm::vec3 p[3], q[3];
+				for (int c = 0; c < 3; ++c)
+				{
+					p[c] = vertices[triangle[c]].position;
+					q[c] = triangle[c] == a ? vertices[b].position : p[c];
+				}
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				flip = glm::dot(before, after) <= 0.0f;
+			}
+			if (flip) continue;
+
+			remap[a] = b;
+			quadrics[positionOf[b]].add(quadrics[positionOf[a]]);
+			appliedCost = std::max(appliedCost, static_cast<double>(collapse.cost));
+			indexCount -= removedTriangles * 3;
+			applied++;
+
+			//The neighbours keep their position during this pass, so that the flip tests stay valid
+			for (uint32_t k = offsets[a]; k < offsets[a + 1]; ++k)
+			{
+				const uint32_t* triangle = &result[adjacency[k] * 3];
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+			}
+			touched[b] = true;
+		}
+		if (applied == 0) break;
+
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			uint32_t i0 = remap[result[i + 0]];
+			uint32_t i1 = remap[result[i + 1]];
+			uint32_t i2 = remap[result[i + 2]];
+			if (i0 == i1 || i1 == i2 || i0 == i2) continue;
+			result[write++] = i0;
+			result[write++] = i1;
+			result[write++] = i2;
+		}
+		result.resize(write);
+	}
+
+	if (resultError) *resultError = static_cast<float>(std::sqrt(appliedCost));
+	return result;
+}
+
+MeshLods MeshSimplifier::generateLods(const MeshData& meshData, uint32_t lodCount, float reduction)
+{
+	MeshLods lods;
+	lods.indices.push_back(meshData.indices);
+	lods.errors.push_back(0.0f);
+	if (meshData.indices.empty() || meshData.indices.size() % 3 != 0) return lods;
+
+	const uint32_t vertexCount = static_cast<uint32_t>(meshData.vertices.size());
+	float error = 0.0f;
+	for (uint32_t lod = 1; lod < lodCount; ++lod)
+	{
+		const std::vector<uint32_t>& previous = lods.indices.back();
+		size_t target = static_cast<size_t>(previous.size() / 3 * reduction) * 3;
+		float lodError = 0.0f;
+		std::vector<uint32_t> indices = simplify(meshData.vertices, previous, target, std::numeric_limits<float>::max(), &lodError);
+		if (indices.empty() || indices.size() > previous.size() * 9 / 10) break; //Not worth a LOD
+
+		MeshOptimizer::optimizeVertexCache(indices, vertexCount);
+		//Simplified from the previous LOD, the errors add up
+		error += lodError;
+		lods.indices.push_back(std::move(indices));
+		lods.errors.push_back(error);
+	}
+	return lods;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include "mesh.h"
+
+// Index lists of decreasing detail over the same vertices, errors[i] is the object space distance
+// between the LOD i and the full mesh (0 for the LOD 0).
+struct MeshLods
+{
+	std::vector<std::vector<uint32_t>> indices;
+	std::vector<float> errors;
+};
+
+// Quadric error metric simplification by edge collapses onto existing vertices, so that all the LODs
+// share the vertex buffer of the mesh.
+// The border vertices and the seam vertices (same position, different attributes) are locked,
+// the collapses across different normals or uvs are penalized.
+class MeshSimplifier
+{
+public:
+	//Collapses edges until the index count reaches targetIndexCount or the error would exceed maxError.
+	//resultError receives the largest error of the applied collapses.
+	static std::vector<uint32_t> simplify(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, size_t targetIndexCount, float maxError, float* resultError = nullptr);
+
+	//Chain of LODs, each one with about reduction times the triangles of the previous one.
+	//Stops early when the locked vertices prevent any further reduction.
+	static MeshLods generateLods(const MeshData& meshData, uint32_t lodCount = c_lodCount, float reduction = 0.5f);
+
+	static constexpr uint32_t c_lodCount = 4;
+	//Weight of the normal and uv differences, relative to the squared length of the collapsed edge
+	static constexpr float c_attributeWeight = 0.5f;
+};
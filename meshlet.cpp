@@ -0,0 +1,98 @@
+#include "meshlet.h"
+
+#include <algorithm>
+#include <limits>
+
+MeshletData MeshletBuilder::build(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t maxVertices, uint32_t maxTriangles)
+{
+	assert(maxVertices >= 3 && maxTriangles >= 1);
+	MeshletData data;
+	if (indices.size() < 3) return data;
+	data.indices.reserve(indices.size());
+
+	//Vertex -> frame of the meshlet using it last, the vertices are counted once per meshlet
+	std::vector<uint32_t> usedBy(vertices.size(), std::numeric_limits<uint32_t>::max());
+	Meshlet meshlet;
+	auto flush = [&]() {
+		if (meshlet.triangleCount == 0) return;
+		computeBounds(vertices, data.indices.data() + meshlet.indexOffset, meshlet);
+		data.meshlets.push_back(meshlet);
+		meshlet = Meshlet();
+		meshlet.indexOffset = static_cast<uint32_t>(data.indices.size());
+	};
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const uint32_t meshletIndex = static_cast<uint32_t>(data.meshlets.size());
+		uint32_t newVertices = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			uint32_t v = indices[i + k];
+			bool duplicate = (k > 0 && v == indices[i]) || (k > 1 && v == indices[i + 1]);
+			if (usedBy[v] != meshletIndex && !duplicate) newVertices++;
+		}
+		if (meshlet.vertexCount + newVertices > maxVertices || meshlet.triangleCount + 1 > maxTriangles)
+			flush();
+
+		const uint32_t currentIndex = static_cast<uint32_t>(data.meshlets.size());
+		for (int k = 0; k < 3; ++k)
+		{
+			uint32_t v = indices[i + k];
+			if (usedBy[v] != currentIndex)
+			{
+				usedBy[v] = currentIndex;
+				meshlet.vertexCount++;
+			}
+			data.indices.push_back(v);
+		}
+		meshlet.triangleCount++;
+	}
+	flush();
+	return data;
+}
+
+void MeshletBuilder::computeBounds(const std::vector<Vertex>& vertices, const uint32_t* indices, Meshlet& meshlet)
+{
+	const uint32_t indexCount = meshlet.triangleCount * 3;
+
+	//Sphere around the center of the box, looser than the minimal sphere but cheap
+	glm::vec3 boxMin(std::numeric_limits<float>::max());
+	glm::vec3 boxMax(std::numeric_limits<float>::lowest());
+	for (uint32_t i = 0; i < indexCount; ++i)
+	{
+		boxMin = glm::min(boxMin, vertices[indices[i]].position);
+		boxMax = glm::max(boxMax, vertices[indices[i]].position);
+	}
+	glm::vec3 center = (boxMin + boxMax) * 0.5f;
+	float radius = 0.0f;
+	for (uint32_t i = 0; i < indexCount; ++i)
+		radius = std::max(radius, glm::length(vertices[indices[i]].position - center));
+	meshlet.sphere = glm::vec4(center, radius);
+
+	//Normal cone from the geometric normals of the triangles
+	std::vector<glm::vec3> normals;
+	normals.reserve(meshlet.triangleCount);
+	glm::vec3 axis(0.0f);
+	for (uint32_t i = 0; i < indexCount; i += 3)
+	{
+		const glm::vec3& p0 = vertices[indices[i + 0]].position;
+		const glm::vec3& p1 = vertices[indices[i + 1]].position;
+		const glm::vec3& p2 = vertices[indices[i + 2]].position;
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+		if (length == 0.0f) continue; //Degenerate
+		normals.push_back(normal / length);
+		axis += normals.back();
+	}
+	meshlet.cone = glm::vec4(0.0, 0.0, 1.0, 1.0);
+	float axisLength = glm::length(axis);
+	if (normals.empty() || axisLength == 0.0f) return;
+	axis /= axisLength;
+
+	float minDot = 1.0f;
+	for (const auto& normal : normals)
+		minDot = std::min(minDot, glm::dot(axis, normal));
+	//Cones wider than ~85 degrees are almost never back facing as a whole
+	if (minDot <= 0.1f) return;
+	meshlet.cone = glm::vec4(axis, std::sqrt(1.0f - minDot * minDot));
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include "vertexLayout.h"
+
+// Small cluster of triangles, culled as a whole on the GPU (see MeshletCuller).
+// Same memory layout as the Meshlet struct of meshletCull.wgsl.
+struct Meshlet
+{
+	glm::vec4 sphere = glm::vec4(0.0);  //Bounding sphere in object space: center, radius
+	glm::vec4 cone = glm::vec4(0.0, 0.0, 1.0, 1.0); //Normal cone: axis, cutoff (sine of the half angle, 1 disables the cone test)
+	uint32_t indexOffset = 0;  //First index in MeshletData::indices
+	uint32_t triangleCount = 0;
+	uint32_t vertexCount = 0;
+	uint32_t padding = 0;
+};
+static_assert(sizeof(Meshlet) == 48, "Uploaded as is in a storage buffer");
+
+struct MeshletData
+{
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> indices; //Vertex indices of the mesh, three per triangle, grouped by meshlet
+};
+
+class MeshletBuilder
+{
+public:
+	//Greedy scan of the triangles in their current order: run it after the vertex cache optimization
+	//so that the meshlets are spatially coherent.
+	static MeshletData build(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t maxVertices = c_maxVertices, uint32_t maxTriangles = c_maxTriangles);
+
+	static constexpr uint32_t c_maxVertices = 64;
+	static constexpr uint32_t c_maxTriangles = 124;
+
+private:
+	static void computeBounds(const std::vector<Vertex>& vertices, const uint32_t* indices, Meshlet& meshlet);
+};
@@ -0,0 +1,254 @@
+#include "meshletCuller.h"
+
+#include <algorithm>
+
+#include "utils.h"
+
+namespace
+{
+	//Mirrors CullUniforms in meshletCull.wgsl
+	struct CullUniforms {
+		glm::mat4 model;
+		glm::mat4 hiZViewProj;
+		glm::vec4 planes[6];
+		glm::vec4 cameraPosition; //w: largest scale of the model matrix
+		glm::vec2 hiZSize;
+		uint32_t hiZMipCount;
+		uint32_t flags;
+		uint32_t meshletCount;
+		uint32_t padding[3];
+	};
+	static_assert(sizeof(CullUniforms) == 272, "Must match the WGSL layout");
+
+	constexpr uint32_t c_frustumCulling = 1;
+	constexpr uint32_t c_coneCulling = 2;
+	constexpr uint32_t c_occlusionCulling = 4;
+	constexpr uint32_t c_maxDispatch = 65535;
+	constexpr uint32_t c_hiZGroupSize = 8;
+
+	Texture createHiZTexture(uint32_t width, uint32_t height, uint32_t mipCount)
+	{
+		TextureDescriptor textureDesc;
+		textureDesc.label = "hiZ";
+		textureDesc.dimension = TextureDimension::e2D;
+		textureDesc.format = TextureFormat::R32Float;
+		textureDesc.mipLevelCount = mipCount;
+		textureDesc.sampleCount = 1;
+		textureDesc.size = { width, height, 1 };
+		textureDesc.usage = TextureUsage::StorageBinding | TextureUsage::TextureBinding;
+		textureDesc.viewFormatCount = 0;
+		textureDesc.viewFormats = nullptr;
+		return Context::getInstance().getDevice().CreateTexture(&textureDesc);
+	}
+
+	TextureView createHiZView(const Texture& texture, uint32_t baseMipLevel, uint32_t mipLevelCount)
+	{
+		TextureViewDescriptor viewDesc;
+		viewDesc.format = TextureFormat::R32Float;
+		viewDesc.dimension = TextureViewDimension::e2D;
+		viewDesc.baseMipLevel = baseMipLevel;
+		viewDesc.mipLevelCount = mipLevelCount;
+		viewDesc.baseArrayLayer = 0;
+		viewDesc.arrayLayerCount = 1;
+		viewDesc.aspect = TextureAspect::All;
+		return texture.CreateView(&viewDesc);
+	}
+
+	Buffer createBuffer(const char* label, BufferUsage usage, uint64_t size)
+	{
+		BufferDescriptor bufferDesc;
+		bufferDesc.label = label;
+		bufferDesc.usage = usage;
+		bufferDesc.size = std::max<uint64_t>(size, 4);
+		bufferDesc.mappedAtCreation = false;
+		return Context::getInstance().getDevice().CreateBuffer(&bufferDesc);
+	}
+}
+
+MeshletCuller::MeshletCuller() :
+	m_cullShader("meshletCull", Utils::loadFile(DATA_DIR "/meshletCull.wgsl")),
+	m_copyDepthShader("hiZCopyDepth", Utils::loadFile(DATA_DIR "/hiZ.wgsl"), "cs_copyDepth"),
+	m_downsampleShader("hiZDownsample", Utils::loadFile(DATA_DIR "/hiZ.wgsl"), "cs_downsample")
+{
+	//Bound until a depth buffer is given, the occlusion test is off meanwhile
+	m_hiZ = createHiZTexture(1, 1, 1);
+	m_hiZView = createHiZView(m_hiZ, 0, 1);
+}
+
+void MeshletCuller::setDepthBuffer(TextureView depthBuffer, uint32_t width, uint32_t height)
+{
+	m_depthBuffer = depthBuffer;
+	m_hiZReady = false;
+	m_hiZVersion++;
+	m_hiZBindGroups.clear();
+	m_hiZSizes.clear();
+
+	uint32_t mipCount = 1;
+	while ((std::max(width, height) >> mipCount) > 0) mipCount++;
+	m_hiZ = createHiZTexture(width, height, mipCount);
+	m_hiZView = createHiZView(m_hiZ, 0, mipCount);
+
+	Device device = Context::getInstance().getDevice();
+	for (uint32_t level = 0; level < mipCount; ++level)
+	{
+		m_hiZSizes.push_back({ std::max(width >> level, 1u), std::max(height >> level, 1u) });
+
+		std::vector<BindGroupEntry> entries(2);
+		entries[0].binding = 1;
+		entries[0].textureView = createHiZView(m_hiZ, level, 1);
+		entries[1].binding = level == 0 ? 2 : 0;
+		entries[1].textureView = level == 0 ? depthBuffer : createHiZView(m_hiZ, level - 1, 1);
+
+		BindGroupDescriptor bindGroupDesc;
+		bindGroupDesc.label = "hiZ";
+		bindGroupDesc.layout = level == 0 ? m_copyDepthShader.getBindGroupLayout() : m_downsampleShader.getBindGroupLayout();
+		bindGroupDesc.entryCount = entries.size();
+		bindGroupDesc.entries = entries.data();
+		m_hiZBindGroups.push_back(device.CreateBindGroup(&bindGroupDesc));
+	}
+}
+
+void MeshletCuller::beginFrame()
+{
+	m_frame++;
+	m_stats = Stats();
+
+	//Forget the entities that are not drawn anymore, or whose mesh is gone
+	for (auto it = m_targets.begin(); it != m_targets.end();)
+	{
+		if (it->second.mesh.expired() || it->second.lastFrame + 1 < m_frame)
+			it = m_targets.erase(it);
+		else
+			++it;
+	}
+}
+
+const MeshletCuller::Target* MeshletCuller::getTarget(entt::entity entity) const
+{
+	auto it = m_targets.find(entity);
+	if (it == m_targets.end() || it->second.lastFrame != m_frame) return nullptr;
+	return &it->second;
+}
+
+MeshletCuller::Target& MeshletCuller::getOrCreateTarget(const Item& item)
+{
+	auto it = m_targets.find(item.entity);
+	if (it != m_targets.end() && it->second.mesh.lock() == item.mesh)
+		return it->second;
+
+	Target& target = m_targets[item.entity];
+	target = Target();
+	target.mesh = item.mesh;
+	target.indices = createBuffer("meshletCulledIndices", BufferUsage::Index | BufferUsage::Storage, item.mesh->getMeshlets().indices.size() * sizeof(uint32_t));
+	target.drawArgs = createBuffer("meshletDrawArgs", BufferUsage::Indirect | BufferUsage::Storage | BufferUsage::CopyDst | BufferUsage::CopySrc, 5 * sizeof(uint32_t));
+	target.uniforms = createBuffer("meshletCullUniforms", BufferUsage::Uniform | BufferUsage::CopyDst, sizeof(CullUniforms));
+	return target;
+}
+
+void MeshletCuller::createBindGroup(Target& target, const Mesh& mesh)
+{
+	std::vector<BindGroupEntry> entries(6);
+	for (uint32_t i = 0; i < entries.size(); ++i)
+		entries[i].binding = i;
+	entries[0].buffer = target.uniforms;
+	entries[0].size = sizeof(CullUniforms);
+	entries[1].buffer = mesh.getMeshletBuffer();
+	entries[1].size = mesh.getMeshlets().meshlets.size() * sizeof(Meshlet);
+	entries[2].buffer = mesh.getMeshletIndexBuffer();
+	entries[2].size = mesh.getMeshlets().indices.size() * sizeof(uint32_t);
+	entries[3].buffer = target.indices;
+	entries[3].size = mesh.getMeshlets().indices.size() * sizeof(uint32_t);
+	entries[4].buffer = target.drawArgs;
+	entries[4].size = 5 * sizeof(uint32_t);
+	entries[5].textureView = m_hiZView;
+
+	BindGroupDescriptor bindGroupDesc;
+	bindGroupDesc.label = "meshletCull";
+	bindGroupDesc.layout = m_cullShader.getBindGroupLayout();
+	bindGroupDesc.entryCount = entries.size();
+	bindGroupDesc.entries = entries.data();
+	target.bindGroup = Context::getInstance().getDevice().CreateBindGroup(&bindGroupDesc);
+	target.hiZVersion = m_hiZVersion;
+}
+
+void MeshletCuller::cull(CommandEncoder& encoder, const std::vector<Item>& items, const glm::mat4& viewProj, const glm::vec3& cameraPosition)
+{
+	if (items.empty()) return;
+	m_viewProj = viewProj;
+
+	//Gribb-Hartmann planes, depth in [0, 1]
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; ++i)
+		rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+	glm::vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[2], rows[3] - rows[2] };
+	for (auto& plane : planes)
+		plane /= glm::length(glm::vec3(plane));
+
+	Queue queue = Context::getInstance().getDevice().GetQueue();
+	ComputePassDescriptor computePassDesc;
+	computePassDesc.label = "meshletCulling";
+	ComputePassEncoder computePass = encoder.BeginComputePass(&computePassDesc);
+	computePass.SetPipeline(m_cullShader.getComputePipeline());
+
+	for (const auto& item : items)
+	{
+		const Mesh& mesh = *item.mesh;
+		const uint32_t meshletCount = static_cast<uint32_t>(mesh.getMeshlets().meshlets.size());
+		Target& target = getOrCreateTarget(item);
+		if (target.lastFrame == m_frame) continue; //Already culled by a previous pass of the frame
+		target.lastFrame = m_frame;
+		if (!target.bindGroup || target.hiZVersion != m_hiZVersion)
+			createBindGroup(target, mesh);
+
+		const glm::vec3 scale(glm::length(glm::vec3(item.model[0])), glm::length(glm::vec3(item.model[1])), glm::length(glm::vec3(item.model[2])));
+		const float maxScale = std::max(scale.x, std::max(scale.y, scale.z));
+		//The cone axis is transformed as a direction, only valid without shear, non uniform scale or mirror
+		const bool uniformScale = std::abs(scale.x - scale.y) <= 1e-3f * maxScale && std::abs(scale.x - scale.z) <= 1e-3f * maxScale;
+		const bool mirrored = glm::determinant(glm::mat3(item.model)) < 0.0f;
+
+		CullUniforms uniforms = {};
+		uniforms.model = item.model;
+		uniforms.hiZViewProj = m_hiZViewProj;
+		for (int i = 0; i < 6; ++i)
+			uniforms.planes[i] = planes[i];
+		uniforms.cameraPosition = glm::vec4(cameraPosition, maxScale);
+		uniforms.hiZSize = m_hiZSizes.empty() ? glm::vec2(1.0f) : glm::vec2(m_hiZSizes[0]);
+		uniforms.hiZMipCount = std::max<uint32_t>(static_cast<uint32_t>(m_hiZSizes.size()), 1);
+		uniforms.flags = (m_frustumCulling ? c_frustumCulling : 0)
+			| (m_coneCulling && uniformScale && !mirrored ? c_coneCulling : 0)
+			| (m_occlusionCulling && m_hiZReady ? c_occlusionCulling : 0);
+		uniforms.meshletCount = meshletCount;
+		queue.WriteBuffer(target.uniforms, 0, &uniforms, sizeof(CullUniforms));
+
+		//The index count is accumulated by the shader, the base vertex follows the defragmentation of the pool
+		uint32_t drawArgs[5] = { 0, 1, 0, mesh.getVertexRange()->offset, 0 };
+		queue.WriteBuffer(target.drawArgs, 0, drawArgs, sizeof(drawArgs));
+
+		computePass.SetBindGroup(0, target.bindGroup, 0, nullptr);
+		computePass.DispatchWorkgroups(std::min(meshletCount, c_maxDispatch), ComputeShader::getGroupCount(meshletCount, c_maxDispatch), 1);
+
+		m_stats.meshlets += meshletCount;
+		m_stats.triangles += mesh.getMeshlets().indices.size() / 3;
+	}
+	computePass.End();
+}
+
+void MeshletCuller::buildHiZ(CommandEncoder& encoder)
+{
+	if (!m_depthBuffer || !m_occlusionCulling) return;
+
+	ComputePassDescriptor computePassDesc;
+	computePassDesc.label = "hiZ";
+	ComputePassEncoder computePass = encoder.BeginComputePass(&computePassDesc);
+	for (size_t level = 0; level < m_hiZBindGroups.size(); ++level)
+	{
+		computePass.SetPipeline(level == 0 ? m_copyDepthShader.getComputePipeline() : m_downsampleShader.getComputePipeline());
+		computePass.SetBindGroup(0, m_hiZBindGroups[level], 0, nullptr);
+		computePass.DispatchWorkgroups(ComputeShader::getGroupCount(m_hiZSizes[level].x, c_hiZGroupSize), ComputeShader::getGroupCount(m_hiZSizes[level].y, c_hiZGroupSize), 1);
+	}
+	computePass.End();
+
+	//The next frame tests against this depth, seen from this camera
+	m_hiZViewProj = m_viewProj;
+	m_hiZReady = true;
+}
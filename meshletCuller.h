@@ -0,0 +1,87 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <entt/entt.hpp>
+
+#include "computeShader.h"
+#include "mesh.h"
+
+// GPU culling of the meshlets of the meshes drawn by a pass (frustum, normal cone and Hi-Z occlusion).
+// Each entity gets its own compacted index buffer and indirect draw arguments, written by a compute pass
+// before the render pass and drawn with DrawIndexedIndirect.
+// The Hi-Z is built from the depth buffer at the end of the pass and used by the next frame.
+class MeshletCuller
+{
+public:
+	MeshletCuller();
+	~MeshletCuller() = default;
+
+	struct Item {
+		entt::entity entity;
+		MeshPtr mesh;
+		glm::mat4 model; //World transform, without the dequantization of the mesh
+	};
+
+	struct Target {
+		std::weak_ptr<Mesh> mesh;
+		Buffer indices{ nullptr };   //Uint32, relative to the vertex range of the mesh
+		Buffer drawArgs{ nullptr };  //DrawIndexedIndirect arguments, copyable to read back the kept triangles (benchmarks/meshletCullingBench.cpp)
+		Buffer uniforms{ nullptr };
+		BindGroup bindGroup{ nullptr };
+		uint32_t hiZVersion = 0;
+		uint64_t lastFrame = 0;
+	};
+
+	//Depth buffer of the culled pass, the occlusion test is disabled until it is set
+	void setDepthBuffer(TextureView depthBuffer, uint32_t width, uint32_t height);
+
+	void setFrustumCulling(bool enabled) { m_frustumCulling = enabled; }
+	void setConeCulling(bool enabled) { m_coneCulling = enabled; }
+	void setOcclusionCulling(bool enabled) { m_occlusionCulling = enabled; }
+
+	void beginFrame();
+	//Encodes the culling of the items, must be called outside of a render pass
+	void cull(CommandEncoder& encoder, const std::vector<Item>& items, const glm::mat4& viewProj, const glm::vec3& cameraPosition);
+	//Builds the Hi-Z from the depth buffer, once the pass is done
+	void buildHiZ(CommandEncoder& encoder);
+
+	//nullptr when the entity was not culled this frame
+	const Target* getTarget(entt::entity entity) const;
+
+	//Counters of the last frame, the visible count would need a read back of the draw arguments
+	struct Stats {
+		size_t meshlets = 0;
+		size_t triangles = 0;
+	};
+	const Stats& getStats() const { return m_stats; }
+
+private:
+	Target& getOrCreateTarget(const Item& item);
+	void createBindGroup(Target& target, const Mesh& mesh);
+
+	ComputeShader m_cullShader;
+	ComputeShader m_copyDepthShader;
+	ComputeShader m_downsampleShader;
+
+	std::unordered_map<entt::entity, Target> m_targets;
+	uint64_t m_frame = 0;
+
+	TextureView m_depthBuffer{ nullptr };
+	Texture m_hiZ{ nullptr };
+	TextureView m_hiZView{ nullptr };   //All the levels, read by the culling
+	std::vector<BindGroup> m_hiZBindGroups; //Level 0 from the depth, then one per downsampled level
+	std::vector<glm::uvec2> m_hiZSizes;
+	uint32_t m_hiZVersion = 0;
+	bool m_hiZReady = false;
+	glm::mat4 m_viewProj = glm::mat4(1.0);
+	glm::mat4 m_hiZViewProj = glm::mat4(1.0);
+
+	bool m_frustumCulling = true;
+	bool m_coneCulling = true;
+	bool m_occlusionCulling = true;
+
+	Stats m_stats;
+};
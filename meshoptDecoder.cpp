@@ -0,0 +1,729 @@
+#include "meshoptDecoder.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define MESHOPT_DECODER_SSE2
+#define MESHOPT_DECODER_SIMD
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define MESHOPT_DECODER_NEON
+#define MESHOPT_DECODER_SIMD
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+	constexpr uint8_t c_vertexHeader = 0xa0;
+	constexpr uint8_t c_indexHeader = 0xe0;
+	constexpr uint8_t c_sequenceHeader = 0xd0;
+
+	constexpr size_t c_byteGroupSize = 16;
+	constexpr size_t c_vertexBlockSizeBytes = 8192;
+	constexpr size_t c_vertexBlockMaxSize = 256;
+	constexpr size_t c_tailMaxSize = 32;
+
+	//Vertices per block: the block fits in 8 KB, a multiple of the byte groups
+	size_t getVertexBlockSize(size_t stride)
+	{
+		size_t result = c_vertexBlockSizeBytes / stride;
+		result &= ~(c_byteGroupSize - 1);
+		return result < c_vertexBlockMaxSize ? result : c_vertexBlockMaxSize;
+	}
+
+	uint8_t unzigzag8(uint8_t v)
+	{
+		return static_cast<uint8_t>(-(v & 1) ^ (v >> 1));
+	}
+
+	int countTrailingZeros(uint64_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return static_cast<int>(index);
+#else
+		return __builtin_ctzll(value);
+#endif
+	}
+
+#ifdef MESHOPT_DECODER_SIMD
+	//The 16 selectors of a group of 2 or 4 bits, most significant bits first, and the mask of the escaped ones:
+	//1 bit per byte with SSE2, 4 with NEON (maskBitsLog2)
+	uint64_t unpackSelectors(const uint8_t* data, int bits, uint8_t* buffer, int& maskBitsLog2)
+	{
+		const uint8_t escape = static_cast<uint8_t>((1 << bits) - 1);
+#ifdef MESHOPT_DECODER_SSE2
+		__m128i values;
+		if (bits == 4)
+		{
+			const __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(data));
+			const __m128i mask = _mm_set1_epi8(15);
+			values = _mm_unpacklo_epi8(_mm_and_si128(_mm_srli_epi16(packed, 4), mask), _mm_and_si128(packed, mask));
+		}
+		else
+		{
+			int32_t packed32;
+			memcpy(&packed32, data, 4);
+			const __m128i packed = _mm_cvtsi32_si128(packed32);
+			const __m128i mask = _mm_set1_epi8(3);
+			const __m128i first = _mm_unpacklo_epi8(_mm_and_si128(_mm_srli_epi16(packed, 6), mask), _mm_and_si128(_mm_srli_epi16(packed, 4), mask));
+			const __m128i second = _mm_unpacklo_epi8(_mm_and_si128(_mm_srli_epi16(packed, 2), mask), _mm_and_si128(packed, mask));
+			values = _mm_unpacklo_epi16(first, second);
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(buffer), values);
+		maskBitsLog2 = 0;
+		return static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(values, _mm_set1_epi8(static_cast<char>(escape)))));
+#else
+		uint8x16_t values;
+		if (bits == 4)
+		{
+			const uint8x8_t packed = vld1_u8(data);
+			const uint8x8x2_t zipped = vzip_u8(vshr_n_u8(packed, 4), vand_u8(packed, vdup_n_u8(15)));
+			values = vcombine_u8(zipped.val[0], zipped.val[1]);
+		}
+		else
+		{
+			uint32_t packed32;
+			memcpy(&packed32, data, 4);
+			const uint8x8_t packed = vreinterpret_u8_u32(vdup_n_u32(packed32));
+			const uint8x8_t mask = vdup_n_u8(3);
+			const uint8x8x2_t first = vzip_u8(vshr_n_u8(packed, 6), vand_u8(vshr_n_u8(packed, 4), mask));
+			const uint8x8x2_t second = vzip_u8(vand_u8(vshr_n_u8(packed, 2), mask), vand_u8(packed, mask));
+			const uint16x4x2_t zipped = vzip_u16(vreinterpret_u16_u8(first.val[0]), vreinterpret_u16_u8(second.val[0]));
+			values = vcombine_u8(vreinterpret_u8_u16(zipped.val[0]), vreinterpret_u8_u16(zipped.val[1]));
+		}
+		vst1q_u8(buffer, values);
+		//No movemask: the narrowing shift keeps 4 bits of each byte of the comparison
+		const uint8x16_t escaped = vceqq_u8(values, vdupq_n_u8(escape));
+		maskBitsLog2 = 2;
+		return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(escaped), 4)), 0) & 0x1111111111111111ull;
+#endif
+	}
+#endif
+
+	//One group of 16 bytes: all zero, 2 or 4 bits per byte (the largest value escapes to a full byte), or 8 bits
+	const uint8_t* decodeBytesGroup(const uint8_t* data, const uint8_t* end, uint8_t* buffer, int bitsLog2)
+	{
+		if (bitsLog2 == 0)
+		{
+			memset(buffer, 0, c_byteGroupSize);
+			return data;
+		}
+		if (bitsLog2 == 3)
+		{
+			if (size_t(end - data) < c_byteGroupSize) return nullptr;
+			memcpy(buffer, data, c_byteGroupSize);
+			return data + c_byteGroupSize;
+		}
+
+		const int bits = bitsLog2 == 1 ? 2 : 4;
+		const size_t selectorSize = c_byteGroupSize * bits / 8;
+		if (size_t(end - data) < selectorSize) return nullptr;
+		const uint8_t* escaped = data + selectorSize;
+#ifdef MESHOPT_DECODER_SIMD
+		//The selectors unpacked at once, then the escaped bytes are copied to the selectors set to the escape value
+		int maskBitsLog2 = 0;
+		uint64_t mask = unpackSelectors(data, bits, buffer, maskBitsLog2);
+		for (; mask; mask &= mask - 1)
+		{
+			if (escaped >= end) return nullptr;
+			buffer[countTrailingZeros(mask) >> maskBitsLog2] = *escaped++;
+		}
+		return escaped;
+#else
+		const uint8_t escape = static_cast<uint8_t>((1 << bits) - 1);
+		for (size_t i = 0; i < c_byteGroupSize; ++i)
+		{
+			//Most significant bits first
+			const size_t bit = i * bits;
+			const uint8_t value = static_cast<uint8_t>((data[bit / 8] >> (8 - bits - bit % 8)) & escape);
+			if (value == escape)
+			{
+				if (escaped >= end) return nullptr;
+				buffer[i] = *escaped++;
+			}
+			else
+				buffer[i] = value;
+		}
+		return escaped;
+#endif
+	}
+
+	//size bytes (a multiple of 16): 2 bits of header per group, then the groups
+	const uint8_t* decodeBytes(const uint8_t* data, const uint8_t* end, uint8_t* buffer, size_t size)
+	{
+		const size_t headerSize = (size / c_byteGroupSize + 3) / 4;
+		if (size_t(end - data) < headerSize) return nullptr;
+		const uint8_t* header = data;
+		data += headerSize;
+		for (size_t i = 0; i < size && data; i += c_byteGroupSize)
+		{
+			const size_t group = i / c_byteGroupSize;
+			const int bitsLog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+			data = decodeBytesGroup(data, end, buffer + i, bitsLog2);
+		}
+		return data;
+	}
+
+	//The vertices are transposed: one byte stream per byte of the vertex, zigzag deltas from the previous vertex
+	const uint8_t* decodeVertexBlock(const uint8_t* data, const uint8_t* end, uint8_t* vertices, size_t count, size_t stride, uint8_t lastVertex[256])
+	{
+		uint8_t buffer[c_vertexBlockMaxSize];
+		const size_t alignedCount = (count + c_byteGroupSize - 1) & ~(c_byteGroupSize - 1);
+		for (size_t k = 0; k < stride; ++k)
+		{
+			data = decodeBytes(data, end, buffer, alignedCount);
+			if (!data) return nullptr;
+			uint8_t previous = lastVertex[k];
+			for (size_t i = 0; i < count; ++i)
+			{
+				previous = static_cast<uint8_t>(unzigzag8(buffer[i]) + previous);
+				vertices[i * stride + k] = previous;
+			}
+		}
+		memcpy(lastVertex, vertices + (count - 1) * stride, stride);
+		return data;
+	}
+
+	uint32_t decodeVByte(const uint8_t*& data)
+	{
+		uint8_t lead = *data++;
+		if (lead < 128) return lead;
+		uint32_t result = lead & 127;
+		uint32_t shift = 7;
+		for (int i = 0; i < 4; ++i)
+		{
+			uint8_t group = *data++;
+			result |= uint32_t(group & 127) << shift;
+			shift += 7;
+			if (group < 128) break;
+		}
+		return result;
+	}
+
+	uint32_t decodeIndex(const uint8_t*& data, uint32_t last)
+	{
+		const uint32_t v = decodeVByte(data);
+		const uint32_t delta = (v >> 1) ^ -int32_t(v & 1);
+		return last + delta;
+	}
+
+	void writeIndex(void* destination, size_t i, size_t indexSize, uint32_t index)
+	{
+		if (indexSize == 2)
+			static_cast<uint16_t*>(destination)[i] = static_cast<uint16_t>(index);
+		else
+			static_cast<uint32_t*>(destination)[i] = index;
+	}
+
+	struct Fifos {
+		uint32_t edges[16][2];
+		uint32_t vertices[16];
+		size_t edgeOffset = 0;
+		size_t vertexOffset = 0;
+
+		void pushEdge(uint32_t a, uint32_t b)
+		{
+			edges[edgeOffset][0] = a;
+			edges[edgeOffset][1] = b;
+			edgeOffset = (edgeOffset + 1) & 15;
+		}
+		void pushVertex(uint32_t v, bool condition = true)
+		{
+			vertices[vertexOffset] = v;
+			vertexOffset = (vertexOffset + (condition ? 1 : 0)) & 15;
+		}
+	};
+
+	//Signed normalized components to a unit vector, the third one is 1 at the same precision
+	template<typename T>
+	void decodeFilterOct(T* data, size_t count)
+	{
+		const float max = float((1 << (sizeof(T) * 8 - 1)) - 1);
+		for (size_t i = 0; i < count; ++i)
+		{
+			float x = float(data[i * 4 + 0]);
+			float y = float(data[i * 4 + 1]);
+			float z = float(data[i * 4 + 2]) - std::fabs(x) - std::fabs(y);
+			//Octahedral fold for z < 0
+			float t = z < 0.0f ? z : 0.0f;
+			x += x >= 0.0f ? t : -t;
+			y += y >= 0.0f ? t : -t;
+			const float s = max / std::sqrt(x * x + y * y + z * z);
+			data[i * 4 + 0] = T(int(x * s + (x >= 0.0f ? 0.5f : -0.5f)));
+			data[i * 4 + 1] = T(int(y * s + (y >= 0.0f ? 0.5f : -0.5f)));
+			data[i * 4 + 2] = T(int(z * s + (z >= 0.0f ? 0.5f : -0.5f)));
+		}
+	}
+
+	//Three smallest components of a unit quaternion, the index of the largest one in the low bits of the fourth
+	void decodeFilterQuat(int16_t* data, size_t count)
+	{
+		const float scale = 1.0f / std::sqrt(2.0f);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const int sf = data[i * 4 + 3] | 3;
+			const float ss = scale / float(sf);
+			const float x = float(data[i * 4 + 0]) * ss;
+			const float y = float(data[i * 4 + 1]) * ss;
+			const float z = float(data[i * 4 + 2]) * ss;
+			const float ww = 1.0f - x * x - y * y - z * z;
+			const float w = std::sqrt(ww >= 0.0f ? ww : 0.0f);
+			const int qc = data[i * 4 + 3] & 3;
+			data[i * 4 + ((qc + 1) & 3)] = int16_t(int(x * 32767.0f + (x >= 0.0f ? 0.5f : -0.5f)));
+			data[i * 4 + ((qc + 2) & 3)] = int16_t(int(y * 32767.0f + (y >= 0.0f ? 0.5f : -0.5f)));
+			data[i * 4 + ((qc + 3) & 3)] = int16_t(int(z * 32767.0f + (z >= 0.0f ? 0.5f : -0.5f)));
+			data[i * 4 + ((qc + 0) & 3)] = int16_t(int(w * 32767.0f + 0.5f));
+		}
+	}
+
+	//24 bits signed mantissa, 8 bits signed exponent, to float
+	void decodeFilterExp(uint32_t* data, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			const uint32_t v = data[i];
+			const int m = int32_t(v << 8) >> 8;
+			const int e = int32_t(v) >> 24;
+			float f;
+			const uint32_t exponent = uint32_t(e + 127) << 23;
+			memcpy(&f, &exponent, sizeof(f));
+			f *= float(m);
+			memcpy(&data[i], &f, sizeof(f));
+		}
+	}
+
+	//The filters on 4 vertices at once, with the operations of the scalar loops in the same order: the results are identical.
+	//They return the number of vertices (values for the exponential filter) filtered, the scalar loops do the rest.
+#ifdef MESHOPT_DECODER_SSE2
+	__m128i roundToInt(__m128 value, __m128 sign)
+	{
+		const __m128 negative = _mm_cmplt_ps(sign, _mm_setzero_ps());
+		const __m128 half = _mm_or_ps(_mm_and_ps(negative, _mm_set1_ps(-0.5f)), _mm_andnot_ps(negative, _mm_set1_ps(0.5f)));
+		return _mm_cvttps_epi32(_mm_add_ps(value, half));
+	}
+
+	void decodeOct4(__m128i& xi, __m128i& yi, __m128i& zi, float max)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		__m128 x = _mm_cvtepi32_ps(xi);
+		__m128 y = _mm_cvtepi32_ps(yi);
+		const __m128 z = _mm_sub_ps(_mm_sub_ps(_mm_cvtepi32_ps(zi), _mm_andnot_ps(signMask, x)), _mm_andnot_ps(signMask, y));
+		const __m128 t = _mm_min_ps(z, zero);
+		const __m128 xPositive = _mm_cmpge_ps(x, zero), yPositive = _mm_cmpge_ps(y, zero);
+		x = _mm_add_ps(x, _mm_or_ps(_mm_and_ps(xPositive, t), _mm_andnot_ps(xPositive, _mm_xor_ps(t, signMask))));
+		y = _mm_add_ps(y, _mm_or_ps(_mm_and_ps(yPositive, t), _mm_andnot_ps(yPositive, _mm_xor_ps(t, signMask))));
+		const __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		const __m128 s = _mm_div_ps(_mm_set1_ps(max), _mm_sqrt_ps(lengthSquared));
+		xi = roundToInt(_mm_mul_ps(x, s), x);
+		yi = roundToInt(_mm_mul_ps(y, s), y);
+		zi = roundToInt(_mm_mul_ps(z, s), z);
+	}
+
+	//x, y, z, w of 4 vertices of 16 bits components, sign extended
+	void loadComponents4(const int16_t* data, __m128i components[4])
+	{
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 8));
+		const __m128i t0 = _mm_unpacklo_epi16(a, b), t1 = _mm_unpackhi_epi16(a, b);
+		const __m128i xy = _mm_unpacklo_epi16(t0, t1), zw = _mm_unpackhi_epi16(t0, t1);
+		components[0] = _mm_srai_epi32(_mm_unpacklo_epi16(xy, xy), 16);
+		components[1] = _mm_srai_epi32(_mm_unpackhi_epi16(xy, xy), 16);
+		components[2] = _mm_srai_epi32(_mm_unpacklo_epi16(zw, zw), 16);
+		components[3] = _mm_srai_epi32(_mm_unpackhi_epi16(zw, zw), 16);
+	}
+
+	//Truncated to 16 bits like the scalar stores, packs_epi32 would saturate
+	__m128i truncate16(__m128i value)
+	{
+		return _mm_srai_epi32(_mm_slli_epi32(value, 16), 16);
+	}
+
+	void storeComponents4(int16_t* data, const __m128i components[4])
+	{
+		const __m128i xy = _mm_packs_epi32(truncate16(components[0]), truncate16(components[1]));
+		const __m128i zw = _mm_packs_epi32(truncate16(components[2]), truncate16(components[3]));
+		const __m128i t0 = _mm_unpacklo_epi16(xy, zw), t1 = _mm_unpackhi_epi16(xy, zw);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(data), _mm_unpacklo_epi16(t0, t1));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(data + 8), _mm_unpackhi_epi16(t0, t1));
+	}
+
+	size_t decodeFilterOctSimd(int8_t* data, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 4));
+			__m128i x = _mm_srai_epi32(_mm_slli_epi32(packed, 24), 24);
+			__m128i y = _mm_srai_epi32(_mm_slli_epi32(packed, 16), 24);
+			__m128i z = _mm_srai_epi32(_mm_slli_epi32(packed, 8), 24);
+			decodeOct4(x, y, z, 127.0f);
+			const __m128i low = _mm_set1_epi32(0xff);
+			__m128i result = _mm_and_si128(packed, _mm_set1_epi32(int(0xff000000)));
+			result = _mm_or_si128(result, _mm_and_si128(x, low));
+			result = _mm_or_si128(result, _mm_slli_epi32(_mm_and_si128(y, low), 8));
+			result = _mm_or_si128(result, _mm_slli_epi32(_mm_and_si128(z, low), 16));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(data + i * 4), result);
+		}
+		return i;
+	}
+
+	size_t decodeFilterOctSimd(int16_t* data, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i components[4];
+			loadComponents4(data + i * 4, components);
+			decodeOct4(components[0], components[1], components[2], 32767.0f);
+			storeComponents4(data + i * 4, components);
+		}
+		return i;
+	}
+
+	size_t decodeFilterQuatSimd(int16_t* data, size_t count)
+	{
+		const __m128 scale = _mm_set1_ps(1.0f / std::sqrt(2.0f));
+		const __m128 one = _mm_set1_ps(1.0f), quantize = _mm_set1_ps(32767.0f);
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128i components[4];
+			loadComponents4(data + i * 4, components);
+			const __m128 ss = _mm_div_ps(scale, _mm_cvtepi32_ps(_mm_or_si128(components[3], _mm_set1_epi32(3))));
+			const __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(components[0]), ss);
+			const __m128 y = _mm_mul_ps(_mm_cvtepi32_ps(components[1]), ss);
+			const __m128 z = _mm_mul_ps(_mm_cvtepi32_ps(components[2]), ss);
+			const __m128 ww = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(one, _mm_mul_ps(x, x)), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+			const __m128 w = _mm_sqrt_ps(_mm_max_ps(ww, _mm_setzero_ps()));
+			//In the order of the rotation by the index of the largest component: w, x, y, z
+			const __m128i values[4] = { _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(w, quantize), _mm_set1_ps(0.5f))),
+				roundToInt(_mm_mul_ps(x, quantize), x), roundToInt(_mm_mul_ps(y, quantize), y), roundToInt(_mm_mul_ps(z, quantize), z) };
+			const __m128i qc = _mm_and_si128(components[3], _mm_set1_epi32(3));
+			__m128i result[4] = {};
+			for (int q = 0; q < 4; ++q)
+			{
+				const __m128i selected = _mm_cmpeq_epi32(qc, _mm_set1_epi32(q));
+				for (int k = 0; k < 4; ++k)
+					result[(q + k) & 3] = _mm_or_si128(result[(q + k) & 3], _mm_and_si128(selected, values[k]));
+			}
+			storeComponents4(data + i * 4, result);
+		}
+		return i;
+	}
+
+	size_t decodeFilterExpSimd(uint32_t* data, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			const __m128i m = _mm_srai_epi32(_mm_slli_epi32(v, 8), 8);
+			const __m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_srai_epi32(v, 24), _mm_set1_epi32(127)), 23);
+			const __m128 f = _mm_mul_ps(_mm_castsi128_ps(exponent), _mm_cvtepi32_ps(m));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_castps_si128(f));
+		}
+		return i;
+	}
+#elif defined(MESHOPT_DECODER_NEON)
+	int32x4_t roundToInt(float32x4_t value, float32x4_t sign)
+	{
+		const uint32x4_t negative = vcltq_f32(sign, vdupq_n_f32(0.0f));
+		return vcvtq_s32_f32(vaddq_f32(value, vbslq_f32(negative, vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f))));
+	}
+
+	void decodeOct4(int32x4_t& xi, int32x4_t& yi, int32x4_t& zi, float max)
+	{
+		const float32x4_t zero = vdupq_n_f32(0.0f);
+		float32x4_t x = vcvtq_f32_s32(xi);
+		float32x4_t y = vcvtq_f32_s32(yi);
+		const float32x4_t z = vsubq_f32(vsubq_f32(vcvtq_f32_s32(zi), vabsq_f32(x)), vabsq_f32(y));
+		const float32x4_t t = vbslq_f32(vcltq_f32(z, zero), z, zero);
+		x = vaddq_f32(x, vbslq_f32(vcgeq_f32(x, zero), t, vnegq_f32(t)));
+		y = vaddq_f32(y, vbslq_f32(vcgeq_f32(y, zero), t, vnegq_f32(t)));
+		const float32x4_t lengthSquared = vaddq_f32(vaddq_f32(vmulq_f32(x, x), vmulq_f32(y, y)), vmulq_f32(z, z));
+		const float32x4_t s = vdivq_f32(vdupq_n_f32(max), vsqrtq_f32(lengthSquared));
+		xi = roundToInt(vmulq_f32(x, s), x);
+		yi = roundToInt(vmulq_f32(y, s), y);
+		zi = roundToInt(vmulq_f32(z, s), z);
+	}
+
+	//8 vertices of 8 bits components, the 4 first then the 4 last
+	size_t decodeFilterOctSimd(int8_t* data, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			int8x8x4_t v = vld4_s8(data + i * 4);
+			int16x8_t components[3];
+			for (int c = 0; c < 3; ++c)
+				components[c] = vmovl_s8(v.val[c]);
+			int32x4_t low[3], high[3];
+			for (int c = 0; c < 3; ++c)
+			{
+				low[c] = vmovl_s16(vget_low_s16(components[c]));
+				high[c] = vmovl_s16(vget_high_s16(components[c]));
+			}
+			decodeOct4(low[0], low[1], low[2], 127.0f);
+			decodeOct4(high[0], high[1], high[2], 127.0f);
+			for (int c = 0; c < 3; ++c)
+				v.val[c] = vmovn_s16(vcombine_s16(vmovn_s32(low[c]), vmovn_s32(high[c])));
+			vst4_s8(data + i * 4, v);
+		}
+		return i;
+	}
+
+	size_t decodeFilterOctSimd(int16_t* data, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			int16x4x4_t v = vld4_s16(data + i * 4);
+			int32x4_t x = vmovl_s16(v.val[0]), y = vmovl_s16(v.val[1]), z = vmovl_s16(v.val[2]);
+			decodeOct4(x, y, z, 32767.0f);
+			v.val[0] = vmovn_s32(x);
+			v.val[1] = vmovn_s32(y);
+			v.val[2] = vmovn_s32(z);
+			vst4_s16(data + i * 4, v);
+		}
+		return i;
+	}
+
+	size_t decodeFilterQuatSimd(int16_t* data, size_t count)
+	{
+		const float32x4_t scale = vdupq_n_f32(1.0f / std::sqrt(2.0f));
+		const float32x4_t one = vdupq_n_f32(1.0f), quantize = vdupq_n_f32(32767.0f);
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			int16x4x4_t v = vld4_s16(data + i * 4);
+			const int32x4_t last = vmovl_s16(v.val[3]);
+			const float32x4_t ss = vdivq_f32(scale, vcvtq_f32_s32(vorrq_s32(last, vdupq_n_s32(3))));
+			const float32x4_t x = vmulq_f32(vcvtq_f32_s32(vmovl_s16(v.val[0])), ss);
+			const float32x4_t y = vmulq_f32(vcvtq_f32_s32(vmovl_s16(v.val[1])), ss);
+			const float32x4_t z = vmulq_f32(vcvtq_f32_s32(vmovl_s16(v.val[2])), ss);
+			const float32x4_t ww = vsubq_f32(vsubq_f32(vsubq_f32(one, vmulq_f32(x, x)), vmulq_f32(y, y)), vmulq_f32(z, z));
+			const float32x4_t w = vsqrtq_f32(vbslq_f32(vcgeq_f32(ww, vdupq_n_f32(0.0f)), ww, vdupq_n_f32(0.0f)));
+			//In the order of the rotation by the index of the largest component: w, x, y, z
+			const int32x4_t values[4] = { vcvtq_s32_f32(vaddq_f32(vmulq_f32(w, quantize), vdupq_n_f32(0.5f))),
+				roundToInt(vmulq_f32(x, quantize), x), roundToInt(vmulq_f32(y, quantize), y), roundToInt(vmulq_f32(z, quantize), z) };
+			const int32x4_t qc = vandq_s32(last, vdupq_n_s32(3));
+			int32x4_t result[4] = { vdupq_n_s32(0), vdupq_n_s32(0), vdupq_n_s32(0), vdupq_n_s32(0) };
+			for (int q = 0; q < 4; ++q)
+			{
+				const uint32x4_t selected = vceqq_s32(qc, vdupq_n_s32(q));
+				for (int k = 0; k < 4; ++k)
+					result[(q + k) & 3] = vbslq_s32(selected, values[k], result[(q + k) & 3]);
+			}
+			for (int c = 0; c < 4; ++c)
+				v.val[c] = vmovn_s32(result[c]);
+			vst4_s16(data + i * 4, v);
+		}
+		return i;
+	}
+
+	size_t decodeFilterExpSimd(uint32_t* data, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			const int32x4_t v = vreinterpretq_s32_u32(vld1q_u32(data + i));
+			const int32x4_t m = vshrq_n_s32(vshlq_n_s32(v, 8), 8);
+			const int32x4_t exponent = vshlq_n_s32(vaddq_s32(vshrq_n_s32(v, 24), vdupq_n_s32(127)), 23);
+			const float32x4_t f = vmulq_f32(vreinterpretq_f32_s32(exponent), vcvtq_f32_s32(m));
+			vst1q_u32(data + i, vreinterpretq_u32_f32(f));
+		}
+		return i;
+	}
+#else
+	template<typename T>
+	size_t decodeFilterOctSimd(T*, size_t) { return 0; }
+	size_t decodeFilterQuatSimd(int16_t*, size_t) { return 0; }
+	size_t decodeFilterExpSimd(uint32_t*, size_t) { return 0; }
+#endif
+}
+
+bool MeshoptDecoder::decodeVertexBuffer(void* destination, size_t count, size_t stride, ByteSpan encoded)
+{
+	if (stride == 0 || stride > 256 || stride % 4 != 0) return false;
+	const uint8_t* data = encoded.data;
+	const uint8_t* end = encoded.data + encoded.size;
+	if (encoded.size < 1 || (data[0] & 0xf0) != c_vertexHeader || (data[0] & 0x0f) != 0) return false;
+	++data;
+
+	//The tail holds the first baseline vertex, padded to 32 bytes
+	const size_t tailSize = stride < c_tailMaxSize ? c_tailMaxSize : stride;
+	if (size_t(end - data) < tailSize) return false;
+	uint8_t lastVertex[256];
+	memcpy(lastVertex, end - stride, stride);
+
+	const size_t blockSize = getVertexBlockSize(stride);
+	uint8_t* vertices = static_cast<uint8_t*>(destination);
+	const uint8_t* blocksEnd = end - tailSize;
+	for (size_t offset = 0; offset < count; offset += blockSize)
+	{
+		const size_t size = count - offset < blockSize ? count - offset : blockSize;
+		data = decodeVertexBlock(data, blocksEnd, vertices + offset * stride, size, stride, lastVertex);
+		if (!data) return false;
+	}
+	return data == blocksEnd;
+}
+
+bool MeshoptDecoder::decodeIndexBuffer(void* destination, size_t count, size_t indexSize, ByteSpan encoded)
+{
+	if (count % 3 != 0 || (indexSize != 2 && indexSize != 4)) return false;
+	//Header, one code per triangle, and the 16 bytes table of the auxiliary codes at the end
+	if (encoded.size < 1 + count / 3 + 16 || (encoded.data[0] & 0xf0) != c_indexHeader) return false;
+	const int version = encoded.data[0] & 0x0f;
+	if (version > 1) return false;
+
+	Fifos fifos;
+	memset(fifos.edges, 0xff, sizeof(fifos.edges));
+	memset(fifos.vertices, 0xff, sizeof(fifos.vertices));
+	uint32_t next = 0;
+	uint32_t last = 0;
+	const int fecMax = version >= 1 ? 13 : 15;
+
+	const uint8_t* code = encoded.data + 1;
+	const uint8_t* data = code + count / 3;
+	const uint8_t* safeEnd = encoded.data + encoded.size - 16;
+	const uint8_t* auxTable = safeEnd;
+	for (size_t i = 0; i < count; i += 3)
+	{
+		//A triangle reads at most 16 bytes: the auxiliary code and three 5 bytes indices
+		if (data > safeEnd) return false;
+		const uint8_t codeTri = *code++;
+		uint32_t a, b, c;
+		if (codeTri < 0xf0)
+		{
+			//Edge from the FIFO, third vertex new, from the FIFO or delta encoded
+			const int fe = codeTri >> 4;
+			a = fifos.edges[(fifos.edgeOffset - 1 - fe) & 15][0];
+			b = fifos.edges[(fifos.edgeOffset - 1 - fe) & 15][1];
+			const int fec = codeTri & 15;
+			if (fec < fecMax)
+			{
+				c = fec == 0 ? next : fifos.vertices[(fifos.vertexOffset - 1 - fec) & 15];
+				next += fec == 0 ? 1 : 0;
+				fifos.pushVertex(c, fec == 0);
+			}
+			else
+			{
+				//13 and 14 are -1 and +1 from the last free index
+				last = c = fec != 15 ? last + (fec - (fec ^ 3)) : decodeIndex(data, last);
+				fifos.pushVertex(c);
+			}
+			fifos.pushEdge(c, b);
+			fifos.pushEdge(a, c);
+		}
+		else
+		{
+			int fea, feb, fec;
+			if (codeTri < 0xfe)
+			{
+				const uint8_t codeAux = auxTable[codeTri & 15];
+				fea = 0;
+				feb = codeAux >> 4;
+				fec = codeAux & 15;
+			}
+			else
+			{
+				const uint8_t codeAux = *data++;
+				if (codeAux == 0) next = 0; //Reset
+				fea = codeTri == 0xfe ? 0 : 15;
+				feb = codeAux >> 4;
+				fec = codeAux & 15;
+			}
+			//next is incremented for the three vertices before the free indices are decoded, as in the encoder
+			a = fea == 0 ? next++ : 0;
+			b = feb == 0 ? next++ : fifos.vertices[(fifos.vertexOffset - feb) & 15];
+			c = fec == 0 ? next++ : fifos.vertices[(fifos.vertexOffset - fec) & 15];
+			if (fea == 15) last = a = decodeIndex(data, last);
+			if (feb == 15) last = b = decodeIndex(data, last);
+			if (fec == 15) last = c = decodeIndex(data, last);
+			fifos.pushVertex(a);
+			fifos.pushVertex(b, feb == 0 || feb == 15);
+			fifos.pushVertex(c, fec == 0 || fec == 15);
+			fifos.pushEdge(b, a);
+			fifos.pushEdge(c, b);
+			fifos.pushEdge(a, c);
+		}
+		writeIndex(destination, i + 0, indexSize, a);
+		writeIndex(destination, i + 1, indexSize, b);
+		writeIndex(destination, i + 2, indexSize, c);
+	}
+	return data == safeEnd;
+}
+
+bool MeshoptDecoder::decodeIndexSequence(void* destination, size_t count, size_t indexSize, ByteSpan encoded)
+{
+	if (indexSize != 2 && indexSize != 4) return false;
+	//Header, at least one byte per index, 4 bytes of tail
+	if (encoded.size < 1 + count + 4 || (encoded.data[0] & 0xf0) != c_sequenceHeader || (encoded.data[0] & 0x0f) > 1) return false;
+
+	const uint8_t* data = encoded.data + 1;
+	const uint8_t* safeEnd = encoded.data + encoded.size - 4;
+	//Two baselines, the low bit of each code selects one
+	uint32_t last[2] = {};
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (data >= safeEnd) return false;
+		uint32_t v = decodeVByte(data);
+		const uint32_t baseline = v & 1;
+		v >>= 1;
+		const uint32_t delta = (v >> 1) ^ -int32_t(v & 1);
+		last[baseline] += delta;
+		writeIndex(destination, i, indexSize, last[baseline]);
+	}
+	return data == safeEnd;
+}
+
+bool MeshoptDecoder::applyFilter(void* data, size_t count, size_t stride, Filter filter)
+{
+	switch (filter)
+	{
+	case Filter::None:
+		return true;
+	case Filter::Octahedral:
+		if (stride == 4)
+		{
+			int8_t* components = static_cast<int8_t*>(data);
+			const size_t done = decodeFilterOctSimd(components, count);
+			decodeFilterOct(components + done * 4, count - done);
+		}
+		else if (stride == 8)
+		{
+			int16_t* components = static_cast<int16_t*>(data);
+			const size_t done = decodeFilterOctSimd(components, count);
+			decodeFilterOct(components + done * 4, count - done);
+		}
+		else
+			return false;
+		return true;
+	case Filter::Quaternion:
+	{
+		if (stride != 8) return false;
+		int16_t* components = static_cast<int16_t*>(data);
+		const size_t done = decodeFilterQuatSimd(components, count);
+		decodeFilterQuat(components + done * 4, count - done);
+		return true;
+	}
+	case Filter::Exponential:
+	{
+		if (stride % 4 != 0) return false;
+		uint32_t* values = static_cast<uint32_t*>(data);
+		const size_t done = decodeFilterExpSimd(values, count * stride / 4);
+		decodeFilterExp(values + done, count * stride / 4 - done);
+		return true;
+	}
+	}
+	return false;
+}
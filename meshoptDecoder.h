@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+#include "mappedFile.h"
+
+// Decoders of the EXT_meshopt_compression buffer views (the meshoptimizer codecs, format version 0 and 1).
+// ATTRIBUTES: byte deltas of the vertices in blocks, TRIANGLES: edge and vertex FIFOs, INDICES: varint deltas.
+// The filters are applied after the ATTRIBUTES decoding. All the functions return false on malformed data.
+// The byte groups and the filters are decoded with SSE2 or NEON when available, the results are the same as the scalar code.
+class MeshoptDecoder
+{
+public:
+	enum class Filter { None, Octahedral, Quaternion, Exponential };
+
+	//count vertices of stride bytes (a multiple of 4, at most 256)
+	static bool decodeVertexBuffer(void* destination, size_t count, size_t stride, ByteSpan encoded);
+	//count indices (a multiple of 3) of indexSize bytes (2 or 4)
+	static bool decodeIndexBuffer(void* destination, size_t count, size_t indexSize, ByteSpan encoded);
+	static bool decodeIndexSequence(void* destination, size_t count, size_t indexSize, ByteSpan encoded);
+
+	//In place, on the decoded vertices
+	static bool applyFilter(void* data, size_t count, size_t stride, Filter filter);
+};
@@ -0,0 +1,572 @@
+#include "mipBuilder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "threadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define MIP_BUILDER_SSE2
+#endif
+
+//The AVX2 loops are compiled for their functions only and selected at run time, the build stays SSE2.
+//They convert the halves with F16C, which every AVX2 CPU has.
+#if defined(MIP_BUILDER_SSE2) && defined(__GNUC__)
+#include <immintrin.h>
+#define MIP_BUILDER_AVX2
+#define MIP_BUILDER_AVX2_TARGET __attribute__((target("avx2,f16c")))
+#elif defined(MIP_BUILDER_SSE2) && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#define MIP_BUILDER_AVX2
+#define MIP_BUILDER_AVX2_TARGET
+#endif
+
+namespace
+{
+	//Linear RGBA, one SSE register
+	struct alignas(16) Texel {
+		float c[4];
+	};
+
+	//Source texels of each destination texel along one axis, count per destination texel (edges clamped)
+	struct Taps {
+		uint32_t count = 0;
+		std::vector<uint32_t> indices;
+		std::vector<float> weights; //Their sum is 1 for each destination texel
+	};
+
+	constexpr float c_kaiserRadius = 2.0f; //In destination texels
+	constexpr float c_kaiserAlpha = 4.0f;
+	constexpr uint32_t c_srgbTableSize = 8192;
+	constexpr float c_pi = 3.14159265358979323846f;
+
+	//Modified Bessel function of the first kind, order 0
+	float besselI0(float x)
+	{
+		const float y = x * x / 4.0f;
+		float sum = 1.0f;
+		float term = 1.0f;
+		for (int k = 1; k < 32 && term > sum * 1e-7f; ++k)
+		{
+			term *= y / float(k * k);
+			sum += term;
+		}
+		return sum;
+	}
+
+	//Kaiser windowed sinc, x in destination texels
+	float kaiser(float x)
+	{
+		if (std::abs(x) >= c_kaiserRadius) return 0.0f;
+		const float t = x / c_kaiserRadius;
+		const float window = besselI0(c_kaiserAlpha * std::sqrt(1.0f - t * t)) / besselI0(c_kaiserAlpha);
+		const float pix = c_pi * x;
+		return (x == 0.0f ? 1.0f : std::sin(pix) / pix) * window;
+	}
+
+	Taps computeTaps(uint32_t sourceSize, uint32_t size, MipBuilder::Filter filter)
+	{
+		Taps taps;
+		if (sourceSize == 1)
+		{
+			taps.count = 1;
+			taps.indices.assign(size, 0);
+			taps.weights.assign(size, 1.0f);
+			return taps;
+		}
+		if (filter == MipBuilder::Filter::Box)
+		{
+			//An odd side of 2n + 1 texels: each destination texel covers 2 + 1/n of them
+			const bool odd = sourceSize % 2 != 0;
+			taps.count = odd ? 3 : 2;
+			for (uint32_t i = 0; i < size; ++i)
+			{
+				for (uint32_t k = 0; k < taps.count; ++k)
+					taps.indices.push_back(std::min(2 * i + k, sourceSize - 1));
+				if (odd)
+				{
+					const float n = float(size);
+					taps.weights.insert(taps.weights.end(), { (n - i) / (2 * n + 1), n / (2 * n + 1), (i + 1) / (2 * n + 1) });
+				}
+				else
+				{
+					taps.weights.insert(taps.weights.end(), { 0.5f, 0.5f });
+				}
+			}
+			return taps;
+		}
+
+		const float scale = float(sourceSize) / float(size);
+		const float radius = c_kaiserRadius * scale;
+		taps.count = static_cast<uint32_t>(std::ceil(2.0f * radius)) + 1;
+		for (uint32_t i = 0; i < size; ++i)
+		{
+			const float center = (i + 0.5f) * scale - 0.5f;
+			const int first = static_cast<int>(std::floor(center - radius)) + 1;
+			const size_t offset = taps.weights.size();
+			float sum = 0.0f;
+			for (uint32_t k = 0; k < taps.count; ++k)
+			{
+				const int index = first + static_cast<int>(k);
+				taps.indices.push_back(static_cast<uint32_t>(std::clamp(index, 0, static_cast<int>(sourceSize) - 1)));
+				taps.weights.push_back(kaiser((index - center) / scale));
+				sum += taps.weights.back();
+			}
+			for (size_t k = offset; k < taps.weights.size(); ++k)
+				taps.weights[k] /= sum;
+		}
+		return taps;
+	}
+
+	struct SrgbTables {
+		float toLinear[256];
+		uint8_t toSrgb[c_srgbTableSize]; //Indexed by the linear value
+		SrgbTables()
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				const float c = i / 255.0f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (uint32_t i = 0; i < c_srgbTableSize; ++i)
+			{
+				const float c = i / float(c_srgbTableSize - 1);
+				const float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+				toSrgb[i] = static_cast<uint8_t>(std::lround(s * 255.0f));
+			}
+		}
+	};
+
+	const SrgbTables& getSrgbTables()
+	{
+		static SrgbTables tables;
+		return tables;
+	}
+
+	float halfToFloat(uint16_t half)
+	{
+		const uint32_t sign = uint32_t(half & 0x8000u) << 16;
+		const uint32_t exponent = (half >> 10) & 0x1fu;
+		const uint32_t mantissa = half & 0x3ffu;
+		if (exponent == 0)
+		{
+			const float value = std::ldexp(float(mantissa), -24); //Subnormal
+			return sign ? -value : value;
+		}
+		const uint32_t bits = exponent == 31 ? sign | 0x7f800000u | (mantissa << 13) : sign | ((exponent + 112) << 23) | (mantissa << 13);
+		float value;
+		memcpy(&value, &bits, 4);
+		return value;
+	}
+
+	uint16_t floatToHalf(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, 4);
+		const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+		const float magnitude = std::abs(value);
+		if (value != value) return sign | 0x7e00;
+		if (magnitude >= 65520.0f) return sign | 0x7c00;
+		if (magnitude < 6.103515625e-05f) return sign | static_cast<uint16_t>(std::lrint(magnitude * 16777216.0f));
+		//Round to nearest even on the 13 dropped bits, a carry goes into the exponent
+		uint32_t magnitudeBits = bits & 0x7fffffffu;
+		magnitudeBits += 0xfffu + ((magnitudeBits >> 13) & 1u);
+		return sign | static_cast<uint16_t>((magnitudeBits >> 13) - (112u << 10));
+	}
+
+	MipBuilder::Simd detectSimd()
+	{
+#if defined(MIP_BUILDER_AVX2) && defined(__GNUC__)
+		//Called from a static initializer, maybe before the one of the runtime
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c"))
+			return MipBuilder::Simd::AVX2;
+#elif defined(MIP_BUILDER_AVX2)
+		//AVX2 and F16C instructions, and the YMM registers saved by the OS
+		int info[4];
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		const bool f16c = (info[2] & (1 << 29)) != 0;
+		if (osxsave && avx && f16c && (_xgetbv(0) & 6) == 6)
+		{
+			__cpuidex(info, 7, 0);
+			if (info[1] & (1 << 5))
+				return MipBuilder::Simd::AVX2;
+		}
+#endif
+#ifdef MIP_BUILDER_SSE2
+		return MipBuilder::Simd::SSE2;
+#else
+		return MipBuilder::Simd::None;
+#endif
+	}
+
+	const MipBuilder::Simd c_cpuSimd = detectSimd();
+	MipBuilder::Simd s_simd = c_cpuSimd;
+
+	void decodeRowScalar(const uint8_t* source, Texel* row, uint32_t count)
+	{
+		for (uint32_t x = 0; x < count; ++x)
+			for (int c = 0; c < 4; ++c)
+				row[x].c[c] = source[4 * x + c] / 255.0f;
+	}
+
+#ifdef MIP_BUILDER_SSE2
+	void decodeRowSse2(const uint8_t* source, Texel* row, uint32_t count)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+		for (uint32_t x = 0; x < count; ++x)
+		{
+			int32_t texel;
+			memcpy(&texel, source + 4 * x, 4);
+			const __m128i channels = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(texel), zero), zero);
+			_mm_store_ps(row[x].c, _mm_mul_ps(_mm_cvtepi32_ps(channels), scale));
+		}
+	}
+#endif
+
+#ifdef MIP_BUILDER_AVX2
+	//Two texels per iteration
+	MIP_BUILDER_AVX2_TARGET void decodeRowAvx2(const uint8_t* source, Texel* row, uint32_t count)
+	{
+		const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+		float* floats = reinterpret_cast<float*>(row);
+		uint32_t x = 0;
+		for (; x + 2 <= count; x += 2)
+		{
+			const __m256i channels = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + 4 * x)));
+			_mm256_storeu_ps(floats + 4 * x, _mm256_mul_ps(_mm256_cvtepi32_ps(channels), scale));
+		}
+		decodeRowSse2(source + 4 * x, row + x, count - x);
+	}
+
+	//Two texels per iteration, the halves are exact in float
+	MIP_BUILDER_AVX2_TARGET void decodeHalfRowAvx2(const uint16_t* halves, Texel* row, uint32_t count)
+	{
+		float* floats = reinterpret_cast<float*>(row);
+		uint32_t x = 0;
+		for (; x + 2 <= count; x += 2)
+			_mm256_storeu_ps(floats + 4 * x, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(halves + 4 * x))));
+		for (; x < count; ++x)
+			_mm_store_ps(row[x].c, _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(halves + 4 * x))));
+	}
+
+	//Rounded to the nearest even, like floatToHalf
+	MIP_BUILDER_AVX2_TARGET void encodeHalfRowAvx2(const Texel* row, uint16_t* halves, uint32_t count)
+	{
+		const __m256 zero = _mm256_setzero_ps();
+		const float* floats = reinterpret_cast<const float*>(row);
+		uint32_t x = 0;
+		for (; x + 2 <= count; x += 2)
+		{
+			const __m128i packed = _mm256_cvtps_ph(_mm256_max_ps(_mm256_loadu_ps(floats + 4 * x), zero), _MM_FROUND_TO_NEAREST_INT);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(halves + 4 * x), packed);
+		}
+		for (; x < count; ++x)
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(halves + 4 * x), _mm_cvtps_ph(_mm_max_ps(_mm_load_ps(row[x].c), _mm256_castps256_ps128(zero)), _MM_FROUND_TO_NEAREST_INT));
+	}
+#endif
+
+	void decodeRow(const uint8_t* source, Texel* row, uint32_t count, TextureFormat format, bool srgb)
+	{
+		if (format == TextureFormat::RGBA32Float)
+		{
+			memcpy(row, source, size_t(count) * sizeof(Texel));
+		}
+		else if (format == TextureFormat::RGBA16Float)
+		{
+			const uint16_t* halves = reinterpret_cast<const uint16_t*>(source);
+#ifdef MIP_BUILDER_AVX2
+			if (s_simd == MipBuilder::Simd::AVX2)
+				return decodeHalfRowAvx2(halves, row, count);
+#endif
+			for (uint32_t x = 0; x < count; ++x)
+				for (int c = 0; c < 4; ++c)
+					row[x].c[c] = halfToFloat(halves[4 * x + c]);
+		}
+		else if (srgb)
+		{
+			const SrgbTables& tables = getSrgbTables();
+			for (uint32_t x = 0; x < count; ++x)
+			{
+				for (int c = 0; c < 3; ++c)
+					row[x].c[c] = tables.toLinear[source[4 * x + c]];
+				row[x].c[3] = source[4 * x + 3] / 255.0f;
+			}
+		}
+#ifdef MIP_BUILDER_AVX2
+		else if (s_simd == MipBuilder::Simd::AVX2)
+			decodeRowAvx2(source, row, count);
+#endif
+#ifdef MIP_BUILDER_SSE2
+		else if (s_simd != MipBuilder::Simd::None)
+			decodeRowSse2(source, row, count);
+#endif
+		else
+			decodeRowScalar(source, row, count);
+	}
+
+	void encodeRow(const Texel* row, uint8_t* destination, uint32_t count, TextureFormat format, bool srgb)
+	{
+#ifdef MIP_BUILDER_AVX2
+		if (format == TextureFormat::RGBA16Float && s_simd == MipBuilder::Simd::AVX2)
+			return encodeHalfRowAvx2(row, reinterpret_cast<uint16_t*>(destination), count);
+#endif
+		if (format == TextureFormat::RGBA32Float || format == TextureFormat::RGBA16Float)
+		{
+			//HDR colors, the ringing of the Kaiser filter does not go below 0
+			float* floats = reinterpret_cast<float*>(destination);
+			uint16_t* halves = reinterpret_cast<uint16_t*>(destination);
+			for (uint32_t x = 0; x < count; ++x)
+			{
+				for (int c = 0; c < 4; ++c)
+				{
+					const float value = std::max(row[x].c[c], 0.0f);
+					if (format == TextureFormat::RGBA32Float)
+						floats[4 * x + c] = value;
+					else
+						halves[4 * x + c] = floatToHalf(value);
+				}
+			}
+		}
+		else if (srgb)
+		{
+			const SrgbTables& tables = getSrgbTables();
+			for (uint32_t x = 0; x < count; ++x)
+			{
+				for (int c = 0; c < 3; ++c)
+					destination[4 * x + c] = tables.toSrgb[std::lround(std::clamp(row[x].c[c], 0.0f, 1.0f) * (c_srgbTableSize - 1))];
+				destination[4 * x + 3] = static_cast<uint8_t>(std::lround(std::clamp(row[x].c[3], 0.0f, 1.0f) * 255.0f));
+			}
+		}
+#ifdef MIP_BUILDER_SSE2
+		else if (s_simd != MipBuilder::Simd::None)
+		{
+			const __m128 scale = _mm_set1_ps(255.0f);
+			for (uint32_t x = 0; x < count; ++x)
+			{
+				//The packs saturate to [0, 255]
+				const __m128i channels = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(row[x].c), scale));
+				const __m128i words = _mm_packs_epi32(channels, channels);
+				const int32_t texel = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+				memcpy(destination + 4 * x, &texel, 4);
+			}
+		}
+#endif
+		else
+		{
+			for (uint32_t x = 0; x < count; ++x)
+				for (int c = 0; c < 4; ++c)
+					destination[4 * x + c] = static_cast<uint8_t>(std::lround(std::clamp(row[x].c[c], 0.0f, 1.0f) * 255.0f));
+		}
+	}
+
+	//sum = weight * row (first tap) or sum += weight * row
+	void accumulateRowScalar(Texel* sum, const Texel* row, uint32_t count, float weight, bool first)
+	{
+		for (uint32_t x = 0; x < count; ++x)
+			for (int c = 0; c < 4; ++c)
+				sum[x].c[c] = (first ? 0.0f : sum[x].c[c]) + weight * row[x].c[c];
+	}
+
+#ifdef MIP_BUILDER_SSE2
+	void accumulateRowSse2(Texel* sum, const Texel* row, uint32_t count, float weight, bool first)
+	{
+		const __m128 w = _mm_set1_ps(weight);
+		if (first)
+		{
+			for (uint32_t x = 0; x < count; ++x)
+				_mm_store_ps(sum[x].c, _mm_mul_ps(_mm_load_ps(row[x].c), w));
+		}
+		else
+		{
+			for (uint32_t x = 0; x < count; ++x)
+				_mm_store_ps(sum[x].c, _mm_add_ps(_mm_load_ps(sum[x].c), _mm_mul_ps(_mm_load_ps(row[x].c), w)));
+		}
+	}
+#endif
+
+#ifdef MIP_BUILDER_AVX2
+	//Two texels per iteration, no FMA so that the results are those of SSE2
+	MIP_BUILDER_AVX2_TARGET void accumulateRowAvx2(Texel* sum, const Texel* row, uint32_t count, float weight, bool first)
+	{
+		const __m256 w = _mm256_set1_ps(weight);
+		float* sums = reinterpret_cast<float*>(sum);
+		const float* rows = reinterpret_cast<const float*>(row);
+		uint32_t x = 0;
+		if (first)
+		{
+			for (; x + 2 <= count; x += 2)
+				_mm256_storeu_ps(sums + 4 * x, _mm256_mul_ps(_mm256_loadu_ps(rows + 4 * x), w));
+		}
+		else
+		{
+			for (; x + 2 <= count; x += 2)
+				_mm256_storeu_ps(sums + 4 * x, _mm256_add_ps(_mm256_loadu_ps(sums + 4 * x), _mm256_mul_ps(_mm256_loadu_ps(rows + 4 * x), w)));
+		}
+		accumulateRowSse2(sum + x, row + x, count - x, weight, first);
+	}
+#endif
+
+	void accumulateRow(Texel* sum, const Texel* row, uint32_t count, float weight, bool first)
+	{
+#ifdef MIP_BUILDER_AVX2
+		if (s_simd == MipBuilder::Simd::AVX2)
+			return accumulateRowAvx2(sum, row, count, weight, first);
+#endif
+#ifdef MIP_BUILDER_SSE2
+		if (s_simd != MipBuilder::Simd::None)
+			return accumulateRowSse2(sum, row, count, weight, first);
+#endif
+		accumulateRowScalar(sum, row, count, weight, first);
+	}
+
+	void filterRowScalar(const Texel* row, const Taps& taps, uint32_t first, uint32_t count, Texel* output)
+	{
+		for (uint32_t x = first; x < count; ++x)
+		{
+			const uint32_t* indices = &taps.indices[size_t(x) * taps.count];
+			const float* weights = &taps.weights[size_t(x) * taps.count];
+			Texel sum = {};
+			for (uint32_t k = 0; k < taps.count; ++k)
+				for (int c = 0; c < 4; ++c)
+					sum.c[c] += weights[k] * row[indices[k]].c[c];
+			output[x] = sum;
+		}
+	}
+
+#ifdef MIP_BUILDER_SSE2
+	void filterRowSse2(const Texel* row, const Taps& taps, uint32_t first, uint32_t count, Texel* output)
+	{
+		for (uint32_t x = first; x < count; ++x)
+		{
+			const uint32_t* indices = &taps.indices[size_t(x) * taps.count];
+			const float* weights = &taps.weights[size_t(x) * taps.count];
+			__m128 sum = _mm_setzero_ps();
+			for (uint32_t k = 0; k < taps.count; ++k)
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(row[indices[k]].c), _mm_set1_ps(weights[k])));
+			_mm_store_ps(output[x].c, sum);
+		}
+	}
+#endif
+
+#ifdef MIP_BUILDER_AVX2
+	//Two destination texels per iteration, they have the same number of taps
+	MIP_BUILDER_AVX2_TARGET void filterRowAvx2(const Texel* row, const Taps& taps, uint32_t count, Texel* output)
+	{
+		uint32_t x = 0;
+		for (; x + 2 <= count; x += 2)
+		{
+			const uint32_t* indices0 = &taps.indices[size_t(x) * taps.count];
+			const uint32_t* indices1 = indices0 + taps.count;
+			const float* weights0 = &taps.weights[size_t(x) * taps.count];
+			const float* weights1 = weights0 + taps.count;
+			__m256 sum = _mm256_setzero_ps();
+			for (uint32_t k = 0; k < taps.count; ++k)
+			{
+				const __m256 texels = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(row[indices0[k]].c)), _mm_load_ps(row[indices1[k]].c), 1);
+				const __m256 weights = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(weights0[k])), _mm_set1_ps(weights1[k]), 1);
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(texels, weights));
+			}
+			_mm256_storeu_ps(output[x].c, sum);
+		}
+		filterRowSse2(row, taps, x, count, output);
+	}
+#endif
+
+	void filterRow(const Texel* row, const Taps& taps, uint32_t count, Texel* output)
+	{
+#ifdef MIP_BUILDER_AVX2
+		if (s_simd == MipBuilder::Simd::AVX2)
+			return filterRowAvx2(row, taps, count, output);
+#endif
+#ifdef MIP_BUILDER_SSE2
+		if (s_simd != MipBuilder::Simd::None)
+			return filterRowSse2(row, taps, 0, count, output);
+#endif
+		filterRowScalar(row, taps, 0, count, output);
+	}
+}
+
+MipBuilder::Simd MipBuilder::getSimd()
+{
+	return s_simd;
+}
+
+void MipBuilder::setSimd(Simd simd)
+{
+	s_simd = std::min(simd, c_cpuSimd);
+}
+
+bool MipBuilder::supports(TextureFormat format)
+{
+	return format == TextureFormat::RGBA8Unorm || format == TextureFormat::RGBA16Float || format == TextureFormat::RGBA32Float;
+}
+
+bool MipBuilder::build(Utils::ImageData& image, Filter filter, double* pMilliseconds)
+{
+	if (!supports(image.format) || image.levels.empty() || image.width <= 0 || image.height <= 0)
+		return false;
+	auto start = std::chrono::steady_clock::now();
+	const uint32_t levelCount = Utils::getMipLevelCount(image.width, image.height);
+	const uint32_t texelBytes = Utils::getFormatBlock(image.format).bytes;
+	image.levels.resize(1);
+	image.levels.resize(levelCount);
+
+	//The previous level in linear RGBA, the level 0 is decoded row by row
+	std::vector<Texel> previous;
+	std::vector<Texel> current;
+	uint32_t sourceWidth = image.width;
+	uint32_t sourceHeight = image.height;
+	for (uint32_t level = 1; level < levelCount; ++level)
+	{
+		const uint32_t width = std::max(sourceWidth / 2, 1u);
+		const uint32_t height = std::max(sourceHeight / 2, 1u);
+		const Taps columnTaps = computeTaps(sourceWidth, width, filter);
+		const Taps rowTaps = computeTaps(sourceHeight, height, filter);
+		current.resize(size_t(width) * height);
+		image.levels[level].resize(size_t(width) * height * texelBytes);
+
+		const uint8_t* levelZero = image.levels[0].data();
+		uint8_t* destination = image.levels[level].data();
+		ThreadPool::getInstance().parallelFor(height, [&](size_t y) {
+			thread_local std::vector<Texel> column;
+			thread_local std::vector<Texel> decoded;
+			column.resize(sourceWidth);
+			//Vertical pass on the whole source rows, then horizontal pass
+			for (uint32_t k = 0; k < rowTaps.count; ++k)
+			{
+				const uint32_t sourceY = rowTaps.indices[y * rowTaps.count + k];
+				const Texel* sourceRow = nullptr;
+				if (level == 1)
+				{
+					decoded.resize(sourceWidth);
+					decodeRow(levelZero + size_t(sourceY) * sourceWidth * texelBytes, decoded.data(), sourceWidth, image.format, image.srgb);
+					sourceRow = decoded.data();
+				}
+				else
+				{
+					sourceRow = previous.data() + size_t(sourceY) * sourceWidth;
+				}
+				accumulateRow(column.data(), sourceRow, sourceWidth, rowTaps.weights[y * rowTaps.count + k], k == 0);
+			}
+			Texel* output = current.data() + y * width;
+			filterRow(column.data(), columnTaps, width, output);
+			encodeRow(output, destination + y * width * texelBytes, width, image.format, image.srgb);
+		});
+
+		previous.swap(current);
+		sourceWidth = width;
+		sourceHeight = height;
+	}
+
+	if (pMilliseconds)
+		*pMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "utils.h"
+
+// Mip chains built on the CPU, for the images cooked at import (the block compression needs every level)
+// and wherever the GPU is not available (MipGenerator builds them at upload otherwise).
+// Each level is filtered from the previous one in linear float RGBA: separable, with weighted taps along each axis,
+// so that the odd sizes keep their last row and column. The sRGB encoded colors are averaged in linear space.
+// The rows of each level are filtered in parallel on the ThreadPool, the texels are processed with AVX2 or SSE2
+// when the CPU has them (see tests/mipBuilderTest.cpp for the comparison with a scalar reference and the throughput).
+class MipBuilder
+{
+public:
+	//Box: 2x2 average (3x3 weighted by coverage on the odd sides), the same as MipGenerator.
+	//Kaiser: windowed sinc over 4 destination texels, sharper mips for the cooked textures.
+	enum class Filter { Box, Kaiser };
+
+	//Instruction set of the texel loops, the best one of the CPU by default
+	enum class Simd { None, SSE2, AVX2 };
+	static Simd getSimd();
+	//For the tests and benchmarks, clamped to what the CPU supports. Not to change while a build runs.
+	static void setSimd(Simd simd);
+
+	//RGBA8Unorm (sRGB or not), RGBA16Float and RGBA32Float
+	static bool supports(TextureFormat format);
+
+	//Replaces the levels after the level 0 by the chain down to 1x1. False, with the image untouched, when the format
+	//is not supported or the image has no level 0. The milliseconds spent are added to pMilliseconds.
+	static bool build(Utils::ImageData& image, Filter filter = Filter::Box, double* pMilliseconds = nullptr);
+};
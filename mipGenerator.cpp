@@ -0,0 +1,92 @@
+#include "mipGenerator.h"
+
+#include <algorithm>
+
+#include "utils.h"
+
+namespace
+{
+	constexpr uint32_t c_groupSize = 8;
+
+	TextureView createLevelView(const Texture& texture, TextureFormat format, uint32_t level)
+	{
+		TextureViewDescriptor viewDesc;
+		viewDesc.format = format;
+		viewDesc.dimension = TextureViewDimension::e2D;
+		viewDesc.baseMipLevel = level;
+		viewDesc.mipLevelCount = 1;
+		viewDesc.baseArrayLayer = 0;
+		viewDesc.arrayLayerCount = 1;
+		viewDesc.aspect = TextureAspect::All;
+		return texture.CreateView(&viewDesc);
+	}
+
+	//Binding of the destination of each format in mipmaps.wgsl
+	uint32_t getDestinationBinding(TextureFormat format)
+	{
+		switch (format) {
+		case TextureFormat::RGBA16Float: return 2;
+		case TextureFormat::RGBA32Float: return 3;
+		default: return 1;
+		}
+	}
+}
+
+MipGenerator::MipGenerator() :
+	m_downsample8("downsample8", Utils::loadFile(DATA_DIR "/mipmaps.wgsl"), "cs_downsample8"),
+	m_downsample8Srgb("downsample8Srgb", Utils::loadFile(DATA_DIR "/mipmaps.wgsl"), "cs_downsample8Srgb"),
+	m_downsample16("downsample16", Utils::loadFile(DATA_DIR "/mipmaps.wgsl"), "cs_downsample16"),
+	m_downsample32("downsample32", Utils::loadFile(DATA_DIR "/mipmaps.wgsl"), "cs_downsample32")
+{
+}
+
+bool MipGenerator::supports(TextureFormat format)
+{
+	return format == TextureFormat::RGBA8Unorm || format == TextureFormat::RGBA16Float || format == TextureFormat::RGBA32Float;
+}
+
+const ComputeShader& MipGenerator::getShader(TextureFormat format, bool srgb) const
+{
+	switch (format) {
+	case TextureFormat::RGBA16Float: return m_downsample16;
+	case TextureFormat::RGBA32Float: return m_downsample32;
+	default: return srgb ? m_downsample8Srgb : m_downsample8;
+	}
+}
+
+void MipGenerator::generate(const Texture& texture, TextureFormat format, uint32_t width, uint32_t height, uint32_t levelCount, bool srgb)
+{
+	assert(supports(format));
+	if (levelCount < 2) return;
+
+	Device device = Context::getInstance().getDevice();
+	const ComputeShader& shader = getShader(format, srgb);
+	CommandEncoder encoder = device.CreateCommandEncoder();
+	ComputePassDescriptor computePassDesc;
+	computePassDesc.label = "mipmaps";
+	ComputePassEncoder computePass = encoder.BeginComputePass(&computePassDesc);
+	computePass.SetPipeline(shader.getComputePipeline());
+	//The levels are written in order, each pass reads the previous one
+	for (uint32_t level = 1; level < levelCount; ++level)
+	{
+		std::vector<BindGroupEntry> entries(2);
+		entries[0].binding = 0;
+		entries[0].textureView = createLevelView(texture, format, level - 1);
+		entries[1].binding = getDestinationBinding(format);
+		entries[1].textureView = createLevelView(texture, format, level);
+
+		BindGroupDescriptor bindGroupDesc;
+		bindGroupDesc.label = "mipmaps";
+		bindGroupDesc.layout = shader.getBindGroupLayout();
+		bindGroupDesc.entryCount = entries.size();
+		bindGroupDesc.entries = entries.data();
+		BindGroup bindGroup = device.CreateBindGroup(&bindGroupDesc);
+
+		computePass.SetBindGroup(0, bindGroup, 0, nullptr);
+		computePass.DispatchWorkgroups(ComputeShader::getGroupCount(std::max(width >> level, 1u), c_groupSize),
+			ComputeShader::getGroupCount(std::max(height >> level, 1u), c_groupSize), 1);
+	}
+	computePass.End();
+	CommandBuffer command = encoder.Finish();
+	device.GetQueue().Submit(1, &command);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "computeShader.h"
+
+// Mip chains built on the device: only the level 0 of a texture is uploaded, each level is then downsampled
+// from the previous one by a compute pass (see mipmaps.wgsl). The odd sizes are filtered over 3 texels per axis
+// so that the non power of two textures keep their borders, the sRGB encoded colors are averaged in linear space.
+class MipGenerator
+{
+public:
+	static MipGenerator& getInstance() {
+		static MipGenerator mipGenerator;
+		return mipGenerator;
+	};
+
+	//The formats written by the shader as storage textures
+	static bool supports(TextureFormat format);
+
+	//The texture needs the StorageBinding and TextureBinding usages, its level 0 written.
+	//The levels 1 to levelCount - 1 are written by a command buffer submitted to the queue.
+	void generate(const Texture& texture, TextureFormat format, uint32_t width, uint32_t height, uint32_t levelCount, bool srgb = false);
+
+private:
+	MipGenerator();
+	~MipGenerator() = default;
+
+	const ComputeShader& getShader(TextureFormat format, bool srgb) const;
+
+	ComputeShader m_downsample8;
+	ComputeShader m_downsample8Srgb;
+	ComputeShader m_downsample16;
+	ComputeShader m_downsample32;
+};
@@ -83,7 +83,7 @@ public:
 	}
 
 	void setPipeline(Pipeline* pipline) { m_pipline = pipline; }
-	const Pipeline* getPipeline() const { return m_pipline; }
+	Pipeline* getPipeline() const { return m_pipline; }
 
 	void addFilter(std::string filter) { m_filters.push_back(filter); }
 	const std::vector<std::string>& getFilters() { return m_filters; }
@@ -111,6 +111,16 @@ public:
 	}
 
 	void setClearDepth(bool clear) { m_clearDepth = clear; }
+
+	//SCENE passes only: the meshes with meshlets are culled on the GPU and drawn indirectly (see MeshletCuller)
+	void setMeshletCulling(bool meshletCulling) { m_meshletCulling = meshletCulling; }
+	bool getMeshletCulling() const { return m_meshletCulling; }
+	//SCENE passes only: the entities small on screen are drawn as impostors at the end of the pass
+	void setImpostors(bool impostors) { m_impostors = impostors; }
+	bool getImpostors() const { return m_impostors; }
+	//A disabled pass is skipped by the Renderer, for the passes not run every frame (see TextureStreamer)
+	void setEnabled(bool enabled) { m_enabled = enabled; }
+	bool isEnabled() const { return m_enabled; }
 private:
 	
 	RenderPassDepthStencilAttachment* m_depthStencilAttachment;
@@ -126,6 +136,9 @@ private:
 	Color m_clearColorValue{ 0.3, 0.3, 0.3, 1.0 };
 	bool m_clearDepth = true;
 	bool m_useStencil = false;
+	bool m_meshletCulling = false;
+	bool m_impostors = true;
+	bool m_enabled = true;
 	Type m_type{ Type::SCENE };
 	//size_t m_uniformBufferVersion = 0;
 	std::unordered_map<Issam::Binding, size_t>m_uniformBufferVersion;
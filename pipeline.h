@@ -17,53 +17,109 @@ public:
 	};
 
 
-	Pipeline(std::string label, Shader* shader, TextureFormat swapChainFormat, TextureFormat depthTextureFormat, BlendingMode blendingMode, PrimitiveTopology primitiveTopology = PrimitiveTopology::TriangleList) {
+	Pipeline(std::string label, Shader* shader, TextureFormat swapChainFormat, TextureFormat depthTextureFormat, BlendingMode blendingMode, PrimitiveTopology primitiveTopology = PrimitiveTopology::TriangleList) :
+		m_label(label),
+		m_shader(shader),
+		m_swapChainFormat(swapChainFormat),
+		m_depthTextureFormat(depthTextureFormat),
+		m_blendingMode(blendingMode),
+		m_primitiveTopology(primitiveTopology)
+	{
+		//Most of the meshes use the standard layout, the other variants are created on first use
+		getRenderPipeline(VertexLayout::getStandard());
+	};
+	~Pipeline() {
+	};
+
+	//One render pipeline per vertex layout, they share the bind group layouts of the shader
+	const RenderPipeline getRenderPipeline(const VertexLayout& vertexLayout = VertexLayout::getStandard()) {
+		return getVariant(vertexLayout).pipeline;
+	}
+
+	//Streams of the layout read by the shader, the stream streams[i] is bound to the vertex buffer slot i.
+	//A position only pass on a split layout only fetches the position stream.
+	const std::vector<uint32_t>& getVertexStreams(const VertexLayout& vertexLayout = VertexLayout::getStandard()) {
+		return getVariant(vertexLayout).streams;
+	}
+
+	TextureFormat getColorFormat() const { return m_swapChainFormat; }
+	TextureFormat getDepthFormat() const { return m_depthTextureFormat; }
+
+private:
+	std::string m_label;
+	Shader* m_shader = nullptr;
+	TextureFormat m_swapChainFormat;
+	TextureFormat m_depthTextureFormat;
+	BlendingMode m_blendingMode;
+	PrimitiveTopology m_primitiveTopology;
+
+	struct Variant {
+		RenderPipeline pipeline{ nullptr };
+		std::vector<uint32_t> streams;
+	};
+	std::unordered_map<uint64_t, Variant> m_variants{};
+
+	const Variant& getVariant(const VertexLayout& vertexLayout) {
+		auto it = m_variants.find(vertexLayout.getKey());
+		if (it != m_variants.end())
+			return it->second;
+		Variant& variant = m_variants[vertexLayout.getKey()];
+		for (uint32_t stream = 0; stream < vertexLayout.getStreamCount(); ++stream)
+		{
+			bool used = std::any_of(vertexLayout.getAttributes().begin(), vertexLayout.getAttributes().end(), [this, stream](const VertexLayout::Attribute& attribute) {
+				return attribute.stream == stream && m_shader->hasVertexInput(attribute.semantic);
+			});
+			if (used) variant.streams.push_back(stream);
+		}
+		variant.pipeline = createRenderPipeline(vertexLayout, variant.streams);
+		return variant;
+	}
+
+	RenderPipeline createRenderPipeline(const VertexLayout& vertexLayout, const std::vector<uint32_t>& streams) {
+		Shader* shader = m_shader;
+		TextureFormat swapChainFormat = m_swapChainFormat;
+		TextureFormat depthTextureFormat = m_depthTextureFormat;
+		BlendingMode blendingMode = m_blendingMode;
+		PrimitiveTopology primitiveTopology = m_primitiveTopology;
+
 		//Creating render pipeline
 		RenderPipelineDescriptor pipelineDesc;
-		pipelineDesc.label = label.c_str();
+		pipelineDesc.label = m_label.c_str();
                 pipelineDesc.depthStencil = nullptr;
 
-		// Vertex fetch
-		std::vector<VertexAttribute> m_vertexAttribs;
-		//Positions
-		VertexAttribute vertexAttribute;
-		vertexAttribute.shaderLocation = 0;
-		vertexAttribute.format = VertexFormat::Float32x3;
-		vertexAttribute.offset = 0;
-		m_vertexAttribs.push_back(vertexAttribute);
-		//Normals
-		vertexAttribute.shaderLocation = 1;
-		vertexAttribute.format = VertexFormat::Float32x3;
-		vertexAttribute.offset = 3 * sizeof(float);
-		m_vertexAttribs.push_back(vertexAttribute);
-		//Tangents
-		vertexAttribute.shaderLocation = 2;
-		vertexAttribute.format = VertexFormat::Float32x3;
-		vertexAttribute.offset = 6 * sizeof(float);
-		m_vertexAttribs.push_back(vertexAttribute);
-		//TexCoords
-		vertexAttribute.shaderLocation = 3;
-		vertexAttribute.format = VertexFormat::Float32x2;
-		vertexAttribute.offset = 9 * sizeof(float);
-		m_vertexAttribs.push_back(vertexAttribute);
-
-		VertexBufferLayout vertexBufferLayout;
-		// [...] Build vertex buffer layout
-		vertexBufferLayout.attributeCount = (uint32_t)m_vertexAttribs.size();
-		vertexBufferLayout.attributes = m_vertexAttribs.data();
-		// == Common to attributes from the same buffer ==
-		vertexBufferLayout.arrayStride = 11 * sizeof(float);
-		vertexBufferLayout.stepMode = VertexStepMode::Vertex;
+		// Vertex fetch, one buffer layout per stream read by the shader
+		std::vector<std::vector<VertexAttribute>> m_vertexAttribs(streams.size());
+		std::vector<VertexBufferLayout> vertexBufferLayouts(streams.size());
+		for (size_t slot = 0; slot < streams.size(); ++slot)
+		{
+			for (const auto& attribute : vertexLayout.getAttributes())
+			{
+				if (attribute.stream != streams[slot] || !shader->hasVertexInput(attribute.semantic)) continue;
+				VertexAttribute vertexAttribute;
+				vertexAttribute.shaderLocation = VertexLayout::getShaderLocation(attribute.semantic);
+				vertexAttribute.format = attribute.format;
+				vertexAttribute.offset = attribute.offset;
+				m_vertexAttribs[slot].push_back(vertexAttribute);
+			}
+
+			VertexBufferLayout& vertexBufferLayout = vertexBufferLayouts[slot];
+			// [...] Build vertex buffer layout
+			vertexBufferLayout.attributeCount = (uint32_t)m_vertexAttribs[slot].size();
+			vertexBufferLayout.attributes = m_vertexAttribs[slot].data();
+			// == Common to attributes from the same buffer ==
+			vertexBufferLayout.arrayStride = vertexLayout.getStride(streams[slot]);
+			vertexBufferLayout.stepMode = VertexStepMode::Vertex;
+		}
 		
 		VertexState vertexState;
-		vertexState.module = shader->getShaderModule();
+		vertexState.module = shader->getShaderModule(vertexLayout);
 		vertexState.entryPoint = "vs_main";
 		vertexState.constantCount = 0;
 		vertexState.constants = nullptr;
 
 		pipelineDesc.vertex = vertexState;
-		pipelineDesc.vertex.bufferCount = 1;
-		pipelineDesc.vertex.buffers = &vertexBufferLayout;
+		pipelineDesc.vertex.bufferCount = vertexBufferLayouts.size();
+		pipelineDesc.vertex.buffers = vertexBufferLayouts.data();
 
 		// Primitive assembly and rasterization
 		pipelineDesc.primitive.topology = primitiveTopology;
@@ -73,7 +129,7 @@ public:
 
 		// Fragment shader
 		FragmentState fragmentState;
-		fragmentState.module = shader->getShaderModule();
+		fragmentState.module = shader->getShaderModule(vertexLayout);
 		fragmentState.entryPoint = "fs_main";
 		fragmentState.constantCount = 0;
 		fragmentState.constants = nullptr;
@@ -125,14 +181,8 @@ public:
 		PipelineLayout layout = Context::getInstance().getDevice().CreatePipelineLayout(&layoutDesc);
 		pipelineDesc.layout = layout;
 
-		m_pipeline = Context::getInstance().getDevice().CreateRenderPipeline(&pipelineDesc);
-	};
-	~Pipeline() {
-	};
-
-	const RenderPipeline getRenderPipeline() const { return m_pipeline; }
-private:
-	RenderPipeline m_pipeline{ nullptr };
+		return Context::getInstance().getDevice().CreateRenderPipeline(&pipelineDesc);
+	}
 
 	BlendState getBlendState(BlendingMode blendingMode)
 	{
@@ -1,8 +1,13 @@
 #pragma once
 
 
+#include <algorithm>
+#include <tuple>
+
 #include "context.h"
 #include "scene.h"
+#include "meshletCuller.h"
+#include "impostor.h"
 
 
 class Renderer
@@ -42,22 +47,39 @@ public:
 
 	void draw()
 	{
+		m_stats = Stats();
+
 		CommandEncoderDescriptor commandEncoderDesc;
 		commandEncoderDesc.label = "Command Encoder";
 		CommandEncoder encoder = Context::getInstance().getDevice().CreateCommandEncoder(&commandEncoderDesc);
 
-		SurfaceTexture surfaceTexture;
-		Context::getInstance().getSurface().GetCurrentTexture(&surfaceTexture);
-
-		TextureView nextTexture = surfaceTexture.texture.CreateView();
-		if (!nextTexture) {
-			std::cerr << "Cannot acquire next swap chain texture" << std::endl;
+		//Headless (see Context::initGraphics): every pass has its color buffer
+		Surface surface = Context::getInstance().getSurface();
+		TextureView nextTexture = nullptr;
+		if (surface)
+		{
+			SurfaceTexture surfaceTexture;
+			surface.GetCurrentTexture(&surfaceTexture);
+			nextTexture = surfaceTexture.texture.CreateView();
+			if (!nextTexture) {
+				std::cerr << "Cannot acquire next swap chain texture" << std::endl;
+			}
 		}
 
 		int passIdx = 0;
 		auto view = m_scene->getRegistry().view<const Issam::WorldTransform, Issam::Filters, Issam::MeshRenderer>();
+		m_meshletCuller.beginFrame();
+		m_camera = findCamera();
+		if (m_camera)
+			m_impostorRenderer.beginFrame(m_camera->m_projection * m_camera->m_view, m_camera->m_pos, findLightDirection());
 		for (auto& pass : m_passes)
 		{
+			if (!pass->isEnabled()) continue;
+
+			//Compute work cannot be encoded inside a render pass
+			if (pass->getType() == Pass::Type::SCENE && pass->getMeshletCulling())
+				cullMeshlets(encoder, pass);
+
 			RenderPassDescriptor renderPassDesc;
 			renderPassDesc.label = ("pass_" + std::to_string(passIdx++)).c_str();
 
@@ -71,8 +93,11 @@ public:
 
 			if (pass->getType() == Pass::Type::SCENE)
 			{
-				const auto pipeline = pass->getPipeline()->getRenderPipeline();
-				renderPass.SetPipeline(pipeline);
+				//One pipeline variant per vertex layout, switched only when the layout changes
+				Pipeline* pipeline = pass->getPipeline();
+				uint64_t boundLayoutKey = VertexLayout::getStandard().getKey();
+				renderPass.SetPipeline(pipeline->getRenderPipeline(VertexLayout::getStandard()));
+				const std::vector<uint32_t>* vertexStreams = &pipeline->getVertexStreams(VertexLayout::getStandard());
 				Shader* shader = pass->getShader();
 				auto& layouts = shader->getBindGroupLayouts();
 
@@ -81,43 +106,125 @@ public:
 				size_t dynamicOffsetCountScene = m_scene->getAttibutedRuntime(attribSceneId)->getNumVersions() - 1;
 				renderPass.SetBindGroup(2, m_scene->getAttibutedRuntime(attribSceneId)->getBindGroup(layouts[static_cast<int>(Issam::Binding::Scene)]), 0, nullptr); //Scene uniforms
 
-				
+				//The geometry of all the meshes lives in a few shared buffers, only rebind when it changes
+				std::vector<Buffer> boundVertexBuffers(vertexStreams->size(), nullptr);
+				Buffer boundIndexBuffer = nullptr;
+
+				auto& attribMaterialId = shader->getAttributedId(Issam::Binding::Material);
+				const uint32_t passMaterialVersion = pass->getUniformBufferVersion(Issam::Binding::Material);
+				m_drawItems.clear();
 				for (auto entity : view) 
 				{
-					const Issam::Filters& filters = view.get<Issam::Filters>(entity);
-					bool shouldDraw = std::any_of(filters.filters.begin(), filters.filters.end(),
-						[&pass](const std::string& filter) {
-						return std::find(pass->getFilters().begin(), pass->getFilters().end(), filter) != pass->getFilters().end();
-					});
-					if (!shouldDraw) continue;
+					if (!acceptsFilters(pass, view.get<Issam::Filters>(entity))) continue;
 
 					const Issam::MeshRenderer& meshRenderer = view.get<Issam::MeshRenderer>(entity);
 					auto transform = view.get<Issam::WorldTransform>(entity);
 					Mesh* mesh = meshRenderer.mesh.get();
 					if (mesh)
 					{
-						Material* material = meshRenderer.material;
-
-						auto& attribMaterialId = shader->getAttributedId(Issam::Binding::Material);
-						uint32_t dynamicOffsetMaterial = pass->getUniformBufferVersion(Issam::Binding::Material) * sizeof(UniformsData);
-						size_t dynamicOffsetCountMaterial = material->getAttibutedRuntime(attribMaterialId)->getNumVersions() - 1;
-						renderPass.SetBindGroup(0, material->getAttibutedRuntime(attribMaterialId)->getBindGroup(layouts[static_cast<int>(Issam::Binding::Material)]), dynamicOffsetCountMaterial, &dynamicOffsetMaterial); //Material
-
-						auto& attribNodelId = shader->getAttributedId(Issam::Binding::Node);
-						uint32_t dynamicOffsetNode = pass->getUniformBufferVersion(Issam::Binding::Node) * sizeof(UniformsData);
-						size_t dynamicOffsetCountNode = transform.getAttibutedRuntime(attribNodelId)->getNumVersions() - 1;
-						renderPass.SetBindGroup(1, transform.getAttibutedRuntime(attribNodelId)->getBindGroup(layouts[static_cast<int>(Issam::Binding::Node)]), dynamicOffsetCountNode, &dynamicOffsetNode); //Node model
-						
-						renderPass.SetVertexBuffer(0, mesh->getVertexBuffer()->getBuffer(), 0, mesh->getVertexBuffer()->getSize());
-						if (mesh->getIndexBuffer() != nullptr)
+						//Gathered and drawn as instanced quads at the end of the pass
+						if (const Issam::Impostor* impostor = pass->getImpostors() ? drawnAsImpostor(entity, transform.getTransform()) : nullptr)
+						{
+							m_impostorRenderer.add(impostor->atlas, transform.getTransform());
+							continue;
+						}
+						uint32_t materialVersion = passMaterialVersion;
+						Issam::AttributedRuntime* materialRuntime = meshRenderer.material->getDrawRuntime(attribMaterialId, materialVersion);
+						m_drawItems.push_back({ entity, mesh->getVertexLayout().getKey(), materialRuntime, materialVersion });
+					}
+				}
+				//By pipeline then by material bind group, the materials sharing one (see MaterialPacker) are drawn together
+				if (m_drawSorting)
+				{
+					std::sort(m_drawItems.begin(), m_drawItems.end(), [](const DrawItem& a, const DrawItem& b) {
+						return std::tie(a.layoutKey, a.materialRuntime, a.materialVersion) < std::tie(b.layoutKey, b.materialRuntime, b.materialVersion);
+					});
+				}
+
+				Issam::AttributedRuntime* boundMaterialRuntime = nullptr;
+				uint32_t boundMaterialOffset = 0;
+				for (const DrawItem& item : m_drawItems)
+				{
+					const entt::entity entity = item.entity;
+					const Issam::MeshRenderer& meshRenderer = view.get<Issam::MeshRenderer>(entity);
+					auto transform = view.get<Issam::WorldTransform>(entity);
+					Mesh* mesh = meshRenderer.mesh.get();
+					const VertexLayout& vertexLayout = mesh->getVertexLayout();
+					if (vertexLayout.getKey() != boundLayoutKey)
+					{
+						boundLayoutKey = vertexLayout.getKey();
+						renderPass.SetPipeline(pipeline->getRenderPipeline(vertexLayout));
+						vertexStreams = &pipeline->getVertexStreams(vertexLayout);
+						boundVertexBuffers.assign(vertexStreams->size(), nullptr);
+						m_stats.pipelineChanges++;
+					}
+
+					//The shared material bind groups stay bound, only their offset changes from a material to the next
+					uint32_t dynamicOffsetMaterial = item.materialVersion * sizeof(UniformsData);
+					if (item.materialRuntime != boundMaterialRuntime || dynamicOffsetMaterial != boundMaterialOffset)
+					{
+						size_t dynamicOffsetCountMaterial = item.materialRuntime->hasDynamicOffset() ? 1 : 0;
+						renderPass.SetBindGroup(0, item.materialRuntime->getBindGroup(layouts[static_cast<int>(Issam::Binding::Material)]), dynamicOffsetCountMaterial, &dynamicOffsetMaterial); //Material
+						if (item.materialRuntime != boundMaterialRuntime)
+							m_stats.materialBindGroupChanges++;
+						boundMaterialRuntime = item.materialRuntime;
+						boundMaterialOffset = dynamicOffsetMaterial;
+					}
+
+					auto& attribNodelId = shader->getAttributedId(Issam::Binding::Node);
+					uint32_t dynamicOffsetNode = pass->getUniformBufferVersion(Issam::Binding::Node) * sizeof(UniformsData);
+					size_t dynamicOffsetCountNode = transform.getAttibutedRuntime(attribNodelId)->getNumVersions() - 1;
+					renderPass.SetBindGroup(1, transform.getAttibutedRuntime(attribNodelId)->getBindGroup(layouts[static_cast<int>(Issam::Binding::Node)]), dynamicOffsetCountNode, &dynamicOffsetNode); //Node model
+					
+					//Only the streams read by the pass are bound, slot i gets the stream (*vertexStreams)[i]
+					const GeometryRange* vertexRange = mesh->getVertexRange();
+					uint32_t fetchedVertexSize = 0;
+					for (uint32_t slot = 0; slot < vertexStreams->size(); ++slot)
+					{
+						const uint32_t stream = (*vertexStreams)[slot];
+						if (vertexRange->getBuffer(stream).Get() != boundVertexBuffers[slot].Get())
+						{
+							boundVertexBuffers[slot] = vertexRange->getBuffer(stream);
+							renderPass.SetVertexBuffer(slot, boundVertexBuffers[slot]);
+						}
+						fetchedVertexSize += vertexLayout.getStride(stream);
+					}
+					const GeometryRange* indexRange = mesh->getIndexRange();
+					//The meshlets are those of the full detail: a coarser LOD is drawn whole, the culling would draw too many triangles
+					const uint32_t lodIndex = indexRange != nullptr ? selectLod(entity, mesh, transform.getTransform()) : 0;
+					const MeshletCuller::Target* culled = pass->getMeshletCulling() && lodIndex == 0 ? m_meshletCuller.getTarget(entity) : nullptr;
+					if (culled != nullptr)
+					{
+						//Compacted indices of the visible meshlets, the count is only known by the GPU
+						boundIndexBuffer = culled->indices;
+						renderPass.SetIndexBuffer(boundIndexBuffer, IndexFormat::Uint32);
+						renderPass.DrawIndexedIndirect(culled->drawArgs, 0);
+						m_stats.triangles += mesh->getLods()[0].indexCount / 3;
+					}
+					else if (indexRange != nullptr)
+					{
+						if (indexRange->getBuffer().Get() != boundIndexBuffer.Get())
 						{
-							renderPass.SetIndexBuffer(mesh->getIndexBuffer()->getBuffer(), IndexFormat::Uint16, 0, mesh->getIndexBuffer()->getSize());
-							renderPass.DrawIndexed(mesh->getIndexBuffer()->getCount(), 1, 0, 0, 0);
+							boundIndexBuffer = indexRange->getBuffer();
+							renderPass.SetIndexBuffer(boundIndexBuffer, mesh->getIndexFormat()); //One index arena per format
 						}
-						else
-							renderPass.Draw(mesh->getVertexCount(), 1, 0, 0);
+						//The LODs are consecutive index lists in the range of the mesh
+						const Mesh::Lod& lod = mesh->getLods()[lodIndex];
+						renderPass.DrawIndexed(lod.indexCount, 1, indexRange->offset + lod.firstIndex, vertexRange->offset, 0);
+						m_stats.triangles += lod.indexCount / 3;
 					}
+					else
+					{
+						renderPass.Draw(mesh->getVertexCount(), 1, vertexRange->offset, 0);
+						m_stats.triangles += mesh->getVertexCount() / 3;
+					}
+
+					m_stats.drawCalls++;
+					m_stats.vertexCount += vertexRange->count;
+					m_stats.vertexBytes += static_cast<size_t>(vertexRange->count) * fetchedVertexSize;
 				}
+				if (pass->getImpostors())
+					m_impostorRenderer.draw(renderPass, pipeline->getColorFormat(), pipeline->getDepthFormat());
 			}
 			else if (pass->getType() == Pass::Type::FILTER)
 			{
@@ -129,8 +236,8 @@ public:
 				renderPass.SetBindGroup(0, m_scene->getAttibutedRuntime(attribSceneId)->getBindGroup(layouts[0]), 0, nullptr); //TODO layouts[0] ?
 				if (fullScreenMesh)
 				{
-					renderPass.SetVertexBuffer(0, fullScreenMesh->getVertexBuffer()->getBuffer(), 0, fullScreenMesh->getVertexBuffer()->getSize());
-					renderPass.Draw(fullScreenMesh->getVertexCount(), 1, 0, 0);
+					renderPass.SetVertexBuffer(0, fullScreenMesh->getVertexRange()->getBuffer());
+					renderPass.Draw(fullScreenMesh->getVertexCount(), 1, fullScreenMesh->getVertexRange()->offset, 0);
 				}
 			}
 			else
@@ -143,6 +250,9 @@ public:
 			//renderPass.popDebugGroup();
 
 			renderPass.End();
+
+			if (pass->getType() == Pass::Type::SCENE && pass->getMeshletCulling())
+				m_meshletCuller.buildHiZ(encoder);
 		}
 		Context::getInstance().getDevice().Tick();
 
@@ -154,9 +264,39 @@ public:
 		commands.push_back(command);
 		m_queue.Submit(commands.size(), commands.data());
 
-		Context::getInstance().getSurface().Present();
+		if (surface)
+			surface.Present();
+
+		m_lodStates.swap(m_nextLodStates);
+		m_nextLodStates.clear();
+		m_stats.impostors = m_camera ? m_impostorRenderer.getInstanceCount() : 0;
 	};
 
+	//Counters of the last frame, the vertex bytes assume each vertex is fetched once
+	struct Stats {
+		size_t drawCalls = 0;
+		size_t pipelineChanges = 0;
+		size_t vertexCount = 0;
+		size_t vertexBytes = 0;
+		size_t triangles = 0; //Before the meshlet culling, the triangles it keeps are only known by the GPU
+		size_t impostors = 0;
+		size_t materialBindGroupChanges = 0; //Another bind group, not counting the offset changes in a shared one
+	};
+	const Stats& getStats() const { return m_stats; }
+
+	MeshletCuller& getMeshletCuller() { return m_meshletCuller; }
+
+	//The LOD selection needs the height of the viewport to project the errors
+	void setViewportSize(uint32_t width, uint32_t height) { m_viewportWidth = width; m_viewportHeight = height; }
+	//Largest error on screen in pixels, 0 always draws the LOD 0
+	void setLodPixelError(float pixelError) { m_lodPixelError = pixelError; }
+	//Relative margin around the threshold before switching back, against popping
+	void setLodHysteresis(float hysteresis) { m_lodHysteresis = hysteresis; }
+	//Entities with an impostor are drawn as a quad below this size on screen in pixels, 0 never
+	void setImpostorPixelSize(float pixelSize) { m_impostorPixelSize = pixelSize; }
+	//Draws sorted by pipeline and material bind group, in the order of the registry otherwise
+	void setDrawSorting(bool drawSorting) { m_drawSorting = drawSorting; }
+
 	void addPass(Pass* pass)
 	{
 		m_passes.push_back(pass);
@@ -169,10 +309,112 @@ public:
 	//void setCamera(Issam::Camera* camera) { m_scene->camera = camera; }
 	//Issam::Camera* getCamera() { return m_scene->camera; }
 private:
-	
+	static bool acceptsFilters(Pass* pass, const Issam::Filters& filters)
+	{
+		return std::any_of(filters.filters.begin(), filters.filters.end(),
+			[&pass](const std::string& filter) {
+			return std::find(pass->getFilters().begin(), pass->getFilters().end(), filter) != pass->getFilters().end();
+		});
+	}
+
+	const Issam::Camera* findCamera()
+	{
+		auto cameras = m_scene->getRegistry().view<const Issam::Camera>();
+		if (cameras.begin() == cameras.end()) return nullptr;
+		return &cameras.get<const Issam::Camera>(*cameras.begin());
+	}
+
+	glm::vec3 findLightDirection()
+	{
+		auto lights = m_scene->getRegistry().view<const Issam::Light>();
+		if (lights.begin() == lights.end()) return glm::vec3(0.0, 1.0, 0.0);
+		return glm::normalize(lights.get<const Issam::Light>(*lights.begin()).m_direction);
+	}
+
+	//The impostor of the entity when its bounding sphere covers less than the pixel threshold, nullptr otherwise
+	const Issam::Impostor* drawnAsImpostor(entt::entity entity, const glm::mat4& model)
+	{
+		if (m_impostorPixelSize <= 0.0f || m_viewportHeight == 0 || !m_camera) return nullptr;
+		const Issam::Impostor* impostor = m_scene->getRegistry().try_get<Issam::Impostor>(entity);
+		if (!impostor || !impostor->atlas) return nullptr;
+
+		const float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		const glm::vec3 center = glm::vec3(model * glm::vec4(impostor->atlas->center, 1.0f));
+		const float radius = impostor->atlas->radius * scale;
+		const float distance = glm::length(center - m_camera->m_pos);
+		if (distance <= radius) return nullptr;
+		const float pixelSize = 2.0f * radius * m_camera->m_projection[1][1] * m_viewportHeight * 0.5f / distance;
+		return pixelSize < m_impostorPixelSize ? impostor : nullptr;
+	}
+
+	//Coarsest LOD whose error, projected on the screen, stays under the pixel threshold.
+	//The LOD of the previous frame is kept while its error is within the hysteresis margin.
+	uint32_t selectLod(entt::entity entity, Mesh* mesh, const glm::mat4& model)
+	{
+		const std::vector<Mesh::Lod>& lods = mesh->getLods();
+		if (lods.size() <= 1 || m_lodPixelError <= 0.0f || m_viewportHeight == 0 || !m_camera) return 0;
+
+		auto boundingBox = mesh->getBoundingBox();
+		const float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		const glm::vec3 center = glm::vec3(model * glm::vec4((boundingBox.first + boundingBox.second) * 0.5f, 1.0f));
+		const float radius = glm::length(boundingBox.second - boundingBox.first) * 0.5f * scale;
+		const float distance = std::max(glm::length(center - m_camera->m_pos) - radius, 1e-3f);
+		//Pixels covered by one object space unit at this distance
+		const float pixelsPerUnit = scale * m_camera->m_projection[1][1] * m_viewportHeight * 0.5f / distance;
+
+		auto it = m_lodStates.find(entity);
+		uint32_t lod = it != m_lodStates.end() ? std::min<uint32_t>(it->second, static_cast<uint32_t>(lods.size()) - 1) : 0;
+		while (lod > 0 && lods[lod].error * pixelsPerUnit > m_lodPixelError * (1.0f + m_lodHysteresis))
+			lod--;
+		while (lod + 1 < lods.size() && lods[lod + 1].error * pixelsPerUnit <= m_lodPixelError * (1.0f - m_lodHysteresis))
+			lod++;
+		m_nextLodStates[entity] = lod;
+		return lod;
+	}
+
+	void cullMeshlets(CommandEncoder& encoder, Pass* pass)
+	{
+		if (!m_camera) return;
+		const Issam::Camera& camera = *m_camera;
+
+		std::vector<MeshletCuller::Item> items;
+		auto view = m_scene->getRegistry().view<const Issam::WorldTransform, Issam::Filters, Issam::MeshRenderer>();
+		for (auto entity : view)
+		{
+			if (!acceptsFilters(pass, view.get<Issam::Filters>(entity))) continue;
+			const Issam::MeshRenderer& meshRenderer = view.get<Issam::MeshRenderer>(entity);
+			if (!meshRenderer.mesh || !meshRenderer.mesh->hasMeshlets()) continue;
+			if (pass->getImpostors() && drawnAsImpostor(entity, view.get<const Issam::WorldTransform>(entity).getTransform())) continue;
+			items.push_back({ entity, meshRenderer.mesh, view.get<const Issam::WorldTransform>(entity).getTransform() });
+		}
+		m_meshletCuller.cull(encoder, items, camera.m_projection * camera.m_view, camera.m_pos);
+	}
+
 	Queue m_queue{ nullptr };
 	std::vector<Pass*> m_passes;
 	Issam::Scene* m_scene;
 
 	Mesh* fullScreenMesh{ nullptr };
+	MeshletCuller m_meshletCuller;
+	ImpostorRenderer m_impostorRenderer;
+	Stats m_stats;
+
+	//A mesh drawn by the current scene pass
+	struct DrawItem {
+		entt::entity entity;
+		uint64_t layoutKey;
+		Issam::AttributedRuntime* materialRuntime;
+		uint32_t materialVersion;
+	};
+	std::vector<DrawItem> m_drawItems; //Kept between the passes for its capacity
+	bool m_drawSorting = true;
+
+	const Issam::Camera* m_camera{ nullptr };
+	uint32_t m_viewportWidth = 0;
+	uint32_t m_viewportHeight = 0;
+	float m_lodPixelError = 1.0f;
+	float m_lodHysteresis = 0.2f;
+	float m_impostorPixelSize = 0.0f;
+	std::unordered_map<entt::entity, uint32_t> m_lodStates;     //LOD drawn last frame
+	std::unordered_map<entt::entity, uint32_t> m_nextLodStates;
 };
\ No newline at end of file
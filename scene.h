@@ -12,9 +12,12 @@
 #include "shader.h"
 #include "material.h"
 #include "attributed.h"
+#include "mesh.h"
 
 #include <entt/entt.hpp>
 
+class ImpostorAtlas;
+
 using namespace glm;
 
 namespace Issam {
@@ -51,7 +54,13 @@ namespace Issam {
 		~WorldTransform() { /*delete m_attributes;*/ };
 		void setTransform(glm::mat4 transform) { 
 			m_matrix = transform;
-			setAttribute("model", m_matrix);
+			setAttribute("model", m_matrix * m_meshTransform);
+		}
+
+		//Applied to the vertices before the world transform (dequantization of the mesh positions)
+		void setMeshTransform(glm::mat4 meshTransform) {
+			m_meshTransform = meshTransform;
+			setAttribute("model", m_matrix * m_meshTransform);
 		}
 
 		void setAttribute(const std::string& name, const Issam::AttributeValue& value)
@@ -71,6 +80,7 @@ namespace Issam {
 		//BindGroup getBindGroup(BindGroupLayout bindGroupLayout) { return m_attributes->getBindGroup(bindGroupLayout); }
 	private:
 		glm::mat4 m_matrix = glm::mat4(1.0);
+		glm::mat4 m_meshTransform = glm::mat4(1.0);
 		std::unordered_map<std::string, Issam::AttributedRuntime*> m_attributeds{};
 	};
 
@@ -101,6 +111,25 @@ namespace Issam {
 		}
 	};
 
+	//Tag for entities whose transform never changes, they can be merged by the StaticBatcher
+	struct Static {};
+
+	//Added on a source entity once its mesh has been merged into a static batch
+	struct Batched {
+		entt::entity batch = entt::null;
+	};
+
+	struct BatchedRange {
+		entt::entity entity = entt::null;
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+	};
+
+	//Index ranges of the source entities in the merged mesh of a batch, the picking tests the sources themselves
+	struct StaticBatch {
+		std::vector<BatchedRange> ranges;
+	};
+
 	struct Hierarchy {
 		entt::entity parent = entt::null;
 		std::vector<entt::entity> children;
@@ -116,6 +145,11 @@ namespace Issam {
 		glm::vec3 m_direction = glm::vec3(0.0);
 	};
 
+	//Baked views of the mesh, drawn instead of it when it covers only a few pixels (see ImpostorRenderer)
+	struct Impostor {
+		std::shared_ptr<ImpostorAtlas> atlas;
+	};
+
 	
 
 	class Scene 
@@ -138,6 +172,9 @@ namespace Issam {
 
 			m_registry.on_update<Camera>().connect<&Scene::onCameraModified>(*this);
 			m_registry.on_update<Light>().connect<&Scene::onLightModified>(*this);
+
+			m_registry.on_construct<MeshRenderer>().connect<&Scene::onMeshRendererModified>(*this);
+			m_registry.on_update<MeshRenderer>().connect<&Scene::onMeshRendererModified>(*this);
 		}
 
 		void setAttribute(const std::string& name, const  Issam::AttributeValue& value)
@@ -187,6 +224,11 @@ namespace Issam {
 			return m_registry.all_of<T>(entity);
 		}
 
+		template<typename T>
+		void removeComponent(entt::entity entity) {
+			m_registry.remove<T>(entity);
+		}
+
 		template<typename T> //To call on_update !
 		T& update(entt::entity entity) {
 			return m_registry.patch<T>(entity);
@@ -294,6 +336,12 @@ namespace Issam {
 			setAttribute("lightDirection", vec4(light.m_direction, 0.0));
 		}
 
+		void onMeshRendererModified(entt::registry& registry, entt::entity entity) {
+			const auto& meshRenderer = registry.get<MeshRenderer>(entity);
+			auto& worldTransform = m_registry.get_or_emplace<WorldTransform>(entity);
+			worldTransform.setMeshTransform(meshRenderer.mesh ? meshRenderer.mesh->getDequantization() : glm::mat4(1.0));
+		}
+
 		void calculateWorldTransforms(entt::entity entity, const glm::mat4& parentTransform = glm::mat4(1.0f)) {
 			auto& localTransform = getComponent<LocalTransform>(entity);
 			auto& globalTransform = m_registry.get_or_emplace<WorldTransform>(entity);
@@ -11,6 +11,7 @@
 #include "uniformsBuffer.h"
 #include "scene.h"
 #include "material.h"
+#include "vertexLayout.h"
 
 
 using namespace wgpu;
@@ -36,7 +37,7 @@ public:
 	void setUserCode(std::string userCode)
 	{
 		m_shaderSource = userCode;
-		m_dirtyShaderModule = true;
+		m_shaderModules.clear();
 	}
 
 
@@ -47,25 +48,34 @@ public:
 		VertexFormat format;
 	};
 
-	void addVertexInput(const std::string& inputName, int location, VertexFormat format)
+	//The format and location come from the VertexLayout of the mesh, use decodeVertex(in) in the vertex shader
+	void addVertexInput(const std::string& inputName, VertexSemantic semantic)
 	{
-		m_vertexInputs.push_back({ inputName , location,format });
-		m_dirtyBindGroupLayouts = true;
-		m_dirtyShaderModule = true;
+		m_vertexInputs.push_back({ inputName , semantic });
+		m_shaderModules.clear();
+	}
+
+	bool hasVertexInput(VertexSemantic semantic) const
+	{
+		return std::any_of(m_vertexInputs.begin(), m_vertexInputs.end(), [semantic](const VertexInputAttr& input) {
+			return input.semantic == semantic;
+		});
 	}
 
 	void addVertexOutput(const std::string& inputName, int location, VertexFormat format)
 	{
 		m_vertexOutputs.push_back({ inputName , location,format });
 		m_dirtyBindGroupLayouts = true;
-		m_dirtyShaderModule = true;
+		m_shaderModules.clear();
 	}
 
 	
 
-	ShaderModule getShaderModule() {
-		if (!m_dirtyShaderModule)
-			return m_shaderModule;
+	//One module per vertex layout, only the vertex inputs and their decoding differ
+	ShaderModule getShaderModule(const VertexLayout& layout = VertexLayout::getStandard()) {
+		auto it = m_shaderModules.find(layout.getKey());
+		if (it != m_shaderModules.end())
+			return it->second;
 
 		//ShaderModule
 		ShaderModuleDescriptor shaderDesc;
@@ -82,16 +92,11 @@ public:
 		// Connect the chain
 		shaderDesc.nextInChain = &shaderCodeDesc;
 
-		std::string vertexInputOutputStr = "struct VertexInput {\n";
-		for (const auto vertexInput : m_vertexInputs)
-		{
-			vertexInputOutputStr += "    @location(" + std::to_string(vertexInput.location) + ") " + vertexInput.name + ": " + toString(vertexInput.format) + ", \n";
-		}
-		vertexInputOutputStr += "}; \n \n";
+		std::string vertexInputOutputStr = getVertexInputStr(layout);
 
 		vertexInputOutputStr += "struct VertexOutput {\n";
 		vertexInputOutputStr += "    @builtin(position) position: vec4f, \n";
-		for (const auto vertexInput : m_vertexOutputs)
+		for (const auto& vertexInput : m_vertexOutputs)
 		{
 			vertexInputOutputStr += "    @location(" + std::to_string(vertexInput.location) + ") " + vertexInput.name + ": " + toString(vertexInput.format) + ", \n";
 		}
@@ -103,13 +108,13 @@ public:
 		addVertexUniformsStr(vertexUniformsStr, group, Issam::Binding::Node);
 		addVertexUniformsStr(vertexUniformsStr, group, Issam::Binding::Scene);
 
-		m_shaderSource = vertexInputOutputStr + vertexUniformsStr + m_shaderSource;
+		std::string shaderSource = vertexInputOutputStr + vertexUniformsStr + m_shaderSource;
 
 		// Setup the actual payload of the shader code descriptor
-		shaderCodeDesc.code = m_shaderSource.c_str();
-		//std::cout << m_shaderSource << std::endl;
+		shaderCodeDesc.code = shaderSource.c_str();
+		//std::cout << shaderSource << std::endl;
 
-		m_shaderModule = Context::getInstance().getDevice().CreateShaderModule(&shaderDesc);
+		ShaderModule shaderModule = Context::getInstance().getDevice().CreateShaderModule(&shaderDesc);
 		
 		auto callback = [](WGPUCompilationInfoRequestStatus status, struct WGPUCompilationInfo const* compilationInfo, void* userdata) {
 			if (status == WGPUCompilationInfoRequestStatus::WGPUCompilationInfoRequestStatus_Success) {
@@ -124,10 +129,10 @@ public:
 				std::cerr << "Failed to get shader compilation info " << std::endl;
 			}
 		};
-		m_shaderModule.GetCompilationInfo(callback, nullptr);
-		assert(m_shaderModule);
-		m_dirtyShaderModule = false;
-		return m_shaderModule;
+		shaderModule.GetCompilationInfo(callback, nullptr);
+		assert(shaderModule);
+		m_shaderModules[layout.getKey()] = shaderModule;
+		return shaderModule;
 	}
 
 	const std::vector<BindGroupLayout>& getBindGroupLayouts() {
@@ -145,7 +150,7 @@ public:
 
 	
 
-	void addTexture(const std::string& name, TextureView defaultTextureView, Issam::Binding binding) { m_textures.push_back({ name, defaultTextureView, binding }); }
+	void addTexture(const std::string& name, TextureView defaultTextureView, Issam::Binding binding, TextureViewDimension dimension = TextureViewDimension::e2D) { m_textures.push_back({ name, defaultTextureView, binding, dimension }); }
 	void addSampler(const std::string& name, Sampler defaultSampler, Issam::Binding binding) { m_samplers.push_back({ name, defaultSampler, binding }); }
 	void addUniform(std::string name, const UniformValue& defaultValue, Issam::Binding binding) {
 		Uniform uniform;
@@ -199,7 +204,7 @@ public:
 			}
 			else if (std::holds_alternative<TextureView>(attrib.value))
 			{
-				m_textures.push_back({ attrib.name, std::get<TextureView>(attrib.value), binding });
+				m_textures.push_back({ attrib.name, std::get<TextureView>(attrib.value), binding, attrib.dimension });
 			}
 			else if (std::holds_alternative<Sampler>(attrib.value))
 				m_samplers.push_back({ attrib.name, std::get<Sampler>(attrib.value), binding });
@@ -212,7 +217,7 @@ public:
 private:
 //	Material* m_material = nullptr;
 	std::vector<std::pair<Uniform, Issam::Binding>> m_uniforms{};
-	std::vector<std::tuple<std::string, TextureView, Issam::Binding> > m_textures{};
+	std::vector<std::tuple<std::string, TextureView, Issam::Binding, TextureViewDimension> > m_textures{};
 	std::vector<std::tuple<std::string, Sampler, Issam::Binding>> m_samplers{};
 	std::vector<BindGroupLayout> m_bindGroupLayouts{};
 	bool m_dirtyBindGroupLayouts = true;
@@ -229,11 +234,11 @@ private:
 		return result;
 	}
 
-	std::vector<std::pair<std::string, TextureView>> getTexturesByBinding(Issam::Binding binding) {
-		std::vector<std::pair<std::string, TextureView>> result;
-		for (const auto& [name, view , bind] : m_textures) {
+	std::vector<std::pair<std::string, TextureViewDimension>> getTexturesByBinding(Issam::Binding binding) {
+		std::vector<std::pair<std::string, TextureViewDimension>> result;
+		for (const auto& [name, view , bind, dimension] : m_textures) {
 			if (bind == binding) {
-				result.push_back({ name, view });
+				result.push_back({ name, dimension });
 			}
 		}
 		return result;
@@ -253,9 +258,16 @@ private:
 	{
 		switch (format)
 		{
-		case VertexFormat::Float32x2: return "vec2f";
+		case VertexFormat::Float32:   return "f32";
+		case VertexFormat::Float32x2: 
+		case VertexFormat::Unorm16x2:
+		case VertexFormat::Snorm16x2:
+		case VertexFormat::Float16x2: return "vec2f";
 		case VertexFormat::Float32x3: return "vec3f";
-		case VertexFormat::Float32x4: return "vec4f";
+		case VertexFormat::Float32x4: 
+		case VertexFormat::Unorm16x4:
+		case VertexFormat::Snorm16x4:
+		case VertexFormat::Float16x4: return "vec4f";
 		default:
 			assert(false);
 			return "UNKNOWN";
@@ -263,6 +275,19 @@ private:
 		}
 	}
 
+	std::string toString(TextureViewDimension dimension)
+	{
+		switch (dimension)
+		{
+		case TextureViewDimension::e2D:      return "texture_2d<f32>";
+		case TextureViewDimension::Cube:     return "texture_cube<f32>";
+		case TextureViewDimension::e2DArray: return "texture_2d_array<f32>";
+		default:
+			assert(false);
+			return "UNKNOWN";
+		}
+	}
+
 	std::string toString(Issam::Binding binding)
 	{
 		switch (binding)
@@ -305,7 +330,7 @@ private:
 			usedGroupe = true;
 			for (const auto& texture : materialTextures)
 			{
-				vertexUniformsStr += "@group(" + std::to_string(group) + ") @binding(" + std::to_string(bindingIdx++) + ") var " + std::get<0>(texture) + " : texture_2d<f32>;\n";
+				vertexUniformsStr += "@group(" + std::to_string(group) + ") @binding(" + std::to_string(bindingIdx++) + ") var " + texture.first + " : " + toString(texture.second) + ";\n";
 			}
 		}
 
@@ -313,7 +338,7 @@ private:
 		if (!materialSamplers.empty())
 		{
 			usedGroupe = true;
-			for (const auto& sampler : m_samplers)
+			for (const auto& sampler : materialSamplers)
 			{
 				vertexUniformsStr += "@group(" + std::to_string(group) + ") @binding(" + std::to_string(bindingIdx++) + ") var " + std::get<0>(sampler) + " : sampler;\n";
 			}
@@ -340,7 +365,7 @@ private:
 			uniformsBindingLayout.visibility = ShaderStage::Vertex | ShaderStage::Fragment;
 			uniformsBindingLayout.buffer.type = BufferBindingType::Uniform;
 			uniformsBindingLayout.buffer.minBindingSize = sizeof(UniformsData);
-			uniformsBindingLayout.buffer.hasDynamicOffset = attributesGroup.getVersionCount() > 1 ? true : false;
+			uniformsBindingLayout.buffer.hasDynamicOffset = attributesGroup.hasDynamicOffset();
 			bindingLayoutEntries.push_back(uniformsBindingLayout);
 		}
 
@@ -355,7 +380,7 @@ private:
 				textureBindingLayout.binding = bindingIdx++;
 				textureBindingLayout.visibility = ShaderStage::Fragment;
 				textureBindingLayout.texture.sampleType = TextureSampleType::Float;
-				textureBindingLayout.texture.viewDimension = TextureViewDimension::e2D;
+				textureBindingLayout.texture.viewDimension = texture.second;
 				bindingLayoutEntries.push_back(textureBindingLayout);
 			}
 		}
@@ -364,7 +389,7 @@ private:
 		if (!materialSamplers.empty())
 		{
 			usedGroupe = true;
-			for (const auto& sampler : m_samplers)
+			for (size_t i = 0; i < materialSamplers.size(); ++i)
 			{
 				// The texture sampler binding
 				BindGroupLayoutEntry samplerBindingLayout;
@@ -385,10 +410,67 @@ private:
 		}
 	}
 
-	std::vector<VertexAttr> m_vertexInputs{};
+	struct VertexInputAttr
+	{
+		std::string name;
+		VertexSemantic semantic;
+	};
+
+	//Raw inputs as fetched from the vertex buffer, then decoded in a layout independent struct
+	std::string getVertexInputStr(const VertexLayout& layout)
+	{
+		bool octahedral = false;
+		std::string inputStr = "struct VertexInput {\n";
+		std::string attributesStr = "struct VertexAttributes {\n";
+		std::string decodeStr = "fn decodeVertex(in: VertexInput) -> VertexAttributes {\n    var out: VertexAttributes;\n";
+		for (const auto& vertexInput : m_vertexInputs)
+		{
+			std::string type = vertexInput.semantic == VertexSemantic::TexCoord ? "vec2f" : "vec3f";
+			attributesStr += "    " + vertexInput.name + ": " + type + ", \n";
+
+			const VertexLayout::Attribute* attribute = layout.getAttribute(vertexInput.semantic);
+			if (!attribute)
+			{
+				decodeStr += "    out." + vertexInput.name + " = " + type + "(0.0);\n";
+				continue;
+			}
+			std::string location = std::to_string(VertexLayout::getShaderLocation(vertexInput.semantic));
+			inputStr += "    @location(" + location + ") " + vertexInput.name + ": " + toString(attribute->format) + ", \n";
+
+			bool isDirection = vertexInput.semantic == VertexSemantic::Normal || vertexInput.semantic == VertexSemantic::Tangent;
+			std::string value = "in." + vertexInput.name;
+			if (isDirection && attribute->format == VertexFormat::Snorm16x2)
+			{
+				octahedral = true;
+				value = "octDecode(" + value + ")";
+			}
+			else if (toString(attribute->format) != type)
+			{
+				value += type == "vec2f" ? ".xy" : ".xyz";
+			}
+			//Quantized positions stay in [0, 1], the dequantization is part of the model matrix
+			decodeStr += "    out." + vertexInput.name + " = " + value + ";\n";
+		}
+		inputStr += "}; \n \n";
+		attributesStr += "}; \n \n";
+		decodeStr += "    return out;\n}\n \n";
+
+		std::string octDecodeStr = "";
+		if (octahedral)
+		{
+			octDecodeStr += "fn octDecode(e: vec2f) -> vec3f {\n";
+			octDecodeStr += "    var n = vec3f(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));\n";
+			octDecodeStr += "    let t = max(-n.z, 0.0);\n";
+			octDecodeStr += "    n.x += select(t, -t, n.x >= 0.0);\n";
+			octDecodeStr += "    n.y += select(t, -t, n.y >= 0.0);\n";
+			octDecodeStr += "    return normalize(n);\n}\n \n";
+		}
+		return inputStr + attributesStr + octDecodeStr + decodeStr;
+	}
+
+	std::vector<VertexInputAttr> m_vertexInputs{};
 	std::vector<VertexAttr> m_vertexOutputs{};
-	ShaderModule m_shaderModule{ nullptr };
-	bool m_dirtyShaderModule = true;
+	std::unordered_map<uint64_t, ShaderModule> m_shaderModules{};
 
 //	UniformsBuffer m_uniformsBuffer[3]{};
 	BindGroup sceneBindGroup{ nullptr };
@@ -0,0 +1,142 @@
+#include "staticBatcher.h"
+
+#include <map>
+
+std::vector<entt::entity> StaticBatcher::build(entt::entity root)
+{
+	std::vector<entt::entity> batches;
+	glm::mat4 rootInverse = glm::inverse(m_scene->getComponent<Issam::WorldTransform>(root).getTransform());
+
+	//Group the sources by material and filters, a batch is drawn by the same passes as its sources
+	std::map<std::pair<Material*, std::vector<std::string>>, std::vector<Source>> groups;
+	auto view = m_scene->getRegistry().view<const Issam::Static, const Issam::WorldTransform, const Issam::Filters, const Issam::MeshRenderer>();
+	for (auto entity : view)
+	{
+		if (m_scene->hasComponent<Issam::Batched>(entity)) continue;
+		if (!isDescendant(entity, root)) continue;
+
+		const Issam::MeshRenderer& meshRenderer = view.get<const Issam::MeshRenderer>(entity);
+		Mesh* mesh = meshRenderer.mesh.get();
+		if (!mesh || !meshRenderer.material) continue;
+		//Already a big draw call, nothing to gain
+		if (static_cast<uint32_t>(mesh->getVertexCount()) > m_maxVertices) continue;
+
+		glm::mat4 transform = rootInverse * view.get<const Issam::WorldTransform>(entity).getTransform();
+		const Issam::Filters& filters = view.get<const Issam::Filters>(entity);
+		groups[{ meshRenderer.material, filters.filters }].push_back({ entity, mesh, transform });
+	}
+
+	for (auto& [key, sources] : groups)
+	{
+		//A single mesh is already one draw call
+		if (sources.size() < 2) continue;
+
+		std::vector<Source> batchSources;
+		uint32_t vertexCount = 0;
+		for (const auto& source : sources)
+		{
+			if (vertexCount + static_cast<uint32_t>(source.mesh->getVertexCount()) > m_maxVertices)
+			{
+				//A source left alone stays drawn by its own entity
+				if (batchSources.size() > 1)
+					batches.push_back(createBatch(root, key.first, key.second, batchSources));
+				batchSources.clear();
+				vertexCount = 0;
+			}
+			batchSources.push_back(source);
+			vertexCount += source.mesh->getVertexCount();
+		}
+		if (batchSources.size() > 1)
+			batches.push_back(createBatch(root, key.first, key.second, batchSources));
+	}
+	return batches;
+}
+
+entt::entity StaticBatcher::createBatch(entt::entity root, Material* material, const std::vector<std::string>& filters, const std::vector<Source>& sources)
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	Issam::StaticBatch staticBatch;
+
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	for (const auto& source : sources)
+	{
+		vertexCount += source.mesh->getVertices().size();
+		indexCount += source.mesh->getIndices().empty() ? source.mesh->getVertices().size() : source.mesh->getIndices().size();
+	}
+	vertices.reserve(vertexCount);
+	indices.reserve(indexCount);
+
+	entt::entity batchEntity = m_scene->addEntity();
+	for (const auto& source : sources)
+	{
+		const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(source.transform)));
+		const glm::mat3 tangentMatrix = glm::mat3(source.transform);
+		const uint32_t baseVertex = static_cast<uint32_t>(vertices.size());
+
+		for (Vertex vertex : source.mesh->getVertices())
+		{
+			vertex.position = glm::vec3(source.transform * glm::vec4(vertex.position, 1.0));
+			if (vertex.normal != glm::vec3(0.0))
+				vertex.normal = glm::normalize(normalMatrix * vertex.normal);
+			if (vertex.tangent != glm::vec3(0.0))
+				vertex.tangent = glm::normalize(tangentMatrix * vertex.tangent);
+			vertices.push_back(vertex);
+		}
+
+		Issam::BatchedRange range;
+		range.entity = source.entity;
+		range.firstIndex = static_cast<uint32_t>(indices.size());
+		if (source.mesh->getIndices().empty())
+		{
+			for (int i = 0; i < source.mesh->getVertexCount(); ++i)
+				indices.push_back(baseVertex + static_cast<uint32_t>(i));
+		}
+		else
+		{
+			for (uint32_t index : source.mesh->getIndices())
+				indices.push_back(baseVertex + index);
+		}
+		range.indexCount = static_cast<uint32_t>(indices.size()) - range.firstIndex;
+		staticBatch.ranges.push_back(range);
+
+		//The source stays in the scene for picking but is not drawn by the batched passes anymore
+		auto& sourceFilters = m_scene->getComponent<Issam::Filters>(source.entity);
+		for (const auto& filter : filters)
+			sourceFilters.remove(filter);
+		m_scene->addComponent<Issam::Batched>(source.entity, Issam::Batched({ batchEntity }));
+	}
+
+	MeshPtr mesh = std::make_shared<Mesh>();
+	//The batch is re-encoded from the float vertices, keep the quantization and the streams of the sources
+	const VertexLayout& sourceLayout = sources.front().mesh->getVertexLayout();
+	mesh->setVertices(vertices, VertexLayout::select(vertices, sourceLayout.hasQuantizedPositions(), sourceLayout.getStreamCount() > 1));
+	mesh->setIndices(indices);
+
+	Issam::MeshRenderer meshRenderer;
+	meshRenderer.mesh = mesh;
+	meshRenderer.material = material;
+
+	Issam::Filters batchFilters;
+	batchFilters.filters = filters;
+
+	m_scene->addComponent<Issam::Name>(batchEntity, Issam::Name({ "staticBatch_" + std::to_string(static_cast<uint32_t>(batchEntity)) }));
+	m_scene->addComponent<Issam::Filters>(batchEntity, batchFilters);
+	m_scene->addComponent<Issam::MeshRenderer>(batchEntity, meshRenderer);
+	m_scene->addComponent<Issam::StaticBatch>(batchEntity, staticBatch);
+	m_scene->addChild(root, batchEntity);
+
+	return batchEntity;
+}
+
+bool StaticBatcher::isDescendant(entt::entity entity, entt::entity root)
+{
+	while (entity != entt::null)
+	{
+		if (entity == root) return true;
+		if (!m_scene->hasComponent<Issam::Hierarchy>(entity)) return false;
+		entity = m_scene->getComponent<Issam::Hierarchy>(entity).parent;
+	}
+	return false;
+}
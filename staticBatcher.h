@@ -0,0 +1,35 @@
+#pragma once
+
+#include <entt/entt.hpp>
+
+#include "scene.h"
+
+// Merges the meshes of static entities sharing a material into a few large meshes.
+// World transforms are baked into the vertices, the source entities are kept (picking, highlight)
+// but lose their filters so that only the batch is drawn by the scene passes.
+class StaticBatcher
+{
+public:
+	StaticBatcher() = delete;
+	StaticBatcher(Issam::Scene* scene) : m_scene(scene) {};
+	~StaticBatcher() = default;
+
+	//The default keeps the batches in the 16 bits index format, larger batches switch to 32 bits indices
+	void setMaxVertices(uint32_t maxVertices) { m_maxVertices = maxVertices; }
+
+	//Batches the static entities below root, the batches are added as children of root
+	std::vector<entt::entity> build(entt::entity root);
+
+private:
+	struct Source {
+		entt::entity entity;
+		Mesh* mesh;
+		glm::mat4 transform;
+	};
+
+	entt::entity createBatch(entt::entity root, Material* material, const std::vector<std::string>& filters, const std::vector<Source>& sources);
+	bool isDescendant(entt::entity entity, entt::entity root);
+
+	Issam::Scene* m_scene;
+	uint32_t m_maxVertices = std::numeric_limits<uint16_t>::max();
+};
@@ -0,0 +1,392 @@
+// BcEncoder output decoded by reference decoders (written from the format specifications, BC7 in the modes 1, 5 and 6),
+// for every format and quality: the PSNR measured on the decoded texels must be the one reported by the encoder and above
+// a floor, then the throughput. On an opaque image, BC7 High must beat BC1 High (the BaseColor choice of selectFormat).
+// bcEncoderTest: the checks and a short benchmark (run by ctest). bcEncoderTest --bench: the benchmark on 4096x4096 images.
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "bcEncoder.h"
+#include "mipBuilder.h"
+#include "threadPool.h"
+
+namespace
+{
+	int s_failures = 0;
+
+	struct Random {
+		uint32_t state = 12345;
+		float next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return (state >> 8) / float(1 << 24);
+		}
+	};
+
+	//Gradients, hard edged discs and noise, with a varying alpha unless opaque: the mix of the content of real textures
+	Utils::ImageData createImage(int width, int height, bool mips, bool opaque = false)
+	{
+		Utils::ImageData image;
+		image.width = width;
+		image.height = height;
+		image.format = TextureFormat::RGBA8Unorm;
+		image.levels.push_back(std::vector<uint8_t>(size_t(width) * height * 4));
+		Random random;
+		uint8_t* pixels = image.levels[0].data();
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				const float u = float(x) / width, v = float(y) / height;
+				const float cellU = std::fmod(u * 6.0f, 1.0f) - 0.5f, cellV = std::fmod(v * 6.0f, 1.0f) - 0.5f;
+				const bool disc = cellU * cellU + cellV * cellV < 0.1f;
+				const float color[4] = {
+					disc ? 0.9f : u,
+					disc ? 0.2f : v,
+					disc ? 0.1f : 0.5f + 0.5f * std::sin(10.0f * (u + v)),
+					opaque ? 1.0f : 0.5f + 0.5f * std::cos(7.0f * u) };
+				for (int c = 0; c < 4; ++c)
+				{
+					const float noisy = std::clamp(color[c] + 0.06f * (random.next() - 0.5f), 0.0f, 1.0f);
+					pixels[(size_t(y) * width + x) * 4 + c] = static_cast<uint8_t>(std::lround(noisy * 255.0f));
+				}
+			}
+		}
+		if (mips)
+			MipBuilder::build(image);
+		return image;
+	}
+
+	void rgb565(uint16_t color, int rgb[3])
+	{
+		const int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	//BC1 color block, both modes, into the RGB of 16 texels
+	void decodeColorBlock(const uint8_t* block, uint8_t texels[64], bool alpha)
+	{
+		uint16_t c0, c1;
+		uint32_t indices;
+		memcpy(&c0, block, 2);
+		memcpy(&c1, block + 2, 2);
+		memcpy(&indices, block + 4, 4);
+		int palette[4][4];
+		rgb565(c0, palette[0]);
+		rgb565(c1, palette[1]);
+		for (int c = 0; c < 3; ++c)
+		{
+			if (c0 > c1 || !alpha)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			else
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+		for (int i = 0; i < 16; ++i)
+			for (int c = 0; c < 3; ++c)
+				texels[4 * i + c] = static_cast<uint8_t>(palette[(indices >> (2 * i)) & 3][c]);
+	}
+
+	//BC4 block (also the alpha of BC3 and each channel of BC5), both modes, into one channel of 16 texels
+	void decodeChannelBlock(const uint8_t* block, uint8_t texels[64], int channel)
+	{
+		const int a0 = block[0], a1 = block[1];
+		int palette[8] = { a0, a1 };
+		for (int i = 1; i < 7; ++i)
+			palette[i + 1] = a0 > a1 ? ((7 - i) * a0 + i * a1) / 7 : (i < 5 ? ((5 - i) * a0 + i * a1) / 5 : (i == 5 ? 0 : 255));
+		uint64_t bits = 0;
+		memcpy(&bits, block + 2, 6);
+		for (int i = 0; i < 16; ++i)
+			texels[4 * i + channel] = static_cast<uint8_t>(palette[(bits >> (3 * i)) & 7]);
+	}
+
+	int interpolate(int e0, int e1, int index, int indexBits)
+	{
+		static constexpr int c_weights2[4] = { 0, 21, 43, 64 };
+		static constexpr int c_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+		static constexpr int c_weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+		const int weight = indexBits == 2 ? c_weights2[index] : indexBits == 3 ? c_weights3[index] : c_weights4[index];
+		return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+	}
+
+	//BC7 block, the modes written by the encoder (1, 5 and 6): any other mode decodes as an error (all 0)
+	void decodeBc7Block(const uint8_t* block, uint8_t texels[64])
+	{
+		//Subset 1 texels of the two subsets partitions, from the table of the format (one row of 4 texels per digit)
+		static constexpr uint16_t c_partitions[64] = {
+			0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80, 0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+			0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce, 0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+			0xaaaa, 0xf0f0, 0x5a5a, 0x33cc, 0x3c3c, 0x55aa, 0x9696, 0xa55a, 0x73ce, 0x13c8, 0x324c, 0x3bdc, 0x6996, 0xc33c, 0x9966, 0x0660,
+			0x0272, 0x04e4, 0x4e40, 0x2720, 0xc936, 0x936c, 0x39c6, 0x639c, 0x9336, 0x9cc6, 0x817e, 0xe718, 0xccf0, 0x0fcc, 0x7744, 0xee22,
+		};
+		static constexpr uint8_t c_anchors[64] = {
+			15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+			15, 15, 6, 8, 2, 8, 15, 15, 2, 8, 2, 2, 2, 15, 15, 6, 6, 2, 6, 8, 15, 15, 2, 2, 15, 15, 15, 15, 15, 2, 2, 15,
+		};
+		uint64_t words[2];
+		memcpy(words, block, 16);
+		uint32_t position = 0;
+		auto read = [&](uint32_t count) {
+			uint32_t value = 0;
+			for (uint32_t i = 0; i < count; ++i, ++position)
+				value |= uint32_t((words[position / 64] >> (position % 64)) & 1) << i;
+			return value;
+		};
+		int mode = 0;
+		while (mode < 8 && !read(1))
+			mode++;
+		if (mode == 6)
+		{
+			int endpoints[2][4];
+			for (int c = 0; c < 4; ++c)
+			{
+				endpoints[0][c] = read(7);
+				endpoints[1][c] = read(7);
+			}
+			const int p0 = read(1), p1 = read(1);
+			for (int i = 0; i < 16; ++i)
+			{
+				const int index = read(i == 0 ? 3 : 4);
+				for (int c = 0; c < 4; ++c)
+					texels[4 * i + c] = static_cast<uint8_t>(interpolate((endpoints[0][c] << 1) | p0, (endpoints[1][c] << 1) | p1, index, 4));
+			}
+		}
+		else if (mode == 5)
+		{
+			const int rotation = read(2);
+			int endpoints[2][4];
+			for (int c = 0; c < 3; ++c)
+			{
+				endpoints[0][c] = read(7);
+				endpoints[1][c] = read(7);
+			}
+			endpoints[0][3] = read(8);
+			endpoints[1][3] = read(8);
+			int colorIndices[16], alphaIndices[16];
+			for (int i = 0; i < 16; ++i)
+				colorIndices[i] = read(i == 0 ? 1 : 2);
+			for (int i = 0; i < 16; ++i)
+				alphaIndices[i] = read(i == 0 ? 1 : 2);
+			for (int i = 0; i < 16; ++i)
+			{
+				for (int c = 0; c < 3; ++c)
+				{
+					const int e0 = (endpoints[0][c] << 1) | (endpoints[0][c] >> 6), e1 = (endpoints[1][c] << 1) | (endpoints[1][c] >> 6);
+					texels[4 * i + c] = static_cast<uint8_t>(interpolate(e0, e1, colorIndices[i], 2));
+				}
+				texels[4 * i + 3] = static_cast<uint8_t>(interpolate(endpoints[0][3], endpoints[1][3], alphaIndices[i], 2));
+				if (rotation)
+					std::swap(texels[4 * i + 3], texels[4 * i + rotation - 1]);
+			}
+		}
+		else if (mode == 1)
+		{
+			const int partition = read(6);
+			int endpoints[4][3]; //Subset 0 then 1, two endpoints each
+			for (int c = 0; c < 3; ++c)
+				for (int e = 0; e < 4; ++e)
+					endpoints[e][c] = read(6);
+			const int pBits[2] = { int(read(1)), int(read(1)) };
+			for (int i = 0; i < 16; ++i)
+			{
+				const int subset = (c_partitions[partition] >> i) & 1;
+				const int index = read(i == 0 || i == c_anchors[partition] ? 2 : 3);
+				for (int c = 0; c < 3; ++c)
+				{
+					const int e0 = (endpoints[2 * subset][c] << 1) | pBits[subset], e1 = (endpoints[2 * subset + 1][c] << 1) | pBits[subset];
+					texels[4 * i + c] = static_cast<uint8_t>(interpolate((e0 << 1) | (e0 >> 6), (e1 << 1) | (e1 >> 6), index, 3));
+				}
+				texels[4 * i + 3] = 255;
+			}
+		}
+		else
+			memset(texels, 0, 64);
+	}
+
+	//Sum of the squared errors of the level 0 over the channels the format encodes
+	double measureError(const Utils::ImageData& source, const Utils::ImageData& image)
+	{
+		const uint32_t blockBytes = Utils::getFormatBlock(image.format).bytes;
+		const int blocksWide = image.width / 4;
+		double error = 0.0;
+		for (int by = 0; by < image.height / 4; ++by)
+		{
+			for (int bx = 0; bx < blocksWide; ++bx)
+			{
+				const uint8_t* block = image.levels[0].data() + (size_t(by) * blocksWide + bx) * blockBytes;
+				uint8_t texels[64] = {};
+				int channels = 4;
+				switch (image.format)
+				{
+				case TextureFormat::BC1RGBAUnorm:
+					decodeColorBlock(block, texels, true);
+					channels = 3;
+					break;
+				case TextureFormat::BC3RGBAUnorm:
+					decodeChannelBlock(block, texels, 3);
+					decodeColorBlock(block + 8, texels, false);
+					break;
+				case TextureFormat::BC4RUnorm:
+					decodeChannelBlock(block, texels, 0);
+					channels = 1;
+					break;
+				case TextureFormat::BC5RGUnorm:
+					decodeChannelBlock(block, texels, 0);
+					decodeChannelBlock(block + 8, texels, 1);
+					channels = 2;
+					break;
+				default:
+					decodeBc7Block(block, texels);
+					break;
+				}
+				for (int i = 0; i < 16; ++i)
+				{
+					const uint8_t* texel = source.levels[0].data() + ((size_t(by) * 4 + i / 4) * source.width + bx * 4 + i % 4) * 4;
+					for (int c = 0; c < channels; ++c)
+						error += double(texel[c] - texels[4 * i + c]) * (texel[c] - texels[4 * i + c]);
+				}
+			}
+		}
+		return error;
+	}
+
+	struct Format {
+		const char* name;
+		TextureFormat format;
+		double minPsnr[2]; //Fast, High: the results of the encoder on the test image, with a margin
+	};
+
+	const Format c_formats[] = {
+		{ "BC1", TextureFormat::BC1RGBAUnorm, { 32.5, 34.0 } },
+		{ "BC3", TextureFormat::BC3RGBAUnorm, { 34.0, 35.0 } },
+		{ "BC4", TextureFormat::BC4RUnorm, { 38.0, 39.5 } },
+		{ "BC5", TextureFormat::BC5RGUnorm, { 38.5, 40.0 } },
+		{ "BC7", TextureFormat::BC7RGBAUnorm, { 35.0, 36.5 } },
+	};
+
+	const char* toString(BcEncoder::Quality quality)
+	{
+		return quality == BcEncoder::Quality::High ? "high" : "fast";
+	}
+
+	void checkCorrectness()
+	{
+		const Utils::ImageData source = createImage(260, 132, true);
+		for (const Format& format : c_formats)
+		{
+			double fastPsnr = 0.0;
+			for (BcEncoder::Quality quality : { BcEncoder::Quality::Fast, BcEncoder::Quality::High })
+			{
+				Utils::ImageData image = source;
+				BcEncoder::Stats stats;
+				const std::string name = std::string(format.name) + " " + toString(quality);
+				if (!BcEncoder::compress(image, format.format, quality, &stats))
+				{
+					std::cout << "FAILED: " << name << " not encoded" << std::endl;
+					s_failures++;
+					continue;
+				}
+
+				//Every level down to 1x1, in whole blocks
+				bool sizes = image.levels.size() == source.levels.size();
+				for (size_t level = 0; sizes && level < image.levels.size(); ++level)
+				{
+					const size_t blocks = size_t((std::max(image.width >> level, 1) + 3) / 4) * ((std::max(image.height >> level, 1) + 3) / 4);
+					sizes = image.levels[level].size() == blocks * Utils::getFormatBlock(format.format).bytes;
+				}
+
+				const double error = measureError(source, image);
+				BcEncoder::Stats decoded;
+				decoded.squaredError = error;
+				decoded.sampleCount = stats.sampleCount;
+				const double psnr = decoded.getPsnr();
+				const int qualityIndex = quality == BcEncoder::Quality::High ? 1 : 0;
+				if (!sizes || std::abs(psnr - stats.getPsnr()) > 0.01 || psnr < format.minPsnr[qualityIndex] || psnr < fastPsnr - 0.05)
+				{
+					std::cout << "FAILED: " << name << (sizes ? "" : " wrong level sizes") << ", PSNR " << psnr << " dB decoded, "
+						<< stats.getPsnr() << " dB reported, " << format.minPsnr[qualityIndex] << " dB expected" << std::endl;
+					s_failures++;
+				}
+				fastPsnr = psnr;
+			}
+		}
+	}
+
+	//BaseColor in High quality selects BC7: on an opaque image it must beat BC1 High, with the modes 1 and 5 in use
+	void checkBc7Modes()
+	{
+		const Utils::ImageData source = createImage(260, 132, false, true);
+		Utils::ImageData bc1 = source, bc7 = source;
+		if (BcEncoder::selectFormat(source, BcEncoder::Role::BaseColor, BcEncoder::Quality::High) != TextureFormat::BC7RGBAUnorm
+			|| !BcEncoder::compress(bc1, TextureFormat::BC1RGBAUnorm, BcEncoder::Quality::High)
+			|| !BcEncoder::compress(bc7, TextureFormat::BC7RGBAUnorm, BcEncoder::Quality::High))
+		{
+			std::cout << "FAILED: opaque BaseColor not encoded in BC7" << std::endl;
+			s_failures++;
+			return;
+		}
+		int modeCounts[8] = {};
+		for (size_t offset = 0; offset < bc7.levels[0].size(); offset += 16)
+		{
+			int mode = 0;
+			while (mode < 8 && !((bc7.levels[0][offset] >> mode) & 1))
+				mode++;
+			modeCounts[std::min(mode, 7)]++;
+		}
+		//Both over the RGB of the texels, the alpha of the BC7 blocks counts too and can only add to its error
+		const double bc1Error = measureError(source, bc1), bc7Error = measureError(source, bc7);
+		const int blockCount = int(bc7.levels[0].size() / 16);
+		if (bc7Error >= bc1Error || modeCounts[1] == 0 || modeCounts[5] == 0 || modeCounts[1] + modeCounts[5] + modeCounts[6] != blockCount)
+		{
+			std::cout << "FAILED: opaque BC7 high, squared error " << bc7Error << " (BC1 high " << bc1Error << "), blocks in modes 1, 5, 6: "
+				<< modeCounts[1] << ", " << modeCounts[5] << ", " << modeCounts[6] << " of " << blockCount << std::endl;
+			s_failures++;
+		}
+	}
+
+	void benchmark(int size)
+	{
+		const Utils::ImageData source = createImage(size, size, false);
+		for (const Format& format : c_formats)
+		{
+			for (BcEncoder::Quality quality : { BcEncoder::Quality::Fast, BcEncoder::Quality::High })
+			{
+				//Best of 3, the first run also warms the thread pool
+				double best = 0.0;
+				BcEncoder::Stats stats;
+				for (int run = 0; run < 3; ++run)
+				{
+					Utils::ImageData image = source;
+					stats = BcEncoder::Stats();
+					BcEncoder::compress(image, format.format, quality, &stats);
+					best = run == 0 ? stats.milliseconds : std::min(best, stats.milliseconds);
+				}
+				std::cout << format.name << " " << toString(quality) << " " << size << "x" << size << ": " << best << " ms, "
+					<< double(stats.texelCount) / 1000.0 / best << " Mtexels/s, PSNR " << stats.getPsnr() << " dB" << std::endl;
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const bool fullBenchmark = argc > 1 && std::strcmp(argv[1], "--bench") == 0;
+	std::cout << "BcEncoder: " << ThreadPool::getInstance().getThreadCount() << " workers" << std::endl;
+
+	checkCorrectness();
+	checkBc7Modes();
+	benchmark(fullBenchmark ? 4096 : 512);
+
+	std::cout << (s_failures ? "FAILED" : "PASSED") << std::endl;
+	return s_failures ? 1 : 0;
+}
@@ -0,0 +1,392 @@
+// Ktx2Reader on KTX2 files built in memory: the levels of the block compressed files are returned as they are stored
+// or decompressed (zlib, zstd), the files it cannot upload are rejected (missing device feature, not 2D, broken level
+// index or payload). With USE_BASISU, the ETC1S and UASTC fixtures are encoded at run time by the basisu encoder and
+// their transcoded formats follow the features and the role, the RGBA8 fallback is compared to the source image.
+// ktx2ReaderTest: the checks (run by ctest).
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef USE_BASISU
+#include <basisu_comp.h>
+#include <basisu_enc.h>
+#include <zstd.h>
+#endif
+
+#include "ktx2.h"
+
+namespace
+{
+	int s_failures = 0;
+
+	void check(bool condition, const std::string& name)
+	{
+		if (!condition)
+		{
+			std::cout << "FAILED: " << name << std::endl;
+			s_failures++;
+		}
+	}
+
+	struct File {
+		uint32_t vkFormat = 145; //VK_FORMAT_BC7_UNORM_BLOCK
+		uint32_t width = 16;
+		uint32_t height = 8;
+		uint32_t depth = 0;
+		uint32_t layerCount = 0;
+		uint32_t faceCount = 1;
+		uint32_t levelCount = 3;
+		uint32_t supercompressionScheme = 0;
+		uint32_t blockBytes = 16;
+		bool compressLevels = false; //With the supercompression scheme, else the levels are stored as they are
+	};
+
+	void write32(std::vector<uint8_t>& bytes, size_t offset, uint32_t value) { memcpy(bytes.data() + offset, &value, 4); }
+	void write64(std::vector<uint8_t>& bytes, size_t offset, uint64_t value) { memcpy(bytes.data() + offset, &value, 8); }
+
+	//zlib stream of stored deflate blocks: there is no compressor in the tree, the reader must still walk the blocks
+	std::vector<uint8_t> compressZlib(const std::vector<uint8_t>& bytes)
+	{
+		std::vector<uint8_t> stream = { 0x78, 0x01 };
+		size_t offset = 0;
+		do
+		{
+			const size_t length = std::min<size_t>(bytes.size() - offset, 65535);
+			const uint16_t length16 = static_cast<uint16_t>(length), complement = static_cast<uint16_t>(~length16);
+			stream.push_back(offset + length == bytes.size() ? 1 : 0);
+			stream.insert(stream.end(), { uint8_t(length16), uint8_t(length16 >> 8), uint8_t(complement), uint8_t(complement >> 8) });
+			stream.insert(stream.end(), bytes.begin() + offset, bytes.begin() + offset + length);
+			offset += length;
+		} while (offset < bytes.size());
+		uint32_t a = 1, b = 0;
+		for (uint8_t byte : bytes)
+		{
+			a = (a + byte) % 65521;
+			b = (b + a) % 65521;
+		}
+		const uint32_t adler = (b << 16) | a;
+		stream.insert(stream.end(), { uint8_t(adler >> 24), uint8_t(adler >> 16), uint8_t(adler >> 8), uint8_t(adler) });
+		return stream;
+	}
+
+	std::vector<uint8_t> compressLevel(const std::vector<uint8_t>& level, uint32_t supercompressionScheme)
+	{
+		if (supercompressionScheme == 3)
+			return compressZlib(level);
+#ifdef USE_BASISU
+		if (supercompressionScheme == 2)
+		{
+			std::vector<uint8_t> compressed(ZSTD_compressBound(level.size()));
+			compressed.resize(ZSTD_compress(compressed.data(), compressed.size(), level.data(), level.size(), 9));
+			return compressed;
+		}
+#endif
+		return level;
+	}
+
+	//Header, level index then the levels from the smallest, like the files written by the KTX tools.
+	//The texels of a level are its index repeated, to find them back.
+	std::vector<uint8_t> createFile(const File& file)
+	{
+		static constexpr uint8_t c_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+		const uint32_t levelCount = std::max(file.levelCount, 1u);
+		std::vector<uint8_t> bytes(Ktx2Reader::c_headerSize + levelCount * 24, 0);
+		memcpy(bytes.data(), c_identifier, sizeof(c_identifier));
+		write32(bytes, 12, file.vkFormat);
+		write32(bytes, 16, 1);
+		write32(bytes, 20, file.width);
+		write32(bytes, 24, file.height);
+		write32(bytes, 28, file.depth);
+		write32(bytes, 32, file.layerCount);
+		write32(bytes, 36, file.faceCount);
+		write32(bytes, 40, file.levelCount);
+		write32(bytes, 44, file.supercompressionScheme);
+		for (uint32_t level = levelCount; level-- > 0;)
+		{
+			const uint32_t width = std::max(file.width >> level, 1u), height = std::max(file.height >> level, 1u);
+			const uint64_t length = uint64_t((width + 3) / 4) * ((height + 3) / 4) * file.blockBytes;
+			std::vector<uint8_t> levelBytes(static_cast<size_t>(length), static_cast<uint8_t>(level + 1));
+			if (file.compressLevels)
+				levelBytes = compressLevel(levelBytes, file.supercompressionScheme);
+			write64(bytes, Ktx2Reader::c_headerSize + level * 24, bytes.size());
+			write64(bytes, Ktx2Reader::c_headerSize + level * 24 + 8, levelBytes.size());
+			write64(bytes, Ktx2Reader::c_headerSize + level * 24 + 16, length);
+			bytes.insert(bytes.end(), levelBytes.begin(), levelBytes.end());
+		}
+		return bytes;
+	}
+
+	//The levels of createFile
+	bool hasLevels(const Utils::ImageData& image, size_t levelCount, uint32_t blockBytes)
+	{
+		bool levels = image.levels.size() == levelCount;
+		for (size_t level = 0; levels && level < levelCount; ++level)
+		{
+			const uint32_t width = std::max(uint32_t(image.width) >> level, 1u), height = std::max(uint32_t(image.height) >> level, 1u);
+			levels = image.levels[level].size() == size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+			for (uint8_t value : image.levels[level])
+				levels = levels && value == level + 1;
+		}
+		return levels;
+	}
+
+	ByteSpan span(const std::vector<uint8_t>& bytes) { return { bytes.data(), bytes.size() }; }
+
+	bool hasAll(FeatureName) { return true; }
+	bool hasNone(FeatureName) { return false; }
+
+	void checkLevels()
+	{
+		const std::vector<uint8_t> bytes = createFile(File());
+		check(Ktx2Reader::isKtx2(span(bytes)), "BC7 file recognized");
+		check(Ktx2Reader::getFormat({ bytes.data(), Ktx2Reader::c_headerSize }, hasAll) == TextureFormat::BC7RGBAUnorm, "BC7 format from the header");
+		const Utils::ImageData image = Ktx2Reader::decode(span(bytes), "bc7", hasAll);
+		check(image.width == 16 && image.height == 8 && image.format == TextureFormat::BC7RGBAUnorm, "BC7 size and format");
+		//16x8, 8x4 then 4x2 padded to one row of blocks
+		check(hasLevels(image, 3, 16) && image.levels[0].size() == 8 * 16 && image.levels[2].size() == 16, "BC7 levels as stored");
+
+		File bc1;
+		bc1.vkFormat = 131;
+		bc1.blockBytes = 8;
+		bc1.levelCount = 5;
+		const Utils::ImageData bc1Image = Ktx2Reader::decode(span(createFile(bc1)), "bc1", hasAll);
+		check(bc1Image.format == TextureFormat::BC1RGBAUnorm && bc1Image.levels.size() == 5 && bc1Image.levels[4].size() == 8, "BC1 down to 1x1");
+
+		File single;
+		single.levelCount = 0; //0: only the base level, the mips are to generate
+		check(Ktx2Reader::decode(span(createFile(single)), "single", hasAll).levels.size() == 1, "level count 0");
+	}
+
+	void checkSupercompression()
+	{
+		//Several stored blocks in the level 0
+		File zlib;
+		zlib.width = 512;
+		zlib.height = 256;
+		zlib.levelCount = 10;
+		zlib.supercompressionScheme = 3;
+		zlib.compressLevels = true;
+		const Utils::ImageData zlibImage = Ktx2Reader::decode(span(createFile(zlib)), "zlib", hasAll);
+		check(zlibImage.format == TextureFormat::BC7RGBAUnorm && hasLevels(zlibImage, 10, 16), "zlib levels decompressed");
+		std::vector<uint8_t> zlibTruncated = createFile(zlib);
+		zlibTruncated.resize(zlibTruncated.size() - 8);
+		check(Ktx2Reader::decode(span(zlibTruncated), "zlib truncated", hasAll).levels.empty(), "zlib truncated");
+
+		File zstd = zlib;
+		zstd.supercompressionScheme = 2;
+		zstd.vkFormat = 131;
+		zstd.blockBytes = 8;
+#ifdef USE_BASISU
+		const Utils::ImageData zstdImage = Ktx2Reader::decode(span(createFile(zstd)), "zstd", hasAll);
+		check(zstdImage.format == TextureFormat::BC1RGBAUnorm && hasLevels(zstdImage, 10, 8), "zstd levels decompressed");
+		//The zstd frame of the level 0 without its last byte
+		std::vector<uint8_t> zstdTruncated = createFile(zstd);
+		uint64_t byteLength = 0;
+		memcpy(&byteLength, zstdTruncated.data() + Ktx2Reader::c_headerSize + 8, 8);
+		write64(zstdTruncated, Ktx2Reader::c_headerSize + 8, byteLength - 1);
+		check(Ktx2Reader::decode(span(zstdTruncated), "zstd truncated", hasAll).levels.empty(), "zstd truncated");
+#else
+		zstd.compressLevels = false;
+		check(Ktx2Reader::decode(span(createFile(zstd)), "zstd", hasAll).levels.empty(), "zstd without USE_BASISU");
+#endif
+	}
+
+	void checkRejected()
+	{
+		check(!Ktx2Reader::isKtx2(span(std::vector<uint8_t>(200, 0))), "not a KTX2 file");
+		check(!Ktx2Reader::isKtx2({ createFile(File()).data(), 40 }), "header too short");
+
+		//The levels of createFile are not Basis Universal data
+		File uastc;
+		uastc.vkFormat = 0;
+		File basisLz;
+		basisLz.vkFormat = 0;
+		basisLz.supercompressionScheme = 1;
+#ifdef USE_BASISU
+		check(Ktx2Reader::getFormat(span(createFile(uastc)), hasAll) == TextureFormat::BC7RGBAUnorm, "UASTC/ETC1S payload to transcode");
+		check(Ktx2Reader::getFormat(span(createFile(basisLz)), hasNone) == TextureFormat::RGBA8Unorm, "BasisLZ payload to transcode");
+		check(Ktx2Reader::decode(span(createFile(uastc)), "invalid UASTC", hasAll).levels.empty(), "invalid UASTC payload");
+		check(Ktx2Reader::decode(span(createFile(basisLz)), "invalid BasisLZ", hasAll).levels.empty(), "invalid BasisLZ payload");
+#else
+		check(Ktx2Reader::getFormat(span(createFile(uastc)), hasAll) == TextureFormat::Undefined, "UASTC/ETC1S payload");
+		check(Ktx2Reader::getFormat(span(createFile(basisLz)), hasAll) == TextureFormat::Undefined, "BasisLZ payload");
+#endif
+		File blockBasisLz;
+		blockBasisLz.supercompressionScheme = 1;
+		check(Ktx2Reader::getFormat(span(createFile(blockBasisLz)), hasAll) == TextureFormat::Undefined, "BasisLZ on BC7 blocks");
+		File zstd;
+		zstd.supercompressionScheme = 2;
+		check(Ktx2Reader::decode(span(createFile(zstd)), "zstd", hasAll).levels.empty(), "levels not zstd compressed");
+
+		check(Ktx2Reader::getFormat(span(createFile(File())), hasNone) == TextureFormat::Undefined, "no BC feature");
+		check(Ktx2Reader::decode(span(createFile(File())), "no feature", hasNone).levels.empty(), "no BC feature decode");
+		File rgba;
+		rgba.vkFormat = 37; //VK_FORMAT_R8G8B8A8_UNORM
+		check(Ktx2Reader::getFormat(span(createFile(rgba)), hasAll) == TextureFormat::Undefined, "not block compressed");
+
+		File array;
+		array.layerCount = 2;
+		check(Ktx2Reader::getFormat(span(createFile(array)), hasAll) == TextureFormat::Undefined, "array texture");
+		File cube;
+		cube.faceCount = 6;
+		check(Ktx2Reader::getFormat(span(createFile(cube)), hasAll) == TextureFormat::Undefined, "cube map");
+		File partialBlocks;
+		partialBlocks.width = 18;
+		check(Ktx2Reader::decode(span(createFile(partialBlocks)), "partial blocks", hasAll).levels.empty(), "base level not in whole blocks");
+
+		std::vector<uint8_t> truncated = createFile(File());
+		truncated.resize(truncated.size() - 1);
+		check(Ktx2Reader::decode(span(truncated), "truncated", hasAll).levels.empty(), "truncated level");
+		std::vector<uint8_t> wrongLength = createFile(File());
+		write64(wrongLength, Ktx2Reader::c_headerSize + 8, 64);
+		check(Ktx2Reader::decode(span(wrongLength), "wrong length", hasAll).levels.empty(), "wrong level length");
+		File manyLevels;
+		manyLevels.levelCount = 4;
+		std::vector<uint8_t> index = createFile(manyLevels);
+		check(Ktx2Reader::decode({ index.data(), Ktx2Reader::c_headerSize + 24 }, "level index", hasAll).levels.empty(), "level index out of the file");
+	}
+
+#ifdef USE_BASISU
+	//Gradients with a disc of alpha, RGBA8
+	std::vector<uint8_t> createImage(int width, int height)
+	{
+		std::vector<uint8_t> pixels(size_t(width) * height * 4);
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				uint8_t* pixel = &pixels[(size_t(y) * width + x) * 4];
+				const float dx = x - width * 0.5f, dy = y - height * 0.5f;
+				pixel[0] = static_cast<uint8_t>(x * 255 / width);
+				pixel[1] = static_cast<uint8_t>(y * 255 / height);
+				pixel[2] = static_cast<uint8_t>(128 + 127 * std::sin(x * 0.2f));
+				pixel[3] = dx * dx + dy * dy < width * height * 0.1f ? 255 : 64;
+			}
+		}
+		return pixels;
+	}
+
+	//KTX2 file of ETC1S (BasisLZ) or UASTC (zstd) blocks with its mips, empty on failure
+	std::vector<uint8_t> encodeBasis(const std::vector<uint8_t>& pixels, int width, int height, bool uastc)
+	{
+		basisu::basisu_encoder_init();
+		basisu::image source(width, height);
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				const uint8_t* pixel = &pixels[(size_t(y) * width + x) * 4];
+				source(x, y) = basisu::color_rgba(pixel[0], pixel[1], pixel[2], pixel[3]);
+			}
+		}
+		basisu::job_pool jobPool(1);
+		basisu::basis_compressor_params params;
+		params.m_source_images.push_back(source);
+		params.m_uastc = uastc;
+		params.m_quality_level = 255;
+		params.m_mip_gen = true;
+		params.m_create_ktx2_file = true;
+		params.m_ktx2_uastc_supercompression = uastc ? basist::KTX2_SS_ZSTANDARD : basist::KTX2_SS_NONE;
+		params.m_read_source_images = false;
+		params.m_write_output_basis_files = false;
+		params.m_status_output = false;
+		params.m_multithreading = false;
+		params.m_pJob_pool = &jobPool;
+		basisu::basis_compressor compressor;
+		if (!compressor.init(params) || compressor.process() != basisu::basis_compressor::cECSuccess)
+			return {};
+		const basisu::uint8_vec& file = compressor.get_output_ktx2_file();
+		return file.size() ? std::vector<uint8_t>(&file[0], &file[0] + file.size()) : std::vector<uint8_t>();
+	}
+
+	bool hasFeature(FeatureName feature, FeatureName query) { return feature == query; }
+
+	//Format of the transcoded levels, and sizes of the levels down to 1x1
+	bool isTranscoded(const Utils::ImageData& image, TextureFormat format, int width, int height)
+	{
+		if (image.format != format || image.width != width || image.height != height) return false;
+		const Utils::FormatBlock block = Utils::getFormatBlock(format);
+		bool levels = image.levels.size() == Utils::getMipLevelCount(width, height);
+		for (uint32_t level = 0; levels && level < image.levels.size(); ++level)
+		{
+			const uint32_t levelWidth = std::max(uint32_t(width) >> level, 1u), levelHeight = std::max(uint32_t(height) >> level, 1u);
+			levels = image.levels[level].size() == size_t((levelWidth + block.width - 1) / block.width) * ((levelHeight + block.height - 1) / block.height) * block.bytes;
+		}
+		return levels;
+	}
+
+	double getPsnr(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b)
+	{
+		if (a.size() != b.size() || a.empty()) return 0.0;
+		double squaredError = 0.0;
+		for (size_t i = 0; i < a.size(); ++i)
+			squaredError += (double(a[i]) - b[i]) * (double(a[i]) - b[i]);
+		const double mse = squaredError / double(a.size());
+		return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+	}
+
+	void checkBasis()
+	{
+		const int width = 64, height = 32;
+		const std::vector<uint8_t> pixels = createImage(width, height);
+		struct Payload {
+			const char* name;
+			bool uastc;
+			double minPsnr;
+		};
+		for (const Payload& payload : { Payload{ "ETC1S", false, 26.0 }, Payload{ "UASTC", true, 34.0 } })
+		{
+			const std::vector<uint8_t> file = encodeBasis(pixels, width, height, payload.uastc);
+			const std::string name = payload.name;
+			check(!file.empty(), name + " fixture encoded");
+			if (file.empty()) continue;
+
+			auto decode = [&](const Ktx2Reader::FeatureQuery& query, BcEncoder::Role role) {
+				return Ktx2Reader::decode(span(file), name, query, role);
+			};
+			const Ktx2Reader::FeatureQuery bcOnly = [](FeatureName feature) { return hasFeature(feature, FeatureName::TextureCompressionBC); };
+			const Ktx2Reader::FeatureQuery etc2Only = [](FeatureName feature) { return hasFeature(feature, FeatureName::TextureCompressionETC2); };
+			const Ktx2Reader::FeatureQuery astcOnly = [](FeatureName feature) { return hasFeature(feature, FeatureName::TextureCompressionASTC); };
+			check(Ktx2Reader::getFormat(span(file), bcOnly) == TextureFormat::BC7RGBAUnorm, name + " format from the header");
+			check(isTranscoded(decode(bcOnly, BcEncoder::Role::BaseColor), TextureFormat::BC7RGBAUnorm, width, height), name + " to BC7");
+			check(isTranscoded(decode(bcOnly, BcEncoder::Role::MetallicRoughness), TextureFormat::BC1RGBAUnorm, width, height), name + " to BC1");
+			check(isTranscoded(decode(bcOnly, BcEncoder::Role::Normal), TextureFormat::BC5RGUnorm, width, height), name + " to BC5");
+			check(isTranscoded(decode(bcOnly, BcEncoder::Role::Mask), TextureFormat::BC4RUnorm, width, height), name + " to BC4");
+			check(isTranscoded(decode(etc2Only, BcEncoder::Role::BaseColor), TextureFormat::ETC2RGBA8Unorm, width, height), name + " to ETC2");
+			check(isTranscoded(decode(etc2Only, BcEncoder::Role::Normal), TextureFormat::EACRG11Unorm, width, height), name + " to EAC RG11");
+			check(isTranscoded(decode(astcOnly, BcEncoder::Role::BaseColor), TextureFormat::ASTC4x4Unorm, width, height), name + " to ASTC 4x4");
+
+			const Utils::ImageData rgba = decode(hasNone, BcEncoder::Role::BaseColor);
+			const double psnr = rgba.levels.empty() ? 0.0 : getPsnr(rgba.levels[0], pixels);
+			if (!isTranscoded(rgba, TextureFormat::RGBA8Unorm, width, height) || psnr < payload.minPsnr)
+			{
+				std::cout << "FAILED: " << name << " to RGBA8, PSNR " << psnr << " dB" << std::endl;
+				s_failures++;
+			}
+
+			std::vector<uint8_t> truncated = file;
+			truncated.resize(truncated.size() / 2);
+			check(Ktx2Reader::decode(span(truncated), name, hasAll).levels.empty(), name + " truncated");
+		}
+
+		//Not in whole blocks: RGBA8 whatever the features
+		const std::vector<uint8_t> odd = encodeBasis(createImage(30, 18), 30, 18, true);
+		check(!odd.empty() && isTranscoded(Ktx2Reader::decode(span(odd), "odd size", hasAll), TextureFormat::RGBA8Unorm, 30, 18), "odd size to RGBA8");
+	}
+#endif
+}
+
+int main()
+{
+	checkLevels();
+	checkSupercompression();
+	checkRejected();
+#ifdef USE_BASISU
+	checkBasis();
+#endif
+
+	std::cout << (s_failures ? "FAILED" : "PASSED") << std::endl;
+	return s_failures ? 1 : 0;
+}
@@ -0,0 +1,344 @@
+// MeshoptDecoder against the meshoptimizer library: the buffers are encoded by its encoders, the decoded vertices and
+// indices must be the original ones, the filters must match its decoders (one unit of rounding on the quantized ones).
+// The truncated streams must be rejected. The byte groups and the filters run the SSE2/NEON paths where available.
+// meshoptDecoderTest: the checks and a short benchmark (run by ctest). meshoptDecoderTest --bench: the benchmark on 4M vertices.
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <meshoptimizer.h>
+
+#include "meshoptDecoder.h"
+
+namespace
+{
+	int s_failures = 0;
+
+	void check(bool condition, const std::string& name)
+	{
+		if (!condition)
+		{
+			std::cout << "FAILED: " << name << std::endl;
+			s_failures++;
+		}
+	}
+
+	ByteSpan span(const std::vector<uint8_t>& bytes, size_t size) { return { bytes.data(), size }; }
+
+	enum class Content { Random, Smooth, Sparse };
+	const char* toString(Content content) { return content == Content::Random ? "random" : content == Content::Smooth ? "smooth" : "sparse"; }
+
+	//Random: every byte group escapes to 8 bits. Smooth: floats of a slow curve, small deltas. Sparse: mostly zero groups.
+	std::vector<uint8_t> createVertices(size_t count, size_t stride, Content content, std::mt19937& random)
+	{
+		std::vector<uint8_t> vertices(count * stride, 0);
+		for (size_t i = 0; i < count; ++i)
+		{
+			for (size_t k = 0; k < stride; k += 4)
+			{
+				uint8_t* component = &vertices[i * stride + k];
+				if (content == Content::Random)
+				{
+					const uint32_t value = random();
+					memcpy(component, &value, 4);
+				}
+				else if (content == Content::Smooth)
+				{
+					const float value = std::sin(float(i) * 0.01f + float(k)) * 100.0f;
+					memcpy(component, &value, 4);
+				}
+				else if (random() % 16 == 0)
+				{
+					component[random() % 4] = static_cast<uint8_t>(random());
+				}
+			}
+		}
+		return vertices;
+	}
+
+	void checkVertexBuffers()
+	{
+		std::mt19937 random(1);
+		meshopt_encodeVertexVersion(0);
+		for (size_t stride : { 4, 8, 12, 16, 20, 32, 64 })
+		{
+			//One vertex, around one byte group, and several blocks
+			for (size_t count : { 1, 15, 16, 17, 1000, 5003 })
+			{
+				for (Content content : { Content::Random, Content::Smooth, Content::Sparse })
+				{
+					const std::string name = std::string("vertices ") + toString(content) + ", stride " + std::to_string(stride) + ", count " + std::to_string(count);
+					const std::vector<uint8_t> vertices = createVertices(count, stride, content, random);
+					std::vector<uint8_t> encoded(meshopt_encodeVertexBufferBound(count, stride));
+					encoded.resize(meshopt_encodeVertexBuffer(encoded.data(), encoded.size(), vertices.data(), count, stride));
+
+					std::vector<uint8_t> decoded(count * stride, 0xcd);
+					check(MeshoptDecoder::decodeVertexBuffer(decoded.data(), count, stride, span(encoded, encoded.size())) && decoded == vertices, name);
+					check(!MeshoptDecoder::decodeVertexBuffer(decoded.data(), count, stride, span(encoded, encoded.size() - 1)), name + " truncated");
+				}
+			}
+		}
+	}
+
+	//rows x columns quads, the vertex cache order of meshopt_optimizeVertexCache like the exporters
+	std::vector<uint32_t> createGrid(uint32_t rows, uint32_t columns)
+	{
+		std::vector<uint32_t> indices;
+		for (uint32_t r = 0; r < rows; ++r)
+		{
+			for (uint32_t c = 0; c < columns; ++c)
+			{
+				const uint32_t i = r * (columns + 1) + c;
+				indices.insert(indices.end(), { i, i + columns + 1, i + 1, i + 1, i + columns + 1, i + columns + 2 });
+			}
+		}
+		const size_t vertexCount = size_t(rows + 1) * (columns + 1);
+		meshopt_optimizeVertexCache(indices.data(), indices.data(), indices.size(), vertexCount);
+		return indices;
+	}
+
+	std::vector<uint32_t> createRandomTriangles(size_t triangleCount, uint32_t vertexCount, std::mt19937& random)
+	{
+		std::vector<uint32_t> indices;
+		while (indices.size() < triangleCount * 3)
+		{
+			const uint32_t a = random() % vertexCount, b = random() % vertexCount, c = random() % vertexCount;
+			if (a != b && b != c && c != a)
+				indices.insert(indices.end(), { a, b, c });
+		}
+		return indices;
+	}
+
+	bool decodeIndices(const std::vector<uint32_t>& indices, const std::vector<uint8_t>& encoded, size_t size, size_t indexSize, bool sequence)
+	{
+		std::vector<uint8_t> decoded(indices.size() * indexSize, 0xcd);
+		const bool success = sequence ? MeshoptDecoder::decodeIndexSequence(decoded.data(), indices.size(), indexSize, span(encoded, size))
+			: MeshoptDecoder::decodeIndexBuffer(decoded.data(), indices.size(), indexSize, span(encoded, size));
+		for (size_t i = 0; success && i < indices.size(); ++i)
+		{
+			uint32_t index = 0;
+			if (indexSize == 2)
+			{
+				uint16_t index16;
+				memcpy(&index16, &decoded[i * 2], 2);
+				index = index16;
+			}
+			else
+			{
+				memcpy(&index, &decoded[i * 4], 4);
+			}
+			if (index != indices[i]) return false;
+		}
+		return success;
+	}
+
+	void checkIndexBuffers()
+	{
+		std::mt19937 random(2);
+		struct Fixture {
+			std::string name;
+			std::vector<uint32_t> indices;
+			uint32_t vertexCount;
+		};
+		const std::vector<Fixture> fixtures = {
+			{ "one triangle", { 0, 1, 2 }, 3 },
+			{ "grid 2x2", createGrid(2, 2), 9 },
+			{ "grid 100x100", createGrid(100, 100), 101 * 101 },
+			{ "random triangles", createRandomTriangles(2000, 1000, random), 1000 },
+			{ "random triangles, 32 bits", createRandomTriangles(2000, 1u << 20, random), 1u << 20 },
+		};
+		for (const Fixture& fixture : fixtures)
+		{
+			for (int version : { 0, 1 })
+			{
+				meshopt_encodeIndexVersion(version);
+				std::vector<uint8_t> encoded(meshopt_encodeIndexBufferBound(fixture.indices.size(), fixture.vertexCount));
+				encoded.resize(meshopt_encodeIndexBuffer(encoded.data(), encoded.size(), fixture.indices.data(), fixture.indices.size()));
+				const std::string name = "triangles " + fixture.name + ", version " + std::to_string(version);
+				if (fixture.vertexCount <= 65536)
+					check(decodeIndices(fixture.indices, encoded, encoded.size(), 2, false), name + ", 16 bits");
+				check(decodeIndices(fixture.indices, encoded, encoded.size(), 4, false), name + ", 32 bits");
+				check(!decodeIndices(fixture.indices, encoded, encoded.size() - 1, 4, false), name + " truncated");
+			}
+		}
+
+		//INDICES: strips and lists of points, runs and jumps between the two baselines
+		std::vector<uint32_t> sequence;
+		for (uint32_t run = 0; run < 200; ++run)
+		{
+			const uint32_t start = random() % 60000;
+			for (uint32_t i = 0; i < 20; ++i)
+				sequence.push_back(start + i);
+		}
+		const std::vector<Fixture> sequences = {
+			{ "one index", { 7 }, 8 },
+			{ "runs", sequence, 60020 },
+			{ "random, 32 bits", createRandomTriangles(1000, 1u << 24, random), 1u << 24 },
+		};
+		for (const Fixture& fixture : sequences)
+		{
+			std::vector<uint8_t> encoded(meshopt_encodeIndexSequenceBound(fixture.indices.size(), fixture.vertexCount));
+			encoded.resize(meshopt_encodeIndexSequence(encoded.data(), encoded.size(), fixture.indices.data(), fixture.indices.size()));
+			const std::string name = "sequence " + fixture.name;
+			if (fixture.vertexCount <= 65536)
+				check(decodeIndices(fixture.indices, encoded, encoded.size(), 2, true), name + ", 16 bits");
+			check(decodeIndices(fixture.indices, encoded, encoded.size(), 4, true), name + ", 32 bits");
+			check(!decodeIndices(fixture.indices, encoded, encoded.size() - 1, 4, true), name + " truncated");
+		}
+	}
+
+	//The quantized components of MeshoptDecoder and meshoptimizer, one unit apart at most (round half away from zero
+	//against round half to even in its SIMD paths)
+	template<typename T>
+	bool closeComponents(const std::vector<uint8_t>& decoded, const std::vector<uint8_t>& expected)
+	{
+		for (size_t i = 0; i < decoded.size(); i += sizeof(T))
+		{
+			T a, b;
+			memcpy(&a, &decoded[i], sizeof(T));
+			memcpy(&b, &expected[i], sizeof(T));
+			if (std::abs(int(a) - int(b)) > 1) return false;
+		}
+		return true;
+	}
+
+	glm::vec4 randomUnitVector(std::mt19937& random, bool quaternion)
+	{
+		std::normal_distribution<float> normal;
+		glm::vec4 v(normal(random), normal(random), normal(random), quaternion ? normal(random) : 0.0f);
+		v /= std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z + v.w * v.w);
+		//The w of a normal is kept as is by the filter, like the sign of a tangent
+		if (!quaternion) v.w = random() % 2 ? 1.0f : -1.0f;
+		return v;
+	}
+
+	void checkFilters()
+	{
+		std::mt19937 random(3);
+		//Around the 4 vertices of the SIMD paths (8 for the 8 bits octahedral with NEON)
+		for (size_t count : { 1, 3, 4, 5, 8, 17, 1000 })
+		{
+			std::vector<float> normals, quaternions;
+			for (size_t i = 0; i < count; ++i)
+			{
+				const glm::vec4 normal = randomUnitVector(random, false), quaternion = randomUnitVector(random, true);
+				normals.insert(normals.end(), { normal.x, normal.y, normal.z, normal.w });
+				quaternions.insert(quaternions.end(), { quaternion.x, quaternion.y, quaternion.z, quaternion.w });
+			}
+			const std::string suffix = ", count " + std::to_string(count);
+
+			struct Quantized {
+				size_t stride;
+				int bits;
+			};
+			for (const Quantized& oct : { Quantized{ 4, 8 }, Quantized{ 8, 12 }, Quantized{ 8, 16 } })
+			{
+				std::vector<uint8_t> encoded(count * oct.stride);
+				meshopt_encodeFilterOct(encoded.data(), count, oct.stride, oct.bits, normals.data());
+				std::vector<uint8_t> decoded = encoded, expected = encoded;
+				meshopt_decodeFilterOct(expected.data(), count, oct.stride);
+				const bool success = MeshoptDecoder::applyFilter(decoded.data(), count, oct.stride, MeshoptDecoder::Filter::Octahedral);
+				check(success && (oct.stride == 4 ? closeComponents<int8_t>(decoded, expected) : closeComponents<int16_t>(decoded, expected)),
+					"octahedral " + std::to_string(oct.bits) + " bits" + suffix);
+			}
+			for (int bits : { 12, 16 })
+			{
+				std::vector<uint8_t> encoded(count * 8);
+				meshopt_encodeFilterQuat(encoded.data(), count, 8, bits, quaternions.data());
+				std::vector<uint8_t> decoded = encoded, expected = encoded;
+				meshopt_decodeFilterQuat(expected.data(), count, 8);
+				const bool success = MeshoptDecoder::applyFilter(decoded.data(), count, 8, MeshoptDecoder::Filter::Quaternion);
+				check(success && closeComponents<int16_t>(decoded, expected), "quaternion " + std::to_string(bits) + " bits" + suffix);
+			}
+			//Not quantized to integers: the same floats
+			for (meshopt_EncodeExpMode mode : { meshopt_EncodeExpSeparate, meshopt_EncodeExpSharedVector })
+			{
+				std::vector<float> values(count * 3);
+				for (float& value : values)
+					value = std::ldexp(float(random() % 20001) / 10000.0f - 1.0f, int(random() % 40) - 20);
+				std::vector<uint8_t> encoded(count * 12);
+				meshopt_encodeFilterExp(encoded.data(), count, 12, 15, values.data(), mode);
+				std::vector<uint8_t> decoded = encoded, expected = encoded;
+				meshopt_decodeFilterExp(expected.data(), count, 12);
+				const bool success = MeshoptDecoder::applyFilter(decoded.data(), count, 12, MeshoptDecoder::Filter::Exponential);
+				check(success && decoded == expected, std::string("exponential ") + (mode == meshopt_EncodeExpSeparate ? "separate" : "shared") + suffix);
+			}
+		}
+
+		std::vector<uint8_t> data(64);
+		check(!MeshoptDecoder::applyFilter(data.data(), 4, 12, MeshoptDecoder::Filter::Octahedral), "octahedral stride 12");
+		check(!MeshoptDecoder::applyFilter(data.data(), 4, 4, MeshoptDecoder::Filter::Quaternion), "quaternion stride 4");
+		check(!MeshoptDecoder::applyFilter(data.data(), 4, 6, MeshoptDecoder::Filter::Exponential), "exponential stride 6");
+	}
+
+	template<typename Function>
+	double measure(Function function)
+	{
+		//Best of 3
+		double best = 0.0;
+		for (int run = 0; run < 3; ++run)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			function();
+			const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			best = run == 0 ? milliseconds : std::min(best, milliseconds);
+		}
+		return best;
+	}
+
+	//Decoding speed of the vertices (16 bytes, smooth), the triangles of a grid and the octahedral normals
+	void benchmark(size_t vertexCount)
+	{
+		std::mt19937 random(4);
+		const size_t stride = 16;
+		const std::vector<uint8_t> vertices = createVertices(vertexCount, stride, Content::Smooth, random);
+		meshopt_encodeVertexVersion(0);
+		std::vector<uint8_t> encodedVertices(meshopt_encodeVertexBufferBound(vertexCount, stride));
+		encodedVertices.resize(meshopt_encodeVertexBuffer(encodedVertices.data(), encodedVertices.size(), vertices.data(), vertexCount, stride));
+		std::vector<uint8_t> decoded(vertices.size());
+		const double vertexMs = measure([&] { MeshoptDecoder::decodeVertexBuffer(decoded.data(), vertexCount, stride, span(encodedVertices, encodedVertices.size())); });
+		std::cout << "vertices " << vertexCount << " x " << stride << " bytes: " << vertexMs << " ms, " << double(vertices.size()) / 1000.0 / vertexMs << " MB/s" << std::endl;
+
+		const uint32_t side = static_cast<uint32_t>(std::sqrt(double(vertexCount))) - 1;
+		const std::vector<uint32_t> indices = createGrid(side, side);
+		meshopt_encodeIndexVersion(1);
+		std::vector<uint8_t> encodedIndices(meshopt_encodeIndexBufferBound(indices.size(), size_t(side + 1) * (side + 1)));
+		encodedIndices.resize(meshopt_encodeIndexBuffer(encodedIndices.data(), encodedIndices.size(), indices.data(), indices.size()));
+		std::vector<uint32_t> decodedIndices(indices.size());
+		const double indexMs = measure([&] { MeshoptDecoder::decodeIndexBuffer(decodedIndices.data(), indices.size(), 4, span(encodedIndices, encodedIndices.size())); });
+		std::cout << "triangles " << indices.size() / 3 << ": " << indexMs << " ms, " << double(indices.size() / 3) / 1000.0 / indexMs << " Mtriangles/s" << std::endl;
+
+		std::vector<float> normals;
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			const glm::vec4 normal = randomUnitVector(random, false);
+			normals.insert(normals.end(), { normal.x, normal.y, normal.z, normal.w });
+		}
+		std::vector<uint8_t> encodedNormals(vertexCount * 8);
+		meshopt_encodeFilterOct(encodedNormals.data(), vertexCount, 8, 16, normals.data());
+		std::vector<uint8_t> filtered;
+		const double filterMs = measure([&] {
+			filtered = encodedNormals;
+			MeshoptDecoder::applyFilter(filtered.data(), vertexCount, 8, MeshoptDecoder::Filter::Octahedral);
+		});
+		std::cout << "octahedral normals " << vertexCount << ": " << filterMs << " ms, " << double(vertexCount) / 1000.0 / filterMs << " Mnormals/s" << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const bool fullBenchmark = argc > 1 && std::strcmp(argv[1], "--bench") == 0;
+
+	checkVertexBuffers();
+	checkIndexBuffers();
+	checkFilters();
+	benchmark(fullBenchmark ? 4 << 20 : 1 << 18);
+
+	std::cout << (s_failures ? "FAILED" : "PASSED") << std::endl;
+	return s_failures ? 1 : 0;
+}
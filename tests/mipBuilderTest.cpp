@@ -0,0 +1,346 @@
+// MipBuilder against a scalar reference in double precision (same filter definitions, written independently),
+// for every instruction set of the CPU, then the throughput of each one.
+// mipBuilderTest: the checks and a short benchmark (run by ctest). mipBuilderTest --bench: the benchmark on 4096x4096 images.
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "mipBuilder.h"
+#include "threadPool.h"
+
+namespace
+{
+	int s_failures = 0;
+
+	//Deterministic content, the same on every run
+	struct Random {
+		uint32_t state = 12345;
+		float next()
+		{
+			state = state * 1664525u + 1013904223u;
+			return (state >> 8) / float(1 << 24);
+		}
+	};
+
+	double srgbToLinear(double c)
+	{
+		return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+	}
+
+	double linearToSrgb(double c)
+	{
+		return c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055;
+	}
+
+	float halfToFloat(uint16_t half)
+	{
+		const int exponent = (half >> 10) & 0x1f;
+		const int mantissa = half & 0x3ff;
+		const double value = exponent == 0 ? std::ldexp(double(mantissa), -24) : std::ldexp(double(mantissa + 1024), exponent - 25);
+		return float(half & 0x8000 ? -value : value);
+	}
+
+	//Positive finite values only, rounded to the nearest
+	uint16_t floatToHalf(float value)
+	{
+		if (value < std::ldexp(1.0f, -14))
+			return static_cast<uint16_t>(std::lround(std::ldexp(value, 24)));
+		int exponent = 0;
+		const float fraction = std::frexp(value, &exponent); //[0.5, 1)
+		long mantissa = std::lround(std::ldexp(fraction, 11)); //[1024, 2048]
+		if (mantissa == 2048)
+		{
+			mantissa = 1024;
+			exponent++;
+		}
+		return static_cast<uint16_t>(((exponent + 14) << 10) | (mantissa - 1024));
+	}
+
+	double besselI0(double x)
+	{
+		double sum = 1.0;
+		double term = 1.0;
+		for (int k = 1; k < 64; ++k)
+		{
+			term *= (x / 2.0) * (x / 2.0) / (double(k) * k);
+			sum += term;
+		}
+		return sum;
+	}
+
+	//Weights of the source texels for each destination texel: (index, weight), clamped to the edges
+	std::vector<std::vector<std::pair<int, double>>> referenceTaps(int sourceSize, int size, MipBuilder::Filter filter)
+	{
+		std::vector<std::vector<std::pair<int, double>>> taps(size);
+		for (int i = 0; i < size; ++i)
+		{
+			if (sourceSize == 1)
+			{
+				taps[i] = { { 0, 1.0 } };
+			}
+			else if (filter == MipBuilder::Filter::Box)
+			{
+				//The destination texel covers [i, i + 1) * sourceSize / size of the source, weighted by the overlap
+				const double begin = double(i) * sourceSize / size;
+				const double end = double(i + 1) * sourceSize / size;
+				for (int s = int(std::floor(begin)); s < int(std::ceil(end)); ++s)
+				{
+					const double overlap = std::min(end, s + 1.0) - std::max(begin, double(s));
+					if (overlap > 0.0)
+						taps[i].push_back({ std::min(s, sourceSize - 1), overlap / (end - begin) });
+				}
+			}
+			else
+			{
+				//Kaiser windowed sinc, radius 2 and alpha 4 in destination texels
+				const double scale = double(sourceSize) / size;
+				const double center = (i + 0.5) * scale - 0.5;
+				double sum = 0.0;
+				for (int s = int(std::floor(center - 2.0 * scale)); s <= int(std::ceil(center + 2.0 * scale)); ++s)
+				{
+					const double x = (s - center) / scale;
+					if (std::abs(x) >= 2.0) continue;
+					const double t = x / 2.0;
+					const double window = besselI0(4.0 * std::sqrt(1.0 - t * t)) / besselI0(4.0);
+					const double sinc = x == 0.0 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+					taps[i].push_back({ std::clamp(s, 0, sourceSize - 1), sinc * window });
+					sum += sinc * window;
+				}
+				for (auto& tap : taps[i])
+					tap.second /= sum;
+			}
+		}
+		return taps;
+	}
+
+	//Each level from the previous one, kept in linear double RGBA
+	std::vector<std::vector<double>> referenceMips(const Utils::ImageData& image, MipBuilder::Filter filter)
+	{
+		int width = image.width;
+		int height = image.height;
+		std::vector<std::vector<double>> levels(1, std::vector<double>(size_t(width) * height * 4));
+		for (size_t i = 0; i < levels[0].size(); ++i)
+		{
+			const uint8_t* bytes = image.levels[0].data();
+			if (image.format == TextureFormat::RGBA32Float)
+			{
+				float value;
+				memcpy(&value, bytes + 4 * i, 4);
+				levels[0][i] = value;
+			}
+			else if (image.format == TextureFormat::RGBA16Float)
+			{
+				uint16_t half;
+				memcpy(&half, bytes + 2 * i, 2);
+				levels[0][i] = halfToFloat(half);
+			}
+			else
+			{
+				levels[0][i] = image.srgb && i % 4 != 3 ? srgbToLinear(bytes[i] / 255.0) : bytes[i] / 255.0;
+			}
+		}
+		while (width > 1 || height > 1)
+		{
+			const int levelWidth = std::max(width / 2, 1);
+			const int levelHeight = std::max(height / 2, 1);
+			const auto columnTaps = referenceTaps(width, levelWidth, filter);
+			const auto rowTaps = referenceTaps(height, levelHeight, filter);
+			const std::vector<double>& source = levels.back();
+			std::vector<double> level(size_t(levelWidth) * levelHeight * 4, 0.0);
+			for (int y = 0; y < levelHeight; ++y)
+				for (int x = 0; x < levelWidth; ++x)
+					for (const auto& [sourceY, rowWeight] : rowTaps[y])
+						for (const auto& [sourceX, columnWeight] : columnTaps[x])
+							for (int c = 0; c < 4; ++c)
+								level[(size_t(y) * levelWidth + x) * 4 + c] += rowWeight * columnWeight * source[(size_t(sourceY) * width + sourceX) * 4 + c];
+			levels.push_back(std::move(level));
+			width = levelWidth;
+			height = levelHeight;
+		}
+		return levels;
+	}
+
+	Utils::ImageData createImage(int width, int height, TextureFormat format, bool srgb)
+	{
+		Utils::ImageData image;
+		image.width = width;
+		image.height = height;
+		image.format = format;
+		image.srgb = srgb;
+		const uint32_t texelBytes = Utils::getFormatBlock(format).bytes;
+		image.levels.push_back(std::vector<uint8_t>(size_t(width) * height * texelBytes));
+		Random random;
+		uint8_t* bytes = image.levels[0].data();
+		for (size_t i = 0; i < size_t(width) * height * 4; ++i)
+		{
+			//Smooth gradients with noise, HDR values up to 16 for the float formats
+			const size_t texel = i / 4;
+			const float gradient = float(texel % width) / width * 0.5f + float(texel / width) / height * 0.25f;
+			const float value = std::min(gradient + 0.25f * random.next(), 1.0f);
+			if (format == TextureFormat::RGBA32Float)
+			{
+				const float hdr = value * 16.0f;
+				memcpy(bytes + 4 * i, &hdr, 4);
+			}
+			else if (format == TextureFormat::RGBA16Float)
+			{
+				const uint16_t half = floatToHalf(value * 16.0f);
+				memcpy(bytes + 2 * i, &half, 2);
+			}
+			else
+			{
+				bytes[i] = static_cast<uint8_t>(std::lround(value * 255.0f));
+			}
+		}
+		return image;
+	}
+
+	//Largest difference with the reference over all the levels: in 8 bits steps, or relative for the float formats
+	double compare(const Utils::ImageData& image, const std::vector<std::vector<double>>& reference)
+	{
+		double maxError = 0.0;
+		for (size_t level = 1; level < reference.size(); ++level)
+		{
+			const uint8_t* bytes = image.levels[level].data();
+			for (size_t i = 0; i < reference[level].size(); ++i)
+			{
+				const double expected = reference[level][i];
+				double error = 0.0;
+				if (image.format == TextureFormat::RGBA32Float || image.format == TextureFormat::RGBA16Float)
+				{
+					float value;
+					if (image.format == TextureFormat::RGBA32Float)
+					{
+						memcpy(&value, bytes + 4 * i, 4);
+					}
+					else
+					{
+						uint16_t half;
+						memcpy(&half, bytes + 2 * i, 2);
+						value = halfToFloat(half);
+					}
+					//The negative lobes of the Kaiser filter are clamped to 0
+					error = std::abs(value - std::max(expected, 0.0)) / std::max(std::abs(expected), 1.0);
+				}
+				else
+				{
+					const double clamped = std::clamp(expected, 0.0, 1.0);
+					const double encoded = image.srgb && i % 4 != 3 ? linearToSrgb(clamped) : clamped;
+					error = std::abs(bytes[i] - encoded * 255.0);
+				}
+				maxError = std::max(maxError, error);
+			}
+		}
+		return maxError;
+	}
+
+	const char* toString(MipBuilder::Simd simd)
+	{
+		switch (simd)
+		{
+		case MipBuilder::Simd::AVX2: return "AVX2";
+		case MipBuilder::Simd::SSE2: return "SSE2";
+		default: return "scalar";
+		}
+	}
+
+	struct Format {
+		const char* name;
+		TextureFormat format;
+		bool srgb;
+		double tolerance; //8 bits steps, or relative error for the float formats
+	};
+
+	//The 8 bits results may round the other way than the reference, the halves are within their precision
+	const Format c_formats[] = {
+		{ "RGBA8", TextureFormat::RGBA8Unorm, false, 1.0 },
+		{ "RGBA8 sRGB", TextureFormat::RGBA8Unorm, true, 1.0 },
+		{ "RGBA16F", TextureFormat::RGBA16Float, false, 1.0e-3 },
+		{ "RGBA32F", TextureFormat::RGBA32Float, false, 1.0e-4 },
+	};
+
+	std::vector<MipBuilder::Simd> getSimds()
+	{
+		std::vector<MipBuilder::Simd> simds;
+		for (MipBuilder::Simd simd : { MipBuilder::Simd::None, MipBuilder::Simd::SSE2, MipBuilder::Simd::AVX2 })
+		{
+			MipBuilder::setSimd(simd);
+			if (MipBuilder::getSimd() == simd)
+				simds.push_back(simd);
+		}
+		return simds;
+	}
+
+	void checkCorrectness(const std::vector<MipBuilder::Simd>& simds)
+	{
+		//Odd, even, one texel wide or high, non power of two
+		const int sizes[][2] = { { 37, 23 }, { 1, 9 }, { 64, 1 }, { 5, 5 }, { 129, 67 }, { 256, 256 }, { 3, 2 } };
+		for (const Format& format : c_formats)
+		{
+			for (MipBuilder::Filter filter : { MipBuilder::Filter::Box, MipBuilder::Filter::Kaiser })
+			{
+				for (const auto& size : sizes)
+				{
+					const Utils::ImageData source = createImage(size[0], size[1], format.format, format.srgb);
+					const auto reference = referenceMips(source, filter);
+					for (MipBuilder::Simd simd : simds)
+					{
+						MipBuilder::setSimd(simd);
+						Utils::ImageData image = source;
+						const bool built = MipBuilder::build(image, filter);
+						const bool levels = built && image.levels.size() == reference.size();
+						const double error = levels ? compare(image, reference) : 0.0;
+						if (!levels || error > format.tolerance)
+						{
+							std::cout << "FAILED: " << format.name << (filter == MipBuilder::Filter::Box ? " box " : " Kaiser ") << size[0] << "x" << size[1]
+								<< " " << toString(simd) << ": " << (levels ? "error " + std::to_string(error) : "wrong level count") << std::endl;
+							s_failures++;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	void benchmark(const std::vector<MipBuilder::Simd>& simds, int size)
+	{
+		for (const Format& format : c_formats)
+		{
+			const Utils::ImageData source = createImage(size, size, format.format, format.srgb);
+			for (MipBuilder::Filter filter : { MipBuilder::Filter::Box, MipBuilder::Filter::Kaiser })
+			{
+				for (MipBuilder::Simd simd : simds)
+				{
+					MipBuilder::setSimd(simd);
+					//Best of 3, the first run also warms the thread pool
+					double best = 0.0;
+					for (int run = 0; run < 3; ++run)
+					{
+						Utils::ImageData image = source;
+						double milliseconds = 0.0;
+						MipBuilder::build(image, filter, &milliseconds);
+						best = run == 0 ? milliseconds : std::min(best, milliseconds);
+					}
+					std::cout << format.name << (filter == MipBuilder::Filter::Box ? " box " : " Kaiser ") << size << "x" << size << " " << toString(simd)
+						<< ": " << best << " ms, " << double(size) * size / 1000.0 / best << " Mtexels/s" << std::endl;
+				}
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const bool fullBenchmark = argc > 1 && std::strcmp(argv[1], "--bench") == 0;
+	const std::vector<MipBuilder::Simd> simds = getSimds();
+	std::cout << "MipBuilder: " << toString(simds.back()) << " CPU, " << ThreadPool::getInstance().getThreadCount() << " workers" << std::endl;
+
+	checkCorrectness(simds);
+	benchmark(simds, fullBenchmark ? 4096 : 512);
+
+	std::cout << (s_failures ? "FAILED" : "PASSED") << std::endl;
+	return s_failures ? 1 : 0;
+}
@@ -0,0 +1,293 @@
+#include "textureStreamer.h"
+
+#include <algorithm>
+
+#include "material.h"
+#include "managers.h"
+#include "shader.h"
+#include "pipeline.h"
+#include "pass.h"
+
+namespace
+{
+	constexpr uint32_t c_maxId = 0xffff;            //16 bits in the feedback pixels
+	constexpr uint64_t c_feedbackInterval = 4;      //Frames between two feedback passes
+	constexpr uint64_t c_requestFrames = 120;       //Frames a request keeps the levels wanted
+	constexpr size_t c_uploadBytesPerFrame = 16ull * 1024 * 1024;
+
+	Texture createTarget(const char* label, uint32_t width, uint32_t height, TextureFormat format, TextureUsage usage, TextureView* pView)
+	{
+		TextureDescriptor textureDesc;
+		textureDesc.label = label;
+		textureDesc.dimension = TextureDimension::e2D;
+		textureDesc.format = format;
+		textureDesc.mipLevelCount = 1;
+		textureDesc.sampleCount = 1;
+		textureDesc.size = { width, height, 1 };
+		textureDesc.usage = usage;
+		textureDesc.viewFormatCount = 0;
+		textureDesc.viewFormats = nullptr;
+		Texture texture = Context::getInstance().getDevice().CreateTexture(&textureDesc);
+
+		TextureViewDescriptor viewDesc;
+		viewDesc.format = format;
+		viewDesc.dimension = TextureViewDimension::e2D;
+		viewDesc.baseMipLevel = 0;
+		viewDesc.mipLevelCount = 1;
+		viewDesc.baseArrayLayer = 0;
+		viewDesc.arrayLayerCount = 1;
+		viewDesc.aspect = TextureAspect::All;
+		*pView = texture.CreateView(&viewDesc);
+		return texture;
+	}
+
+	//A block compressed texture needs whole blocks at its level 0
+	bool isCreatable(const Utils::ImageData& image, uint32_t level)
+	{
+		const Utils::FormatBlock block = Utils::getFormatBlock(image.format);
+		return std::max(uint32_t(image.width) >> level, 1u) % block.width == 0 && std::max(uint32_t(image.height) >> level, 1u) % block.height == 0;
+	}
+}
+
+void TextureStreamer::setFeedbackPass(Pass* pass, uint32_t viewportWidth, uint32_t viewportHeight, TextureFormat depthFormat)
+{
+	m_feedbackPass = pass;
+	m_feedbackWidth = std::max(viewportWidth / c_feedbackScale, 1u);
+	m_feedbackHeight = std::max(viewportHeight / c_feedbackScale, 1u);
+	m_feedbackRowBytes = (m_feedbackWidth * 4 + 255) / 256 * 256;
+
+	TextureView colorView = nullptr;
+	TextureView depthView = nullptr;
+	m_feedbackTexture = createTarget("feedback", m_feedbackWidth, m_feedbackHeight, TextureFormat::RGBA8Unorm, TextureUsage::RenderAttachment | TextureUsage::CopySrc, &colorView);
+	createTarget("feedbackDepth", m_feedbackWidth, m_feedbackHeight, depthFormat, TextureUsage::RenderAttachment, &depthView);
+	pass->setColorBuffer(colorView);
+	pass->setDepthBuffer(depthView);
+	pass->setClearColor(true);
+	pass->setClearColorValue(Color({ 0.0, 0.0, 0.0, 0.0 })); //Alpha 0: no request
+	pass->setImpostors(false);
+	pass->setEnabled(false);
+
+	BufferDescriptor bufferDesc;
+	bufferDesc.label = "feedbackReadback";
+	bufferDesc.size = uint64_t(m_feedbackRowBytes) * m_feedbackHeight;
+	bufferDesc.usage = BufferUsage::MapRead | BufferUsage::CopyDst;
+	bufferDesc.mappedAtCreation = false;
+	m_readback = Context::getInstance().getDevice().CreateBuffer(&bufferDesc);
+	m_readbackState = ReadbackState::Idle;
+}
+
+uint32_t TextureStreamer::add(Utils::ImageData&& image, const std::string& managerId)
+{
+	if (image.levels.empty() || image.levels.size() != Utils::getMipLevelCount(image.width, image.height) || m_entries.size() >= c_maxId)
+		return 0;
+
+	Entry entry;
+	const uint32_t levelCount = static_cast<uint32_t>(image.levels.size());
+	entry.finestLevel = 0;
+	while (entry.finestLevel < levelCount && !isCreatable(image, entry.finestLevel))
+		entry.finestLevel++;
+	if (entry.finestLevel == levelCount)
+		return 0;
+	entry.image = std::move(image);
+	entry.managerId = managerId;
+	//The first level under c_initialSize, else the coarsest one
+	entry.initialLevel = entry.finestLevel;
+	for (uint32_t level = entry.finestLevel; level < levelCount; ++level)
+	{
+		if (!isCreatable(entry.image, level)) continue;
+		entry.initialLevel = level;
+		if (std::max(uint32_t(entry.image.width) >> level, uint32_t(entry.image.height) >> level) <= c_initialSize) break;
+	}
+
+	while (m_nextId == 0 || m_nextId > c_maxId || m_entries.count(m_nextId))
+		m_nextId = m_nextId >= c_maxId ? 1 : m_nextId + 1;
+	const uint32_t id = m_nextId++;
+	Entry& added = m_entries[id] = std::move(entry);
+	setResidentLevel(added, added.initialLevel);
+	return id;
+}
+
+void TextureStreamer::remove(uint32_t id)
+{
+	m_entries.erase(id);
+}
+
+TextureView TextureStreamer::getTextureView(uint32_t id) const
+{
+	auto it = m_entries.find(id);
+	return it != m_entries.end() ? it->second.view : nullptr;
+}
+
+void TextureStreamer::addUser(uint32_t id, Material* material, const std::string& textureAttribute, const std::string& streamingAttribute)
+{
+	auto it = m_entries.find(id);
+	if (it == m_entries.end()) return;
+	Entry& entry = it->second;
+	entry.users.push_back({ material, textureAttribute });
+	material->setAttribute(textureAttribute, entry.view);
+	material->setAttribute(streamingAttribute, glm::vec4(float(id), float(entry.image.width), float(entry.image.height), 0.0f));
+}
+
+size_t TextureStreamer::getResidentBytes(const Entry& entry, uint32_t level)
+{
+	size_t bytes = 0;
+	for (size_t l = level; l < entry.image.levels.size(); ++l)
+		bytes += entry.image.levels[l].size();
+	return bytes;
+}
+
+uint32_t TextureStreamer::getCoarserLevel(const Entry& entry, uint32_t level)
+{
+	for (uint32_t l = level + 1; l <= entry.initialLevel; ++l)
+		if (isCreatable(entry.image, l)) return l;
+	return level;
+}
+
+uint32_t TextureStreamer::getFinerLevel(const Entry& entry, uint32_t level)
+{
+	for (uint32_t l = level; l-- > entry.finestLevel;)
+		if (isCreatable(entry.image, l)) return l;
+	return level;
+}
+
+void TextureStreamer::setResidentLevel(Entry& entry, uint32_t level)
+{
+	//The levels are all written again, the finest one is most of the bytes anyway
+	entry.texture = Utils::uploadImageData(entry.image, &entry.view, level);
+	entry.residentLevel = level;
+	const size_t bytes = getResidentBytes(entry, level);
+	m_uploadedThisFrame += bytes;
+	m_stats.uploadedBytes += bytes;
+
+	for (const User& user : entry.users)
+		user.material->setAttribute(user.textureAttribute, entry.view);
+	TextureManager::getInstance().update(entry.managerId, entry.view);
+}
+
+void TextureStreamer::readFeedback()
+{
+	const uint8_t* pixels = static_cast<const uint8_t*>(m_readback.GetConstMappedRange(0, uint64_t(m_feedbackRowBytes) * m_feedbackHeight));
+	std::unordered_map<uint32_t, uint32_t> requests;
+	for (uint32_t y = 0; y < m_feedbackHeight; ++y)
+	{
+		const uint8_t* row = pixels + size_t(y) * m_feedbackRowBytes;
+		for (uint32_t x = 0; x < m_feedbackWidth; ++x)
+		{
+			const uint8_t* pixel = row + 4 * x;
+			if (pixel[3] == 0) continue;
+			const uint32_t id = pixel[0] | (uint32_t(pixel[1]) << 8);
+			auto inserted = requests.insert({ id, pixel[2] });
+			inserted.first->second = std::min<uint32_t>(inserted.first->second, pixel[2]);
+		}
+	}
+	m_readback.Unmap();
+
+	for (const auto& [id, level] : requests)
+	{
+		auto it = m_entries.find(id);
+		if (it == m_entries.end()) continue;
+		it->second.requestedLevel = level;
+		it->second.lastRequest = m_frame;
+	}
+	m_stats.feedbackReads++;
+}
+
+void TextureStreamer::stream()
+{
+	auto getWantedLevel = [this](const Entry& entry) {
+		if (entry.lastRequest == 0 || m_frame - entry.lastRequest > c_requestFrames)
+			return entry.initialLevel;
+		return std::clamp(entry.requestedLevel, entry.finestLevel, entry.initialLevel);
+	};
+
+	size_t residentBytes = 0;
+	std::vector<Entry*> growing;
+	std::vector<Entry*> shrinkable;
+	for (auto& [id, entry] : m_entries)
+	{
+		residentBytes += getResidentBytes(entry, entry.residentLevel);
+		const uint32_t wanted = getWantedLevel(entry);
+		if (entry.residentLevel > wanted && getFinerLevel(entry, entry.residentLevel) != entry.residentLevel)
+			growing.push_back(&entry);
+		else if (entry.residentLevel < wanted)
+			shrinkable.push_back(&entry);
+	}
+	//The largest missing detail first, the textures seen the longest ago are dropped first
+	std::sort(growing.begin(), growing.end(), [&getWantedLevel](const Entry* a, const Entry* b) {
+		return a->residentLevel - getWantedLevel(*a) > b->residentLevel - getWantedLevel(*b);
+	});
+	std::sort(shrinkable.begin(), shrinkable.end(), [](const Entry* a, const Entry* b) { return a->lastRequest < b->lastRequest; });
+
+	size_t nextShrinkable = 0;
+	for (Entry* entry : growing)
+	{
+		if (m_uploadedThisFrame >= c_uploadBytesPerFrame) break;
+		//One level per update, the coarse levels are in place while the finer ones come
+		const uint32_t level = getFinerLevel(*entry, entry->residentLevel);
+		const size_t growth = getResidentBytes(*entry, level) - getResidentBytes(*entry, entry->residentLevel);
+		while (residentBytes + growth > m_budget && nextShrinkable < shrinkable.size())
+		{
+			Entry& dropped = *shrinkable[nextShrinkable++];
+			const size_t before = getResidentBytes(dropped, dropped.residentLevel);
+			setResidentLevel(dropped, getWantedLevel(dropped));
+			residentBytes -= before - getResidentBytes(dropped, dropped.residentLevel);
+		}
+		if (residentBytes + growth > m_budget) break;
+		setResidentLevel(*entry, level);
+		residentBytes += growth;
+	}
+
+	m_stats.textureCount = m_entries.size();
+	m_stats.residentBytes = residentBytes;
+	m_stats.fullBytes = 0;
+	for (const auto& [id, entry] : m_entries)
+		m_stats.fullBytes += getResidentBytes(entry, entry.finestLevel);
+}
+
+void TextureStreamer::update()
+{
+	m_frame++;
+	m_uploadedThisFrame = 0;
+	if (m_readbackState == ReadbackState::Mapped)
+	{
+		readFeedback();
+		m_readbackState = ReadbackState::Idle;
+	}
+
+	stream();
+
+	if (!m_feedbackPass) return;
+	const bool feedback = m_readbackState == ReadbackState::Idle && !m_entries.empty() && m_frame - m_lastFeedbackFrame >= c_feedbackInterval;
+	m_feedbackPass->setEnabled(feedback);
+	if (feedback)
+	{
+		m_readbackState = ReadbackState::Rendered;
+		m_lastFeedbackFrame = m_frame;
+	}
+}
+
+void TextureStreamer::endFrame()
+{
+	if (m_readbackState != ReadbackState::Rendered) return;
+
+	Device device = Context::getInstance().getDevice();
+	ImageCopyTexture source;
+	source.texture = m_feedbackTexture;
+	ImageCopyBuffer destination;
+	destination.buffer = m_readback;
+	destination.layout.bytesPerRow = m_feedbackRowBytes;
+	destination.layout.rowsPerImage = m_feedbackHeight;
+	Extent3D size = { m_feedbackWidth, m_feedbackHeight, 1 };
+	CommandEncoder encoder = device.CreateCommandEncoder();
+	encoder.CopyTextureToBuffer(&source, &destination, &size);
+	CommandBuffer command = encoder.Finish();
+	device.GetQueue().Submit(1, &command);
+
+	//Mapped during a later Device::Tick, read by the next update after that
+	m_readbackState = ReadbackState::Mapping;
+	auto onMapped = [](WGPUBufferMapAsyncStatus status, void* userdata) {
+		TextureStreamer* streamer = static_cast<TextureStreamer*>(userdata);
+		streamer->m_readbackState = status == WGPUBufferMapAsyncStatus_Success ? ReadbackState::Mapped : ReadbackState::Idle;
+	};
+	m_readback.MapAsync(MapMode::Read, 0, uint64_t(m_feedbackRowBytes) * m_feedbackHeight, onMapped, this);
+}
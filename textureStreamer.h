@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "utils.h"
+
+class Material;
+class Pass;
+
+// Mip streaming of the material textures: each texture starts with its small levels only (at most c_initialSize),
+// the finer ones are uploaded as the camera gets close, under a budget of GPU memory.
+// The levels needed come from a feedback pass (see feedback.wgsl), rendered at low resolution every few frames:
+// each pixel records the streamed texture it samples and the mip level it would use. The pass is read back
+// asynchronously, so the streaming follows the view with a few frames of delay.
+// The whole mip chain stays on the CPU. A texture changing of resident levels is recreated, its users
+// (material attributes, TextureManager entry) get the new view.
+class TextureStreamer
+{
+public:
+	static TextureStreamer& getInstance() {
+		static TextureStreamer textureStreamer;
+		return textureStreamer;
+	};
+
+	static constexpr uint32_t c_initialSize = 64;  //Largest side of the levels resident at first
+	static constexpr uint32_t c_feedbackScale = 8; //The feedback pass is rendered at 1/c_feedbackScale of the viewport
+
+	struct Stats {
+		size_t textureCount = 0;
+		size_t residentBytes = 0;
+		size_t fullBytes = 0;      //With every level resident
+		size_t uploadedBytes = 0;  //Since the start
+		size_t feedbackReads = 0;
+	};
+
+	//Its color and depth targets are created here, at 1/c_feedbackScale of the viewport size.
+	//The pass draws the streamed materials with the feedback shader, it is enabled by update when a feedback is wanted.
+	void setFeedbackPass(Pass* pass, uint32_t viewportWidth, uint32_t viewportHeight, TextureFormat depthFormat);
+	//GPU memory of the streamed textures, the finer levels are dropped from the textures not seen recently to stay under it
+	void setBudget(size_t bytes) { m_budget = bytes; }
+	size_t getBudget() const { return m_budget; }
+
+	//Takes an image with its whole mip chain, returns its id (0 when the image cannot be streamed: it is then not taken).
+	//managerId: the TextureManager entry updated with the new views, when it exists.
+	uint32_t add(Utils::ImageData&& image, const std::string& managerId);
+	void remove(uint32_t id);
+	TextureView getTextureView(uint32_t id) const;
+	//Sets the texture attribute of the material, and the vec4 streamingAttribute read by the feedback shader
+	//(id, width, height of the level 0). Updated with each new view until the texture is removed.
+	void addUser(uint32_t id, Material* material, const std::string& textureAttribute, const std::string& streamingAttribute);
+
+	//Before Renderer::draw: reads the last feedback, uploads or drops levels, enables the feedback pass
+	void update();
+	//After Renderer::draw: copies the feedback rendered this frame for its readback
+	void endFrame();
+
+	const Stats& getStats() const { return m_stats; }
+
+private:
+	TextureStreamer() = default;
+	~TextureStreamer() = default;
+
+	struct User {
+		Material* material;
+		std::string textureAttribute;
+	};
+
+	struct Entry {
+		Utils::ImageData image;
+		std::string managerId;
+		Texture texture{ nullptr };
+		TextureView view{ nullptr };
+		uint32_t residentLevel = 0; //Finest level on the GPU
+		uint32_t finestLevel = 0;   //Finest level a texture can be created from (whole blocks for the compressed formats)
+		uint32_t initialLevel = 0;
+		uint32_t requestedLevel = UINT32_MAX; //From the last feedback seeing the texture
+		uint64_t lastRequest = 0;             //Frame of that feedback
+		std::vector<User> users;
+	};
+
+	static size_t getResidentBytes(const Entry& entry, uint32_t level);
+	//Next coarser or finer level the texture can be created from, level itself when there is none
+	static uint32_t getCoarserLevel(const Entry& entry, uint32_t level);
+	static uint32_t getFinerLevel(const Entry& entry, uint32_t level);
+	void setResidentLevel(Entry& entry, uint32_t level);
+	void readFeedback();
+	void stream();
+
+	std::unordered_map<uint32_t, Entry> m_entries;
+	uint32_t m_nextId = 1;
+	size_t m_budget = 256ull * 1024 * 1024;
+	size_t m_uploadedThisFrame = 0;
+	uint64_t m_frame = 0;
+	Stats m_stats;
+
+	Pass* m_feedbackPass = nullptr;
+	Texture m_feedbackTexture{ nullptr };
+	uint32_t m_feedbackWidth = 0;
+	uint32_t m_feedbackHeight = 0;
+	uint32_t m_feedbackRowBytes = 0; //Padded to 256 bytes for the copy
+	Buffer m_readback{ nullptr };
+	enum class ReadbackState { Idle, Rendered, Mapping, Mapped };
+	ReadbackState m_readbackState = ReadbackState::Idle;
+	uint64_t m_lastFeedbackFrame = 0;
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for the CPU side of the asset import (decoding, mesh processing...).
+// GPU objects must still be created on the main thread.
+class ThreadPool
+{
+public:
+	ThreadPool(size_t threadCount = std::max(1u, std::thread::hardware_concurrency()) - 1)
+	{
+		threadCount = std::max<size_t>(threadCount, 1);
+		for (size_t i = 0; i < threadCount; ++i)
+			m_workers.emplace_back([this]() { workerLoop(); });
+	};
+	~ThreadPool()
+	{
+		stop();
+	};
+
+	static ThreadPool& getInstance() {
+		static ThreadPool threadPool;
+		return threadPool;
+	};
+
+	size_t getThreadCount() const { return m_workers.size(); }
+
+	//For the benchmarks scaling with the core count: runs the queued tasks, then restarts with threadCount workers.
+	//Not to call from a task, or while tasks are being submitted.
+	void setThreadCount(size_t threadCount)
+	{
+		stop();
+		m_workers.clear();
+		m_stop = false;
+		for (size_t i = 0; i < std::max<size_t>(threadCount, 1); ++i)
+			m_workers.emplace_back([this]() { workerLoop(); });
+	}
+
+	template<typename F>
+	auto submit(F&& task) -> std::future<decltype(task())>
+	{
+		using Result = decltype(task());
+		auto packagedTask = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+		std::future<Result> future = packagedTask->get_future();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tasks.push([packagedTask]() { (*packagedTask)(); });
+		}
+		m_condition.notify_one();
+		return future;
+	}
+
+	//Runs task(i) for i in [0, count) on the workers and on the calling thread, returns once all are done.
+	//The calling thread takes its share of the work, so it can be nested in a task without deadlocking.
+	void parallelFor(size_t count, std::function<void(size_t)> task)
+	{
+		if (count == 0) return;
+		struct State {
+			std::function<void(size_t)> task;
+			size_t count = 0;
+			std::atomic<size_t> next{ 0 };
+			std::atomic<size_t> done{ 0 };
+			std::mutex mutex;
+			std::condition_variable finished;
+		};
+		auto state = std::make_shared<State>();
+		state->task = std::move(task);
+		state->count = count;
+
+		auto run = [state]() {
+			size_t i;
+			while ((i = state->next.fetch_add(1)) < state->count)
+			{
+				state->task(i);
+				if (state->done.fetch_add(1) + 1 == state->count)
+				{
+					std::lock_guard<std::mutex> lock(state->mutex);
+					state->finished.notify_all();
+				}
+			}
+		};
+
+		size_t helpers = std::min(count - 1, m_workers.size());
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (size_t i = 0; i < helpers; ++i)
+				m_tasks.push(run);
+		}
+		m_condition.notify_all();
+
+		run();
+		std::unique_lock<std::mutex> lock(state->mutex);
+		state->finished.wait(lock, [&state]() { return state->done.load() == state->count; });
+	}
+
+private:
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_condition.notify_all();
+		for (auto& worker : m_workers)
+			worker.join();
+	}
+
+	void workerLoop()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+				if (m_stop && m_tasks.empty()) return;
+				task = std::move(m_tasks.front());
+				m_tasks.pop();
+			}
+			task();
+		}
+	}
+
+	std::vector<std::thread> m_workers;
+	std::queue<std::function<void()>> m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_stop = false;
+};
@@ -12,7 +12,7 @@
 #include<vector>
 
 
-#define UNIFORMS_MAX 64
+#define UNIFORMS_MAX 128
 
 #include <webgpu/webgpu_cpp.h>
 using namespace wgpu;
@@ -1,5 +1,7 @@
 
 #include "utils.h"
+#include "mipGenerator.h"
+#include "hdrEncoder.h"
 
 
 
@@ -203,97 +205,122 @@ std::string Utils::getFileExtension(const std::string& filePath) {
 	return filePath.substr(dotPosition + 1);
 }
 
-// Auxiliary function for loadTexture
-template<typename T>
-static void writeMipMaps(
-	Texture texture,
-	Extent3D textureSize,
-	uint32_t mipLevelCount,
-	const T* pixelData
-) {
-	Queue queue = Context::getInstance().getDevice().GetQueue();
+uint32_t Utils::getMipLevelCount(uint32_t width, uint32_t height) {
+	uint32_t levelCount = 1;
+	while ((std::max(width, height) >> levelCount) > 0) levelCount++;
+	return levelCount;
+}
 
-	// Arguments telling which part of the texture we upload to
-	ImageCopyTexture destination;
-	destination.texture = texture;
-	destination.origin = { 0, 0, 0 };
-	destination.aspect = TextureAspect::All;
+Utils::ImageData Utils::createImageData(void* pixelData, int width, int height, TextureFormat format) {
+	ImageData image;
+	if (!pixelData) return image;
 
-	// Arguments telling how the C++ side pixel memory is laid out
-	TextureDataLayout source;
-	source.offset = 0;
+	image.width = width;
+	image.height = height;
+	image.format = format;
+	const uint8_t* bytes = static_cast<const uint8_t*>(pixelData);
+	image.levels.emplace_back(bytes, bytes + size_t(width) * height * getFormatBlock(format).bytes);
 
-	// Create image data
-	Extent3D mipLevelSize = textureSize;
-	std::vector<T> previousLevelPixels;
-	Extent3D previousMipLevelSize;
-	for (uint32_t level = 0; level < mipLevelCount; ++level) {
-		std::vector<T> pixels(4 * mipLevelSize.width * mipLevelSize.height);
-		if (level == 0) {
-			// We cannot really avoid this copy since we need this
-			// in previousLevelPixels at the next iteration
-			memcpy(pixels.data(), pixelData, pixels.size() * sizeof(T));
-		}
-		else {
-			// Create mip level data
-			for (uint32_t i = 0; i < mipLevelSize.width; ++i) {
-				for (uint32_t j = 0; j < mipLevelSize.height; ++j) {
-					T* p = &pixels[4 * (j * mipLevelSize.width + i)];
-					// Get the corresponding 4 pixels from the previous level
-					T* p00 = &previousLevelPixels[4 * ((2 * j + 0) * previousMipLevelSize.width + (2 * i + 0))];
-					T* p01 = &previousLevelPixels[4 * ((2 * j + 0) * previousMipLevelSize.width + (2 * i + 1))];
-					T* p10 = &previousLevelPixels[4 * ((2 * j + 1) * previousMipLevelSize.width + (2 * i + 0))];
-					T* p11 = &previousLevelPixels[4 * ((2 * j + 1) * previousMipLevelSize.width + (2 * i + 1))];
-					// Average
-					p[0] = (p00[0] + p01[0] + p10[0] + p11[0]) / (T)4;
-					p[1] = (p00[1] + p01[1] + p10[1] + p11[1]) / (T)4;
-					p[2] = (p00[2] + p01[2] + p10[2] + p11[2]) / (T)4;
-					p[3] = (p00[3] + p01[3] + p10[3] + p11[3]) / (T)4;
-				}
-			}
-		}
-
-		// Upload data to the GPU texture
-		destination.mipLevel = level;
-		source.bytesPerRow = 4 * mipLevelSize.width * sizeof(T);
-		source.rowsPerImage = mipLevelSize.height;
-		queue.WriteTexture(&destination, pixels.data(), pixels.size() * sizeof(T), &source, &mipLevelSize);
-
-		previousLevelPixels = std::move(pixels);
-		previousMipLevelSize = mipLevelSize;
-		mipLevelSize.width /= 2;
-		mipLevelSize.height /= 2;
-	}
+	stbi_image_free(pixelData);
+	// (Do not use data after this)
+	return image;
 }
 
-static uint32_t bit_width(uint32_t m) {
-	if (m == 0) return 0;
-	else { uint32_t w = 0; while (m >>= 1) ++w; return w; }
+Utils::FormatBlock Utils::getFormatBlock(TextureFormat format) {
+	switch (format) {
+	case TextureFormat::BC1RGBAUnorm:
+	case TextureFormat::BC1RGBAUnormSrgb:
+	case TextureFormat::BC4RUnorm:
+	case TextureFormat::BC4RSnorm:
+	case TextureFormat::ETC2RGB8Unorm:
+	case TextureFormat::ETC2RGB8UnormSrgb:
+	case TextureFormat::ETC2RGB8A1Unorm:
+	case TextureFormat::ETC2RGB8A1UnormSrgb:
+	case TextureFormat::EACR11Unorm:
+	case TextureFormat::EACR11Snorm:
+		return { 4, 4, 8 };
+	case TextureFormat::BC2RGBAUnorm:
+	case TextureFormat::BC2RGBAUnormSrgb:
+	case TextureFormat::BC3RGBAUnorm:
+	case TextureFormat::BC3RGBAUnormSrgb:
+	case TextureFormat::BC5RGUnorm:
+	case TextureFormat::BC5RGSnorm:
+	case TextureFormat::BC6HRGBUfloat:
+	case TextureFormat::BC6HRGBFloat:
+	case TextureFormat::BC7RGBAUnorm:
+	case TextureFormat::BC7RGBAUnormSrgb:
+	case TextureFormat::ETC2RGBA8Unorm:
+	case TextureFormat::ETC2RGBA8UnormSrgb:
+	case TextureFormat::EACRG11Unorm:
+	case TextureFormat::EACRG11Snorm:
+		return { 4, 4, 16 };
+	case TextureFormat::ASTC4x4Unorm: case TextureFormat::ASTC4x4UnormSrgb: return { 4, 4, 16 };
+	case TextureFormat::ASTC5x4Unorm: case TextureFormat::ASTC5x4UnormSrgb: return { 5, 4, 16 };
+	case TextureFormat::ASTC5x5Unorm: case TextureFormat::ASTC5x5UnormSrgb: return { 5, 5, 16 };
+	case TextureFormat::ASTC6x5Unorm: case TextureFormat::ASTC6x5UnormSrgb: return { 6, 5, 16 };
+	case TextureFormat::ASTC6x6Unorm: case TextureFormat::ASTC6x6UnormSrgb: return { 6, 6, 16 };
+	case TextureFormat::ASTC8x5Unorm: case TextureFormat::ASTC8x5UnormSrgb: return { 8, 5, 16 };
+	case TextureFormat::ASTC8x6Unorm: case TextureFormat::ASTC8x6UnormSrgb: return { 8, 6, 16 };
+	case TextureFormat::ASTC8x8Unorm: case TextureFormat::ASTC8x8UnormSrgb: return { 8, 8, 16 };
+	case TextureFormat::ASTC10x5Unorm: case TextureFormat::ASTC10x5UnormSrgb: return { 10, 5, 16 };
+	case TextureFormat::ASTC10x6Unorm: case TextureFormat::ASTC10x6UnormSrgb: return { 10, 6, 16 };
+	case TextureFormat::ASTC10x8Unorm: case TextureFormat::ASTC10x8UnormSrgb: return { 10, 8, 16 };
+	case TextureFormat::ASTC10x10Unorm: case TextureFormat::ASTC10x10UnormSrgb: return { 10, 10, 16 };
+	case TextureFormat::ASTC12x10Unorm: case TextureFormat::ASTC12x10UnormSrgb: return { 12, 10, 16 };
+	case TextureFormat::ASTC12x12Unorm: case TextureFormat::ASTC12x12UnormSrgb: return { 12, 12, 16 };
+	case TextureFormat::RGBA16Float:
+		return { 1, 1, 8 };
+	case TextureFormat::RGBA32Float:
+		return { 1, 1, 16 };
+	default:
+		return { 1, 1, 4 };
+	}
 }
-Texture Utils::loadTexture(void* pixelData, int& width, int& height, int& channels, TextureFormat format, TextureView* pTextureView) {
 
-	assert(pixelData);
+Texture Utils::uploadImageData(const ImageData& image, TextureView* pTextureView, uint32_t firstLevel) {
+
+	assert(firstLevel < image.levels.size());
+
+	//A single uncompressed level gets its mips from the GPU
+	const bool generateMips = image.levels.size() == 1 && MipGenerator::supports(image.format);
 
 	// Use the width, height, channels and data variables here
 	TextureDescriptor textureDesc;
 	textureDesc.dimension = TextureDimension::e2D;
-	textureDesc.format = format; // by convention for bmp, png and jpg file. Be careful with other formats.
-	textureDesc.size = { (unsigned int)width, (unsigned int)height, 1 };
-	textureDesc.mipLevelCount = bit_width(std::max(textureDesc.size.width, textureDesc.size.height));
+	textureDesc.format = image.format; // by convention for bmp, png and jpg file. Be careful with other formats.
+	textureDesc.size = { std::max((uint32_t)image.width >> firstLevel, 1u), std::max((uint32_t)image.height >> firstLevel, 1u), 1 };
+	textureDesc.mipLevelCount = generateMips ? getMipLevelCount(image.width, image.height) : static_cast<uint32_t>(image.levels.size()) - firstLevel;
 	textureDesc.sampleCount = 1;
-	textureDesc.usage = TextureUsage::TextureBinding | TextureUsage::CopyDst;
+	//CopySrc: the TextureManager copies the coarse levels of the textures it evicts
+	textureDesc.usage = TextureUsage::TextureBinding | TextureUsage::CopyDst | TextureUsage::CopySrc;
+	if (generateMips)
+		textureDesc.usage |= TextureUsage::StorageBinding;
 	textureDesc.viewFormatCount = 0;
 	textureDesc.viewFormats = nullptr;
 	Texture texture = Context::getInstance().getDevice().CreateTexture(&textureDesc);
 
 	// Upload data to the GPU texture
-	if(format != TextureFormat::RGBA32Float)
-		writeMipMaps<unsigned char>(texture, textureDesc.size, textureDesc.mipLevelCount, (unsigned char*)pixelData);
-	else
-		writeMipMaps<float>(texture, textureDesc.size, textureDesc.mipLevelCount, (float*)pixelData);
-
-	stbi_image_free(pixelData);
-	// (Do not use data after this)
+	Queue queue = Context::getInstance().getDevice().GetQueue();
+	ImageCopyTexture destination;
+	destination.texture = texture;
+	destination.origin = { 0, 0, 0 };
+	destination.aspect = TextureAspect::All;
+	TextureDataLayout source;
+	source.offset = 0;
+	//The compressed levels are copied in whole blocks, the last ones are larger than the level
+	const FormatBlock block = getFormatBlock(image.format);
+	for (uint32_t level = 0; level + firstLevel < image.levels.size(); ++level) {
+		const std::vector<uint8_t>& bytes = image.levels[firstLevel + level];
+		const uint32_t blocksWide = (std::max(textureDesc.size.width >> level, 1u) + block.width - 1) / block.width;
+		const uint32_t blocksHigh = (std::max(textureDesc.size.height >> level, 1u) + block.height - 1) / block.height;
+		Extent3D mipLevelSize = { blocksWide * block.width, blocksHigh * block.height, 1 };
+		destination.mipLevel = level;
+		source.bytesPerRow = static_cast<uint32_t>(bytes.size() / blocksHigh);
+		source.rowsPerImage = blocksHigh;
+		queue.WriteTexture(&destination, bytes.data(), bytes.size(), &source, &mipLevelSize);
+	}
+	if (generateMips)
+		MipGenerator::getInstance().generate(texture, image.format, textureDesc.size.width, textureDesc.size.height, textureDesc.mipLevelCount, image.srgb);
 
 	if (pTextureView) {
 		TextureViewDescriptor textureViewDesc;
@@ -310,7 +337,13 @@ Texture Utils::loadTexture(void* pixelData, int& width, int& height, int& channe
 	return texture;
 }
 
-Texture Utils::loadImageFromPath(const std::string& path, TextureView* pTextureView, bool hdr) {
+Texture Utils::loadTexture(void* pixelData, int& width, int& height, TextureFormat format, TextureView* pTextureView) {
+
+	assert(pixelData);
+	return uploadImageData(createImageData(pixelData, width, height, format), pTextureView);
+}
+
+Utils::ImageData Utils::decodeImageFromPath(const std::string& path, bool hdr, TextureFormat hdrFormat) {
 	int width, height, channels;
 	void* data = nullptr;
 	TextureFormat format = TextureFormat::Undefined;
@@ -329,5 +362,16 @@ Texture Utils::loadImageFromPath(const std::string& path, TextureView* pTextureV
 		std::cerr << "Failed to load image from path: " << path << std::endl;
 	}
 
-	return loadTexture(data, width, height, channels, format, pTextureView);
-}
\ No newline at end of file
+	ImageData image = createImageData(data, width, height, format);
+	if (hdr && !image.levels.empty() && hdrFormat != format)
+	{
+		double milliseconds = 0.0;
+		HdrEncoder::encode(image, hdrFormat, &milliseconds);
+		std::cout << "HDR image " << path << " (" << width << "x" << height << ") converted in " << milliseconds << " ms" << std::endl;
+	}
+	return image;
+}
+
+Texture Utils::loadImageFromPath(const std::string& path, TextureView* pTextureView, bool hdr) {
+	return uploadImageData(decodeImageFromPath(path, hdr), pTextureView);
+}
@@ -30,7 +30,40 @@ namespace Utils
 
 	std::string getFileExtension(const std::string& filePath);
 	
-	Texture loadTexture(void* pixelData, int& width, int& height, int& channels, TextureFormat format, TextureView* pTextureView = nullptr);
+	//Pixels of an image and of its mip chain (RGBA, rows tightly packed), level 0 first.
+	//For the block compressed formats, the rows of blocks of each level (see Ktx2Reader).
+	//Built on any thread by createImageData/decodeImage*, the texture is created on the main thread by uploadImageData.
+	//A single level gets its mips built on the GPU at upload (see MipGenerator), or on the CPU by MipBuilder.
+	struct ImageData {
+		int width = 0;
+		int height = 0;
+		TextureFormat format = TextureFormat::Undefined;
+		bool srgb = false; //sRGB encoded colors in a Unorm format, their mips are averaged in linear space
+		std::vector<std::vector<uint8_t>> levels;
+	};
+
+	//Levels down to 1x1
+	uint32_t getMipLevelCount(uint32_t width, uint32_t height);
+
+	//Texels per block and bytes per block of a format, 1x1 for the uncompressed ones
+	struct FormatBlock {
+		uint32_t width = 1;
+		uint32_t height = 1;
+		uint32_t bytes = 4;
+	};
+
+	FormatBlock getFormatBlock(TextureFormat format);
+
+	//Takes the stb_image pixels (freed) as the level 0, empty ImageData when they are null
+	ImageData createImageData(void* pixelData, int width, int height, TextureFormat format);
+
+	//firstLevel: the texture only holds the levels from this one (see TextureStreamer)
+	Texture uploadImageData(const ImageData& image, TextureView* pTextureView = nullptr, uint32_t firstLevel = 0);
+
+	Texture loadTexture(void* pixelData, int& width, int& height, TextureFormat format, TextureView* pTextureView = nullptr);
+
+	//hdr: decoded in float, then converted to hdrFormat (see HdrEncoder)
+	ImageData decodeImageFromPath(const std::string& path, bool hdr = false, TextureFormat hdrFormat = TextureFormat::RGB9E5Ufloat);
 
 	Texture loadImageFromPath(const std::string& path, TextureView* pTextureView = nullptr, bool hdr = false);
 }
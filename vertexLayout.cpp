@@ -0,0 +1,220 @@
+#include "vertexLayout.h"
+
+#include <algorithm>
+#include <cstring>
+
+uint32_t getVertexFormatSize(VertexFormat format)
+{
+	switch (format)
+	{
+	case VertexFormat::Unorm16x2:
+	case VertexFormat::Snorm16x2:
+	case VertexFormat::Float16x2:
+	case VertexFormat::Float32:    return 4;
+	case VertexFormat::Unorm16x4:
+	case VertexFormat::Snorm16x4:
+	case VertexFormat::Float16x4:
+	case VertexFormat::Float32x2:  return 8;
+	case VertexFormat::Float32x3:  return 12;
+	case VertexFormat::Float32x4:  return 16;
+	default:
+		assert(false); //Not used by the vertex layouts
+		return 0;
+	}
+}
+
+void VertexLayout::addAttribute(VertexSemantic semantic, VertexFormat format, uint32_t stream)
+{
+	assert(!hasAttribute(semantic));
+	assert(stream <= m_strides.size()); //Streams are added in order
+	if (stream == m_strides.size())
+		m_strides.push_back(0);
+	m_attributes.push_back({ semantic, format, m_strides[stream], stream });
+	m_strides[stream] += getVertexFormatSize(format);
+	//FNV-1a on (semantic, format, stream), the offsets follow from the order
+	updateKey((static_cast<uint64_t>(stream) << 40) | (static_cast<uint64_t>(semantic) << 32) | static_cast<uint64_t>(format));
+}
+
+void VertexLayout::addAttribute(VertexSemantic semantic, VertexFormat format, uint32_t stream, uint32_t offset)
+{
+	assert(!hasAttribute(semantic));
+	assert(offset % 4 == 0);
+	if (stream >= m_strides.size())
+		m_strides.resize(stream + 1, 0);
+	m_attributes.push_back({ semantic, format, offset, stream });
+	m_strides[stream] = std::max(m_strides[stream], offset + getVertexFormatSize(format));
+	updateKey((static_cast<uint64_t>(offset) << 48) | (static_cast<uint64_t>(stream) << 40) | (static_cast<uint64_t>(semantic) << 32) | static_cast<uint64_t>(format));
+}
+
+void VertexLayout::setStride(uint32_t stream, uint32_t stride)
+{
+	assert(stream < m_strides.size() && stride >= m_strides[stream] && stride % 4 == 0);
+	m_strides[stream] = stride;
+	updateKey((static_cast<uint64_t>(1) << 63) | (static_cast<uint64_t>(stream) << 40) | stride);
+}
+
+uint32_t VertexLayout::getVertexSize() const
+{
+	uint32_t size = 0;
+	for (uint32_t stride : m_strides)
+		size += stride;
+	return size;
+}
+
+const VertexLayout::Attribute* VertexLayout::getAttribute(VertexSemantic semantic) const
+{
+	for (const auto& attribute : m_attributes)
+	{
+		if (attribute.semantic == semantic)
+			return &attribute;
+	}
+	return nullptr;
+}
+
+bool VertexLayout::hasQuantizedPositions() const
+{
+	const Attribute* position = getAttribute(VertexSemantic::Position);
+	return position && (position->format == VertexFormat::Unorm16x4 || position->format == VertexFormat::Unorm16x2);
+}
+
+std::string VertexLayout::getSemanticName(VertexSemantic semantic)
+{
+	switch (semantic)
+	{
+	case VertexSemantic::Position: return "position";
+	case VertexSemantic::Normal:   return "normal";
+	case VertexSemantic::Tangent:  return "tangent";
+	case VertexSemantic::TexCoord: return "uv";
+	default: assert(false); return "";
+	}
+}
+
+const VertexLayout& VertexLayout::getStandard()
+{
+	static VertexLayout standard = []() {
+		VertexLayout layout;
+		layout.addAttribute(VertexSemantic::Position, VertexFormat::Float32x3);
+		layout.addAttribute(VertexSemantic::Normal, VertexFormat::Float32x3);
+		layout.addAttribute(VertexSemantic::Tangent, VertexFormat::Float32x3);
+		layout.addAttribute(VertexSemantic::TexCoord, VertexFormat::Float32x2);
+		return layout;
+	}();
+	return standard;
+}
+
+VertexLayout VertexLayout::getStandardSplit()
+{
+	VertexLayout layout;
+	layout.addAttribute(VertexSemantic::Position, VertexFormat::Float32x3, 0);
+	layout.addAttribute(VertexSemantic::Normal, VertexFormat::Float32x3, 1);
+	layout.addAttribute(VertexSemantic::Tangent, VertexFormat::Float32x3, 1);
+	layout.addAttribute(VertexSemantic::TexCoord, VertexFormat::Float32x2, 1);
+	return layout;
+}
+
+VertexLayout VertexLayout::getQuantized(bool normalizedUVs, bool splitPositions)
+{
+	const uint32_t stream = splitPositions ? 1 : 0;
+	VertexLayout layout;
+	layout.addAttribute(VertexSemantic::Position, VertexFormat::Unorm16x4, 0);
+	layout.addAttribute(VertexSemantic::Normal, VertexFormat::Snorm16x2, stream);
+	layout.addAttribute(VertexSemantic::Tangent, VertexFormat::Snorm16x2, stream);
+	//unorm16 is more precise in [0, 1], float16 handles the tiled uvs
+	layout.addAttribute(VertexSemantic::TexCoord, normalizedUVs ? VertexFormat::Unorm16x2 : VertexFormat::Float16x2, stream);
+	return layout;
+}
+
+VertexLayout VertexLayout::select(const std::vector<Vertex>& vertices, bool quantized, bool splitPositions)
+{
+	if (!quantized) return splitPositions ? getStandardSplit() : getStandard();
+	bool normalizedUVs = std::all_of(vertices.begin(), vertices.end(), [](const Vertex& vertex) {
+		return vertex.uv.x >= 0.0f && vertex.uv.x <= 1.0f && vertex.uv.y >= 0.0f && vertex.uv.y <= 1.0f;
+	});
+	return getQuantized(normalizedUVs, splitPositions);
+}
+
+namespace
+{
+	//Octahedral mapping of a unit vector to [-1, 1]^2
+	glm::vec2 octEncode(glm::vec3 n)
+	{
+		float length = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		if (length == 0.0f) return glm::vec2(0.0f);
+		n /= length;
+		glm::vec2 p(n.x, n.y);
+		if (n.z < 0.0f)
+		{
+			p.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+			p.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+		}
+		return p;
+	}
+
+	void encodeAttribute(uint8_t* dst, VertexFormat format, const glm::vec4& value)
+	{
+		switch (format)
+		{
+		case VertexFormat::Float32x2: memcpy(dst, &value, 2 * sizeof(float)); break;
+		case VertexFormat::Float32x3: memcpy(dst, &value, 3 * sizeof(float)); break;
+		case VertexFormat::Float32x4: memcpy(dst, &value, 4 * sizeof(float)); break;
+		case VertexFormat::Unorm16x2:
+		case VertexFormat::Unorm16x4:
+		case VertexFormat::Snorm16x2:
+		case VertexFormat::Snorm16x4:
+		case VertexFormat::Float16x2:
+		case VertexFormat::Float16x4:
+		{
+			bool four = format == VertexFormat::Unorm16x4 || format == VertexFormat::Snorm16x4 || format == VertexFormat::Float16x4;
+			uint16_t packed[4];
+			for (int i = 0; i < (four ? 4 : 2); ++i)
+			{
+				if (format == VertexFormat::Unorm16x2 || format == VertexFormat::Unorm16x4)
+					packed[i] = glm::packUnorm1x16(value[i]);
+				else if (format == VertexFormat::Snorm16x2 || format == VertexFormat::Snorm16x4)
+					packed[i] = glm::packSnorm1x16(value[i]);
+				else
+					packed[i] = glm::packHalf1x16(value[i]);
+			}
+			memcpy(dst, packed, (four ? 4 : 2) * sizeof(uint16_t));
+			break;
+		}
+		default: assert(false);
+		}
+	}
+}
+
+std::vector<std::vector<uint8_t>> VertexLayout::encode(const std::vector<Vertex>& vertices, const glm::vec3& boxMin, const glm::vec3& boxExtent) const
+{
+	std::vector<std::vector<uint8_t>> streams(m_strides.size());
+	for (size_t stream = 0; stream < m_strides.size(); ++stream)
+		streams[stream].resize(vertices.size() * m_strides[stream]);
+	const glm::vec3 invExtent = 1.0f / glm::max(boxExtent, glm::vec3(1e-20f));
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		const Vertex& vertex = vertices[i];
+		for (const auto& attribute : m_attributes)
+		{
+			uint8_t* dst = streams[attribute.stream].data() + i * m_strides[attribute.stream];
+			glm::vec4 value(0.0f);
+			bool octahedral = attribute.format == VertexFormat::Snorm16x2;
+			switch (attribute.semantic)
+			{
+			case VertexSemantic::Position:
+				value = hasQuantizedPositions() ? glm::vec4((vertex.position - boxMin) * invExtent, 1.0f) : glm::vec4(vertex.position, 1.0f);
+				break;
+			case VertexSemantic::Normal:
+				value = octahedral ? glm::vec4(octEncode(vertex.normal), 0.0f, 0.0f) : glm::vec4(vertex.normal, 0.0f);
+				break;
+			case VertexSemantic::Tangent:
+				value = octahedral ? glm::vec4(octEncode(vertex.tangent), 0.0f, 0.0f) : glm::vec4(vertex.tangent, 0.0f);
+				break;
+			case VertexSemantic::TexCoord:
+				value = glm::vec4(vertex.uv, 0.0f, 0.0f);
+				break;
+			default: assert(false);
+			}
+			encodeAttribute(dst + attribute.offset, attribute.format, value);
+		}
+	}
+	return streams;
+}
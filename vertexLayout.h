@@ -0,0 +1,99 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "context.h"
+
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_FORCE_LEFT_HANDED
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+using namespace wgpu;
+
+//CPU side vertex, kept by the meshes for bounding boxes, picking and batching
+struct Vertex {
+	glm::vec3 position = glm::vec3(0.0, 0.0, 0.0);
+	glm::vec3 normal = glm::vec3(0.0, 0.0, 0.0);
+	glm::vec3 tangent = glm::vec3(0.0, 0.0, 0.0);
+	glm::vec2 uv = glm::vec2(0.0, 0.0);
+};
+static_assert(sizeof(Vertex) == 11 * sizeof(float), "Vertex is uploaded as is with the standard layout");
+
+//The shader location of an attribute is its semantic, whatever the layout
+enum class VertexSemantic : uint8_t
+{
+	Position = 0,
+	Normal,
+	Tangent,
+	TexCoord,
+	Count
+};
+
+// Describes how the vertices of a mesh are stored on the GPU.
+// Shared by Mesh (encoding), Pipeline (vertex buffer layouts) and Shader (WGSL inputs and decoding).
+// The attributes can be split in several streams (one buffer each), so that a pass reading only
+// the positions does not fetch the other attributes. benchmarks/vertexFetchBench.cpp compares their fetch on the GPU.
+class VertexLayout
+{
+public:
+	struct Attribute
+	{
+		VertexSemantic semantic;
+		VertexFormat format;
+		uint32_t offset; //In the stream
+		uint32_t stream;
+	};
+
+	VertexLayout() = default;
+	~VertexLayout() = default;
+
+	void addAttribute(VertexSemantic semantic, VertexFormat format, uint32_t stream = 0);
+	//Explicit offset in the stream, for the vertices read in place from a file (interleaved or padded)
+	void addAttribute(VertexSemantic semantic, VertexFormat format, uint32_t stream, uint32_t offset);
+	//At least the size of the attributes of the stream
+	void setStride(uint32_t stream, uint32_t stride);
+
+	const std::vector<Attribute>& getAttributes() const { return m_attributes; }
+	const Attribute* getAttribute(VertexSemantic semantic) const;
+	bool hasAttribute(VertexSemantic semantic) const { return getAttribute(semantic) != nullptr; }
+	uint32_t getStreamCount() const { return static_cast<uint32_t>(m_strides.size()); }
+	uint32_t getStride(uint32_t stream) const { return m_strides[stream]; }
+	const std::vector<uint32_t>& getStrides() const { return m_strides; }
+	//Bytes per vertex, all streams together
+	uint32_t getVertexSize() const;
+
+	//Unique per combination of formats, used to cache the pipelines and shader modules
+	uint64_t getKey() const { return m_key; }
+	bool operator==(const VertexLayout& other) const { return m_key == other.m_key; }
+	bool operator!=(const VertexLayout& other) const { return m_key != other.m_key; }
+
+	//Positions are stored normalized in the bounding box of the mesh
+	bool hasQuantizedPositions() const;
+
+	//Writes the vertices in this layout, one buffer per stream.
+	//Positions are expressed in the box (min, extent) when quantized
+	std::vector<std::vector<uint8_t>> encode(const std::vector<Vertex>& vertices, const glm::vec3& boxMin, const glm::vec3& boxExtent) const;
+
+	static uint32_t getShaderLocation(VertexSemantic semantic) { return static_cast<uint32_t>(semantic); }
+	static std::string getSemanticName(VertexSemantic semantic);
+
+	//44 bytes, float32 everywhere, interleaved in one stream
+	static const VertexLayout& getStandard();
+	//Same formats, positions (12 bytes) in stream 0 and the other attributes in stream 1
+	static VertexLayout getStandardSplit();
+	//20 bytes: unorm16 positions, octahedral snorm16 normals and tangents, unorm16 or float16 uvs
+	static VertexLayout getQuantized(bool normalizedUVs, bool splitPositions = false);
+	//Picks the smallest layout able to represent the vertices without visible loss
+	static VertexLayout select(const std::vector<Vertex>& vertices, bool quantized, bool splitPositions = false);
+
+private:
+	void updateKey(uint64_t value) { m_key = (m_key ^ value) * 1099511628211ull; }
+
+	std::vector<Attribute> m_attributes{};
+	std::vector<uint32_t> m_strides{};
+	uint64_t m_key = 0;
+};
+
+uint32_t getVertexFormatSize(VertexFormat format);